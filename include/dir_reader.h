@@ -0,0 +1,76 @@
+//
+//  include/dir_reader.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef DIR_READER_H
+#define DIR_READER_H
+
+#include <dirent.h>
+#include <stdint.h>
+
+#include "notnull.h"
+
+/*
+ * On Linux, where a struct dirent has the same layout as the entries returned
+ * by getdents64(), directory-entries are read in large batches straight into
+ * the reader's buffer. Everywhere else, we fall back to readdir().
+ */
+
+#if defined(__linux__) && defined(_DIRENT_MATCHES_DIRENT64)
+#if _DIRENT_MATCHES_DIRENT64
+#define DIR_READER_USE_GETDENTS
+#endif
+#endif
+
+/*
+ * A dir_reader can be opened and closed for any number of directories, one at
+ * a time, reusing its buffer each time.
+ */
+
+struct dir_reader {
+    int fd;
+
+#if defined(DIR_READER_USE_GETDENTS)
+    char *buffer;
+
+    uint64_t offset;
+    uint64_t size;
+#else
+    DIR *dir;
+#endif
+};
+
+enum dir_reader_result {
+    E_DIR_READER_OK,
+    E_DIR_READER_ALLOC_FAIL,
+    E_DIR_READER_OPEN_FAIL
+};
+
+/*
+ * Start reading the directory at fd. On success, the reader takes ownership of
+ * fd, and closes it in dir_reader_close().
+ */
+
+enum dir_reader_result
+dir_reader_open(struct dir_reader *__notnull reader, int fd);
+
+/*
+ * Return the next regular-file or sub-directory entry, skipping over "." and
+ * "..", as well as all other types of entries. Entries of unknown type are
+ * stat-ed to find their type. The returned entry stays valid until the next
+ * call, and may be shorter than a struct dirent.
+ *
+ * When NULL is returned, errno is zero if all entries have been read, and is
+ * otherwise the error that prevented reading any more entries.
+ */
+
+struct dirent *dir_reader_next(struct dir_reader *__notnull reader);
+
+void dir_reader_close(struct dir_reader *__notnull reader);
+void dir_reader_destroy(struct dir_reader *__notnull reader);
+
+#endif /* DIR_READER_H */
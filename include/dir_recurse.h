@@ -39,6 +39,20 @@ typedef bool
                         uint64_t name_length,
                         void *info);
 
+/*
+ * Called with the directory's open file-descriptor before a file is opened,
+ * and from any thread the directory is read on. If filter_callback returns
+ * false, the file is skipped without being opened.
+ */
+
+typedef bool
+(*dir_recurse_filter_callback)(int dir_fd,
+                               const char *__notnull dir_path,
+                               uint64_t dir_path_length,
+                               const struct dirent *__notnull dirent,
+                               uint64_t name_length,
+                               void *info);
+
 /*
  * dir_path and dir_path_length refer to the sub-directory when result is
  * E_DIR_RECURSE_FAILED_TO_OPEN_SUBDIR.
@@ -59,6 +73,7 @@ dir_recurse(const char *__notnull path,
             uint64_t path_length,
             int file_open_flags,
             void *callback_info,
+            dir_recurse_filter_callback filter_callback,
             __notnull dir_recurse_callback callback,
             __notnull dir_recurse_fail_callback fail_callback);
 
@@ -68,7 +83,32 @@ dir_recurse_with_subdirs(
     const uint64_t path_length,
     int file_open_flags,
     void *const callback_info,
+    const dir_recurse_filter_callback filter_callback,
     __notnull const dir_recurse_callback callback,
     __notnull const dir_recurse_fail_callback fail_callback);
 
+/*
+ * Recurse the directory at path and all its sub-directories like
+ * dir_recurse_with_subdirs(), but with up to thread_count threads reading
+ * directories ahead of the calling thread.
+ *
+ * Both callback and fail_callback are still only called on the calling thread,
+ * one at a time, and in the same depth-first order as
+ * dir_recurse_with_subdirs(). Files are opened on the calling thread. If
+ * callback or fail_callback return false, recursing stops entirely.
+ *
+ * Falls back to dir_recurse_with_subdirs() if no threads could be created.
+ */
+
+enum dir_recurse_result
+dir_recurse_with_subdirs_parallel(
+    const char *__notnull path,
+    uint64_t path_length,
+    int file_open_flags,
+    uint64_t thread_count,
+    void *callback_info,
+    dir_recurse_filter_callback filter_callback,
+    __notnull dir_recurse_callback callback,
+    __notnull dir_recurse_fail_callback fail_callback);
+
 #endif /* DIR_RECURSE_H */
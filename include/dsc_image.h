@@ -13,6 +13,7 @@
 #include "likely.h"
 #include "macho_file.h"
 #include "notnull.h"
+#include "range.h"
 #include "string_buffer.h"
 #include "tbd.h"
 
@@ -64,6 +65,19 @@ struct dsc_image_parse_options {
 
 };
 
+/*
+ * File-ranges of the parts of a dsc-image's data that dsc_image_parse() reads
+ * from, used to advise the kernel on the cache's mapping ahead of time.
+ *
+ * Any range that could not be found is left empty.
+ */
+
+struct dsc_image_ranges {
+    struct range load_commands;
+    struct range export_trie;
+    struct range symbol_table;
+};
+
 enum dsc_image_parse_result
 dsc_image_parse(struct tbd_create_info *__notnull info_in,
                 struct dyld_shared_cache_info *__notnull dsc_info,
@@ -75,4 +89,9 @@ dsc_image_parse(struct tbd_create_info *__notnull info_in,
                 struct tbd_parse_options tbd_options,
                 struct dsc_image_parse_options options);
 
+void
+dsc_image_get_ranges(const struct dyld_shared_cache_info *__notnull dsc_info,
+                     const struct dyld_cache_image_info *__notnull image,
+                     struct dsc_image_ranges *__notnull ranges_out);
+
 #endif /* DSC_IMAGE_H */
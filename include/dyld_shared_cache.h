@@ -20,10 +20,18 @@
 struct dyld_shared_cache_parse_options {
     bool zero_image_pads : 1;
     bool verify_image_path_offsets : 1;
+    bool use_huge_pages : 1;
 };
 
 struct dyld_shared_cache_flags {
     bool unmap_map : 1;
+
+    /*
+     * map_is_copy is set when the cache was copied into anonymous memory,
+     * rather than mapped directly from its file.
+     */
+
+    bool map_is_copy : 1;
 };
 
 enum dyld_shared_cache_parse_result {
@@ -81,6 +89,17 @@ dyld_shared_cache_parse_from_range(
     uint64_t end,
     struct dyld_shared_cache_parse_options options);
 
+enum dyld_shared_cache_advice {
+    DYLD_SHARED_CACHE_ADVICE_WILL_NEED,
+    DYLD_SHARED_CACHE_ADVICE_DONT_NEED
+};
+
+void
+dyld_shared_cache_advise_range(
+    const struct dyld_shared_cache_info *__notnull info,
+    struct range range,
+    enum dyld_shared_cache_advice advice);
+
 void
 dyld_shared_cache_print_list_of_images(int fd,
                                        uint64_t start,
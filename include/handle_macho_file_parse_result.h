@@ -9,6 +9,8 @@
 #ifndef HANDLE_MACHO_PARSE_RESULT_H
 #define HANDLE_MACHO_PARSE_RESULT_H
 
+#include <stdio.h>
+
 #include "macho_file.h"
 #include "tbd_for_main.h"
 
@@ -21,6 +23,12 @@ struct handle_macho_file_parse_error_cb_info {
 
     bool print_paths;
     bool is_recursing;
+
+    /*
+     * Errors (and requests) are printed to file, or stderr if file is NULL.
+     */
+
+    FILE *file;
 };
 
 bool
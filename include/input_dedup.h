@@ -0,0 +1,93 @@
+//
+//  include/input_dedup.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef INPUT_DEDUP_H
+#define INPUT_DEDUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "array.h"
+#include "notnull.h"
+#include "result_cache.h"
+#include "tbd_for_main.h"
+
+/*
+ * An input_dedup keeps track of the mach-o files parsed during a run, so a
+ * file reached again through another path (a hard-link, or a path provided
+ * more than once) is only parsed once.
+ *
+ * Files are matched by their device and inode, and, with match_contents, also
+ * by a digest of their contents. As the tbd of a file doesn't depend on the
+ * path it was found at, the tbd written out for the first path is later
+ * copied to the write-paths of all other paths.
+ */
+
+struct input_dedup {
+    /*
+     * Open-addressed table of indices into entries (plus one, so zero is an
+     * empty bucket), hashed by key.
+     */
+
+    uint64_t *buckets;
+    uint64_t bucket_count;
+
+    struct array entries;
+    struct array copies;
+
+    bool match_contents : 1;
+};
+
+enum input_dedup_result {
+    E_INPUT_DEDUP_OK,
+    E_INPUT_DEDUP_ALLOC_FAIL
+};
+
+/*
+ * Returns whether tbds created with tbd's options can be copied between
+ * write-paths. Only tbds written to their own files, that can be overwritten,
+ * are copied.
+ */
+
+bool input_dedup_can_dedup(const struct tbd_for_main *__notnull tbd);
+
+/*
+ * Look up the mach-o file at fd, parsed with the options of tbd. If an earlier
+ * file matches, a copy from its write-path to write_path is added, to be made
+ * in input_dedup_write_copies(), and true is returned.
+ *
+ * Otherwise, the file is added with write_path as where its tbd is written, and
+ * false is returned.
+ */
+
+bool
+input_dedup_find_or_add(struct input_dedup *__notnull dedup,
+                        const struct tbd_for_main *__notnull tbd,
+                        int fd,
+                        const char *__notnull write_path,
+                        uint64_t write_path_length);
+
+/*
+ * Mark the tbd of the mach-o file at fd, added with the options of tbd, as
+ * written out during this run. Copies are only made from tbds marked written.
+ */
+
+void
+input_dedup_mark_written(struct input_dedup *__notnull dedup,
+                         const struct tbd_for_main *__notnull tbd,
+                         int fd);
+
+/*
+ * Make all copies added, which have to wait until the tbds they copy from have
+ * been written out.
+ */
+
+void input_dedup_write_copies(struct input_dedup *__notnull dedup);
+void input_dedup_destroy(struct input_dedup *__notnull dedup);
+
+#endif /* INPUT_DEDUP_H */
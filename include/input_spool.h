@@ -0,0 +1,35 @@
+//
+//  include/input_spool.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef INPUT_SPOOL_H
+#define INPUT_SPOOL_H
+
+#include "notnull.h"
+
+enum input_spool_result {
+    E_INPUT_SPOOL_OK,
+
+    E_INPUT_SPOOL_CREATE_FAIL,
+    E_INPUT_SPOOL_READ_FAIL,
+    E_INPUT_SPOOL_WRITE_FAIL,
+    E_INPUT_SPOOL_SEEK_FAIL
+};
+
+/*
+ * Copy all the data of a non-seekable input (such as stdin or a pipe) into an
+ * anonymous file, so that the input can be parsed as a regular file (with
+ * fstat(), lseek(), and mmap()).
+ *
+ * On success, fd_out will be set to the file-descriptor of the anonymous file,
+ * seeked to its beginning. The provided fd is not closed.
+ */
+
+enum input_spool_result
+input_spool_create_from_fd(int fd, int *__notnull fd_out);
+
+#endif /* INPUT_SPOOL_H */
@@ -0,0 +1,51 @@
+//
+//  include/magic_prefilter.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef MAGIC_PREFILTER_H
+#define MAGIC_PREFILTER_H
+
+#include <stdint.h>
+
+#include "notnull.h"
+#include "our_io.h"
+
+/*
+ * The most files magic_prefilter_files() reads from at once.
+ */
+
+#define MAGIC_PREFILTER_BATCH_COUNT 32
+
+enum magic_prefilter_result {
+    E_MAGIC_PREFILTER_MACHO,
+    E_MAGIC_PREFILTER_DSC,
+    E_MAGIC_PREFILTER_NEITHER,
+    E_MAGIC_PREFILTER_READ_FAIL
+};
+
+/*
+ * Classify the file at fd as a (possible) mach-o or dyld_shared_cache file
+ * with a single read at the start of the file, without moving the file's
+ * offset, so the parsers can be run on fd afterwards as usual.
+ *
+ * Files too small to hold a mach_header are never either.
+ */
+
+enum magic_prefilter_result magic_prefilter_file(int fd);
+
+/*
+ * Classify count files at once, with the reads of all files submitted
+ * together through batch.
+ */
+
+void
+magic_prefilter_files(struct our_io_batch *__notnull batch,
+                      const int *__notnull fds,
+                      enum magic_prefilter_result *__notnull results,
+                      uint64_t count);
+
+#endif /* MAGIC_PREFILTER_H */
@@ -0,0 +1,169 @@
+//
+//  include/manifest.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <sys/stat.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "array.h"
+#include "notnull.h"
+
+/*
+ * A manifest records, for every input file a tbd was created from, the
+ * input's device, inode, size, modification-time and a digest of its
+ * contents, along with the path of the tbd created.
+ *
+ * The manifest written out by a run is loaded by the next, so inputs that
+ * haven't changed since, and whose tbds still exist, can be skipped.
+ *
+ * The manifest also records a digest of the options the tbds were created
+ * with. If a run's options differ, none of the loaded entries are used, so
+ * every input is parsed again.
+ */
+
+struct manifest_entry {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+
+    uint64_t digest;
+
+    char *output_path;
+    uint64_t output_path_length;
+
+    /*
+     * Set when the entry's input was found unchanged, so the entry is written
+     * out again. May be set from any thread.
+     */
+
+    bool is_unchanged;
+};
+
+struct manifest {
+    /*
+     * The digest of all options provided through manifest_add_options().
+     */
+
+    uint64_t options_digest;
+
+    /*
+     * The entries loaded from the previous manifest, which are never added to
+     * or removed from after loading, and so can be looked up from any thread.
+     */
+
+    struct manifest_entry *entries;
+    uint64_t entry_count;
+
+    /*
+     * Open-addressed table of indices into entries (plus one, so zero is an
+     * empty bucket), hashed by inode.
+     */
+
+    uint64_t *buckets;
+    uint64_t bucket_count;
+
+    /*
+     * Entries for inputs a tbd was created from during this run.
+     */
+
+    struct array new_entries;
+};
+
+enum manifest_result {
+    E_MANIFEST_OK,
+    E_MANIFEST_ALLOC_FAIL,
+    E_MANIFEST_OPEN_FAIL,
+    E_MANIFEST_READ_FAIL,
+    E_MANIFEST_INVALID,
+    E_MANIFEST_WRITE_FAIL
+};
+
+/*
+ * Add the size bytes of options, used to create the tbds recorded, to the
+ * manifest's options-digest. Must be called for every set of options before
+ * manifest_load().
+ */
+
+void
+manifest_add_options(struct manifest *__notnull manifest,
+                     const void *__notnull options,
+                     uint64_t size);
+
+/*
+ * Load the manifest at path. If no file exists at path, or the manifest was
+ * written with different options, the manifest is simply left empty.
+ */
+
+enum manifest_result
+manifest_load(struct manifest *__notnull manifest, const char *__notnull path);
+
+/*
+ * Returns whether any loaded entry has the inode ino, which is enough to know
+ * that a file doesn't need to be checked any further.
+ */
+
+bool
+manifest_has_inode(const struct manifest *__notnull manifest, uint64_t ino);
+
+struct manifest_entry *
+manifest_find(const struct manifest *__notnull manifest,
+              const struct stat *__notnull sbuf,
+              const char *__notnull output_path,
+              uint64_t output_path_length);
+
+/*
+ * Returns whether sbuf still matches the size and modification-time recorded
+ * in entry.
+ */
+
+bool
+manifest_entry_matches(const struct manifest_entry *__notnull entry,
+                       const struct stat *__notnull sbuf);
+
+void manifest_entry_mark_unchanged(struct manifest_entry *__notnull entry);
+
+/*
+ * Record that a tbd at output_path was created from the input described by
+ * sbuf and digest. Should only be called from a single thread.
+ */
+
+enum manifest_result
+manifest_add_entry(struct manifest *__notnull manifest,
+                   const struct stat *__notnull sbuf,
+                   uint64_t digest,
+                   const char *__notnull output_path,
+                   uint64_t output_path_length);
+
+/*
+ * Get a digest of the entire contents of the file at fd, without moving the
+ * file's offset.
+ */
+
+enum manifest_result
+manifest_digest_file(int fd, uint64_t *__notnull digest_out);
+
+/*
+ * Write out all unchanged and newly added entries to path. The manifest is
+ * first written to a temporary file next to path, so an interrupted run
+ * doesn't leave behind a partial manifest.
+ */
+
+enum manifest_result
+manifest_write(const struct manifest *__notnull manifest,
+               const char *__notnull path);
+
+void manifest_destroy(struct manifest *__notnull manifest);
+
+#endif /* MANIFEST_H */
@@ -12,11 +12,14 @@
 #include <sys/types.h>
 
 #include <dirent.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
 int our_open(const char *path, int flags, int mode);
 int our_openat(int dirfd, const char *pathname, int flags);
+int our_openat_with_mode(int dirfd, const char *pathname, int flags, int mode);
 
 int our_mkdir(const char *path, mode_t mode);
 int our_unlink(const char *path);
@@ -24,10 +27,73 @@ int our_rmdir(const char *path);
 
 off_t our_lseek(int fd, off_t offset, int whence);
 ssize_t our_read(int fd, void *buf, size_t size);
+ssize_t our_pread(int fd, void *buf, size_t size, off_t offset);
+ssize_t our_write(int fd, const void *buf, size_t size);
 
 DIR *our_fdopendir(int fd);
 struct dirent *our_readdir(DIR *dir);
 
 ssize_t our_getline(char **lineptr, size_t *n, FILE *stream);
 
+/*
+ * A single read, as part of a batch.
+ *
+ * result is the number of bytes read, or -1 if the read failed, with error
+ * storing the error.
+ */
+
+struct our_io_read {
+    int fd;
+
+    void *buf;
+    size_t size;
+    off_t offset;
+
+    ssize_t result;
+    int error;
+};
+
+/*
+ * An our_io_batch submits a batch of reads all at once, so they are in flight
+ * together. On Linux, this is done through io_uring. Wherever io_uring isn't
+ * available, the reads are simply done one after another.
+ */
+
+struct our_io_batch {
+    int ring_fd;
+    uint32_t entry_count;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+
+    void *cq_ring;
+    size_t cq_ring_size;
+
+    void *sqes;
+    size_t sqes_size;
+
+    uint32_t sq_off_head;
+    uint32_t sq_off_tail;
+    uint32_t sq_off_mask;
+    uint32_t sq_off_array;
+
+    uint32_t cq_off_head;
+    uint32_t cq_off_tail;
+    uint32_t cq_off_mask;
+    uint32_t cq_off_cqes;
+};
+
+/*
+ * Returns whether io_uring is used. The batch can be used either way.
+ */
+
+bool our_io_batch_init(struct our_io_batch *batch, uint32_t entry_count);
+
+void
+our_io_batch_read(struct our_io_batch *batch,
+                  struct our_io_read *reads,
+                  uint64_t count);
+
+void our_io_batch_destroy(struct our_io_batch *batch);
+
 #endif /* OUR_IO_H */
@@ -12,6 +12,7 @@
 #include "magic_buffer.h"
 #include "string_buffer.h"
 #include "tbd_for_main.h"
+#include "write_queue.h"
 
 /*
  * magic_in should be atleast 16 bytes large.
@@ -38,6 +39,13 @@ struct parse_dsc_for_main_args {
 
     FILE *combine_file;
 
+    /*
+     * When not NULL, tbds are handed to write_queue to be written out on its
+     * writer thread.
+     */
+
+    struct write_queue *write_queue;
+
     bool dont_handle_non_dsc_error : 1;
     bool print_paths : 1;
 
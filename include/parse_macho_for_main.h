@@ -9,9 +9,12 @@
 #ifndef PARSE_MACHO_FOR_MAIN_H
 #define PARSE_MACHO_FOR_MAIN_H
 
+#include "macho_file.h"
 #include "magic_buffer.h"
+#include "result_cache.h"
 #include "string_buffer.h"
 #include "tbd_for_main.h"
+#include "write_queue.h"
 
 struct parse_macho_for_main_options {
     bool verify_write_path : 1;
@@ -43,6 +46,22 @@ struct parse_macho_for_main_args {
 
     FILE *combine_file;
 
+    /*
+     * When not NULL, tbds are handed to write_queue to be written out on its
+     * writer thread.
+     */
+
+    struct write_queue *write_queue;
+
+    /*
+     * When not NULL, tbds are looked up in result_cache before parsing, and
+     * stored in it once created. cache_key is valid once has_cache_key is set.
+     */
+
+    const struct result_cache *result_cache;
+    struct result_cache_key cache_key;
+
+    bool has_cache_key : 1;
     bool dont_handle_non_macho_error : 1;
     bool print_paths : 1;
 
@@ -56,6 +75,25 @@ enum parse_macho_for_main_result {
     E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR
 };
 
+/*
+ * Create the cache-key of the file at args' fd, and if args' result-cache has
+ * a tbd stored for it, write the stored tbd out in place of parsing the file,
+ * setting result_out.
+ *
+ * Returns false if the file still has to be parsed, in which case its tbd is
+ * stored in the cache once created.
+ */
+
+bool
+write_cached_macho_file_for_main(
+    struct parse_macho_for_main_args *__notnull args,
+    enum parse_macho_for_main_result *__notnull result_out);
+
+bool
+write_cached_macho_file_for_main_while_recursing(
+    struct parse_macho_for_main_args *__notnull args,
+    enum parse_macho_for_main_result *__notnull result_out);
+
 enum parse_macho_for_main_result
 parse_macho_file_for_main(struct parse_macho_for_main_args args);
 
@@ -63,4 +101,21 @@ enum parse_macho_for_main_result
 parse_macho_file_for_main_while_recursing(
     struct parse_macho_for_main_args *__notnull args_ptr);
 
+/*
+ * Handle a mach-o file that was already opened and parsed into args' tbd (such
+ * as by a parse_pool), printing any errors in open_result and parse_result,
+ * and writing out its tbd, the same way the functions above do after parsing.
+ */
+
+enum parse_macho_for_main_result
+write_parsed_macho_file_for_main(struct parse_macho_for_main_args args,
+                                 enum macho_file_open_result open_result,
+                                 enum macho_file_parse_result parse_result);
+
+enum parse_macho_for_main_result
+write_parsed_macho_file_for_main_while_recursing(
+    struct parse_macho_for_main_args *__notnull args_ptr,
+    enum macho_file_open_result open_result,
+    enum macho_file_parse_result parse_result);
+
 #endif /* PARSE_MACHO_FOR_MAIN_H */
@@ -0,0 +1,150 @@
+//
+//  include/parse_pool.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef PARSE_POOL_H
+#define PARSE_POOL_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "macho_file.h"
+#include "magic_buffer.h"
+#include "notnull.h"
+#include "result_cache.h"
+#include "string_buffer.h"
+#include "tbd_for_main.h"
+
+/*
+ * A parse_pool parses mach-o files on a set of worker threads, while writing
+ * out their tbds stays on the calling thread.
+ *
+ * Each worker owns a clone of the tbd_for_main it parses files for, along with
+ * its own magic_buffer and export-trie string_buffer. Files are handed to the
+ * workers in turn, and are finished on the calling thread in the same order
+ * they were added, so the created files and any printed errors don't depend
+ * on which worker is fastest.
+ *
+ * Errors found while parsing a file are collected, and printed out right
+ * before the file is finished. As workers can't ask for user-input, the
+ * tbd_for_mains of all files added should have no_requests set.
+ *
+ * All parse_pool functions are to be called from a single thread.
+ */
+
+struct parse_pool_file {
+    /*
+     * The worker's clone of orig, holding the parsed info.
+     */
+
+    struct tbd_for_main *tbd;
+    struct tbd_for_main *orig;
+
+    int fd;
+
+    struct magic_buffer *magic_buffer;
+    struct string_buffer *export_trie_sb;
+
+    /*
+     * When not recursing, name will be NULL and dir_path will store the entire
+     * path.
+     */
+
+    char *dir_path;
+    uint64_t dir_path_length;
+
+    char *name;
+    uint64_t name_length;
+
+    /*
+     * The key the file's tbd is to be stored under in the result-cache, valid
+     * only if has_cache_key is set.
+     */
+
+    struct result_cache_key cache_key;
+
+    bool has_cache_key : 1;
+    bool print_paths : 1;
+
+    enum macho_file_open_result open_result;
+    enum macho_file_parse_result parse_result;
+
+    void *info;
+};
+
+/*
+ * Called on the calling thread for every file added, in the order the files
+ * were added. The callback is responsible for closing the file's fd.
+ */
+
+typedef void
+(*parse_pool_finish_callback)(struct parse_pool_file *__notnull file,
+                              void *info);
+
+struct parse_pool_worker;
+
+struct parse_pool {
+    struct parse_pool_worker *workers;
+    uint64_t worker_count;
+
+    /*
+     * Files are handed out to the workers in turn, so the oldest pending file
+     * always belongs to the worker pending_count workers before next_worker.
+     */
+
+    uint64_t next_worker;
+    uint64_t pending_count;
+
+    parse_pool_finish_callback finish_callback;
+    void *finish_info;
+};
+
+enum parse_pool_result {
+    E_PARSE_POOL_OK,
+    E_PARSE_POOL_ALLOC_FAIL,
+    E_PARSE_POOL_THREAD_CREATE_FAIL
+};
+
+enum parse_pool_result
+parse_pool_start(struct parse_pool *__notnull pool,
+                 uint64_t worker_count,
+                 __notnull parse_pool_finish_callback finish_callback,
+                 void *finish_info);
+
+/*
+ * Hand the file at fd over to the next worker, first finishing the oldest
+ * pending file if all workers are busy.
+ *
+ * dir_path, name, and cache_key (if not NULL) are copied, while orig has to
+ * stay valid until the file is finished.
+ */
+
+enum parse_pool_result
+parse_pool_add_file(struct parse_pool *__notnull pool,
+                    struct tbd_for_main *__notnull orig,
+                    int fd,
+                    const char *__notnull dir_path,
+                    uint64_t dir_path_length,
+                    const char *name,
+                    uint64_t name_length,
+                    bool print_paths,
+                    const struct result_cache_key *cache_key,
+                    void *info);
+
+/*
+ * Wait for and finish all pending files.
+ */
+
+void parse_pool_drain(struct parse_pool *__notnull pool);
+
+/*
+ * Finish all pending files, then stop all workers and free their clones.
+ */
+
+void parse_pool_finish(struct parse_pool *__notnull pool);
+
+#endif /* PARSE_POOL_H */
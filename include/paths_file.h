@@ -0,0 +1,73 @@
+//
+//  include/paths_file.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef PATHS_FILE_H
+#define PATHS_FILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "notnull.h"
+
+/*
+ * A paths_file reads a list of paths, as provided with --paths-from, one at a
+ * time, so the list is never read into memory all at once.
+ *
+ * Paths are separated by either newlines or null-characters, whichever is found
+ * first, so lists from find -print0 (whose paths may hold newlines) and lists
+ * of lines can both be read. Empty paths are skipped.
+ */
+
+struct paths_file {
+    int fd;
+
+    char *buffer;
+    uint64_t capacity;
+
+    /*
+     * The unread part of the buffer.
+     */
+
+    uint64_t start;
+    uint64_t end;
+
+    char delimiter;
+
+    bool found_delimiter : 1;
+    bool reached_end : 1;
+};
+
+enum paths_file_result {
+    E_PATHS_FILE_OK,
+    E_PATHS_FILE_ALLOC_FAIL,
+    E_PATHS_FILE_OPEN_FAIL,
+    E_PATHS_FILE_READ_FAIL,
+
+    E_PATHS_FILE_NO_MORE_PATHS
+};
+
+/*
+ * Open the list at path, or read the list from stdin if path is NULL.
+ */
+
+enum paths_file_result
+paths_file_open(struct paths_file *__notnull paths_file, const char *path);
+
+/*
+ * Read the next path in the list. The path is null-terminated, and stays valid
+ * (and can be modified) until the next call.
+ */
+
+enum paths_file_result
+paths_file_next(struct paths_file *__notnull paths_file,
+                char **__notnull path_out,
+                uint64_t *__notnull length_out);
+
+void paths_file_close(struct paths_file *__notnull paths_file);
+
+#endif /* PATHS_FILE_H */
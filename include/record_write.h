@@ -0,0 +1,53 @@
+//
+//  include/record_write.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef RECORD_WRITE_H
+#define RECORD_WRITE_H
+
+#include <stdint.h>
+
+#include "notnull.h"
+#include "target_list.h"
+#include "write_buffer.h"
+
+/*
+ * Functions to write out tbds as a stream of records, to be split apart by a
+ * consumer without having to parse any yaml.
+ *
+ * Each record is a header, followed by its path, its comma-separated list of
+ * archs, and then the tbd itself. The header is:
+ *
+ *     char magic[4];           "TBDR"
+ *     uint32_t path_length;
+ *     uint32_t archs_length;
+ *     uint32_t reserved;       Always 0
+ *     uint64_t size;           Length of the tbd
+ *
+ * with all integers stored in little-endian.
+ *
+ * In the NUL-delimited variant, for shell pipelines, the path, archs, and the
+ * tbd are instead each followed by a NUL byte.
+ *
+ * Like the wb functions, these functions return 0 on success, and 1 on
+ * failure.
+ */
+
+int
+record_write_header(struct write_buffer *__notnull wb,
+                    const char *__notnull path,
+                    uint64_t path_length,
+                    const struct target_list *__notnull targets,
+                    uint64_t size);
+
+int
+record_write_nul_delimited_header(struct write_buffer *__notnull wb,
+                                  const char *__notnull path,
+                                  uint64_t path_length,
+                                  const struct target_list *__notnull targets);
+
+#endif /* RECORD_WRITE_H */
@@ -16,6 +16,14 @@
 
 #include "notnull.h"
 
+/*
+ * Open (creating if needed) the file at path, creating any missing directories
+ * in its hierarchy.
+ *
+ * The parent directories of files opened are cached, so later files in the
+ * same directory are opened with a single openat() call.
+ */
+
 int
 open_r(char *path,
        uint64_t path_length,
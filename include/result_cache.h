@@ -0,0 +1,127 @@
+//
+//  include/result_cache.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "notnull.h"
+#include "tbd.h"
+#include "tbd_for_main.h"
+
+/*
+ * A result_cache is a directory of tbds, each stored under a key made from the
+ * contents of the mach-o file it was created from, along with every option
+ * that affects what the tbd holds.
+ *
+ * The directory can be shared by any number of tbd processes, running at the
+ * same time or not. Entries are written to a temporary file first, and only
+ * renamed into place once complete, so an entry is never seen half-written.
+ */
+
+struct result_cache {
+    char *path;
+    uint64_t path_length;
+};
+
+struct result_cache_key {
+    uint64_t hash[2];
+};
+
+enum result_cache_result {
+    E_RESULT_CACHE_OK,
+    E_RESULT_CACHE_ALLOC_FAIL,
+    E_RESULT_CACHE_NOT_A_DIRECTORY,
+    E_RESULT_CACHE_MKDIR_FAIL,
+    E_RESULT_CACHE_READ_FAIL,
+    E_RESULT_CACHE_WRITE_FAIL
+};
+
+/*
+ * Use the directory at path as the cache, creating it if it doesn't exist.
+ */
+
+enum result_cache_result
+result_cache_create(struct result_cache *__notnull cache,
+                    const char *__notnull path);
+
+/*
+ * Returns whether tbds created with tbd's options can be cached. Only tbds
+ * written to their own files (without a binary index) are cached.
+ */
+
+bool result_cache_can_cache(const struct tbd_for_main *__notnull tbd);
+
+/*
+ * Create the key for the mach-o file at fd, parsed with the options of tbd,
+ * without moving the file's offset.
+ */
+
+enum result_cache_result
+result_cache_create_key(const struct tbd_for_main *__notnull tbd,
+                        int fd,
+                        struct result_cache_key *__notnull key_out);
+
+/*
+ * Create a key for the file with the device dev and inode ino, parsed with the
+ * options of tbd. Unlike the key above, this key doesn't change with the
+ * file's contents, and so is only meaningful within a single run.
+ */
+
+void
+result_cache_create_file_id_key(const struct tbd_for_main *__notnull tbd,
+                                uint64_t dev,
+                                uint64_t ino,
+                                struct result_cache_key *__notnull key_out);
+
+/*
+ * Create a key for only the options of tbd. The key changes whenever the tbds
+ * created with tbd's options would, whatever file they're created from.
+ */
+
+void
+result_cache_create_options_key(const struct tbd_for_main *__notnull tbd,
+                                struct result_cache_key *__notnull key_out);
+
+/*
+ * Open the entry stored for key, returning -1 if the cache has no such entry.
+ */
+
+int
+result_cache_open_entry(const struct result_cache *__notnull cache,
+                        const struct result_cache_key *__notnull key);
+
+/*
+ * Write out the entry at entry_fd to file, cloning the entry where the
+ * filesystem supports it.
+ *
+ * With only_if_changed, file is left untouched if it already has the entry's
+ * exact contents.
+ */
+
+enum result_cache_result
+result_cache_write_entry(int entry_fd,
+                         FILE *__notnull file,
+                         bool only_if_changed);
+
+/*
+ * Store the tbd described by info, written with options, as the entry for key.
+ */
+
+enum result_cache_result
+result_cache_store(const struct result_cache *__notnull cache,
+                   const struct result_cache_key *__notnull key,
+                   const struct tbd_create_info *__notnull info,
+                   struct tbd_create_options options);
+
+void result_cache_destroy(struct result_cache *__notnull cache);
+
+#endif /* RESULT_CACHE_H */
@@ -0,0 +1,67 @@
+//
+//  include/serve.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdbool.h>
+
+#include "dyld_shared_cache.h"
+#include "notnull.h"
+
+/*
+ * With --serve, tbd stays running and listens on a unix-domain socket for
+ * requests from tbd --client.
+ *
+ * A request holds the client's working directory and its arguments, sent along
+ * with the client's stdin, stdout, and stderr. Every request is run in its own
+ * process, forked from the server, with the client's file-descriptors as its
+ * standard streams, so output reaches the client directly, and all write-paths
+ * are written out by the server just as they would be by the client. Once the
+ * request finishes, its exit status is sent back for the client to exit with.
+ *
+ * The socket is only accessible by its owner, and requests are only accepted
+ * from clients running as the server's user.
+ *
+ * The server keeps the dyld_shared_cache files provided as arguments mapped
+ * and parsed across requests. As requests are forked from the server, they
+ * find these files already mapped, and don't have to map them again.
+ */
+
+typedef int (*serve_handler)(int argc, char *const argv[]);
+
+/*
+ * Run the server on the socket at path, calling handler in a forked process
+ * for every request. Only returns if the server couldn't be started, or was
+ * interrupted.
+ */
+
+int serve_run_server(const char *__notnull path, serve_handler handler);
+
+/*
+ * Send argc arguments in argv as a request to the server at path, returning the
+ * request's exit status.
+ */
+
+int
+serve_run_client(const char *__notnull path, int argc, char *const argv[]);
+
+/*
+ * Find the dyld_shared_cache file at fd in the files kept mapped by the
+ * server, parsed with options.
+ *
+ * info_out is only valid for the lifetime of the request, and doesn't own the
+ * mapping, so it can be destroyed as usual.
+ */
+
+bool
+serve_find_mapped_dsc(int fd,
+                      struct dyld_shared_cache_parse_options options,
+                      struct dyld_shared_cache_info *__notnull info_out);
+
+#endif /* SERVE_H */
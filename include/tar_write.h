@@ -0,0 +1,45 @@
+//
+//  include/tar_write.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef TAR_WRITE_H
+#define TAR_WRITE_H
+
+#include <stdint.h>
+
+#include "notnull.h"
+#include "write_buffer.h"
+
+/*
+ * Functions to write out a POSIX (ustar) tar archive.
+ *
+ * Every member is a regular file. Names too long for the ustar name and prefix
+ * fields are stored in a pax extended header preceding the member.
+ *
+ * Like the wb functions, these functions return 0 on success, and 1 on
+ * failure.
+ */
+
+int
+tar_write_header(struct write_buffer *__notnull wb,
+                 const char *__notnull name,
+                 uint64_t name_length,
+                 uint64_t size);
+
+/*
+ * Pad out a member of size bytes to the tar block-size.
+ */
+
+int tar_write_padding(struct write_buffer *__notnull wb, uint64_t size);
+
+/*
+ * Write out the two zero-filled blocks that end an archive.
+ */
+
+int tar_write_end(struct write_buffer *__notnull wb);
+
+#endif /* TAR_WRITE_H */
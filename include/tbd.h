@@ -18,6 +18,7 @@
 #include "bit_list.h"
 #include "notnull.h"
 #include "target_list.h"
+#include "write_buffer.h"
 
 /*
  * Options to handle when parsing out information for tbd_create_info.
@@ -115,7 +116,13 @@ enum tbd_version {
     TBD_VERSION_V1,
     TBD_VERSION_V2,
     TBD_VERSION_V3,
-    TBD_VERSION_V4
+    TBD_VERSION_V4,
+
+    /*
+     * tbd-version v5 is written out as json, instead of yaml.
+     */
+
+    TBD_VERSION_V5
 };
 
 const char *tbd_version_to_string(enum tbd_version version);
@@ -370,11 +377,78 @@ struct tbd_create_options {
     };
 };
 
+/*
+ * Render the tbd described by info into wb. The caller is responsible for
+ * flushing wb afterwards.
+ */
+
+enum tbd_create_result
+tbd_create_with_info_to_buffer(const struct tbd_create_info *__notnull info,
+                               struct write_buffer *__notnull wb,
+                               struct tbd_create_options options);
+
 enum tbd_create_result
 tbd_create_with_info(const struct tbd_create_info *__notnull info,
                      FILE *__notnull file,
                      struct tbd_create_options options);
 
+/*
+ * Count the exact length of the tbd first, then resize file and render the tbd
+ * directly into a mapping of it. Falls back to tbd_create_with_info() if file
+ * isn't a regular file.
+ */
+
+enum tbd_create_result
+tbd_create_with_info_mapped(const struct tbd_create_info *__notnull info,
+                            FILE *__notnull file,
+                            struct tbd_create_options options);
+
+/*
+ * Render the tbd into memory first, and only replace the contents of file, an
+ * untruncated write-file, if they differ from the rendered tbd. Falls back to
+ * tbd_create_with_info() if file isn't a regular file.
+ */
+
+enum tbd_create_result
+tbd_create_with_info_if_changed(const struct tbd_create_info *__notnull info,
+                                FILE *__notnull file,
+                                struct tbd_create_options options);
+
+/*
+ * Write the tbd out to file, a tar archive, as a member named name.
+ */
+
+enum tbd_create_result
+tbd_create_with_info_as_tar_member(
+    const struct tbd_create_info *__notnull info,
+    FILE *__notnull file,
+    const char *__notnull name,
+    uint64_t name_length,
+    struct tbd_create_options options);
+
+/*
+ * Write the tbd out to file as a record of a record-stream, as described in
+ * record_write.h.
+ */
+
+enum tbd_create_result
+tbd_create_with_info_as_record(const struct tbd_create_info *__notnull info,
+                               FILE *__notnull file,
+                               const char *__notnull path,
+                               uint64_t path_length,
+                               bool nul_delimited,
+                               struct tbd_create_options options);
+
+/*
+ * Write a binary index of the tbd, as described in tbd_write_index.h, out to
+ * fd.
+ */
+
+enum tbd_create_result
+tbd_create_index_with_info(const struct tbd_create_info *__notnull info,
+                           int fd,
+                           struct tbd_create_options options);
+
 void
 tbd_create_info_clear_fields_and_create_from(
     struct tbd_create_info *__notnull dst,
@@ -58,18 +58,42 @@ struct tbd_for_main_dsc_image_filter {
     enum tbd_for_main_dsc_image_filter_parse_status status;
 };
 
+enum tbd_for_main_archive_format {
+    TBD_FOR_MAIN_ARCHIVE_FORMAT_TAR,
+    TBD_FOR_MAIN_ARCHIVE_FORMAT_RECORDS,
+    TBD_FOR_MAIN_ARCHIVE_FORMAT_NUL_DELIMITED
+};
+
 struct tbd_for_main_options {
     bool recurse_directories    : 1;
     bool recurse_subdirectories : 1;
 
+    /*
+     * When set, parse_path is a list of the paths of files to parse, which are
+     * then handled just like files found while recursing.
+     */
+
+    bool paths_from_file : 1;
+
     bool replace_path_extension     : 1;
     bool preserve_directory_subdirs : 1;
 
     bool no_overwrite : 1;
     bool combine_tbds : 1;
+    bool map_output   : 1;
+
+    bool write_if_changed : 1;
+    bool write_archive    : 1;
+    bool binary_index     : 1;
 
     bool no_requests     : 1;
     bool ignore_warnings : 1;
+
+    /*
+     * The format all tbds are written out in when write_archive is set.
+     */
+
+    enum tbd_for_main_archive_format archive_format;
 };
 
 struct tbd_for_main_flags {
@@ -80,6 +104,13 @@ struct tbd_for_main_flags {
 
     bool dsc_write_path_is_file : 1;
 
+    /*
+     * An archive written to stdout still needs a write_path to create member
+     * names under, so write_path is set to "." instead of NULL.
+     */
+
+    bool archive_to_stdout : 1;
+
     bool provided_archs           : 1;
     bool provided_current_version : 1;
     bool provided_compat_version  : 1;
@@ -143,6 +174,13 @@ struct tbd_for_main {
     struct array dsc_image_filters;
     struct array dsc_image_numbers;
 
+    /*
+     * Paths to other dyld_shared_cache files (of other architectures) whose
+     * images are merged into the images of the cache at parse_path.
+     */
+
+    struct array dsc_merge_paths;
+
     enum tbd_platform platform;
     uint64_t dsc_filter_paths_count;
 
@@ -221,6 +259,48 @@ tbd_for_main_write_to_file(const struct tbd_for_main *__notnull tbd,
                            FILE *__notnull file,
                            bool print_paths);
 
+/*
+ * Write out info the same way tbd_for_main_write_to_file() does, but without
+ * using the tbd_for_main, so info can be written after the tbd_for_main has
+ * moved on to the next file.
+ */
+
+void
+tbd_for_main_write_info_to_file(
+    const struct tbd_create_info *__notnull info,
+    struct tbd_create_options write_options,
+    struct tbd_for_main_options options,
+    char *__notnull write_path,
+    uint64_t write_path_length,
+    char *terminator,
+    FILE *__notnull file,
+    bool print_paths);
+
+/*
+ * With the tar and record output-formats, all tbds are written as members of a
+ * single archive at write_path (or stdout). Write-paths are still created as if
+ * write_path were a directory, and the part following write_path is used as
+ * the name of the tbd's member.
+ */
+
+enum tbd_for_main_open_write_file_result
+tbd_for_main_open_archive(const struct tbd_for_main *__notnull tbd,
+                          FILE **__notnull file_out);
+
+char *
+tbd_for_main_get_archive_member_name(const struct tbd_for_main *__notnull tbd,
+                                     char *__notnull write_path,
+                                     uint64_t write_path_length,
+                                     uint64_t *__notnull length_out);
+
+/*
+ * Write out the end of the archive, and close file if it isn't stdout.
+ */
+
+int
+tbd_for_main_close_archive(const struct tbd_for_main *__notnull tbd,
+                           FILE *__notnull file);
+
 void
 tbd_for_main_write_to_stdout(const struct tbd_for_main *__notnull tbd,
                              const char *__notnull input_path,
@@ -11,84 +11,98 @@
 
 #include "notnull.h"
 #include "tbd.h"
+#include "write_buffer.h"
 
 int
-tbd_write_archs_for_header(FILE *__notnull const file,
+tbd_write_archs_for_header(struct write_buffer *__notnull wb,
                            const struct target_list list);
 
 int
-tbd_write_targets_for_header(FILE *__notnull file,
+tbd_write_targets_for_header(struct write_buffer *__notnull wb,
                              struct target_list list,
                              enum tbd_version version);
 
-int tbd_write_current_version(FILE *__notnull file, uint32_t version);
-int tbd_write_compatibility_version(FILE *__notnull file, uint32_t version);
+int
+tbd_write_current_version(struct write_buffer *__notnull wb, uint32_t version);
+
+int
+tbd_write_compatibility_version(struct write_buffer *__notnull wb,
+                                uint32_t version);
+
+int tbd_write_flags(struct write_buffer *__notnull wb, struct tbd_flags flags);
+int tbd_write_footer(struct write_buffer *__notnull wb);
 
-int tbd_write_flags(FILE *__notnull file, struct tbd_flags flags);
-int tbd_write_footer(FILE *__notnull file);
+/*
+ * Write the footer to a FILE that tbds were written to through
+ * tbd_create_with_info(), such as a combined .tbd file.
+ */
 
-int tbd_write_install_name(FILE *__notnull file,
-                           const struct tbd_create_info *__notnull info);
+int tbd_write_footer_to_file(FILE *__notnull file);
 
-int tbd_write_magic(FILE *__notnull file, enum tbd_version version);
+int
+tbd_write_install_name(struct write_buffer *__notnull wb,
+                       const struct tbd_create_info *__notnull info);
+
+int
+tbd_write_magic(struct write_buffer *__notnull wb, enum tbd_version version);
 
 int
 tbd_write_parent_umbrella_for_archs(
-    FILE *__notnull file,
+    struct write_buffer *__notnull wb,
     const struct tbd_create_info *__notnull info);
 
 int
-tbd_write_platform(FILE *__notnull file,
+tbd_write_platform(struct write_buffer *__notnull wb,
                    const struct tbd_create_info *__notnull info,
                    enum tbd_version version);
 
 int
-tbd_write_objc_constraint(FILE *__notnull file,
+tbd_write_objc_constraint(struct write_buffer *__notnull wb,
                           enum tbd_objc_constraint constraint);
 
 int
-tbd_write_swift_version(FILE *__notnull file,
+tbd_write_swift_version(struct write_buffer *__notnull wb,
                         enum tbd_version version,
                         uint32_t swift_version);
 
 int
-tbd_write_metadata(FILE *__notnull file,
+tbd_write_metadata(struct write_buffer *__notnull wb,
                    const struct tbd_create_info *__notnull info_in,
                    struct tbd_create_options options);
 
 int
 tbd_write_metadata_with_full_targets(
-    FILE *__notnull file,
+    struct write_buffer *__notnull wb,
     const struct tbd_create_info *__notnull info_in,
     struct tbd_create_options options);
 
 int
-tbd_write_uuids_for_archs(FILE *__notnull file,
+tbd_write_uuids_for_archs(struct write_buffer *__notnull wb,
                           const struct array *__notnull uuids);
 
 int
-tbd_write_uuids_for_targets(FILE *__notnull file,
+tbd_write_uuids_for_targets(struct write_buffer *__notnull wb,
                             const struct array *__notnull uuids,
                             enum tbd_version version);
 
 int
-tbd_write_symbols_for_archs(FILE *__notnull file,
+tbd_write_symbols_for_archs(struct write_buffer *__notnull wb,
                             const struct tbd_create_info *__notnull info,
                             struct tbd_create_options options);
 
 int
-tbd_write_symbols_for_targets(FILE *__notnull const file,
+tbd_write_symbols_for_targets(struct write_buffer *__notnull wb,
                               const struct tbd_create_info *__notnull info,
                               struct tbd_create_options options);
 
 int
-tbd_write_symbols_with_full_archs(FILE *__notnull file,
+tbd_write_symbols_with_full_archs(struct write_buffer *__notnull wb,
                                   const struct tbd_create_info *__notnull info,
                                   struct tbd_create_options options);
 
 int
 tbd_write_symbols_with_full_targets(
-    FILE *__notnull file,
+    struct write_buffer *__notnull wb,
     const struct tbd_create_info *__notnull info,
     struct tbd_create_options options);
 
@@ -0,0 +1,77 @@
+//
+//  include/tbd_write_index.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef TBD_WRITE_INDEX_H
+#define TBD_WRITE_INDEX_H
+
+#include "notnull.h"
+#include "tbd.h"
+#include "write_buffer.h"
+
+/*
+ * A binary index of a tbd, meant to be mapped into memory, so a tool can check
+ * whether a library exports a symbol for a target without parsing a tbd.
+ *
+ * All integers are stored in little-endian, and all offsets are from the start
+ * of the file. The index begins with an 80-byte header:
+ *
+ *     char magic[4];                   "TBDI"
+ *     uint32_t version;                1
+ *     uint32_t target_count;           At most 64
+ *     uint32_t group_count;
+ *     uint32_t symbol_count;
+ *     uint32_t bucket_count;           A power of two
+ *     uint32_t install_name_offset;    Offset into the string pool
+ *     uint32_t install_name_length;
+ *     uint32_t current_version;        Packed as in mach-o files
+ *     uint32_t compatibility_version;
+ *     uint64_t targets_offset;
+ *     uint64_t groups_offset;
+ *     uint64_t symbols_offset;
+ *     uint64_t buckets_offset;
+ *     uint64_t strings_offset;
+ *
+ * The target table is a list of target_count entries of:
+ *
+ *     uint32_t name_offset;            Such as "arm64-macos"
+ *     uint32_t name_length;
+ *
+ * Symbols are organized into groups of symbols of the same kind and the same
+ * targets, each with its symbols sorted by name. The group table is a list of
+ * group_count entries of:
+ *
+ *     uint64_t targets;                Bit n is set for target n
+ *     uint32_t kind;                   0 for exports, 1 for re-exports, and
+ *                                      2 for undefineds
+ *     uint32_t type;                   0 for global, 1 for objc-class,
+ *                                      2 for objc-eh-type, 3 for objc-ivar,
+ *                                      4 for weak, and 5 for thread-local
+ *     uint32_t first_symbol;
+ *     uint32_t symbol_count;
+ *
+ * The symbol table is a list of symbol_count entries of:
+ *
+ *     uint32_t name_offset;
+ *     uint32_t name_length;
+ *     uint32_t group;
+ *     uint32_t next;                   Next symbol in the same bucket, or
+ *                                      UINT32_MAX
+ *
+ * The bucket table is a list of bucket_count indices of the first symbol in
+ * each bucket (or UINT32_MAX), where a symbol is in the bucket of the 32-bit
+ * FNV-1a hash of its name, modulo bucket_count.
+ *
+ * Finally, the string pool holds all strings, each followed by a NUL byte.
+ */
+
+int
+tbd_write_index(struct write_buffer *__notnull wb,
+                const struct tbd_create_info *__notnull info,
+                struct tbd_create_options options);
+
+#endif /* TBD_WRITE_INDEX_H */
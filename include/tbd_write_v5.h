@@ -0,0 +1,29 @@
+//
+//  include/tbd_write_v5.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef TBD_WRITE_V5_H
+#define TBD_WRITE_V5_H
+
+#include "notnull.h"
+#include "tbd.h"
+#include "write_buffer.h"
+
+/*
+ * Write out info as a tbd-version v5 (json) document.
+ *
+ * The document is streamed out directly from info's sorted metadata and
+ * symbols arrays, using the same grouping by targets and symbol-type as the
+ * export-groups of tbd-version v4.
+ */
+
+int
+tbd_write_v5(struct write_buffer *__notnull wb,
+             const struct tbd_create_info *__notnull info,
+             struct tbd_create_options options);
+
+#endif /* TBD_WRITE_V5_H */
@@ -0,0 +1,93 @@
+//
+//  include/write_buffer.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef WRITE_BUFFER_H
+#define WRITE_BUFFER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "notnull.h"
+
+/*
+ * A write_buffer collects formatted text before handing it off in large
+ * write() calls.
+ *
+ * A write_buffer created with a file-descriptor is flushed to it whenever its
+ * fixed capacity is filled. A write_buffer created with a negative
+ * file-descriptor instead grows to hold all text appended.
+ *
+ * A counting write_buffer only keeps track of the length of text appended,
+ * and a write_buffer created with a fixed buffer fails once the buffer has been
+ * filled.
+ *
+ * Like the tbd_write functions built on top of them, the wb functions below
+ * return 0 on success, and 1 on either an allocation or write failure.
+ */
+
+struct write_buffer {
+    char *data;
+
+    uint64_t length;
+    uint64_t capacity;
+
+    int fd;
+
+    bool is_counting : 1;
+    bool is_fixed : 1;
+};
+
+void wb_create_with_fd(struct write_buffer *__notnull wb, int fd);
+void wb_create_for_counting(struct write_buffer *__notnull wb);
+
+void
+wb_create_with_fixed_buffer(struct write_buffer *__notnull wb,
+                            char *__notnull buffer,
+                            uint64_t capacity);
+
+int
+wb_add_bytes(struct write_buffer *__notnull wb,
+             const void *__notnull bytes,
+             uint64_t length);
+
+/*
+ * Append a string-literal without having its length computed at runtime.
+ */
+
+#define wb_add_literal(wb, literal) \
+    wb_add_bytes((wb), (literal), sizeof(literal) - 1)
+
+int
+wb_add_c_str(struct write_buffer *__notnull wb, const char *__notnull c_str);
+
+int wb_add_char(struct write_buffer *__notnull wb, char ch);
+
+int wb_add_spaces(struct write_buffer *__notnull wb, uint64_t count);
+
+int wb_add_uint(struct write_buffer *__notnull wb, uint64_t number);
+
+/*
+ * Append a mach-o packed-version (xxxx.yy.zz), omitting the trailing
+ * components that are zero.
+ */
+
+int wb_add_packed_version(struct write_buffer *__notnull wb, uint32_t version);
+
+/*
+ * Append the 16 bytes of uuid in the upper-case 8-4-4-4-12 hex form.
+ */
+
+int
+wb_add_uuid(struct write_buffer *__notnull wb, const uint8_t *__notnull uuid);
+
+int wb_flush(struct write_buffer *__notnull wb);
+
+void wb_clear(struct write_buffer *__notnull wb);
+void wb_destroy(struct write_buffer *__notnull wb);
+
+#endif /* WRITE_BUFFER_H */
@@ -0,0 +1,111 @@
+//
+//  include/write_queue.h
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#ifndef WRITE_QUEUE_H
+#define WRITE_QUEUE_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "array.h"
+#include "notnull.h"
+#include "tbd.h"
+#include "tbd_for_main.h"
+
+/*
+ * A write_queue moves the writing out of tbds to a separate writer thread, so
+ * that writing out one file overlaps with parsing the next one.
+ *
+ * While parsing a file, the write-files for its tbd are added as jobs with
+ * write_queue_add_job(). write_queue_submit() then hands the tbd_create_info
+ * over to the writer thread, and gives the tbd_for_main a recycled
+ * tbd_create_info to parse the next file into.
+ *
+ * All write_queue functions besides the writer thread itself are to be called
+ * from a single thread.
+ */
+
+struct write_queue_entry;
+
+struct write_queue {
+    pthread_t thread;
+    pthread_mutex_t lock;
+
+    pthread_cond_t has_entries;
+    pthread_cond_t has_space;
+    pthread_cond_t is_drained;
+
+    /*
+     * The jobs of the file currently being parsed.
+     */
+
+    struct array pending_jobs;
+
+    struct write_queue_entry *front;
+    struct write_queue_entry *back;
+    struct write_queue_entry *free_list;
+
+    uint64_t queued_count;
+
+    bool is_writing : 1;
+    bool is_finishing : 1;
+};
+
+enum write_queue_result {
+    E_WRITE_QUEUE_OK,
+    E_WRITE_QUEUE_THREAD_CREATE_FAIL
+};
+
+enum write_queue_result write_queue_start(struct write_queue *__notnull queue);
+
+/*
+ * Add a job to write the tbd of the file currently being parsed, stored in
+ * tbd's info, to file.
+ *
+ * write_path is copied, while the write_queue takes ownership of file, and
+ * closes it after writing if close_file is true. If the job can't be queued,
+ * it's written out before returning.
+ */
+
+void
+write_queue_add_job(struct write_queue *__notnull queue,
+                    const struct tbd_for_main *__notnull tbd,
+                    FILE *__notnull file,
+                    char *__notnull write_path,
+                    uint64_t write_path_length,
+                    char *terminator,
+                    bool close_file,
+                    bool print_paths);
+
+/*
+ * Queue the jobs added for tbd's info, and reset tbd's info from orig, as
+ * tbd_create_info_clear_fields_and_create_from() does.
+ *
+ * If no jobs were added, tbd's info is simply reset.
+ */
+
+void
+write_queue_submit(struct write_queue *__notnull queue,
+                   struct tbd_for_main *__notnull tbd,
+                   const struct tbd_create_info *__notnull orig);
+
+/*
+ * Wait for all queued jobs to be written out. Needed before freeing any memory
+ * the queued tbd_create_infos may point to, such as a dyld_shared_cache map.
+ */
+
+void write_queue_drain(struct write_queue *__notnull queue);
+
+/*
+ * Write out all queued jobs, then stop the writer thread and free all
+ * recycled tbd_create_infos.
+ */
+
+void write_queue_finish(struct write_queue *__notnull queue);
+
+#endif /* WRITE_QUEUE_H */
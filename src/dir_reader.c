@@ -0,0 +1,202 @@
+//
+//  src/dir_reader.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "dir_reader.h"
+#include "our_io.h"
+#include "unused.h"
+
+#if defined(DIR_READER_USE_GETDENTS)
+#include <sys/syscall.h>
+#endif
+
+/*
+ * Some file-systems don't provide the type of their directory-entries, and
+ * leave it as DT_UNKNOWN, so we have to stat the entry to find its type.
+ *
+ * The entry's type is then filled in, so callers can still rely on d_type.
+ */
+
+static void
+fill_unknown_entry_type(const int dir_fd, struct dirent *__notnull const entry)
+{
+    struct stat sbuf = {};
+    if (fstatat(dir_fd, entry->d_name, &sbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+        return;
+    }
+
+    if (S_ISREG(sbuf.st_mode)) {
+        entry->d_type = DT_REG;
+    } else if (S_ISDIR(sbuf.st_mode)) {
+        entry->d_type = DT_DIR;
+    }
+}
+
+static inline bool
+should_skip_entry(const int dir_fd, struct dirent *__notnull const entry) {
+    if (entry->d_type == DT_UNKNOWN) {
+        fill_unknown_entry_type(dir_fd, entry);
+    }
+
+    switch (entry->d_type) {
+        case DT_DIR: {
+            const char *const name = entry->d_name;
+            if (name[0] != '.') {
+                return false;
+            }
+
+            return (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+        }
+
+        case DT_REG:
+            return false;
+
+        default:
+            return true;
+    }
+}
+
+#if defined(DIR_READER_USE_GETDENTS)
+
+/*
+ * Large enough to read most directories in one or two calls, while huge
+ * directories (such as dumps of /usr/lib) still only take a call per few
+ * hundred entries.
+ */
+
+static const uint64_t reader_buffer_size = 65536;
+
+enum dir_reader_result
+dir_reader_open(struct dir_reader *__notnull const reader, const int fd) {
+    if (reader->buffer == NULL) {
+        reader->buffer = malloc(reader_buffer_size);
+        if (reader->buffer == NULL) {
+            return E_DIR_READER_ALLOC_FAIL;
+        }
+    }
+
+    reader->fd = fd;
+    reader->offset = 0;
+    reader->size = 0;
+
+    return E_DIR_READER_OK;
+}
+
+static int64_t read_entries(struct dir_reader *__notnull const reader) {
+    do {
+        const long size =
+            syscall(SYS_getdents64,
+                    reader->fd,
+                    reader->buffer,
+                    reader_buffer_size);
+
+        if (size != -1) {
+            return size;
+        }
+    } while (errno == EINTR);
+
+    return -1;
+}
+
+struct dirent *dir_reader_next(struct dir_reader *__notnull const reader) {
+    do {
+        if (reader->offset == reader->size) {
+            const int64_t size = read_entries(reader);
+            if (size <= 0) {
+                if (size == 0) {
+                    errno = 0;
+                }
+
+                return NULL;
+            }
+
+            reader->offset = 0;
+            reader->size = (uint64_t)size;
+        }
+
+        struct dirent *const entry =
+            (struct dirent *)(reader->buffer + reader->offset);
+
+        reader->offset += entry->d_reclen;
+        if (!should_skip_entry(reader->fd, entry)) {
+            return entry;
+        }
+    } while (true);
+}
+
+void dir_reader_close(struct dir_reader *__notnull const reader) {
+    close(reader->fd);
+
+    reader->fd = -1;
+    reader->offset = 0;
+    reader->size = 0;
+}
+
+void dir_reader_destroy(struct dir_reader *__notnull const reader) {
+    free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+#else
+
+enum dir_reader_result
+dir_reader_open(struct dir_reader *__notnull const reader, const int fd) {
+    DIR *const dir = our_fdopendir(fd);
+    if (dir == NULL) {
+        return E_DIR_READER_OPEN_FAIL;
+    }
+
+    reader->fd = fd;
+    reader->dir = dir;
+
+    return E_DIR_READER_OK;
+}
+
+struct dirent *dir_reader_next(struct dir_reader *__notnull const reader) {
+    do {
+        /*
+         * Set errno to zero so we can distinguish when readdir() has failed,
+         * and when there are no more entries left.
+         */
+
+        errno = 0;
+
+        struct dirent *const entry = our_readdir(reader->dir);
+        if (entry == NULL) {
+            return NULL;
+        }
+
+        if (!should_skip_entry(reader->fd, entry)) {
+            return entry;
+        }
+    } while (true);
+}
+
+void dir_reader_close(struct dir_reader *__notnull const reader) {
+    closedir(reader->dir);
+
+    reader->fd = -1;
+    reader->dir = NULL;
+}
+
+void dir_reader_destroy(struct dir_reader *__unused __notnull const reader) {
+    return;
+}
+
+#endif
@@ -9,18 +9,24 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "array.h"
+#include "copy.h"
+#include "dir_reader.h"
 #include "dir_recurse.h"
 #include "our_io.h"
 #include "path.h"
 #include "unused.h"
+#include "util.h"
 
 static inline uint64_t
-get_name_length(struct dirent *__unused __notnull const entry,
+get_name_length(const struct dirent *__unused __notnull const entry,
                 const char *__unused __notnull const name)
 {
 #if defined(__APPLE__) || defined(_DIRENT_HAVE_D_NAMLEN)
@@ -35,6 +41,7 @@ dir_recurse(const char *__notnull const path,
             const uint64_t path_length,
             const int open_flags,
             void *const callback_info,
+            const dir_recurse_filter_callback filter_callback,
             __notnull const dir_recurse_callback callback,
             __notnull const dir_recurse_fail_callback fail_callback)
 {
@@ -43,24 +50,15 @@ dir_recurse(const char *__notnull const path,
         return E_DIR_RECURSE_FAILED_TO_OPEN;
     }
 
-    DIR *const dir = our_fdopendir(dir_fd);
-    if (dir == NULL) {
+    struct dir_reader reader = {};
+    if (dir_reader_open(&reader, dir_fd) != E_DIR_READER_OK) {
         close(dir_fd);
         return E_DIR_RECURSE_FAILED_TO_OPEN;
     }
 
-    /*
-     * Set errno to zero so we can distinguish later when readdir() has failed,
-     * and when there are no more files and sub-directories left.
-     */
-
-    errno = 0;
-
     do {
-        struct dirent *entry = our_readdir(dir);
+        struct dirent *const entry = dir_reader_next(&reader);
         if (entry == NULL) {
-            closedir(dir);
-
             if (errno != 0) {
                 fail_callback(path,
                               path_length,
@@ -69,7 +67,7 @@ dir_recurse(const char *__notnull const path,
                               callback_info);
             }
 
-            return E_DIR_RECURSE_OK;
+            break;
         }
 
         if (entry->d_type != DT_REG) {
@@ -77,6 +75,22 @@ dir_recurse(const char *__notnull const path,
         }
 
         const char *const entry_name = entry->d_name;
+        const uint64_t name_len = get_name_length(entry, entry_name);
+
+        if (filter_callback != NULL) {
+            const bool should_open =
+                filter_callback(dir_fd,
+                                path,
+                                path_length,
+                                entry,
+                                name_len,
+                                callback_info);
+
+            if (!should_open) {
+                continue;
+            }
+        }
+
         const int fd = our_openat(dir_fd, entry_name, open_flags);
 
         if (fd < 0) {
@@ -94,190 +108,312 @@ dir_recurse(const char *__notnull const path,
             break;
         }
 
-        const uint64_t name_len = get_name_length(entry, entry_name);
         if (!callback(path, path_length, fd, entry, name_len, callback_info)) {
             break;
         }
-
-        /*
-         * We need to reset errno as we don't know what happened while in
-         * callback().
-         */
-
-        errno = 0;
     } while (true);
 
-    closedir(dir);
+    dir_reader_close(&reader);
+    dir_reader_destroy(&reader);
+
     return E_DIR_RECURSE_OK;
 }
 
+/*
+ * Each level of sub-directories being read gets its own dir_reader, so the
+ * reader's buffer is reused for every directory at that level.
+ */
+
+struct walk_reader {
+    struct dir_reader reader;
+    struct walk_reader *child;
+};
+
+static struct walk_reader *
+get_child_reader(struct walk_reader *__notnull const reader) {
+    if (reader->child == NULL) {
+        reader->child = calloc(1, sizeof(struct walk_reader));
+    }
+
+    return reader->child;
+}
+
+static void destroy_readers(struct walk_reader *__notnull const reader) {
+    struct walk_reader *child = reader->child;
+    dir_reader_destroy(&reader->reader);
+
+    while (child != NULL) {
+        struct walk_reader *const next = child->child;
+
+        dir_reader_destroy(&child->reader);
+        free(child);
+
+        child = next;
+    }
+
+    reader->child = NULL;
+}
+
+struct recurse_walk {
+    /*
+     * The path of the directory currently being read. The name of each
+     * sub-directory is appended in place while the sub-directory is read, and
+     * removed afterwards, so no path is allocated per sub-directory.
+     */
+
+    char *path;
+    uint64_t path_length;
+    uint64_t path_capacity;
+
+    int file_open_flags;
+    void *callback_info;
+
+    dir_recurse_filter_callback filter_callback;
+    dir_recurse_callback callback;
+    dir_recurse_fail_callback fail_callback;
+};
+
+/*
+ * Where walk's path was before a component was pushed, to be restored with
+ * pop_path_component().
+ */
+
+struct path_mark {
+    uint64_t length;
+    uint64_t slashes_index;
+};
+
+/*
+ * Append name to walk's path in the same way path_append_component() would,
+ * overwriting any slashes at the end of the path.
+ */
+
+static bool
+push_path_component(struct recurse_walk *__notnull const walk,
+                    const char *__notnull const name,
+                    const uint64_t name_length,
+                    struct path_mark *__notnull const mark_out)
+{
+    const uint64_t length = walk->path_length;
+    const uint64_t base = remove_end_slashes(walk->path, length);
+
+    /*
+     * Add one for the slash-separator, and another for the null-terminator.
+     */
+
+    const uint64_t needed = base + name_length + 2;
+    if (needed > walk->path_capacity) {
+        uint64_t capacity = walk->path_capacity * 2;
+        if (capacity < needed) {
+            capacity = needed;
+        }
+
+        char *const path = realloc(walk->path, capacity);
+        if (path == NULL) {
+            return false;
+        }
+
+        walk->path = path;
+        walk->path_capacity = capacity;
+    }
+
+    char *iter = walk->path + base;
+    if (base != 0) {
+        *iter = '/';
+        iter++;
+    }
+
+    memcpy(iter, name, name_length);
+    iter[name_length] = '\0';
+
+    walk->path_length = (uint64_t)(iter - walk->path) + name_length;
+
+    mark_out->length = length;
+    mark_out->slashes_index = base;
+
+    return true;
+}
+
+static void
+pop_path_component(struct recurse_walk *__notnull const walk,
+                   const struct path_mark mark)
+{
+    const uint64_t length = mark.length;
+    const uint64_t index = mark.slashes_index;
+
+    memset(walk->path + index, '/', length - index);
+    walk->path[length] = '\0';
+
+    walk->path_length = length;
+}
+
 static enum dir_recurse_result
-recurse_dir_fd(const int dir_fd,
-               const char *__notnull const dir_path,
-               const uint64_t dir_path_length,
-               const int file_open_flags,
-               void *const callback_info,
-               __notnull const dir_recurse_callback callback,
-               __notnull const dir_recurse_fail_callback fail_callback)
+recurse_dir_fd(struct recurse_walk *__notnull const walk,
+               struct walk_reader *__notnull const reader,
+               const int dir_fd)
 {
-    DIR *const dir = our_fdopendir(dir_fd);
-    if (dir == NULL) {
+    if (dir_reader_open(&reader->reader, dir_fd) != E_DIR_READER_OK) {
         close(dir_fd);
         return E_DIR_RECURSE_FAILED_TO_OPEN;
     }
 
-    bool found_dot = false;
-    bool found_two_dot = false;
+    const dir_recurse_callback callback = walk->callback;
+    const dir_recurse_fail_callback fail_callback = walk->fail_callback;
 
-    errno = 0;
+    void *const callback_info = walk->callback_info;
+    enum dir_recurse_result result = E_DIR_RECURSE_OK;
 
     do {
-        struct dirent *entry = our_readdir(dir);
+        struct dirent *const entry = dir_reader_next(&reader->reader);
         if (entry == NULL) {
-            closedir(dir);
-
             if (errno != 0) {
-                fail_callback(dir_path,
-                              dir_path_length,
+                fail_callback(walk->path,
+                              walk->path_length,
                               E_DIR_RECURSE_FAILED_TO_READ_ENTRY,
                               entry,
                               callback_info);
             }
 
-            return E_DIR_RECURSE_OK;
+            break;
         }
 
-        bool should_exit = false;
-        switch (entry->d_type) {
-            case DT_DIR: {
-                const char *const name = entry->d_name;
-                if (!found_dot) {
-                    if (memcmp(name, ".", sizeof(".")) == 0) {
-                        found_dot = true;
-                        continue;
-                    }
-                }
-
-                if (!found_two_dot) {
-                    if (memcmp(name, "..", sizeof("..")) == 0) {
-                        found_two_dot = true;
-                        continue;
-                    }
-                }
+        const char *const name = entry->d_name;
+        const uint64_t name_length = get_name_length(entry, name);
 
-                const uint64_t name_length = get_name_length(entry, name);
-                uint64_t subdir_path_length = 0;
-
-                char *const subdir_path =
-                    path_append_component(dir_path,
-                                          dir_path_length,
-                                          name,
-                                          name_length,
-                                          &subdir_path_length);
-
-                if (subdir_path == NULL) {
-                    const bool should_continue =
-                        fail_callback(dir_path,
-                                      dir_path_length,
-                                      E_DIR_RECURSE_FAILED_TO_ALLOC_PATH,
-                                      entry,
-                                      callback_info);
+        if (entry->d_type == DT_DIR) {
+            struct walk_reader *const child = get_child_reader(reader);
+            struct path_mark mark = {};
 
-                    if (!should_continue) {
-                        should_exit = true;
-                    }
+            if (child == NULL ||
+                !push_path_component(walk, name, name_length, &mark))
+            {
+                const bool should_continue =
+                    fail_callback(walk->path,
+                                  walk->path_length,
+                                  E_DIR_RECURSE_FAILED_TO_ALLOC_PATH,
+                                  entry,
+                                  callback_info);
 
+                if (!should_continue) {
                     break;
                 }
 
-                const int subdir_fd =
-                    our_openat(dir_fd, name, O_RDONLY | O_DIRECTORY);
+                continue;
+            }
 
-                if (subdir_fd < 0) {
-                    const bool should_continue =
-                        fail_callback(subdir_path,
-                                      subdir_path_length,
-                                      E_DIR_RECURSE_FAILED_TO_OPEN_SUBDIR,
-                                      entry,
-                                      callback_info);
+            const int subdir_fd =
+                our_openat(dir_fd, name, O_RDONLY | O_DIRECTORY);
 
-                    if (!should_continue) {
-                        should_exit = true;
-                    }
+            if (subdir_fd < 0) {
+                const bool should_continue =
+                    fail_callback(walk->path,
+                                  walk->path_length,
+                                  E_DIR_RECURSE_FAILED_TO_OPEN_SUBDIR,
+                                  entry,
+                                  callback_info);
 
-                    free(subdir_path);
+                pop_path_component(walk, mark);
+                if (!should_continue) {
                     break;
                 }
 
-                const enum dir_recurse_result recurse_subdir_result =
-                    recurse_dir_fd(subdir_fd,
-                                   subdir_path,
-                                   subdir_path_length,
-                                   file_open_flags,
-                                   callback_info,
-                                   callback,
-                                   fail_callback);
-
-                free(subdir_path);
+                continue;
+            }
 
-                if (recurse_subdir_result != E_DIR_RECURSE_OK) {
-                    return recurse_subdir_result;
-                }
+            result = recurse_dir_fd(walk, child, subdir_fd);
+            pop_path_component(walk, mark);
 
+            if (result != E_DIR_RECURSE_OK) {
                 break;
             }
 
-            case DT_REG: {
-                const char *const name = entry->d_name;
-                const int fd = our_openat(dir_fd, name, file_open_flags);
+            continue;
+        }
 
-                if (fd < 0) {
-                    const bool should_continue =
-                        fail_callback(dir_path,
-                                      dir_path_length,
-                                      E_DIR_RECURSE_FAILED_TO_OPEN_FILE,
+        if (walk->filter_callback != NULL) {
+            const bool should_open =
+                walk->filter_callback(dir_fd,
+                                      walk->path,
+                                      walk->path_length,
                                       entry,
+                                      name_length,
                                       callback_info);
 
-                    if (!should_continue) {
-                        should_exit = true;
-                    }
-
-                    break;
-                }
-
-                const uint64_t name_length = get_name_length(entry, name);
-                const bool callback_result =
-                    callback(dir_path,
-                             dir_path_length,
-                             fd,
-                             entry,
-                             name_length,
-                             callback_info);
-
-                if (!callback_result) {
-                    should_exit = true;
-                }
+            if (!should_open) {
+                continue;
+            }
+        }
 
-                /*
-                 * We need to reset errno as we don't know what happened while
-                 * in callback().
-                 */
+        const int fd = our_openat(dir_fd, name, walk->file_open_flags);
+        if (fd < 0) {
+            const bool should_continue =
+                fail_callback(walk->path,
+                              walk->path_length,
+                              E_DIR_RECURSE_FAILED_TO_OPEN_FILE,
+                              entry,
+                              callback_info);
 
-                errno = 0;
+            if (!should_continue) {
                 break;
             }
 
-            default:
-                continue;
+            continue;
         }
 
-        if (should_exit) {
+        const bool callback_result =
+            callback(walk->path,
+                     walk->path_length,
+                     fd,
+                     entry,
+                     name_length,
+                     callback_info);
+
+        if (!callback_result) {
             break;
         }
     } while (true);
 
-    return E_DIR_RECURSE_OK;
+    dir_reader_close(&reader->reader);
+    return result;
+}
+
+static enum dir_recurse_result
+recurse_dir_fd_at_path(const int dir_fd,
+                       const char *__notnull const dir_path,
+                       const uint64_t dir_path_length,
+                       const int file_open_flags,
+                       void *const callback_info,
+                       const dir_recurse_filter_callback filter_callback,
+                       __notnull const dir_recurse_callback callback,
+                       __notnull const dir_recurse_fail_callback fail_callback)
+{
+    char *const path = alloc_and_copy(dir_path, dir_path_length);
+    if (path == NULL) {
+        close(dir_fd);
+        return E_DIR_RECURSE_FAILED_TO_OPEN;
+    }
+
+    struct recurse_walk walk = {
+        .path = path,
+        .path_length = dir_path_length,
+        .path_capacity = dir_path_length + 1,
+
+        .file_open_flags = file_open_flags,
+        .callback_info = callback_info,
+
+        .filter_callback = filter_callback,
+        .callback = callback,
+        .fail_callback = fail_callback
+    };
+
+    struct walk_reader reader = {};
+    const enum dir_recurse_result result =
+        recurse_dir_fd(&walk, &reader, dir_fd);
+
+    destroy_readers(&reader);
+    free(walk.path);
+
+    return result;
 }
 
 enum dir_recurse_result
@@ -286,6 +422,7 @@ dir_recurse_with_subdirs(
     const uint64_t dir_path_length,
     const int file_open_flags,
     void *const callback_info,
+    const dir_recurse_filter_callback filter_callback,
     __notnull const dir_recurse_callback callback,
     __notnull const dir_recurse_fail_callback fail_callback)
 {
@@ -294,19 +431,755 @@ dir_recurse_with_subdirs(
         return E_DIR_RECURSE_FAILED_TO_OPEN;
     }
 
-    const enum dir_recurse_result recurse_dir_result =
-        recurse_dir_fd(dir_fd,
-                       dir_path,
-                       dir_path_length,
-                       file_open_flags,
-                       callback_info,
-                       callback,
-                       fail_callback);
+    return recurse_dir_fd_at_path(dir_fd,
+                                  dir_path,
+                                  dir_path_length,
+                                  file_open_flags,
+                                  callback_info,
+                                  filter_callback,
+                                  callback,
+                                  fail_callback);
+}
+
+/*
+ * The most directories that may be read ahead of the calling thread. Every
+ * such directory holds an open file-descriptor until the calling thread has
+ * gone through its entries.
+ */
+
+#define PARALLEL_MAX_LISTED_DIRS 8
+#define PARALLEL_MAX_THREADS 8
+
+enum walk_record_kind {
+    WALK_RECORD_FILE,
+    WALK_RECORD_SUBDIR,
+    WALK_RECORD_FAILURE
+};
+
+/*
+ * An entry of a directory, recorded in the order the directory was read in.
+ */
+
+struct walk_record {
+    enum walk_record_kind kind;
+
+    /*
+     * Only set for sub-directories, until the sub-directory has been freed by
+     * the calling thread.
+     */
+
+    struct walk_node *subdir;
+
+    uint64_t name_length;
+
+    int error;
+    enum dir_recurse_fail_result fail_result;
+
+    bool has_dirent;
+    struct dirent dirent;
+};
+
+enum walk_node_state {
+    WALK_NODE_PENDING,
+    WALK_NODE_LISTING,
+    WALK_NODE_LISTED
+};
+
+/*
+ * A directory, which is read (listed) into its records by any thread, and then
+ * gone through by the calling thread in depth-first order, so files are handed
+ * to the callbacks in the same order as dir_recurse_with_subdirs().
+ */
+
+struct walk_node {
+    char *path;
+    uint64_t path_length;
+
+    int fd;
+    int open_error;
+
+    struct array records;
+    enum walk_node_state state;
+
+    bool failed_to_open;
+
+    /*
+     * Link in the stack of pending directories.
+     */
+
+    struct walk_node *next;
+};
+
+struct parallel_walk {
+    pthread_mutex_t lock;
+
+    pthread_cond_t has_work;
+    pthread_cond_t has_listed;
+
+    /*
+     * Sub-directories are pushed in reverse, so directories are mostly read in
+     * the order the calling thread will go through them.
+     */
+
+    struct walk_node *pending;
+
+    /*
+     * The number of directories being listed, or listed and not yet gone
+     * through by the calling thread.
+     */
+
+    uint64_t open_count;
+
+    int file_open_flags;
 
-    if (recurse_dir_result != E_DIR_RECURSE_OK) {
-        return recurse_dir_result;
+    /*
+     * Called on the threads reading directories.
+     */
+
+    dir_recurse_filter_callback filter_callback;
+    void *callback_info;
+
+    bool is_finished : 1;
+};
+
+static struct walk_node *
+walk_node_create(char *__notnull const path, const uint64_t path_length) {
+    struct walk_node *const node = calloc(1, sizeof(*node));
+    if (node == NULL) {
+        return NULL;
     }
 
-    return E_DIR_RECURSE_OK;
+    node->path = path;
+    node->path_length = path_length;
+    node->fd = -1;
+
+    return node;
+}
+
+/*
+ * Free node, along with all sub-directories it still holds.
+ */
+
+static void walk_node_free(struct walk_node *__notnull const node) {
+    struct walk_record *record = node->records.data;
+    const struct walk_record *const end = node->records.data_end;
+
+    for (; record != end; record++) {
+        if (record->subdir != NULL) {
+            walk_node_free(record->subdir);
+        }
+    }
+
+    if (node->fd >= 0) {
+        close(node->fd);
+    }
+
+    array_destroy(&node->records);
+
+    free(node->path);
+    free(node);
+}
+
+/*
+ * Only copy the used part of the directory-entry, as entries returned by
+ * readdir() may be shorter than a struct dirent.
+ */
+
+static void
+copy_dirent(struct dirent *__notnull const dst,
+            const struct dirent *__notnull const src,
+            const uint64_t name_length)
+{
+    memset(dst, 0, sizeof(*dst));
+    memcpy(dst, src, offsetof(struct dirent, d_name) + name_length);
+}
+
+static bool
+add_record(struct walk_node *__notnull const node,
+           struct walk_record *__notnull const record,
+           const struct dirent *const dirent,
+           const uint64_t name_length)
+{
+    if (dirent != NULL) {
+        copy_dirent(&record->dirent, dirent, name_length);
+
+        record->name_length = name_length;
+        record->has_dirent = true;
+    }
+
+    const enum array_result add_record_result =
+        array_add_item(&node->records, sizeof(*record), record, NULL);
+
+    return (add_record_result == E_ARRAY_OK);
+}
+
+static bool
+add_failure_record(struct walk_node *__notnull const node,
+                   const enum dir_recurse_fail_result fail_result,
+                   const struct dirent *const dirent,
+                   const uint64_t name_length)
+{
+    struct walk_record record = {
+        .kind = WALK_RECORD_FAILURE,
+        .error = errno,
+        .fail_result = fail_result
+    };
+
+    return add_record(node, &record, dirent, name_length);
+}
+
+static bool
+add_subdir_record(struct walk_node *__notnull const node,
+                  const struct dirent *__notnull const dirent,
+                  const uint64_t name_length)
+{
+    uint64_t subdir_path_length = 0;
+    char *const subdir_path =
+        path_append_component(node->path,
+                              node->path_length,
+                              dirent->d_name,
+                              name_length,
+                              &subdir_path_length);
+
+    if (subdir_path == NULL) {
+        return add_failure_record(node,
+                                  E_DIR_RECURSE_FAILED_TO_ALLOC_PATH,
+                                  dirent,
+                                  name_length);
+    }
+
+    struct walk_node *const subdir =
+        walk_node_create(subdir_path, subdir_path_length);
+
+    if (subdir == NULL) {
+        free(subdir_path);
+        return add_failure_record(node,
+                                  E_DIR_RECURSE_FAILED_TO_ALLOC_PATH,
+                                  dirent,
+                                  name_length);
+    }
+
+    struct walk_record record = {
+        .kind = WALK_RECORD_SUBDIR,
+        .subdir = subdir
+    };
+
+    if (!add_record(node, &record, dirent, name_length)) {
+        walk_node_free(subdir);
+        return false;
+    }
+
+    return true;
 }
 
+static inline bool
+should_open_file(const struct parallel_walk *__notnull const walk,
+                 const struct walk_node *__notnull const node,
+                 const struct dirent *__notnull const dirent,
+                 const uint64_t name_length)
+{
+    const dir_recurse_filter_callback filter_callback = walk->filter_callback;
+    if (filter_callback == NULL) {
+        return true;
+    }
+
+    return filter_callback(node->fd,
+                           node->path,
+                           node->path_length,
+                           dirent,
+                           name_length,
+                           walk->callback_info);
+}
+
+/*
+ * Read all entries of node into its records, keeping node's file-descriptor
+ * open for the calling thread to open its files with.
+ */
+
+static void
+list_node(struct parallel_walk *__notnull const walk,
+          struct dir_reader *__notnull const reader,
+          struct walk_node *__notnull const node)
+{
+    if (node->fd < 0) {
+        node->fd = our_open(node->path, O_RDONLY | O_DIRECTORY, 0);
+        if (node->fd < 0) {
+            node->failed_to_open = true;
+            node->open_error = errno;
+
+            return;
+        }
+    }
+
+    /*
+     * The reader closes the file-descriptor it reads from, so it's given its
+     * own.
+     */
+
+    const int reader_fd = dup(node->fd);
+    if (reader_fd < 0) {
+        add_failure_record(node, E_DIR_RECURSE_FAILED_TO_READ_ENTRY, NULL, 0);
+        return;
+    }
+
+    if (dir_reader_open(reader, reader_fd) != E_DIR_READER_OK) {
+        close(reader_fd);
+        add_failure_record(node, E_DIR_RECURSE_FAILED_TO_READ_ENTRY, NULL, 0);
+
+        return;
+    }
+
+    do {
+        struct dirent *const entry = dir_reader_next(reader);
+        if (entry == NULL) {
+            if (errno != 0) {
+                add_failure_record(node,
+                                   E_DIR_RECURSE_FAILED_TO_READ_ENTRY,
+                                   NULL,
+                                   0);
+            }
+
+            break;
+        }
+
+        const uint64_t name_length = get_name_length(entry, entry->d_name);
+        bool added = true;
+
+        if (entry->d_type == DT_DIR) {
+            added = add_subdir_record(node, entry, name_length);
+        } else if (should_open_file(walk, node, entry, name_length)) {
+            struct walk_record record = {
+                .kind = WALK_RECORD_FILE
+            };
+
+            added = add_record(node, &record, entry, name_length);
+        }
+
+        if (!added) {
+            errno = ENOMEM;
+            add_failure_record(node,
+                               E_DIR_RECURSE_FAILED_TO_READ_ENTRY,
+                               NULL,
+                               0);
+
+            break;
+        }
+    } while (true);
+
+    dir_reader_close(reader);
+}
+
+/*
+ * Push node's sub-directories onto the pending stack, with the first
+ * sub-directory on top. Must be called with walk's lock held.
+ */
+
+static void
+push_subdirs_locked(struct parallel_walk *__notnull const walk,
+                    struct walk_node *__notnull const node)
+{
+    const struct walk_record *const begin = node->records.data;
+    const struct walk_record *record = node->records.data_end;
+
+    bool pushed = false;
+    while (record != begin) {
+        record--;
+        if (record->subdir == NULL) {
+            continue;
+        }
+
+        record->subdir->next = walk->pending;
+        walk->pending = record->subdir;
+
+        pushed = true;
+    }
+
+    if (pushed) {
+        pthread_cond_broadcast(&walk->has_work);
+    }
+}
+
+static void
+finish_listing(struct parallel_walk *__notnull const walk,
+               struct walk_node *__notnull const node)
+{
+    pthread_mutex_lock(&walk->lock);
+
+    node->state = WALK_NODE_LISTED;
+    push_subdirs_locked(walk, node);
+
+    pthread_cond_broadcast(&walk->has_listed);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+static inline bool
+has_work_locked(const struct parallel_walk *__notnull const walk) {
+    return (walk->pending != NULL &&
+            walk->open_count < PARALLEL_MAX_LISTED_DIRS);
+}
+
+static void *list_pending_nodes(void *__notnull const arg) {
+    struct parallel_walk *const walk = (struct parallel_walk *)arg;
+    struct dir_reader reader = {};
+
+    pthread_mutex_lock(&walk->lock);
+
+    do {
+        while (!walk->is_finished && !has_work_locked(walk)) {
+            pthread_cond_wait(&walk->has_work, &walk->lock);
+        }
+
+        if (walk->is_finished) {
+            break;
+        }
+
+        struct walk_node *const node = walk->pending;
+
+        walk->pending = node->next;
+        walk->open_count += 1;
+
+        node->state = WALK_NODE_LISTING;
+        pthread_mutex_unlock(&walk->lock);
+
+        list_node(walk, &reader, node);
+        finish_listing(walk, node);
+
+        pthread_mutex_lock(&walk->lock);
+    } while (true);
+
+    pthread_mutex_unlock(&walk->lock);
+    dir_reader_destroy(&reader);
+
+    return NULL;
+}
+
+/*
+ * Remove node from the pending stack. Must be called with walk's lock held.
+ */
+
+static void
+remove_pending_locked(struct parallel_walk *__notnull const walk,
+                      struct walk_node *__notnull const node)
+{
+    struct walk_node **link = &walk->pending;
+    while (*link != node) {
+        link = &(*link)->next;
+    }
+
+    *link = node->next;
+}
+
+/*
+ * Wait until node has been listed, listing it on the calling thread if no
+ * other thread has started to, so the calling thread never waits on a
+ * directory that no thread is reading.
+ */
+
+static void
+wait_for_node(struct parallel_walk *__notnull const walk,
+              struct dir_reader *__notnull const reader,
+              struct walk_node *__notnull const node)
+{
+    pthread_mutex_lock(&walk->lock);
+
+    if (node->state == WALK_NODE_PENDING) {
+        remove_pending_locked(walk, node);
+
+        walk->open_count += 1;
+        node->state = WALK_NODE_LISTING;
+
+        pthread_mutex_unlock(&walk->lock);
+
+        list_node(walk, reader, node);
+        finish_listing(walk, node);
+
+        return;
+    }
+
+    while (node->state != WALK_NODE_LISTED) {
+        pthread_cond_wait(&walk->has_listed, &walk->lock);
+    }
+
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/*
+ * Close node's file-descriptor once the calling thread has gone through it,
+ * making room for another directory to be read.
+ */
+
+static void
+finish_node(struct parallel_walk *__notnull const walk,
+            struct walk_node *__notnull const node)
+{
+    if (node->fd >= 0) {
+        close(node->fd);
+        node->fd = -1;
+    }
+
+    pthread_mutex_lock(&walk->lock);
+
+    walk->open_count -= 1;
+    pthread_cond_signal(&walk->has_work);
+
+    pthread_mutex_unlock(&walk->lock);
+}
+
+struct walk_callbacks {
+    void *info;
+
+    dir_recurse_callback callback;
+    dir_recurse_fail_callback fail_callback;
+};
+
+static bool
+handle_node(struct parallel_walk *__notnull walk,
+            struct dir_reader *__notnull reader,
+            const struct walk_callbacks *__notnull callbacks,
+            struct walk_node *__notnull node);
+
+static bool
+handle_subdir(struct parallel_walk *__notnull const walk,
+              struct dir_reader *__notnull const reader,
+              const struct walk_callbacks *__notnull const callbacks,
+              struct walk_record *__notnull const record)
+{
+    struct walk_node *const subdir = record->subdir;
+    wait_for_node(walk, reader, subdir);
+
+    bool should_continue = true;
+    if (subdir->failed_to_open) {
+        errno = subdir->open_error;
+        should_continue =
+            callbacks->fail_callback(subdir->path,
+                                     subdir->path_length,
+                                     E_DIR_RECURSE_FAILED_TO_OPEN_SUBDIR,
+                                     &record->dirent,
+                                     callbacks->info);
+
+        finish_node(walk, subdir);
+    } else {
+        should_continue = handle_node(walk, reader, callbacks, subdir);
+    }
+
+    /*
+     * Once stopped, the sub-directory is freed along with the rest of the
+     * walk, after all threads have finished.
+     */
+
+    if (should_continue) {
+        walk_node_free(subdir);
+        record->subdir = NULL;
+    }
+
+    return should_continue;
+}
+
+/*
+ * Go through the records of node, which must have been listed, handing files
+ * and failures to the callbacks, and going into each sub-directory in turn.
+ */
+
+static bool
+handle_node(struct parallel_walk *__notnull const walk,
+            struct dir_reader *__notnull const reader,
+            const struct walk_callbacks *__notnull const callbacks,
+            struct walk_node *__notnull const node)
+{
+    const dir_recurse_fail_callback fail_callback = callbacks->fail_callback;
+    void *const info = callbacks->info;
+
+    struct walk_record *record = node->records.data;
+    const struct walk_record *const end = node->records.data_end;
+
+    bool should_continue = true;
+    for (; record != end && should_continue; record++) {
+        struct dirent *const dirent =
+            (record->has_dirent) ? &record->dirent : NULL;
+
+        switch (record->kind) {
+            case WALK_RECORD_FILE: {
+                const int fd =
+                    our_openat(node->fd,
+                               record->dirent.d_name,
+                               walk->file_open_flags);
+
+                if (fd < 0) {
+                    should_continue =
+                        fail_callback(node->path,
+                                      node->path_length,
+                                      E_DIR_RECURSE_FAILED_TO_OPEN_FILE,
+                                      dirent,
+                                      info);
+
+                    break;
+                }
+
+                should_continue =
+                    callbacks->callback(node->path,
+                                        node->path_length,
+                                        fd,
+                                        dirent,
+                                        record->name_length,
+                                        info);
+
+                break;
+            }
+
+            case WALK_RECORD_SUBDIR:
+                should_continue =
+                    handle_subdir(walk, reader, callbacks, record);
+
+                break;
+
+            case WALK_RECORD_FAILURE:
+                errno = record->error;
+                should_continue =
+                    fail_callback(node->path,
+                                  node->path_length,
+                                  record->fail_result,
+                                  dirent,
+                                  info);
+
+                break;
+        }
+    }
+
+    finish_node(walk, node);
+    return should_continue;
+}
+
+static uint64_t get_parallel_thread_count(const uint64_t thread_count) {
+    if (thread_count != 0) {
+        if (thread_count > PARALLEL_MAX_THREADS) {
+            return PARALLEL_MAX_THREADS;
+        }
+
+        return thread_count;
+    }
+
+    const long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1) {
+        return 1;
+    }
+
+    if ((uint64_t)cpu_count > PARALLEL_MAX_THREADS) {
+        return PARALLEL_MAX_THREADS;
+    }
+
+    return (uint64_t)cpu_count;
+}
+
+enum dir_recurse_result
+dir_recurse_with_subdirs_parallel(
+    const char *__notnull const dir_path,
+    const uint64_t dir_path_length,
+    const int file_open_flags,
+    const uint64_t thread_count,
+    void *const callback_info,
+    const dir_recurse_filter_callback filter_callback,
+    __notnull const dir_recurse_callback callback,
+    __notnull const dir_recurse_fail_callback fail_callback)
+{
+    const int dir_fd = our_open(dir_path, O_RDONLY | O_DIRECTORY, 0);
+    if (dir_fd < 0) {
+        return E_DIR_RECURSE_FAILED_TO_OPEN;
+    }
+
+    char *const path = alloc_and_copy(dir_path, dir_path_length);
+    struct walk_node *root = NULL;
+
+    if (path != NULL) {
+        root = walk_node_create(path, dir_path_length);
+        if (root == NULL) {
+            free(path);
+        }
+    }
+
+    if (root == NULL) {
+        close(dir_fd);
+        return dir_recurse_with_subdirs(dir_path,
+                                        dir_path_length,
+                                        file_open_flags,
+                                        callback_info,
+                                        filter_callback,
+                                        callback,
+                                        fail_callback);
+    }
+
+    root->fd = dir_fd;
+
+    struct parallel_walk walk = {
+        .pending = root,
+        .file_open_flags = file_open_flags,
+        .filter_callback = filter_callback,
+        .callback_info = callback_info
+    };
+
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.has_work, NULL);
+    pthread_cond_init(&walk.has_listed, NULL);
+
+    const uint64_t count = get_parallel_thread_count(thread_count);
+
+    pthread_t threads[PARALLEL_MAX_THREADS];
+    uint64_t created_count = 0;
+
+    for (; created_count != count; created_count++) {
+        pthread_t *const thread = threads + created_count;
+        if (pthread_create(thread, NULL, list_pending_nodes, &walk) != 0) {
+            break;
+        }
+    }
+
+    /*
+     * If no threads could be created, read the directories on this thread, as
+     * dir_recurse_with_subdirs() does.
+     */
+
+    enum dir_recurse_result result = E_DIR_RECURSE_OK;
+    if (created_count != 0) {
+        const struct walk_callbacks callbacks = {
+            .info = callback_info,
+            .callback = callback,
+            .fail_callback = fail_callback
+        };
+
+        struct dir_reader reader = {};
+
+        wait_for_node(&walk, &reader, root);
+        handle_node(&walk, &reader, &callbacks, root);
+
+        pthread_mutex_lock(&walk.lock);
+
+        walk.is_finished = true;
+        pthread_cond_broadcast(&walk.has_work);
+
+        pthread_mutex_unlock(&walk.lock);
+
+        for (uint64_t i = 0; i != created_count; i++) {
+            pthread_join(threads[i], NULL);
+        }
+
+        dir_reader_destroy(&reader);
+        walk_node_free(root);
+    } else {
+        free(root->path);
+        free(root);
+
+        result = recurse_dir_fd_at_path(dir_fd,
+                                        dir_path,
+                                        dir_path_length,
+                                        file_open_flags,
+                                        callback_info,
+                                        filter_callback,
+                                        callback,
+                                        fail_callback);
+    }
+
+    pthread_cond_destroy(&walk.has_listed);
+    pthread_cond_destroy(&walk.has_work);
+    pthread_mutex_destroy(&walk.lock);
+
+    return result;
+}
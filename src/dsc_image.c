@@ -10,11 +10,13 @@
 
 #include "mach-o/loader.h"
 #include "mach-o/fat.h"
+#include "mach-o/nlist.h"
 
 #include "dsc_image.h"
 #include "macho_file_parse_load_commands.h"
 #include "macho_file_parse_export_trie.h"
 #include "macho_file_parse_symtab.h"
+#include "swap.h"
 #include "tbd.h"
 #include "unused.h"
 
@@ -155,7 +157,7 @@ translate_macho_file_parse_result(const enum macho_file_parse_result result) {
  */
 
 static uint64_t
-get_offset_from_addr(struct dyld_shared_cache_info *__notnull const info,
+get_offset_from_addr(const struct dyld_shared_cache_info *__notnull const info,
                      const uint64_t address,
                      uint64_t *__notnull const max_size_out)
 {
@@ -311,6 +313,8 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
         .macho_size = max_image_size,
 
         .arch = dsc_info->arch,
+        .arch_index = dsc_info->arch_index,
+
         .available_map_range = dsc_info->available_range,
 
         .ncmds = header->ncmds,
@@ -355,6 +359,8 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
                 .info_in = info_in,
                 .available_range = dsc_info->available_range,
 
+                .arch_index = dsc_info->arch_index,
+
                 .is_64 = is_64,
                 .is_big_endian = is_big_endian,
 
@@ -395,6 +401,7 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
 
             .stroff = lc_info.symtab.stroff,
             .strsize = lc_info.symtab.strsize,
+            .arch_index = dsc_info->arch_index,
 
             .tbd_options = tbd_options
         };
@@ -423,3 +430,162 @@ dsc_image_parse(struct tbd_create_info *__notnull const info_in,
 
     return E_DSC_IMAGE_PARSE_OK;
 }
+
+static inline struct range
+range_from_offset_and_size(const uint64_t offset, const uint64_t size) {
+    const struct range range = {
+        .begin = offset,
+        .end = offset + size
+    };
+
+    return range;
+}
+
+/*
+ * Only a minimal walk of the load-commands is performed here, as the ranges
+ * are only used as hints for the kernel, and are never read from directly.
+ *
+ * Any malformed data simply results in the remaining ranges being left empty,
+ * with the actual errors being reported later by dsc_image_parse().
+ */
+
+void
+dsc_image_get_ranges(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    const struct dyld_cache_image_info *__notnull const image,
+    struct dsc_image_ranges *__notnull const ranges_out)
+{
+    *ranges_out = (struct dsc_image_ranges){};
+
+    uint64_t max_image_size = 0;
+    const uint64_t file_offset =
+        get_offset_from_addr(dsc_info, image->address, &max_image_size);
+
+    if (file_offset == 0) {
+        return;
+    }
+
+    if (max_image_size < sizeof(struct mach_header)) {
+        return;
+    }
+
+    const struct mach_header *const header =
+        (const struct mach_header *)(dsc_info->map + file_offset);
+
+    const uint32_t magic = header->magic;
+
+    const bool is_64 = (magic == MH_MAGIC_64 || magic == MH_CIGAM_64);
+    const bool is_big_endian = (magic == MH_CIGAM || magic == MH_CIGAM_64);
+
+    if (!is_64 && !is_big_endian && magic != MH_MAGIC) {
+        return;
+    }
+
+    const uint32_t header_size =
+        (is_64) ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+
+    uint32_t ncmds = header->ncmds;
+    uint32_t sizeofcmds = header->sizeofcmds;
+
+    if (is_big_endian) {
+        ncmds = swap_uint32(ncmds);
+        sizeofcmds = swap_uint32(sizeofcmds);
+    }
+
+    if (max_image_size - header_size < sizeofcmds) {
+        return;
+    }
+
+    ranges_out->load_commands =
+        range_from_offset_and_size(file_offset, header_size + sizeofcmds);
+
+    const uint8_t *lc_iter = (const uint8_t *)header + header_size;
+    const uint8_t *const lc_end = lc_iter + sizeofcmds;
+
+    for (uint32_t i = 0; i != ncmds; i++) {
+        if ((uint64_t)(lc_end - lc_iter) < sizeof(struct load_command)) {
+            break;
+        }
+
+        const struct load_command *const lc =
+            (const struct load_command *)lc_iter;
+
+        uint32_t cmd = lc->cmd;
+        uint32_t cmdsize = lc->cmdsize;
+
+        if (is_big_endian) {
+            cmd = swap_uint32(cmd);
+            cmdsize = swap_uint32(cmdsize);
+        }
+
+        if (cmdsize < sizeof(struct load_command)) {
+            break;
+        }
+
+        if ((uint64_t)(lc_end - lc_iter) < cmdsize) {
+            break;
+        }
+
+        switch (cmd) {
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                if (cmdsize < sizeof(struct dyld_info_command)) {
+                    break;
+                }
+
+                const struct dyld_info_command *const dyld_info =
+                    (const struct dyld_info_command *)lc;
+
+                uint32_t export_off = dyld_info->export_off;
+                uint32_t export_size = dyld_info->export_size;
+
+                if (is_big_endian) {
+                    export_off = swap_uint32(export_off);
+                    export_size = swap_uint32(export_size);
+                }
+
+                ranges_out->export_trie =
+                    range_from_offset_and_size(export_off, export_size);
+
+                break;
+            }
+
+            case LC_SYMTAB: {
+                if (cmdsize < sizeof(struct symtab_command)) {
+                    break;
+                }
+
+                const struct symtab_command *const symtab =
+                    (const struct symtab_command *)lc;
+
+                uint32_t symoff = symtab->symoff;
+                uint32_t nsyms = symtab->nsyms;
+
+                if (is_big_endian) {
+                    symoff = swap_uint32(symoff);
+                    nsyms = swap_uint32(nsyms);
+                }
+
+                /*
+                 * The string-table is shared between every image in the
+                 * cache, so only the image's own slice of the symbol-table is
+                 * recorded.
+                 */
+
+                const uint64_t nlist_size =
+                    (is_64) ?
+                        sizeof(struct nlist_64) : sizeof(struct nlist);
+
+                ranges_out->symbol_table =
+                    range_from_offset_and_size(symoff, nlist_size * nsyms);
+
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        lc_iter += cmdsize;
+    }
+}
@@ -9,6 +9,11 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#if defined(__linux__)
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#endif
+
 #include <errno.h>
 
 #include <stdlib.h>
@@ -199,6 +204,116 @@ get_arch_info_from_magic(const char magic[const 16],
     return 0;
 }
 
+/*
+ * Extracting every image of a dyld_shared_cache jumps between the headers and
+ * __LINKEDIT data all over the cache, which is a lot of TLB misses when the
+ * cache is mapped with regular pages.
+ */
+
+#if defined(MADV_HUGEPAGE) && defined(__linux__)
+
+/*
+ * A file on tmpfs lives in memory that isn't backed by the page-cache of a
+ * disk, so its mapping only gets huge-pages if tmpfs was mounted to allow them.
+ */
+
+static bool is_on_tmpfs(const int fd) {
+    struct statfs sbuf = {};
+    if (fstatfs(fd, &sbuf) != 0) {
+        return false;
+    }
+
+    return (sbuf.f_type == TMPFS_MAGIC);
+}
+
+/*
+ * Copy the file at fd into an anonymous mapping advised to use huge-pages.
+ */
+
+static uint8_t *copy_to_huge_pages(const int fd, const uint64_t size) {
+    uint8_t *const map =
+        mmap(0,
+             size,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS,
+             -1,
+             0);
+
+    if (map == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    /*
+     * Advise before reading in the file, so the pages are faulted in as
+     * huge-pages from the start.
+     */
+
+    madvise(map, size, MADV_HUGEPAGE);
+
+    if (our_lseek(fd, 0, SEEK_SET) < 0) {
+        munmap(map, size);
+        return MAP_FAILED;
+    }
+
+    for (uint64_t offset = 0; offset != size;) {
+        const ssize_t count = our_read(fd, map + offset, size - offset);
+        if (count <= 0) {
+            munmap(map, size);
+            return MAP_FAILED;
+        }
+
+        offset += (uint64_t)count;
+    }
+
+    return map;
+}
+
+#endif
+
+/*
+ * The file is mapped as usual, and the mapping is advised to use huge-pages,
+ * so the cache stays shared with the page-cache.
+ *
+ * Only a file on tmpfs is instead copied into anonymous memory, as tmpfs
+ * usually doesn't provide huge-pages for file mappings.
+ *
+ * On platforms without MADV_HUGEPAGE, we simply map the file as usual.
+ */
+
+static uint8_t *
+map_with_huge_pages(const int fd,
+                    const uint64_t size,
+                    bool *__notnull const is_copy_out)
+{
+#if defined(MADV_HUGEPAGE) && defined(__linux__)
+    if (is_on_tmpfs(fd)) {
+        uint8_t *const copy = copy_to_huge_pages(fd, size);
+        if (copy != MAP_FAILED) {
+            *is_copy_out = true;
+        }
+
+        return copy;
+    }
+#endif
+
+    uint8_t *const map =
+        mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    if (map == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+#ifdef MADV_HUGEPAGE
+    /*
+     * Failing to get huge-pages isn't an error, as we can still use the map.
+     */
+
+    madvise(map, size, MADV_HUGEPAGE);
+#endif
+
+    return map;
+}
+
 enum dyld_shared_cache_parse_result
 dyld_shared_cache_parse_from_file(
     struct dyld_shared_cache_info *__notnull const info_in,
@@ -313,8 +428,14 @@ dyld_shared_cache_parse_from_file(
      * itself.
      */
 
-    uint8_t *const map =
-        mmap(0, dsc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    uint8_t *map = NULL;
+    bool map_is_copy = false;
+
+    if (options.use_huge_pages) {
+        map = map_with_huge_pages(fd, dsc_size, &map_is_copy);
+    } else {
+        map = mmap(0, dsc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
 
     if (map == MAP_FAILED) {
         return E_DYLD_SHARED_CACHE_PARSE_MMAP_FAIL;
@@ -465,11 +586,90 @@ dyld_shared_cache_parse_from_file(
     info_in->size = dsc_size;
 
     info_in->available_range = available_range;
+
     info_in->flags.unmap_map = true;
+    info_in->flags.map_is_copy = map_is_copy;
 
     return E_DYLD_SHARED_CACHE_PARSE_OK;
 }
 
+/*
+ * Advise the kernel on a file-range of the cache's mapping.
+ *
+ * When we're done with a range, we round inwards so we never release a page
+ * shared with data we may still need, and never release anything before the
+ * available-range, as the image-infos array is written to (see the pad field),
+ * and dropping those pages from a private mapping would discard our changes.
+ *
+ * Where supported, MADV_COLD is preferred over MADV_DONTNEED, as it only
+ * deprioritizes the pages instead of dropping them outright.
+ */
+
+void
+dyld_shared_cache_advise_range(
+    const struct dyld_shared_cache_info *__notnull const info,
+    struct range range,
+    const enum dyld_shared_cache_advice advice)
+{
+    if (range.end > info->size) {
+        range.end = info->size;
+    }
+
+    if (range.begin >= range.end) {
+        return;
+    }
+
+    const uint64_t page_size = (uint64_t)getpagesize();
+    const uint64_t page_mask = page_size - 1;
+
+    switch (advice) {
+        case DYLD_SHARED_CACHE_ADVICE_WILL_NEED: {
+            const uint64_t begin = range.begin & ~page_mask;
+            uint64_t end = range.end;
+
+            if (guard_overflow_add(&end, page_mask)) {
+                return;
+            }
+
+            end &= ~page_mask;
+            madvise(info->map + begin, end - begin, MADV_WILLNEED);
+
+            break;
+        }
+
+        case DYLD_SHARED_CACHE_ADVICE_DONT_NEED: {
+            /*
+             * A copied map cannot be read back in from the file, and releasing
+             * part of it would only split up its huge-pages.
+             */
+
+            if (info->flags.map_is_copy) {
+                return;
+            }
+
+            uint64_t begin = range.begin;
+            if (begin < info->available_range.begin) {
+                begin = info->available_range.begin;
+            }
+
+            begin = (begin + page_mask) & ~page_mask;
+
+            const uint64_t end = range.end & ~page_mask;
+            if (begin >= end) {
+                return;
+            }
+
+#ifdef MADV_COLD
+            madvise(info->map + begin, end - begin, MADV_COLD);
+#else
+            madvise(info->map + begin, end - begin, MADV_DONTNEED);
+#endif
+
+            break;
+        }
+    }
+}
+
 void
 dyld_shared_cache_info_destroy(
     struct dyld_shared_cache_info *__notnull const info)
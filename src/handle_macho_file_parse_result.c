@@ -22,84 +22,89 @@ handle_macho_file_for_main_error_callback(
     const struct handle_macho_file_parse_error_cb_info *const cb_info =
         (const struct handle_macho_file_parse_error_cb_info *)callback_info;
 
+    FILE *file = cb_info->file;
+    if (file == NULL) {
+        file = stderr;
+    }
+
     bool request_result = false;
     switch (type) {
         case ERR_MACHO_FILE_PARSE_CURRENT_VERSION_CONFLICT:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has archs with multiple "
                         "current-versions conflicting with one another\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has archs with multiple "
                         "current-versions conflicting with one another\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file has archs with multiple "
                       "current-versions conflicting with one another\n",
-                      stderr);
+                      file);
             }
 
             return false;
 
         case ERR_MACHO_FILE_PARSE_COMPAT_VERSION_CONFLICT:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has archs with multiple "
                         "compatibility-versions conflicting with one another\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has archs with multiple "
                         "compatibility-versions conflicting with one another\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file has archs with multiple "
                       "compatibility-versions conflicting with one another\n",
-                      stderr);
+                      file);
             }
 
             return false;
 
         case ERR_MACHO_FILE_PARSE_EXPORT_TRIE_CONFLICT:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has archs with multiple "
                         "export-tries conflicting with one another\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has archs with multiple "
                         "export-tries conflicting with one another\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file has archs with multiple "
                       "export-tries conflicting with one another\n",
-                      stderr);
+                      file);
             }
 
             return false;
 
         case ERR_MACHO_FILE_PARSE_FILETYPE_CONFLICT:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has archs with multiple "
                         "mach-o filetypes conflictingwith one another\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has archs with multiple "
                         "mach-o filetypes conflicting with one another\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file has archs with multiple mach-o "
                       "filetypes conflicting with one another\n",
-                      stderr);
+                      file);
             }
 
             return false;
@@ -110,7 +115,7 @@ handle_macho_file_for_main_error_callback(
                     request_if_should_ignore_flags(cb_info->orig,
                                                    cb_info->tbd,
                                                    false,
-                                                   stderr,
+                                                   file,
                                                    "Mach-o file (at "
                                                    "path %s/%s) has archs with "
                                                    "differing sets of flags "
@@ -124,7 +129,7 @@ handle_macho_file_for_main_error_callback(
                     request_if_should_ignore_flags(cb_info->orig,
                                                    cb_info->tbd,
                                                    false,
-                                                   stderr,
+                                                   file,
                                                    "Mach-o file (at path %s) "
                                                    "has archs with differing "
                                                    "sets of flags conflicting "
@@ -135,7 +140,7 @@ handle_macho_file_for_main_error_callback(
                     request_if_should_ignore_flags(cb_info->orig,
                                                    cb_info->tbd,
                                                    false,
-                                                   stderr,
+                                                   file,
                                                    "The provided mach-o file "
                                                    "has archs with differing "
                                                    "sets of flags conflicting "
@@ -150,20 +155,20 @@ handle_macho_file_for_main_error_callback(
 
         case ERR_MACHO_FILE_PARSE_INSTALL_NAME_CONFLICT:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has archs with multiple "
                         "install-names conflicting with one another\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has archs with multiple "
                         "install-names conflicting with one another\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file has archs with multiple "
                       "install-names conflicting with one another\n",
-                      stderr);
+                      file);
             }
 
             return false;
@@ -174,7 +179,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "Mach-o file (at path %s/%s), or one of "
                                      "its archs, has an invalid platform\n",
                                      cb_info->dir_path,
@@ -185,7 +190,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "Mach-o file (at path %s), or one of its "
                                      "archs, has an invalid platform\n",
                                      cb_info->dir_path);
@@ -194,7 +199,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "The provided mach-o file, or one of its "
                                      "archs, has an invalid platform\n");
             }
@@ -211,7 +216,7 @@ handle_macho_file_for_main_error_callback(
                     request_parent_umbrella(cb_info->orig,
                                             cb_info->tbd,
                                             false,
-                                            stderr,
+                                            file,
                                             "Mach-o file (at path %s/%s), or "
                                             "one of its archs, has an invalid "
                                             "parent-umbrella\n",
@@ -222,7 +227,7 @@ handle_macho_file_for_main_error_callback(
                     request_parent_umbrella(cb_info->orig,
                                             cb_info->tbd,
                                             false,
-                                            stderr,
+                                            file,
                                             "Mach-o file (at path %s), or one "
                                             "of its archs, has an invalid "
                                             "parent-umbrella\n",
@@ -232,7 +237,7 @@ handle_macho_file_for_main_error_callback(
                     request_parent_umbrella(cb_info->orig,
                                             cb_info->tbd,
                                             false,
-                                            stderr,
+                                            file,
                                             "The provided mach-o file, or one "
                                             "of its archs, has an invalid "
                                             "parent-umbrella\n");
@@ -246,20 +251,20 @@ handle_macho_file_for_main_error_callback(
 
         case ERR_MACHO_FILE_PARSE_INVALID_UUID:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s), or one of its archs, has "
                         "an invalid uuid\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-archs file (at path %s), or one of its archs, "
                         "has an invalid uuid\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file, or one of its archs, has an "
                       "invalid uuid\n",
-                      stderr);
+                      file);
             }
 
             return false;
@@ -270,7 +275,7 @@ handle_macho_file_for_main_error_callback(
                     request_objc_constraint(cb_info->orig,
                                             cb_info->tbd,
                                             false,
-                                            stderr,
+                                            file,
                                             "Mach-o file (at path %s/%s) has "
                                             "archs with multiple "
                                             "objc-constraints conflicting "
@@ -282,7 +287,7 @@ handle_macho_file_for_main_error_callback(
                     request_objc_constraint(cb_info->orig,
                                             cb_info->tbd,
                                             false,
-                                            stderr,
+                                            file,
                                             "Mach-o file (at path %s) has "
                                             "archs with multiple "
                                             "objc-constraints conflicting with "
@@ -293,7 +298,7 @@ handle_macho_file_for_main_error_callback(
                     request_objc_constraint(cb_info->orig,
                                             cb_info->tbd,
                                             false,
-                                            stderr,
+                                            file,
                                             "The provided mach-o file has "
                                             "archs multiple objc-constraints "
                                             "conflicting with one another\n");
@@ -311,7 +316,7 @@ handle_macho_file_for_main_error_callback(
                     request_parent_umbrella(cb_info->orig,
                                             cb_info->tbd,
                                             false,
-                                            stderr,
+                                            file,
                                             "Mach-o file (at path %s) has "
                                             "archs with multiple "
                                             "parent-umbrellas conflicting with "
@@ -322,7 +327,7 @@ handle_macho_file_for_main_error_callback(
                     request_parent_umbrella(cb_info->orig,
                                             cb_info->tbd,
                                             false,
-                                            stderr,
+                                            file,
                                             "The provided mach-o file, has "
                                             "archs with multiple "
                                             "parent-umbrellas conflicting with "
@@ -341,7 +346,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "Mach-o file (at path %s/%s) has archs "
                                      "with multiple platforms conflicting with "
                                      "one another\n",
@@ -352,7 +357,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "Mach-o file (at path %s) has multiple "
                                      "platforms conflicting with one another\n",
                                      cb_info->dir_path);
@@ -361,7 +366,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "The provided mach-o file has archs with "
                                      "multiple platforms conflicting with one "
                                      "another\n");
@@ -379,7 +384,7 @@ handle_macho_file_for_main_error_callback(
                     request_swift_version(cb_info->orig,
                                           cb_info->tbd,
                                           false,
-                                          stderr,
+                                          file,
                                           "Mach-o file (at path %s/%s) has "
                                           "archs with multiple swift-versions "
                                           "conflicting with one another\n",
@@ -390,7 +395,7 @@ handle_macho_file_for_main_error_callback(
                     request_swift_version(cb_info->orig,
                                           cb_info->tbd,
                                           false,
-                                          stderr,
+                                          file,
                                           "Mach-o file (at path %s) has archs "
                                           "with multiple swift-versions "
                                           "conflicting with one another\n",
@@ -400,7 +405,7 @@ handle_macho_file_for_main_error_callback(
                     request_swift_version(cb_info->orig,
                                           cb_info->tbd,
                                           false,
-                                          stderr,
+                                          file,
                                           "The provided mach-o file has archs "
                                           "multiple swift-versions conflicting "
                                           "with one another\n");
@@ -414,60 +419,60 @@ handle_macho_file_for_main_error_callback(
 
         case ERR_MACHO_FILE_PARSE_SYMBOL_TABLE_CONFLICT:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has archs with multiple "
                         "symbol-tables conflicting with one another\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has archs with multiple "
                         "symbol-tables conflicting with one another\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file has archs with multiple "
                       "symbol-tables conflicting with one another\n",
-                      stderr);
+                      file);
             }
 
             return false;
 
         case ERR_MACHO_FILE_PARSE_TARGET_PLATFORM_CONFLICT:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has archs with multiple "
                         "platforms conflicting with one another\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has archs with multiple "
                         "platforms conflicting with one another\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file has archs with multiple "
                       "platforms conflicting with one another\n",
-                      stderr);
+                      file);
             }
 
             return false;
 
         case ERR_MACHO_FILE_PARSE_UUID_CONFLICT:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has multiple archs with "
                         "uuids that are not unique\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has multiple archs with "
                         "uuids that are not unique\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file has archs with multiple uuids "
                       "that are not unique\n",
-                      stderr);
+                      file);
             }
 
             return false;
@@ -478,7 +483,7 @@ handle_macho_file_for_main_error_callback(
                     request_install_name(cb_info->orig,
                                          cb_info->tbd,
                                          false,
-                                         stderr,
+                                         file,
                                          "Mach-o file (at path %s/%s), or one "
                                          "of its archs, has an invalid "
                                          "install-name\n",
@@ -489,7 +494,7 @@ handle_macho_file_for_main_error_callback(
                     request_install_name(cb_info->orig,
                                          cb_info->tbd,
                                          false,
-                                         stderr,
+                                         file,
                                          "Mach-o file (at path %s), or one of "
                                          "its archs, has an invalid "
                                          "install-name\n",
@@ -499,7 +504,7 @@ handle_macho_file_for_main_error_callback(
                     request_install_name(cb_info->orig,
                                          cb_info->tbd,
                                          false,
-                                         stderr,
+                                         file,
                                          "The provided mach-o file, or one of "
                                          "its archs, has an invalid "
                                          "install-name\n");
@@ -522,12 +527,12 @@ handle_macho_file_for_main_error_callback(
             }
 
             if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) is not a dynamic-library\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file is not a dynamic library\n",
-                      stderr);
+                      file);
             }
 
             return false;
@@ -538,7 +543,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "Mach-o file (at path %s/%s), does not "
                                      "have a platform\n",
                                      cb_info->dir_path,
@@ -548,7 +553,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "Mach-o file (at path %s), does not have "
                                      "a platform\n",
                                      cb_info->dir_path);
@@ -557,7 +562,7 @@ handle_macho_file_for_main_error_callback(
                     request_platform(cb_info->orig,
                                      cb_info->tbd,
                                      false,
-                                     stderr,
+                                     file,
                                      "The provided mach-o file does not have a "
                                      "platform\n");
             }
@@ -570,20 +575,20 @@ handle_macho_file_for_main_error_callback(
 
         case ERR_MACHO_FILE_PARSE_NO_UUID:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s), or one of its archs, "
                         "does not have a uuid\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s), or one of its archs does "
                         "not have a uuid\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file, or one of its archs, does not "
                       "have a uuid\n ",
-                      stderr);
+                      file);
             }
 
             return false;
@@ -599,34 +604,34 @@ handle_macho_file_for_main_error_callback(
             }
 
             if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s), or one of its archs, has "
                         "the wrong mach-o filetype\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file, or one of its archs, has the "
                       "wrong mach-o filetype\n",
-                      stderr);
+                      file);
             }
 
             return false;
 
         case WARN_MACHO_FILE_SYMBOL_TABLE_OUTOFSYNC:
             if (cb_info->is_recursing) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s/%s) has a symbol-table "
                         "out-of-sync with the export-trie\r\n",
                         cb_info->dir_path,
                         cb_info->name);
             } else if (cb_info->print_paths) {
-                fprintf(stderr,
+                fprintf(file,
                         "Mach-o file (at path %s) has a symbol-table "
                         "out-of-sync with the export-trie\r\n",
                         cb_info->dir_path);
             } else {
                 fputs("The provided mach-o file, or one of its archs, has a "
                       "symbol-table out-of-sync with the export-trie",
-                      stderr);
+                      file);
             }
 
             return false;
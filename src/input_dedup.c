@@ -0,0 +1,441 @@
+//
+//  src/input_dedup.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "copy.h"
+#include "input_dedup.h"
+#include "our_io.h"
+#include "recursive.h"
+
+/*
+ * An entry is found both by the key of its device and inode, and, with
+ * match_contents, by the key of its contents.
+ */
+
+struct input_dedup_entry {
+    struct result_cache_key key;
+    struct result_cache_key contents_key;
+
+    char *write_path;
+    uint64_t write_path_length;
+
+    bool has_contents_key : 1;
+    bool is_written : 1;
+};
+
+struct input_dedup_copy {
+    const struct tbd_for_main *tbd;
+
+    /*
+     * The index of the entry the copy was found through, as entries may be
+     * moved as more are added.
+     */
+
+    uint64_t entry_index;
+
+    char *write_path;
+    uint64_t write_path_length;
+};
+
+bool input_dedup_can_dedup(const struct tbd_for_main *__notnull const tbd) {
+    if (tbd->options.no_overwrite) {
+        return false;
+    }
+
+    return result_cache_can_cache(tbd);
+}
+
+static inline bool
+keys_match(const struct result_cache_key *__notnull const left,
+           const struct result_cache_key *__notnull const right)
+{
+    return (left->hash[0] == right->hash[0] && left->hash[1] == right->hash[1]);
+}
+
+static inline bool
+entry_matches(const struct input_dedup_entry *__notnull const entry,
+              const struct result_cache_key *__notnull const key)
+{
+    if (keys_match(&entry->key, key)) {
+        return true;
+    }
+
+    return (entry->has_contents_key && keys_match(&entry->contents_key, key));
+}
+
+static struct input_dedup_entry *
+find_entry(const struct input_dedup *__notnull const dedup,
+           const struct result_cache_key *__notnull const key)
+{
+    if (dedup->bucket_count == 0) {
+        return NULL;
+    }
+
+    struct input_dedup_entry *const entries = dedup->entries.data;
+
+    const uint64_t mask = dedup->bucket_count - 1;
+    uint64_t index = key->hash[1] & mask;
+
+    do {
+        const uint64_t bucket = dedup->buckets[index];
+        if (bucket == 0) {
+            return NULL;
+        }
+
+        struct input_dedup_entry *const entry = entries + (bucket - 1);
+        if (entry_matches(entry, key)) {
+            return entry;
+        }
+
+        index = (index + 1) & mask;
+    } while (true);
+}
+
+static void
+insert_bucket(uint64_t *__notnull const buckets,
+              const uint64_t mask,
+              const struct result_cache_key *__notnull const key,
+              const uint64_t bucket)
+{
+    uint64_t index = key->hash[1] & mask;
+    while (buckets[index] != 0) {
+        index = (index + 1) & mask;
+    }
+
+    buckets[index] = bucket;
+}
+
+/*
+ * Keep the table at most half-full, so probes stay short. Each entry takes up
+ * at most two buckets.
+ */
+
+static enum input_dedup_result
+grow_buckets_if_needed(struct input_dedup *__notnull const dedup) {
+    const uint64_t entry_count = dedup->entries.item_count;
+    if ((entry_count + 1) * 4 <= dedup->bucket_count) {
+        return E_INPUT_DEDUP_OK;
+    }
+
+    uint64_t bucket_count = dedup->bucket_count * 2;
+    if (bucket_count == 0) {
+        bucket_count = 64;
+    }
+
+    uint64_t *const buckets = calloc(bucket_count, sizeof(uint64_t));
+    if (buckets == NULL) {
+        return E_INPUT_DEDUP_ALLOC_FAIL;
+    }
+
+    const struct input_dedup_entry *const entries = dedup->entries.data;
+    const uint64_t mask = bucket_count - 1;
+
+    for (uint64_t i = 0; i != entry_count; i++) {
+        const struct input_dedup_entry *const entry = entries + i;
+        insert_bucket(buckets, mask, &entry->key, i + 1);
+
+        if (entry->has_contents_key) {
+            insert_bucket(buckets, mask, &entry->contents_key, i + 1);
+        }
+    }
+
+    free(dedup->buckets);
+
+    dedup->buckets = buckets;
+    dedup->bucket_count = bucket_count;
+
+    return E_INPUT_DEDUP_OK;
+}
+
+static enum input_dedup_result
+add_entry(struct input_dedup *__notnull const dedup,
+          const struct result_cache_key *__notnull const key,
+          const struct result_cache_key *const contents_key,
+          const char *__notnull const write_path,
+          const uint64_t write_path_length)
+{
+    if (grow_buckets_if_needed(dedup) != E_INPUT_DEDUP_OK) {
+        return E_INPUT_DEDUP_ALLOC_FAIL;
+    }
+
+    char *const path = alloc_and_copy(write_path, write_path_length);
+    if (path == NULL) {
+        return E_INPUT_DEDUP_ALLOC_FAIL;
+    }
+
+    struct input_dedup_entry entry = {
+        .key = *key,
+        .write_path = path,
+        .write_path_length = write_path_length
+    };
+
+    if (contents_key != NULL) {
+        entry.contents_key = *contents_key;
+        entry.has_contents_key = true;
+    }
+
+    const enum array_result add_entry_result =
+        array_add_item(&dedup->entries, sizeof(entry), &entry, NULL);
+
+    if (add_entry_result != E_ARRAY_OK) {
+        free(path);
+        return E_INPUT_DEDUP_ALLOC_FAIL;
+    }
+
+    const uint64_t mask = dedup->bucket_count - 1;
+    const uint64_t bucket = dedup->entries.item_count;
+
+    insert_bucket(dedup->buckets, mask, key, bucket);
+    if (contents_key != NULL) {
+        insert_bucket(dedup->buckets, mask, contents_key, bucket);
+    }
+
+    return E_INPUT_DEDUP_OK;
+}
+
+static enum input_dedup_result
+add_copy(struct input_dedup *__notnull const dedup,
+         const struct tbd_for_main *__notnull const tbd,
+         const struct input_dedup_entry *__notnull const entry,
+         const char *__notnull const write_path,
+         const uint64_t write_path_length)
+{
+    char *const path = alloc_and_copy(write_path, write_path_length);
+    if (path == NULL) {
+        return E_INPUT_DEDUP_ALLOC_FAIL;
+    }
+
+    const struct input_dedup_entry *const entries = dedup->entries.data;
+    const struct input_dedup_copy copy = {
+        .tbd = tbd,
+        .entry_index = (uint64_t)(entry - entries),
+
+        .write_path = path,
+        .write_path_length = write_path_length
+    };
+
+    const enum array_result add_copy_result =
+        array_add_item(&dedup->copies, sizeof(copy), &copy, NULL);
+
+    if (add_copy_result != E_ARRAY_OK) {
+        free(path);
+        return E_INPUT_DEDUP_ALLOC_FAIL;
+    }
+
+    return E_INPUT_DEDUP_OK;
+}
+
+bool
+input_dedup_find_or_add(struct input_dedup *__notnull const dedup,
+                        const struct tbd_for_main *__notnull const tbd,
+                        const int fd,
+                        const char *__notnull const write_path,
+                        const uint64_t write_path_length)
+{
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) != 0) {
+        return false;
+    }
+
+    struct result_cache_key file_id_key = {};
+    result_cache_create_file_id_key(tbd,
+                                    (uint64_t)sbuf.st_dev,
+                                    (uint64_t)sbuf.st_ino,
+                                    &file_id_key);
+
+    const struct input_dedup_entry *entry = find_entry(dedup, &file_id_key);
+
+    struct result_cache_key contents_key = {};
+    bool has_contents_key = false;
+
+    if (entry == NULL && dedup->match_contents) {
+        const enum result_cache_result create_key_result =
+            result_cache_create_key(tbd, fd, &contents_key);
+
+        if (create_key_result == E_RESULT_CACHE_OK) {
+            entry = find_entry(dedup, &contents_key);
+            has_contents_key = true;
+        }
+    }
+
+    if (entry != NULL) {
+        /*
+         * A path provided more than once is written out only once.
+         */
+
+        if (entry->write_path_length == write_path_length &&
+            memcmp(entry->write_path, write_path, write_path_length) == 0)
+        {
+            return true;
+        }
+
+        const enum input_dedup_result add_copy_result =
+            add_copy(dedup, tbd, entry, write_path, write_path_length);
+
+        return (add_copy_result == E_INPUT_DEDUP_OK);
+    }
+
+    /*
+     * If the file can't be added, it simply won't be matched later on.
+     */
+
+    const struct result_cache_key *entry_contents_key = NULL;
+    if (has_contents_key) {
+        entry_contents_key = &contents_key;
+    }
+
+    add_entry(dedup,
+              &file_id_key,
+              entry_contents_key,
+              write_path,
+              write_path_length);
+
+    return false;
+}
+
+void
+input_dedup_mark_written(struct input_dedup *__notnull const dedup,
+                         const struct tbd_for_main *__notnull const tbd,
+                         const int fd)
+{
+    if (dedup->bucket_count == 0) {
+        return;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) != 0) {
+        return;
+    }
+
+    struct result_cache_key file_id_key = {};
+    result_cache_create_file_id_key(tbd,
+                                    (uint64_t)sbuf.st_dev,
+                                    (uint64_t)sbuf.st_ino,
+                                    &file_id_key);
+
+    struct input_dedup_entry *const entry = find_entry(dedup, &file_id_key);
+    if (entry != NULL) {
+        entry->is_written = true;
+    }
+}
+
+static void
+write_copy(const struct input_dedup *__notnull const dedup,
+           const struct input_dedup_copy *__notnull const copy)
+{
+    const struct input_dedup_entry *const entry =
+        (const struct input_dedup_entry *)dedup->entries.data +
+        copy->entry_index;
+
+    const struct tbd_for_main *const tbd = copy->tbd;
+    char *const write_path = copy->write_path;
+
+    /*
+     * If the first path failed to parse, a tbd at its write-path can only be
+     * left over from an earlier run, and must not be copied. The error itself
+     * was already printed for the first path.
+     */
+
+    if (!entry->is_written) {
+        fprintf(stderr,
+                "Not writing tbd (at path: %s), as the same file failed to be "
+                "written out through another path\n",
+                write_path);
+
+        return;
+    }
+
+    const int source_fd = our_open(entry->write_path, O_RDONLY, 0);
+    if (source_fd < 0) {
+        return;
+    }
+
+    FILE *file = NULL;
+    char *terminator = NULL;
+
+    const enum tbd_for_main_open_write_file_result open_file_result =
+        tbd_for_main_open_write_file_for_path(tbd,
+                                              write_path,
+                                              copy->write_path_length,
+                                              &file,
+                                              &terminator);
+
+    if (open_file_result != E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK) {
+        fprintf(stderr,
+                "Failed to open write-file (at path: %s), error: %s\n",
+                write_path,
+                strerror(errno));
+
+        close(source_fd);
+        return;
+    }
+
+    const enum result_cache_result write_result =
+        result_cache_write_entry(source_fd,
+                                 file,
+                                 tbd->options.write_if_changed);
+
+    if (write_result != E_RESULT_CACHE_OK) {
+        if (!tbd->options.ignore_warnings) {
+            fprintf(stderr,
+                    "Failed to write to write-file (at path %s)\n",
+                    write_path);
+        }
+
+        if (terminator != NULL) {
+            remove_file_r(write_path, copy->write_path_length, terminator);
+        }
+    }
+
+    fclose(file);
+    close(source_fd);
+}
+
+void input_dedup_write_copies(struct input_dedup *__notnull const dedup) {
+    struct input_dedup_copy *copy = dedup->copies.data;
+    const struct input_dedup_copy *const end = dedup->copies.data_end;
+
+    for (; copy != end; copy++) {
+        write_copy(dedup, copy);
+        free(copy->write_path);
+    }
+
+    array_clear(&dedup->copies);
+}
+
+void input_dedup_destroy(struct input_dedup *__notnull const dedup) {
+    struct input_dedup_entry *entry = dedup->entries.data;
+    const struct input_dedup_entry *const end = dedup->entries.data_end;
+
+    for (; entry != end; entry++) {
+        free(entry->write_path);
+    }
+
+    struct input_dedup_copy *copy = dedup->copies.data;
+    const struct input_dedup_copy *const copies_end = dedup->copies.data_end;
+
+    for (; copy != copies_end; copy++) {
+        free(copy->write_path);
+    }
+
+    free(dedup->buckets);
+
+    array_destroy(&dedup->entries);
+    array_destroy(&dedup->copies);
+
+    dedup->buckets = NULL;
+    dedup->bucket_count = 0;
+}
@@ -0,0 +1,124 @@
+//
+//  src/input_spool.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <sys/mman.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "input_spool.h"
+#include "our_io.h"
+
+/*
+ * Create an anonymous file to hold the spooled input. Where available, we use
+ * memfd_create() so the data never touches disk. Otherwise, we fall back to an
+ * unlinked temporary file.
+ */
+
+static int create_spool_fd(void) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    const int memfd = memfd_create("tbd-input", MFD_CLOEXEC);
+    if (memfd != -1) {
+        return memfd;
+    }
+#endif
+
+    const char *tmp_dir = getenv("TMPDIR");
+    if (tmp_dir == NULL || tmp_dir[0] == '\0') {
+        tmp_dir = "/tmp";
+    }
+
+    char path[4096];
+    const int length =
+        snprintf(path, sizeof(path), "%s/tbd-input-XXXXXX", tmp_dir);
+
+    if (length < 0 || (size_t)length >= sizeof(path)) {
+        return -1;
+    }
+
+    const int fd = mkstemp(path);
+    if (fd == -1) {
+        return -1;
+    }
+
+    unlink(path);
+    return fd;
+}
+
+static int write_all(const int fd, const uint8_t *buf, uint64_t size) {
+    while (size != 0) {
+        const ssize_t written = our_write(fd, buf, size);
+        if (written <= 0) {
+            return 1;
+        }
+
+        buf += written;
+        size -= (uint64_t)written;
+    }
+
+    return 0;
+}
+
+enum input_spool_result
+input_spool_create_from_fd(const int fd, int *__notnull const fd_out) {
+    const int spool_fd = create_spool_fd();
+    if (spool_fd == -1) {
+        return E_INPUT_SPOOL_CREATE_FAIL;
+    }
+
+    /*
+     * Use a large buffer to keep the number of read() and write() calls low,
+     * as dyld_shared_cache files are often gigabytes large.
+     */
+
+    const uint64_t buffer_size = 1ull << 20;
+    uint8_t *const buffer = malloc(buffer_size);
+
+    if (buffer == NULL) {
+        close(spool_fd);
+        return E_INPUT_SPOOL_CREATE_FAIL;
+    }
+
+    do {
+        const ssize_t count = our_read(fd, buffer, buffer_size);
+        if (count == 0) {
+            break;
+        }
+
+        if (count < 0) {
+            free(buffer);
+            close(spool_fd);
+
+            return E_INPUT_SPOOL_READ_FAIL;
+        }
+
+        if (write_all(spool_fd, buffer, (uint64_t)count)) {
+            free(buffer);
+            close(spool_fd);
+
+            return E_INPUT_SPOOL_WRITE_FAIL;
+        }
+    } while (true);
+
+    free(buffer);
+
+    if (our_lseek(spool_fd, 0, SEEK_SET) < 0) {
+        close(spool_fd);
+        return E_INPUT_SPOOL_SEEK_FAIL;
+    }
+
+    *fd_out = spool_fd;
+    return E_INPUT_SPOOL_OK;
+}
@@ -0,0 +1,113 @@
+//
+//  src/magic_prefilter.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mach-o/fat.h"
+#include "mach-o/loader.h"
+
+#include "magic_prefilter.h"
+#include "our_io.h"
+
+/*
+ * All dyld_shared_cache magics start with "dyld_v1", followed by the
+ * architecture, which is left for the parser to check.
+ */
+
+static const char dsc_magic_prefix[] = "dyld_v1";
+
+static enum magic_prefilter_result
+classify_header(const uint8_t *__notnull const buff, const ssize_t read_size) {
+    if (read_size < 0) {
+        return E_MAGIC_PREFILTER_READ_FAIL;
+    }
+
+    /*
+     * Reading an entire mach_header also tells us whether the file is large
+     * enough to be parsed at all.
+     */
+
+    if ((size_t)read_size < sizeof(struct mach_header)) {
+        return E_MAGIC_PREFILTER_NEITHER;
+    }
+
+    uint32_t magic = 0;
+    memcpy(&magic, buff, sizeof(magic));
+
+    switch (magic) {
+        case MH_MAGIC:
+        case MH_CIGAM:
+        case MH_MAGIC_64:
+        case MH_CIGAM_64:
+        case FAT_MAGIC:
+        case FAT_CIGAM:
+        case FAT_MAGIC_64:
+        case FAT_CIGAM_64:
+            return E_MAGIC_PREFILTER_MACHO;
+
+        default:
+            break;
+    }
+
+    const size_t prefix_length = sizeof(dsc_magic_prefix) - 1;
+    if (memcmp(buff, dsc_magic_prefix, prefix_length) == 0) {
+        return E_MAGIC_PREFILTER_DSC;
+    }
+
+    return E_MAGIC_PREFILTER_NEITHER;
+}
+
+enum magic_prefilter_result magic_prefilter_file(const int fd) {
+    uint8_t buff[sizeof(struct mach_header)];
+
+    const ssize_t read_size = our_pread(fd, buff, sizeof(buff), 0);
+    return classify_header(buff, read_size);
+}
+
+void
+magic_prefilter_files(struct our_io_batch *__notnull const batch,
+                      const int *__notnull const fds,
+                      enum magic_prefilter_result *__notnull const results,
+                      const uint64_t count)
+{
+    uint8_t buffs[MAGIC_PREFILTER_BATCH_COUNT][sizeof(struct mach_header)];
+    struct our_io_read reads[MAGIC_PREFILTER_BATCH_COUNT];
+
+    for (uint64_t index = 0; index < count;) {
+        uint64_t chunk_count = count - index;
+        if (chunk_count > MAGIC_PREFILTER_BATCH_COUNT) {
+            chunk_count = MAGIC_PREFILTER_BATCH_COUNT;
+        }
+
+        for (uint64_t i = 0; i != chunk_count; i++) {
+            const struct our_io_read read = {
+                .fd = fds[index + i],
+                .buf = buffs[i],
+                .size = sizeof(buffs[i])
+            };
+
+            reads[i] = read;
+        }
+
+        our_io_batch_read(batch, reads, chunk_count);
+        for (uint64_t i = 0; i != chunk_count; i++) {
+            const struct our_io_read *const read = reads + i;
+            const ssize_t result = read->result;
+
+            if (result < 0) {
+                errno = read->error;
+            }
+
+            results[index + i] = classify_header(buffs[i], result);
+        }
+
+        index += chunk_count;
+    }
+}
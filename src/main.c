@@ -18,21 +18,30 @@
 
 #include "copy.h"
 #include "dir_recurse.h"
+#include "input_dedup.h"
+#include "input_spool.h"
 #include "macho_file.h"
+#include "magic_prefilter.h"
+#include "manifest.h"
 #include "our_io.h"
 #include "path.h"
+#include "paths_file.h"
 
 #include "parse_or_list_fields.h"
 #include "parse_dsc_for_main.h"
 #include "parse_macho_for_main.h"
+#include "parse_pool.h"
 
 #include "request_user_input.h"
+#include "result_cache.h"
+#include "serve.h"
 #include "tbd.h"
 #include "tbd_for_main.h"
 #include "tbd_write.h"
 #include "unused.h"
 #include "usage.h"
 #include "util.h"
+#include "write_queue.h"
 
 struct recurse_callback_info {
     struct tbd_for_main *tbd;
@@ -41,35 +50,441 @@ struct recurse_callback_info {
     FILE *combine_file;
     uint64_t files_parsed;
 
+    /*
+     * When not NULL, files the manifest shows to be unchanged are skipped.
+     * files_unchanged may also be incremented by the threads reading
+     * directories.
+     */
+
+    struct manifest *manifest;
+    uint64_t files_unchanged;
+
+    struct write_queue *write_queue;
+
+    /*
+     * When not NULL, mach-o files are parsed on parse_pool's workers.
+     */
+
+    struct parse_pool *parse_pool;
+
+    /*
+     * When not NULL, files found are queued up until the reads of their
+     * magics can be submitted together.
+     */
+
+    struct recursed_file_queue *file_queue;
+
+    /*
+     * When not NULL, tbds of mach-o files are looked up in, and stored in,
+     * result_cache.
+     */
+
+    const struct result_cache *result_cache;
+
+    /*
+     * Files already found (through another path) are copied from the tbd of
+     * the first path, instead of being parsed again.
+     */
+
+    struct input_dedup *input_dedup;
+
     struct retained_user_info *retained;
     struct string_buffer *export_trie_sb;
 };
 
+/*
+ * The info given to the parse-pool's finish-callback, for files that weren't
+ * found while recursing.
+ */
+
+struct pooled_file_info {
+    struct retained_user_info *retained;
+    const struct result_cache *result_cache;
+    struct input_dedup *input_dedup;
+};
+
+struct recursed_file {
+    int fd;
+
+    char *dir_path;
+    uint64_t dir_path_length;
+
+    char *name;
+    uint64_t name_length;
+
+    /*
+     * Files found in the same directory share their dir_path, which is then
+     * only owned by the first of them.
+     */
+
+    bool owns_dir_path : 1;
+};
+
+struct recursed_file_queue {
+    struct our_io_batch io_batch;
+
+    struct recursed_file files[MAGIC_PREFILTER_BATCH_COUNT];
+    uint64_t count;
+};
+
+/*
+ * Record the tbd just created for the file in args in the manifest, so the
+ * file can be skipped next time if it doesn't change.
+ */
+
+static void
+record_in_manifest(struct recurse_callback_info *__notnull const recurse_info,
+                   const struct parse_macho_for_main_args *__notnull const args)
+{
+    struct stat sbuf = {};
+    if (fstat(args->fd, &sbuf) != 0) {
+        return;
+    }
+
+    /*
+     * If the digest can't be created, the file will simply be parsed again
+     * next time.
+     */
+
+    uint64_t digest = 0;
+    if (manifest_digest_file(args->fd, &digest) != E_MANIFEST_OK) {
+        return;
+    }
+
+    uint64_t output_path_length = 0;
+    char *const output_path =
+        tbd_for_main_create_write_path_for_recursing(recurse_info->tbd,
+                                                     args->dir_path,
+                                                     args->dir_path_length,
+                                                     args->name,
+                                                     args->name_length,
+                                                     "tbd",
+                                                     3,
+                                                     &output_path_length);
+
+    const enum manifest_result add_entry_result =
+        manifest_add_entry(recurse_info->manifest,
+                           &sbuf,
+                           digest,
+                           output_path,
+                           output_path_length);
+
+    if (add_entry_result != E_MANIFEST_OK) {
+        fputs("Failed to allocate memory for a manifest entry\n", stderr);
+    }
+
+    free(output_path);
+}
+
+/*
+ * Returns true if the file was handled as a mach-o file, or false if it should
+ * be parsed as another filetype.
+ */
+
 static bool
-recurse_directory_callback(const char *__notnull const dir_path,
-                           const uint64_t dir_path_length,
-                           const int fd,
-                           struct dirent *const dirent,
-                           const uint64_t name_length,
-                           void *__notnull const callback_info)
+handle_recursed_macho_result(
+    struct recurse_callback_info *__notnull const recurse_info,
+    const struct parse_macho_for_main_args *__notnull const args,
+    const enum parse_macho_for_main_result result)
 {
-    struct recurse_callback_info *const recurse_info =
-        (struct recurse_callback_info *)callback_info;
+    switch (result) {
+        case E_PARSE_MACHO_FOR_MAIN_OK: {
+            const struct tbd_for_main_options options =
+                recurse_info->tbd->options;
+
+            if (options.combine_tbds || options.write_archive) {
+                recurse_info->combine_file = args->combine_file;
+            }
+
+            if (recurse_info->manifest != NULL) {
+                record_in_manifest(recurse_info, args);
+            }
+
+            input_dedup_mark_written(recurse_info->input_dedup,
+                                     recurse_info->orig,
+                                     args->fd);
+
+            recurse_info->files_parsed += 1;
+            close(args->fd);
+
+            return true;
+        }
+
+        case E_PARSE_MACHO_FOR_MAIN_NOT_A_MACHO:
+            break;
+
+        case E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR:
+            close(args->fd);
+            return true;
+    }
+
+    return false;
+}
+
+static void
+parse_recursed_non_macho_file(
+    struct recurse_callback_info *__notnull const recurse_info,
+    const int fd,
+    struct magic_buffer *__notnull const magic_buffer,
+    const char *__notnull const dir_path,
+    const uint64_t dir_path_length,
+    const char *__notnull const name,
+    const uint64_t name_length)
+{
+    struct tbd_for_main *const tbd = recurse_info->tbd;
+
+    /*
+     * An archive is shared by all files the same way a combine-file is.
+     */
+
+    const bool should_combine =
+        tbd->options.combine_tbds || tbd->options.write_archive;
+
+    if (tbd->filetypes.dyld_shared_cache) {
+        struct parse_dsc_for_main_args args = {
+            .fd = fd,
+
+            .magic_buffer = magic_buffer,
+            .retained = recurse_info->retained,
+
+            .tbd = tbd,
+            .orig = recurse_info->orig,
+
+            .dsc_dir_path = dir_path,
+            .dsc_dir_path_length = dir_path_length,
+
+            .dsc_name = name,
+            .dsc_name_length = name_length,
+
+            .dont_handle_non_dsc_error = true,
+            .print_paths = true,
+
+            .export_trie_sb = recurse_info->export_trie_sb,
+            .write_queue = recurse_info->write_queue
+        };
+
+        if (should_combine) {
+            args.combine_file = recurse_info->combine_file;
+        }
+
+        const enum parse_dsc_for_main_result parse_as_dsc_result =
+            parse_dsc_for_main_while_recursing(&args);
+
+        switch (parse_as_dsc_result) {
+            case E_PARSE_DSC_FOR_MAIN_OK:
+                if (should_combine) {
+                    recurse_info->combine_file = args.combine_file;
+                }
+
+                recurse_info->files_parsed += 1;
+                close(fd);
+
+                return;
 
+            case E_PARSE_DSC_FOR_MAIN_NOT_A_SHARED_CACHE:
+                break;
+
+            case E_PARSE_DSC_FOR_MAIN_OTHER_ERROR:
+                close(fd);
+                return;
+
+            /*
+             * This error shouldn't be returned while recursing.
+             */
+
+            case E_PARSE_DSC_FOR_MAIN_CLOSE_COMBINE_FILE_FAIL:
+                break;
+        }
+    }
+
+    close(fd);
+}
+
+static inline bool path_exists(const char *__notnull const path) {
+    struct stat sbuf = {};
+    return (stat(path, &sbuf) == 0);
+}
+
+/*
+ * Returns whether the file at fd, whose modification-time no longer matches
+ * the manifest, still has the same contents, in which case its tbd doesn't
+ * have to be created again.
+ */
+
+static bool
+has_unchanged_contents(
+    struct recurse_callback_info *__notnull const recurse_info,
+    const int fd,
+    const char *__notnull const dir_path,
+    const uint64_t dir_path_length,
+    const char *__notnull const name,
+    const uint64_t name_length)
+{
+    struct manifest *const manifest = recurse_info->manifest;
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) != 0) {
+        return false;
+    }
+
+    if (!manifest_has_inode(manifest, (uint64_t)sbuf.st_ino)) {
+        return false;
+    }
+
+    uint64_t output_path_length = 0;
+    char *const output_path =
+        tbd_for_main_create_write_path_for_recursing(recurse_info->tbd,
+                                                     dir_path,
+                                                     dir_path_length,
+                                                     name,
+                                                     name_length,
+                                                     "tbd",
+                                                     3,
+                                                     &output_path_length);
+
+    const struct manifest_entry *const entry =
+        manifest_find(manifest, &sbuf, output_path, output_path_length);
+
+    bool is_unchanged = false;
+    uint64_t digest = 0;
+
+    if (entry != NULL &&
+        entry->size == (uint64_t)sbuf.st_size &&
+        path_exists(output_path) &&
+        manifest_digest_file(fd, &digest) == E_MANIFEST_OK &&
+        entry->digest == digest)
+    {
+        /*
+         * Record the new modification-time, so the file can be skipped
+         * without being opened next time.
+         */
+
+        manifest_add_entry(manifest,
+                           &sbuf,
+                           digest,
+                           output_path,
+                           output_path_length);
+
+        is_unchanged = true;
+    }
+
+    free(output_path);
+    return is_unchanged;
+}
+
+/*
+ * Returns whether the mach-o file at fd was already found through another
+ * path, in which case its tbd will be copied from the one created for the
+ * other path.
+ */
+
+static bool
+is_duplicate_recursed_file(
+    struct recurse_callback_info *__notnull const recurse_info,
+    const int fd,
+    const char *__notnull const dir_path,
+    const uint64_t dir_path_length,
+    const char *__notnull const name,
+    const uint64_t name_length)
+{
+    const struct tbd_for_main *const orig = recurse_info->orig;
+    if (!input_dedup_can_dedup(orig)) {
+        return false;
+    }
+
+    uint64_t write_path_length = 0;
+    char *const write_path =
+        tbd_for_main_create_write_path_for_recursing(recurse_info->tbd,
+                                                     dir_path,
+                                                     dir_path_length,
+                                                     name,
+                                                     name_length,
+                                                     "tbd",
+                                                     3,
+                                                     &write_path_length);
+
+    const bool is_duplicate =
+        input_dedup_find_or_add(recurse_info->input_dedup,
+                                orig,
+                                fd,
+                                write_path,
+                                write_path_length);
+
+    free(write_path);
+    return is_duplicate;
+}
+
+static void
+handle_recursed_file(struct recurse_callback_info *__notnull const recurse_info,
+                     const int fd,
+                     const char *__notnull const dir_path,
+                     const uint64_t dir_path_length,
+                     const char *__notnull const name,
+                     const uint64_t name_length,
+                     const enum magic_prefilter_result prefilter_result)
+{
     struct tbd_for_main *const orig = recurse_info->orig;
     struct tbd_for_main *const tbd = recurse_info->tbd;
 
-    struct retained_user_info *const retained = recurse_info->retained;
-    struct magic_buffer magic_buffer = {};
+    /*
+     * Most files found while recursing are neither mach-o files nor
+     * dyld_shared_cache files, so reject them before setting up either parser.
+     *
+     * If the file couldn't be read, we leave reporting the error to the
+     * parsers.
+     */
 
-    const char *const name = dirent->d_name;
-    const bool should_combine = tbd->options.combine_tbds;
+    if (prefilter_result == E_MAGIC_PREFILTER_NEITHER) {
+        close(fd);
+        return;
+    }
+
+    if (recurse_info->manifest != NULL &&
+        prefilter_result == E_MAGIC_PREFILTER_MACHO)
+    {
+        const bool is_unchanged =
+            has_unchanged_contents(recurse_info,
+                                   fd,
+                                   dir_path,
+                                   dir_path_length,
+                                   name,
+                                   name_length);
+
+        if (is_unchanged) {
+            __atomic_add_fetch(&recurse_info->files_unchanged,
+                               1,
+                               __ATOMIC_RELAXED);
+
+            close(fd);
+
+            return;
+        }
+    }
+
+    if (tbd->filetypes.macho && prefilter_result == E_MAGIC_PREFILTER_MACHO) {
+        const bool is_duplicate =
+            is_duplicate_recursed_file(recurse_info,
+                                       fd,
+                                       dir_path,
+                                       dir_path_length,
+                                       name,
+                                       name_length);
+
+        if (is_duplicate) {
+            recurse_info->files_parsed += 1;
+            close(fd);
+
+            return;
+        }
+    }
 
-    if (tbd->filetypes.macho) {
+    struct magic_buffer magic_buffer = {};
+
+    if (tbd->filetypes.macho && prefilter_result != E_MAGIC_PREFILTER_DSC) {
         struct parse_macho_for_main_args args = {
             .fd = fd,
             .magic_buffer = &magic_buffer,
-            .retained = retained,
+            .retained = recurse_info->retained,
 
             .tbd = tbd,
             .orig = orig,
@@ -83,137 +498,835 @@ recurse_directory_callback(const char *__notnull const dir_path,
             .dont_handle_non_macho_error = true,
             .print_paths = true,
 
-            .export_trie_sb = recurse_info->export_trie_sb
+            .export_trie_sb = recurse_info->export_trie_sb,
+            .write_queue = recurse_info->write_queue,
+            .result_cache = recurse_info->result_cache
         };
 
-        if (should_combine) {
+        if (tbd->options.combine_tbds || tbd->options.write_archive) {
             args.combine_file = recurse_info->combine_file;
         }
 
-        const enum parse_macho_for_main_result parse_as_macho_result =
+        /*
+         * A file whose tbd is in the result-cache doesn't have to be parsed at
+         * all.
+         */
+
+        enum parse_macho_for_main_result parse_as_macho_result =
+            E_PARSE_MACHO_FOR_MAIN_OK;
+
+        const bool wrote_cached =
+            write_cached_macho_file_for_main_while_recursing(
+                &args,
+                &parse_as_macho_result);
+
+        if (wrote_cached) {
+            handle_recursed_macho_result(recurse_info,
+                                         &args,
+                                         parse_as_macho_result);
+
+            return;
+        }
+
+        /*
+         * If the file can't be handed to the parse-pool, simply parse it on
+         * this thread.
+         */
+
+        struct parse_pool *const parse_pool = recurse_info->parse_pool;
+        if (parse_pool != NULL) {
+            const struct result_cache_key *cache_key = NULL;
+            if (args.has_cache_key) {
+                cache_key = &args.cache_key;
+            }
+
+            const enum parse_pool_result add_file_result =
+                parse_pool_add_file(parse_pool,
+                                    orig,
+                                    fd,
+                                    dir_path,
+                                    dir_path_length,
+                                    name,
+                                    name_length,
+                                    true,
+                                    cache_key,
+                                    recurse_info);
+
+            if (add_file_result == E_PARSE_POOL_OK) {
+                return;
+            }
+
+            parse_pool_drain(parse_pool);
+        }
+
+        parse_as_macho_result =
             parse_macho_file_for_main_while_recursing(&args);
 
-        switch (parse_as_macho_result) {
-            case E_PARSE_MACHO_FOR_MAIN_OK: {
-                if (should_combine) {
-                    recurse_info->combine_file = args.combine_file;
-                }
+        if (handle_recursed_macho_result(recurse_info,
+                                         &args,
+                                         parse_as_macho_result))
+        {
+            return;
+        }
+    }
+
+    if (prefilter_result == E_MAGIC_PREFILTER_MACHO) {
+        close(fd);
+        return;
+    }
+
+    parse_recursed_non_macho_file(recurse_info,
+                                  fd,
+                                  &magic_buffer,
+                                  dir_path,
+                                  dir_path_length,
+                                  name,
+                                  name_length);
+}
+
+/*
+ * Classify all queued files with a single batch of reads, then handle them in
+ * the order they were found.
+ */
+
+static void
+handle_queued_files(struct recurse_callback_info *__notnull const recurse_info)
+{
+    struct recursed_file_queue *const queue = recurse_info->file_queue;
+    if (queue == NULL || queue->count == 0) {
+        return;
+    }
+
+    const uint64_t count = queue->count;
+
+    int fds[MAGIC_PREFILTER_BATCH_COUNT];
+    enum magic_prefilter_result results[MAGIC_PREFILTER_BATCH_COUNT];
+
+    for (uint64_t i = 0; i != count; i++) {
+        fds[i] = queue->files[i].fd;
+    }
+
+    magic_prefilter_files(&queue->io_batch, fds, results, count);
+
+    for (uint64_t i = 0; i != count; i++) {
+        const struct recursed_file *const file = queue->files + i;
+        handle_recursed_file(recurse_info,
+                             file->fd,
+                             file->dir_path,
+                             file->dir_path_length,
+                             file->name,
+                             file->name_length,
+                             results[i]);
+    }
+
+    for (uint64_t i = 0; i != count; i++) {
+        struct recursed_file *const file = queue->files + i;
+        if (file->owns_dir_path) {
+            free(file->dir_path);
+        }
+
+        free(file->name);
+    }
+
+    queue->count = 0;
+}
+
+static bool
+queue_file(struct recursed_file_queue *__notnull const queue,
+           const int fd,
+           const char *__notnull const dir_path,
+           const uint64_t dir_path_length,
+           const char *__notnull const name,
+           const uint64_t name_length)
+{
+    struct recursed_file file = {
+        .fd = fd,
+        .dir_path_length = dir_path_length,
+        .name_length = name_length
+    };
+
+    if (queue->count != 0) {
+        const struct recursed_file *const last =
+            queue->files + (queue->count - 1);
+
+        if (last->dir_path_length == dir_path_length &&
+            memcmp(last->dir_path, dir_path, dir_path_length) == 0)
+        {
+            file.dir_path = last->dir_path;
+        }
+    }
+
+    if (file.dir_path == NULL) {
+        file.dir_path = alloc_and_copy(dir_path, dir_path_length);
+        if (file.dir_path == NULL) {
+            return false;
+        }
+
+        file.owns_dir_path = true;
+    }
+
+    file.name = alloc_and_copy(name, name_length);
+    if (file.name == NULL) {
+        if (file.owns_dir_path) {
+            free(file.dir_path);
+        }
+
+        return false;
+    }
+
+    queue->files[queue->count] = file;
+    queue->count += 1;
+
+    return true;
+}
+
+/*
+ * Returns whether the manifest shows the file with sbuf to be unchanged, with
+ * its tbd still existing, in which case the file doesn't have to be opened.
+ *
+ * As this is called from the threads reading directories, only the entries
+ * loaded into the manifest, and the write-path options of orig, are used.
+ */
+
+static bool
+is_unchanged_in_manifest(
+    struct recurse_callback_info *__notnull const recurse_info,
+    const struct stat *__notnull const sbuf,
+    const char *__notnull const dir_path,
+    const uint64_t dir_path_length,
+    const char *__notnull const name,
+    const uint64_t name_length)
+{
+    uint64_t output_path_length = 0;
+    char *const output_path =
+        tbd_for_main_create_write_path_for_recursing(recurse_info->orig,
+                                                     dir_path,
+                                                     dir_path_length,
+                                                     name,
+                                                     name_length,
+                                                     "tbd",
+                                                     3,
+                                                     &output_path_length);
+
+    struct manifest_entry *const entry =
+        manifest_find(recurse_info->manifest,
+                      sbuf,
+                      output_path,
+                      output_path_length);
+
+    bool is_unchanged = false;
+    if (entry != NULL &&
+        manifest_entry_matches(entry, sbuf) &&
+        path_exists(output_path))
+    {
+        manifest_entry_mark_unchanged(entry);
+        __atomic_add_fetch(&recurse_info->files_unchanged,
+                           1,
+                           __ATOMIC_RELAXED);
+
+        is_unchanged = true;
+    }
+
+    free(output_path);
+    return is_unchanged;
+}
+
+/*
+ * Skip files the manifest shows to be unchanged, and whose tbds still exist,
+ * without opening them.
+ */
+
+static bool
+recurse_directory_filter_callback(const int dir_fd,
+                                  const char *__notnull const dir_path,
+                                  const uint64_t dir_path_length,
+                                  const struct dirent *__notnull const dirent,
+                                  const uint64_t name_length,
+                                  void *__notnull const callback_info)
+{
+    struct recurse_callback_info *const recurse_info =
+        (struct recurse_callback_info *)callback_info;
+
+    /*
+     * Most files won't be in the manifest at all, which we can tell from the
+     * directory-entry alone.
+     */
+
+    struct manifest *const manifest = recurse_info->manifest;
+    if (!manifest_has_inode(manifest, (uint64_t)dirent->d_ino)) {
+        return true;
+    }
+
+    const char *const name = dirent->d_name;
+
+    struct stat sbuf = {};
+    if (fstatat(dir_fd, name, &sbuf, 0) != 0) {
+        return true;
+    }
+
+    const bool is_unchanged =
+        is_unchanged_in_manifest(recurse_info,
+                                 &sbuf,
+                                 dir_path,
+                                 dir_path_length,
+                                 name,
+                                 name_length);
+
+    return !is_unchanged;
+}
+
+/*
+ * Queue up the file found at fd, or handle it right away if it can't be
+ * queued, after all files queued before it.
+ */
+
+static void
+queue_or_handle_file(struct recurse_callback_info *__notnull const recurse_info,
+                     const int fd,
+                     const char *__notnull const dir_path,
+                     const uint64_t dir_path_length,
+                     const char *__notnull const name,
+                     const uint64_t name_length)
+{
+    struct recursed_file_queue *const queue = recurse_info->file_queue;
+
+    if (queue != NULL) {
+        const bool queued =
+            queue_file(queue,
+                       fd,
+                       dir_path,
+                       dir_path_length,
+                       name,
+                       name_length);
+
+        if (queued) {
+            if (queue->count == MAGIC_PREFILTER_BATCH_COUNT) {
+                handle_queued_files(recurse_info);
+            }
+
+            return;
+        }
+
+        handle_queued_files(recurse_info);
+    }
+
+    handle_recursed_file(recurse_info,
+                         fd,
+                         dir_path,
+                         dir_path_length,
+                         name,
+                         name_length,
+                         magic_prefilter_file(fd));
+}
+
+static bool
+recurse_directory_callback(const char *__notnull const dir_path,
+                           const uint64_t dir_path_length,
+                           const int fd,
+                           struct dirent *const dirent,
+                           const uint64_t name_length,
+                           void *__notnull const callback_info)
+{
+    struct recurse_callback_info *const recurse_info =
+        (struct recurse_callback_info *)callback_info;
+
+    queue_or_handle_file(recurse_info,
+                         fd,
+                         dir_path,
+                         dir_path_length,
+                         dirent->d_name,
+                         name_length);
+
+    return true;
+}
+
+static bool
+recurse_directory_fail_callback(const char *const dir_path,
+                                __unused const uint64_t dir_path_length,
+                                enum dir_recurse_fail_result result,
+                                struct dirent *const dirent,
+                                void *__notnull const callback_info)
+{
+    /*
+     * Handle all files found before the failure first, so errors are printed
+     * in the order they happened.
+     */
+
+    const int error = errno;
+
+    handle_queued_files((struct recurse_callback_info *)callback_info);
+    errno = error;
+
+    switch (result) {
+        case E_DIR_RECURSE_FAILED_TO_ALLOC_PATH:
+            fputs("Failed to allocate memory for a path-string\n", stderr);
+            break;
+
+        case E_DIR_RECURSE_FAILED_TO_OPEN_FILE:
+            fprintf(stderr,
+                    "Failed to open file (at path %s/%s), error: %s\n",
+                    dir_path,
+                    dirent->d_name,
+                    strerror(errno));
+
+            break;
+
+        case E_DIR_RECURSE_FAILED_TO_OPEN_SUBDIR:
+            fprintf(stderr,
+                    "Failed to open sub-directory at path: %s, error: %s\n",
+                    dir_path,
+                    strerror(errno));
+
+            break;
+
+        case E_DIR_RECURSE_FAILED_TO_READ_ENTRY:
+            fprintf(stderr,
+                    "Failed to read directory-entry while recursing directory "
+                    "at path: %s, error: %s\n",
+                    dir_path,
+                    strerror(errno));
+
+            break;
+    }
+
+    return true;
+}
+
+/*
+ * Handle a path listed in the file provided with --paths-from, just like a file
+ * found while recursing.
+ */
+
+static void
+handle_listed_path(struct recurse_callback_info *__notnull const recurse_info,
+                   char *__notnull const path,
+                   const uint64_t path_length)
+{
+    uint64_t full_path_length = path_length;
+    char *const full_path =
+        path_get_absolute_path(path, path_length, &full_path_length);
+
+    if (full_path == NULL) {
+        handle_queued_files(recurse_info);
+        fputs("Failed to allocate memory\n", stderr);
+
+        return;
+    }
+
+    const int fd = our_open(full_path, O_RDONLY, 0);
+    if (fd < 0) {
+        const int error = errno;
+        handle_queued_files(recurse_info);
+
+        fprintf(stderr,
+                "Failed to open file (at path %s), error: %s\n",
+                full_path,
+                strerror(error));
+
+        if (full_path != path) {
+            free(full_path);
+        }
+
+        return;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) != 0 || !S_ISREG(sbuf.st_mode)) {
+        handle_queued_files(recurse_info);
+        fprintf(stderr, "Unsupported object at path: %s\n", full_path);
+
+        if (full_path != path) {
+            free(full_path);
+        }
+
+        close(fd);
+        return;
+    }
+
+    /*
+     * full_path is absolute, so always has a slash before the file's name. A
+     * file at the root keeps the root as its folder.
+     */
+
+    char *slash = full_path + full_path_length - 1;
+    while (*slash != '/') {
+        slash--;
+    }
+
+    const char *dir_path = full_path;
+    uint64_t dir_path_length = (uint64_t)(slash - full_path);
+
+    if (dir_path_length == 0) {
+        dir_path = "/";
+        dir_path_length = 1;
+    } else {
+        *slash = '\0';
+    }
+
+    const char *const name = slash + 1;
+    const uint64_t name_length = full_path_length - dir_path_length - 1;
+
+    struct manifest *const manifest = recurse_info->manifest;
+    if (manifest != NULL &&
+        manifest_has_inode(manifest, (uint64_t)sbuf.st_ino))
+    {
+        const bool is_unchanged =
+            is_unchanged_in_manifest(recurse_info,
+                                     &sbuf,
+                                     dir_path,
+                                     dir_path_length,
+                                     name,
+                                     name_length);
+
+        if (is_unchanged) {
+            if (full_path != path) {
+                free(full_path);
+            }
+
+            close(fd);
+            return;
+        }
+    }
+
+    queue_or_handle_file(recurse_info,
+                         fd,
+                         dir_path,
+                         dir_path_length,
+                         name,
+                         name_length);
+
+    if (full_path != path) {
+        free(full_path);
+    }
+}
+
+/*
+ * Read the list of paths at list_path (or from stdin if list_path is NULL) one
+ * path at a time, so even a list of many thousands of files is handled by a
+ * single process, sharing all state across the files.
+ */
+
+static void
+parse_paths_from_file(
+    struct recurse_callback_info *__notnull const recurse_info,
+    const char *const list_path)
+{
+    const char *const list_name = (list_path != NULL) ? list_path : "stdin";
+
+    struct paths_file paths_file = {};
+    const enum paths_file_result open_result =
+        paths_file_open(&paths_file, list_path);
+
+    switch (open_result) {
+        case E_PATHS_FILE_OK:
+            break;
+
+        case E_PATHS_FILE_ALLOC_FAIL:
+            fputs("Failed to allocate memory\n", stderr);
+            return;
+
+        case E_PATHS_FILE_OPEN_FAIL:
+        case E_PATHS_FILE_READ_FAIL:
+        case E_PATHS_FILE_NO_MORE_PATHS:
+            fprintf(stderr,
+                    "Failed to open list of paths (at path %s), error: %s\n",
+                    list_name,
+                    strerror(errno));
+
+            return;
+    }
+
+    do {
+        char *path = NULL;
+        uint64_t path_length = 0;
+
+        const enum paths_file_result next_result =
+            paths_file_next(&paths_file, &path, &path_length);
+
+        if (next_result == E_PATHS_FILE_NO_MORE_PATHS) {
+            break;
+        }
+
+        if (next_result != E_PATHS_FILE_OK) {
+            const int error = errno;
+            handle_queued_files(recurse_info);
+
+            if (next_result == E_PATHS_FILE_ALLOC_FAIL) {
+                fputs("Failed to allocate memory\n", stderr);
+            } else {
+                fprintf(stderr,
+                        "Failed to read list of paths (at path %s), error: "
+                        "%s\n",
+                        list_name,
+                        strerror(error));
+            }
+
+            break;
+        }
+
+        handle_listed_path(recurse_info, path, path_length);
+    } while (true);
+
+    paths_file_close(&paths_file);
+}
+
+/*
+ * Our parsers need to seek through (and in the case of dyld_shared_cache
+ * files, map) their input, which isn't possible for stdin or pipes.
+ *
+ * For such inputs, we spool the input into an anonymous file, and replace
+ * fd_in with the anonymous file's descriptor.
+ */
+
+static int
+spool_input_if_needed(int *__notnull const fd_in,
+                      const char *__notnull const path,
+                      const bool print_paths)
+{
+    const int fd = *fd_in;
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) == 0) {
+        if (S_ISREG(sbuf.st_mode)) {
+            return 0;
+        }
+    }
+
+    int spool_fd = -1;
+    const enum input_spool_result spool_result =
+        input_spool_create_from_fd(fd, &spool_fd);
+
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+
+    switch (spool_result) {
+        case E_INPUT_SPOOL_OK:
+            *fd_in = spool_fd;
+            return 0;
+
+        case E_INPUT_SPOOL_CREATE_FAIL:
+            fputs("Failed to create an anonymous file to store input\n",
+                  stderr);
+
+            break;
+
+        case E_INPUT_SPOOL_READ_FAIL:
+            if (print_paths) {
+                fprintf(stderr,
+                        "Failed to read input (from %s), error: %s\n",
+                        path,
+                        strerror(errno));
+            } else {
+                fprintf(stderr,
+                        "Failed to read the provided input, error: %s\n",
+                        strerror(errno));
+            }
+
+            break;
+
+        case E_INPUT_SPOOL_WRITE_FAIL:
+        case E_INPUT_SPOOL_SEEK_FAIL:
+            fprintf(stderr,
+                    "Failed to store input in an anonymous file, error: %s\n",
+                    strerror(errno));
+
+            break;
+    }
+
+    return 1;
+}
+
+/*
+ * Parse a single file that isn't a mach-o file as the other filetypes of tbd,
+ * using copy to hold the parsed info.
+ */
+
+static void
+parse_non_macho_file(struct tbd_for_main *__notnull const tbd,
+                     struct tbd_for_main *__notnull const copy,
+                     const int fd,
+                     struct magic_buffer *__notnull const magic_buffer,
+                     const char *__notnull const parse_path,
+                     const uint64_t parse_path_length,
+                     const bool print_paths,
+                     struct retained_user_info *__notnull const retained,
+                     struct string_buffer *__notnull const export_trie_sb)
+{
+    if (tbd->filetypes.dyld_shared_cache) {
+        struct parse_dsc_for_main_args args = {
+            .fd = fd,
+            .magic_buffer = magic_buffer,
+            .retained = retained,
+
+            .tbd = copy,
+            .orig = tbd,
+
+            .dsc_dir_path = parse_path,
+            .dsc_dir_path_length = parse_path_length,
+
+            .dont_handle_non_dsc_error = false,
+            .print_paths = print_paths,
+
+            .export_trie_sb = export_trie_sb,
+            .options.verify_write_path = true
+        };
+
+        const enum parse_dsc_for_main_result parse_result =
+            parse_dsc_for_main(args);
+
+        if (parse_result != E_PARSE_DSC_FOR_MAIN_NOT_A_SHARED_CACHE) {
+            return;
+        }
+    }
+
+    if (!tbd->filetypes.user_provided) {
+        if (print_paths) {
+            fputs("File (at path %s) is not among any of the provided "
+                  "filetypes\n",
+                  stderr);
+        } else {
+            fputs("File at the provided path is not among any of the "
+                  "provided filetypes\n",
+                  stderr);
+        }
+    } else {
+        if (print_paths) {
+            fputs("File (at path %s) is not among any of the supported "
+                  "filetypes\n",
+                  stderr);
+        } else {
+            fputs("File at the provided path is not among any of the "
+                  "supported filetypes\n",
+                  stderr);
+        }
+    }
 
-                recurse_info->files_parsed += 1;
-                close(fd);
+    tbd_for_main_destroy(tbd);
+}
 
-                return true;
-            }
+/*
+ * Write out a file parsed by the parse-pool, as the loop in main() and
+ * recurse_directory_callback() do after parsing.
+ */
 
-            case E_PARSE_MACHO_FOR_MAIN_NOT_A_MACHO:
-                break;
+static void
+finish_pooled_file(struct parse_pool_file *__notnull const file,
+                   void *__notnull const info)
+{
+    struct tbd_for_main *const orig = file->orig;
 
-            case E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR:
-                close(fd);
-                return true;
-        }
-    }
+    /*
+     * Only files from recursing directories have a recurse_callback_info.
+     */
 
-    if (tbd->filetypes.dyld_shared_cache) {
-        struct parse_dsc_for_main_args args = {
-            .fd = fd,
+    if (file->info != NULL) {
+        struct recurse_callback_info *const recurse_info =
+            (struct recurse_callback_info *)file->info;
 
-            .magic_buffer = &magic_buffer,
-            .retained = retained,
+        struct parse_macho_for_main_args args = {
+            .fd = file->fd,
+            .magic_buffer = file->magic_buffer,
+            .retained = recurse_info->retained,
 
-            .tbd = tbd,
+            .tbd = file->tbd,
             .orig = orig,
 
-            .dsc_dir_path = dir_path,
-            .dsc_dir_path_length = dir_path_length,
+            .dir_path = file->dir_path,
+            .dir_path_length = file->dir_path_length,
 
-            .dsc_name = name,
-            .dsc_name_length = name_length,
+            .name = file->name,
+            .name_length = file->name_length,
 
-            .dont_handle_non_dsc_error = true,
+            .dont_handle_non_macho_error = true,
             .print_paths = true,
 
-            .export_trie_sb = recurse_info->export_trie_sb
+            .export_trie_sb = file->export_trie_sb,
+            .write_queue = recurse_info->write_queue,
+
+            .result_cache = recurse_info->result_cache,
+            .cache_key = file->cache_key,
+            .has_cache_key = file->has_cache_key
         };
 
-        if (should_combine) {
+        if (orig->options.combine_tbds || orig->options.write_archive) {
             args.combine_file = recurse_info->combine_file;
         }
 
-        const enum parse_dsc_for_main_result parse_as_dsc_result =
-            parse_dsc_for_main_while_recursing(&args);
-
-        switch (parse_as_dsc_result) {
-            case E_PARSE_DSC_FOR_MAIN_OK:
-                if (should_combine) {
-                    recurse_info->combine_file = args.combine_file;
-                }
-
-                recurse_info->files_parsed += 1;
-                close(fd);
-
-                return true;
+        const enum parse_macho_for_main_result parse_as_macho_result =
+            write_parsed_macho_file_for_main_while_recursing(
+                &args,
+                file->open_result,
+                file->parse_result);
+
+        if (handle_recursed_macho_result(recurse_info,
+                                         &args,
+                                         parse_as_macho_result))
+        {
+            return;
+        }
 
-            case E_PARSE_DSC_FOR_MAIN_NOT_A_SHARED_CACHE:
-                break;
+        parse_recursed_non_macho_file(recurse_info,
+                                      file->fd,
+                                      file->magic_buffer,
+                                      file->dir_path,
+                                      file->dir_path_length,
+                                      file->name,
+                                      file->name_length);
 
-            case E_PARSE_DSC_FOR_MAIN_OTHER_ERROR:
-                close(fd);
-                return true;
+        return;
+    }
 
-            /*
-             * This error shouldn't be returned while recursing.
-             */
+    const struct pooled_file_info *const pooled_info =
+        (const struct pooled_file_info *)info;
 
-            case E_PARSE_DSC_FOR_MAIN_CLOSE_COMBINE_FILE_FAIL:
-                break;
-        }
-    }
+    struct retained_user_info *const retained = pooled_info->retained;
+    struct parse_macho_for_main_args args = {
+        .fd = file->fd,
+        .magic_buffer = file->magic_buffer,
+        .retained = retained,
 
-    close(fd);
-    return true;
-}
+        .tbd = file->tbd,
+        .orig = orig,
 
-static bool
-recurse_directory_fail_callback(const char *const dir_path,
-                                __unused const uint64_t dir_path_length,
-                                enum dir_recurse_fail_result result,
-                                struct dirent *const dirent,
-                                void *__unused const callback_info)
-{
-    switch (result) {
-        case E_DIR_RECURSE_FAILED_TO_ALLOC_PATH:
-            fputs("Failed to allocate memory for a path-string\n", stderr);
-            break;
+        .dir_path = file->dir_path,
+        .dir_path_length = file->dir_path_length,
 
-        case E_DIR_RECURSE_FAILED_TO_OPEN_FILE:
-            fprintf(stderr,
-                    "Failed to open file (at path %s/%s), error: %s\n",
-                    dir_path,
-                    dirent->d_name,
-                    strerror(errno));
+        .dont_handle_non_macho_error = orig->filetypes.dyld_shared_cache,
+        .print_paths = file->print_paths,
 
-            break;
+        .export_trie_sb = file->export_trie_sb,
+        .options.verify_write_path = true,
 
-        case E_DIR_RECURSE_FAILED_TO_OPEN_SUBDIR:
-            fprintf(stderr,
-                    "Failed to open sub-directory at path: %s, error: %s\n",
-                    dir_path,
-                    strerror(errno));
+        .result_cache = pooled_info->result_cache,
+        .cache_key = file->cache_key,
+        .has_cache_key = file->has_cache_key
+    };
 
-            break;
+    const enum parse_macho_for_main_result parse_result =
+        write_parsed_macho_file_for_main(args,
+                                         file->open_result,
+                                         file->parse_result);
 
-        case E_DIR_RECURSE_FAILED_TO_READ_ENTRY:
-            fprintf(stderr,
-                    "Failed to read directory-entry while recursing directory "
-                    "at path: %s, error: %s\n",
-                    dir_path,
-                    strerror(errno));
+    if (parse_result != E_PARSE_MACHO_FOR_MAIN_NOT_A_MACHO) {
+        if (parse_result == E_PARSE_MACHO_FOR_MAIN_OK) {
+            input_dedup_mark_written(pooled_info->input_dedup, orig, file->fd);
+        }
 
-            break;
+        close(file->fd);
+        return;
     }
 
-    return true;
+    struct tbd_for_main copy = *orig;
+    parse_non_macho_file(orig,
+                         &copy,
+                         file->fd,
+                         file->magic_buffer,
+                         file->dir_path,
+                         file->dir_path_length,
+                         file->print_paths,
+                         retained,
+                         file->export_trie_sb);
 }
 
 static void destroy_tbds_array(struct array *const tbds) {
@@ -383,6 +1496,7 @@ verify_tbd_for_main(struct tbd_for_main *__notnull const tbd,
             break;
 
         case TBD_VERSION_V4:
+        case TBD_VERSION_V5:
             result = check_objc_constraint(tbd, version, result);
             break;
     }
@@ -512,7 +1626,18 @@ verify_tbd_for_main(struct tbd_for_main *__notnull const tbd,
                 result = 1;
             }
         } else if (S_ISDIR(info.st_mode)) {
-            if (!tbd->options.recurse_directories) {
+            if (tbd->options.paths_from_file) {
+                fprintf(stderr,
+                        "Cannot read a list of paths from directory at path: "
+                        "%s\n",
+                        path);
+
+                if (full_path != path) {
+                    free(full_path);
+                }
+
+                result = 1;
+            } else if (!tbd->options.recurse_directories) {
                 fputs("Please provide option '-r' if you want to recurse the "
                       "provided directory\n",
                       stderr);
@@ -521,6 +1646,20 @@ verify_tbd_for_main(struct tbd_for_main *__notnull const tbd,
                     free(full_path);
                 }
 
+                result = 1;
+            }
+        } else if (S_ISFIFO(info.st_mode) || S_ISCHR(info.st_mode)) {
+            /*
+             * Pipes (and devices like /dev/stdin) are spooled into an
+             * anonymous file before parsing.
+             */
+
+            if (tbd->options.recurse_directories) {
+                fprintf(stderr, "Cannot recurse file at path: %s\n", path);
+                if (full_path != path) {
+                    free(full_path);
+                }
+
                 result = 1;
             }
         } else {
@@ -570,6 +1709,37 @@ verify_tbd_for_main(struct tbd_for_main *__notnull const tbd,
         }
     }
 
+    if (tbd->dsc_merge_paths.item_count != 0) {
+        if (!tbd->filetypes.dyld_shared_cache) {
+            fprintf(stderr,
+                    "--merge-dsc has been provided for path (%s) that will "
+                    "not be parsed as a dyld_shared_cache file.\n"
+                    "Please provide option --dsc to parse the file as a "
+                    "dyld_shared_cache file",
+                    path);
+
+            result = 1;
+        }
+
+        if (tbd->options.recurse_directories ||
+            tbd->options.paths_from_file)
+        {
+            fputs("Option --merge-dsc cannot be provided while recursing a "
+                  "directory, or with --paths-from\n",
+                  stderr);
+
+            result = 1;
+        }
+    }
+
+    if (tbd->options.paths_from_file && tbd->options.recurse_directories) {
+        fputs("Option -r cannot be provided with --paths-from. Please list the "
+              "paths of the files to parse instead\n",
+              stderr);
+
+        result = 1;
+    }
+
     return result;
 }
 
@@ -590,6 +1760,32 @@ int main(const int argc, char *const argv[]) {
     bool has_stdout = false;
     bool will_parse_export_trie = false;
 
+    /*
+     * The number of workers to parse mach-o files on, or 1 to parse all files
+     * on this thread.
+     */
+
+    uint64_t job_count = 1;
+
+    /*
+     * The path of the manifest used to skip unchanged files while recursing.
+     */
+
+    const char *manifest_path = NULL;
+
+    /*
+     * The path of the directory tbds are cached in, shared across runs.
+     */
+
+    const char *cache_dir_path = NULL;
+
+    /*
+     * Mach-o files are always matched by their device and inode, and with
+     * dedup_contents, also by their contents.
+     */
+
+    bool dedup_contents = false;
+
     for (int index = 1; index != argc; index++) {
         /*
          * Every argument parsed in this loop should be an option. Any extra
@@ -683,6 +1879,49 @@ int main(const int argc, char *const argv[]) {
                         tbd->options.replace_path_extension = true;
                     } else if (strcmp(in_opt, "combine-tbds") == 0) {
                         tbd->options.combine_tbds = true;
+                    } else if (strcmp(in_opt, "map-output") == 0) {
+                        tbd->options.map_output = true;
+                    } else if (strcmp(in_opt, "write-if-changed") == 0) {
+                        tbd->options.write_if_changed = true;
+                    } else if (strcmp(in_opt, "binary-index") == 0) {
+                        tbd->options.binary_index = true;
+                    } else if (strcmp(in_opt, "output-format") == 0) {
+                        index += 1;
+                        if (index == argc) {
+                            fputs("Please provide an output-format. Run "
+                                  "--help for a list of output-formats\n",
+                                  stderr);
+
+                            destroy_tbds_array(&tbds);
+                            return 1;
+                        }
+
+                        const char *const format = argv[index];
+                        struct tbd_for_main_options *const options =
+                            &tbd->options;
+
+                        if (strcmp(format, "tbd") == 0) {
+                            options->write_archive = false;
+                        } else if (strcmp(format, "tar") == 0) {
+                            options->write_archive = true;
+                            options->archive_format =
+                                TBD_FOR_MAIN_ARCHIVE_FORMAT_TAR;
+                        } else if (strcmp(format, "records") == 0) {
+                            options->write_archive = true;
+                            options->archive_format =
+                                TBD_FOR_MAIN_ARCHIVE_FORMAT_RECORDS;
+                        } else if (strcmp(format, "nul-delimited") == 0) {
+                            options->write_archive = true;
+                            options->archive_format =
+                                TBD_FOR_MAIN_ARCHIVE_FORMAT_NUL_DELIMITED;
+                        } else {
+                            fprintf(stderr,
+                                    "Unrecognized output-format: %s\n",
+                                    format);
+
+                            destroy_tbds_array(&tbds);
+                            return 1;
+                        }
                     } else {
                         fprintf(stderr, "Unrecognized option: %s\n", in_arg);
                         destroy_tbds_array(&tbds);
@@ -693,17 +1932,78 @@ int main(const int argc, char *const argv[]) {
                     continue;
                 }
 
+                /*
+                 * tbd-version v5 documents are json, and can't be combined
+                 * into a single file like yaml documents can.
+                 */
+
+                if (tbd->options.combine_tbds &&
+                    tbd->info.version == TBD_VERSION_V5)
+                {
+                    print_not_supported_error(tbd,
+                                              "--combine-tbds",
+                                              TBD_VERSION_V5);
+
+                    destroy_tbds_array(&tbds);
+                    return 1;
+                }
+
+                if (tbd->options.combine_tbds && tbd->options.write_archive) {
+                    fputs("Option --combine-tbds cannot be provided with the "
+                          "tar, records, or nul-delimited output-formats, "
+                          "which already write all .tbd files to a single "
+                          "archive\n",
+                          stderr);
+
+                    destroy_tbds_array(&tbds);
+                    return 1;
+                }
+
+                /*
+                 * Binary indexes are written next to each .tbd file, so they
+                 * need a separate file for every tbd.
+                 */
+
+                const bool binary_index = tbd->options.binary_index;
+                if (binary_index &&
+                    (tbd->options.combine_tbds || tbd->options.write_archive))
+                {
+                    fputs("Option --binary-index cannot be provided with "
+                          "--combine-tbds, or the tar, records, or "
+                          "nul-delimited output-formats\n",
+                          stderr);
+
+                    destroy_tbds_array(&tbds);
+                    return 1;
+                }
+
                 /*
                  * We only allow printing to stdout for single-files, and
-                 * not when recursing directories.
+                 * not when recursing directories, unless all files are
+                 * written to a single archive.
                  */
 
                 const char *const path = in_arg;
                 if (strcmp(path, "stdout") == 0) {
-                    if (tbd->options.recurse_directories) {
+                    const bool to_archive = tbd->options.write_archive;
+                    const bool has_many_files =
+                        tbd->options.recurse_directories ||
+                        tbd->options.paths_from_file;
+
+                    if (has_many_files && !to_archive) {
                         fputs("Writing to stdout (terminal) while recursing "
-                              "a directory is not supported.\nPlease provide "
-                              "a directory to write all created files to\n",
+                              "a directory, or with --paths-from, is not "
+                              "supported.\nPlease provide a directory to "
+                              "write all created files to\n",
+                              stderr);
+
+                        destroy_tbds_array(&tbds);
+                        return 1;
+                    }
+
+                    if (binary_index) {
+                        fputs("Option --binary-index cannot be provided when "
+                              "writing to stdout\n",
                               stderr);
 
                         destroy_tbds_array(&tbds);
@@ -719,10 +2019,28 @@ int main(const int argc, char *const argv[]) {
                         return 1;
                     }
 
+                    /*
+                     * Member names are created under the write-path, so
+                     * provide one for the archive written to stdout.
+                     */
+
+                    if (to_archive) {
+                        tbd->write_path = alloc_and_copy(".", 1);
+                        if (tbd->write_path == NULL) {
+                            fputs("Failed to allocate memory\n", stderr);
+                            destroy_tbds_array(&tbds);
+
+                            return 1;
+                        }
+
+                        tbd->write_path_length = 1;
+                        tbd->flags.archive_to_stdout = true;
+                    }
+
                     found_path = true;
                     has_stdout = true;
 
-                    continue;
+                    break;
                 }
 
                 /*
@@ -736,6 +2054,7 @@ int main(const int argc, char *const argv[]) {
 
                 const struct tbd_for_main_options options = tbd->options;
                 if (!options.recurse_directories &&
+                    !options.paths_from_file &&
                     !tbd->filetypes.dyld_shared_cache)
                 {
                     if (options.preserve_directory_subdirs) {
@@ -799,8 +2118,10 @@ int main(const int argc, char *const argv[]) {
                 struct stat info = {};
                 if (stat(full_path, &info) == 0) {
                     if (S_ISREG(info.st_mode)) {
-                        if (options.recurse_directories &&
-                            !tbd->options.combine_tbds)
+                        if ((options.recurse_directories ||
+                             options.paths_from_file) &&
+                            !options.combine_tbds &&
+                            !options.write_archive)
                         {
                             fputs("Writing to a regular file while recursing a "
                                   "directory is not supported.\nTo combine all "
@@ -819,6 +2140,7 @@ int main(const int argc, char *const argv[]) {
                         }
                     } else if (S_ISDIR(info.st_mode)) {
                         if (!options.recurse_directories &&
+                            !options.paths_from_file &&
                             !tbd->filetypes.dyld_shared_cache)
                         {
                             fputs("Writing to a directory while parsing a "
@@ -835,6 +2157,20 @@ int main(const int argc, char *const argv[]) {
                             return 1;
                         }
 
+                        if (options.write_archive) {
+                            fputs("We cannot write an archive to a "
+                                  "directory.\nPlease provide a path to a file "
+                                  "to write the archive to\n",
+                                  stderr);
+
+                            if (full_path != path) {
+                                free(full_path);
+                            }
+
+                            destroy_tbds_array(&tbds);
+                            return 1;
+                        }
+
                         if (options.combine_tbds) {
                             fputs("We cannot combine all tbds to a single file "
                                   "and write to a directory.\nPlease provide a "
@@ -884,13 +2220,30 @@ int main(const int argc, char *const argv[]) {
             }
 
             current_tbd_index += 1;
-        } else if (strcmp(option, "p") == 0 || strcmp(option, "path") == 0) {
+        } else if (strcmp(option, "p") == 0 ||
+                   strcmp(option, "path") == 0 ||
+                   strcmp(option, "paths-from") == 0)
+        {
+            /*
+             * --paths-from takes the same options as --path, but is followed by
+             * a file listing the paths to parse, rather than a single path.
+             */
+
+            const bool paths_from_file = (strcmp(option, "paths-from") == 0);
+
             index += 1;
             if (index == argc) {
-                fputs("Please provide either a path to a mach-o file, a path "
-                      "to a dyld_shared_cache file, or \"stdin\" to parse from "
-                      "terminal input\n",
-                      stderr);
+                if (paths_from_file) {
+                    fputs("Please provide either a path to a file listing the "
+                          "paths of files to parse, or \"-\" to read the list "
+                          "from stdin\n",
+                          stderr);
+                } else {
+                    fputs("Please provide either a path to a mach-o file, a "
+                          "path to a dyld_shared_cache file, or \"stdin\" to "
+                          "parse from terminal input\n",
+                          stderr);
+                }
 
                 destroy_tbds_array(&tbds);
                 return 1;
@@ -899,12 +2252,23 @@ int main(const int argc, char *const argv[]) {
             struct tbd_for_main tbd = {};
             setup_tbd_for_main(&tbd);
 
+            tbd.options.paths_from_file = paths_from_file;
+
             bool found_path = false;
             for (; index != argc; index++) {
                 const char *const inner_arg = argv[index];
                 const char inner_arg_front = inner_arg[0];
 
-                if (inner_arg_front == '-') {
+                /*
+                 * A list of paths can also be read from stdin with "-".
+                 */
+
+                const bool is_stdin_list =
+                    paths_from_file &&
+                    inner_arg_front == '-' &&
+                    inner_arg[1] == '\0';
+
+                if (inner_arg_front == '-' && !is_stdin_list) {
                     const char *inner_opt = inner_arg + 1;
                     const char inner_opt_front = inner_opt[0];
 
@@ -929,7 +2293,8 @@ int main(const int argc, char *const argv[]) {
                     return 1;
                 }
 
-                if (verify_tbd_for_main(&tbd, inner_arg)) {
+                const char *const path = (is_stdin_list) ? "stdin" : inner_arg;
+                if (verify_tbd_for_main(&tbd, path)) {
                     destroy_tbds_array(&tbds);
                     return 1;
                 }
@@ -962,37 +2327,109 @@ int main(const int argc, char *const argv[]) {
                     }
                 }
 
-                found_path = true;
-                break;
+                found_path = true;
+                break;
+            }
+
+            if (!found_path) {
+                fputs("Please provide either a path to a mach-o file or "
+                      "\"stdin\" to parse from terminal input\n",
+                      stderr);
+
+                destroy_tbds_array(&tbds);
+                return 1;
+            }
+
+            if (!tbd.parse_options.ignore_exports) {
+                if (!tbd.macho_options.use_symbol_table) {
+                    will_parse_export_trie = true;
+                }
+            }
+
+            const enum array_result add_tbd_result =
+                array_add_item(&tbds, sizeof(tbd), &tbd, NULL);
+
+            if (add_tbd_result != E_ARRAY_OK) {
+                fputs("Internal failure: Failed to add path-info to array\n",
+                      stderr);
+
+                destroy_tbds_array(&tbds);
+                free(tbd.parse_path);
+
+                return 1;
+            }
+        } else if (strcmp(option, "cache-dir") == 0) {
+            index += 1;
+            if (index == argc) {
+                fputs("Please provide a path to a cache directory\n", stderr);
+
+                destroy_tbds_array(&tbds);
+                return 1;
+            }
+
+            cache_dir_path = argv[index];
+        } else if (strcmp(option, "client") == 0) {
+            if (index != 1 || argc < 3) {
+                fputs("--client needs to be run with a path to the socket of a "
+                      "server, followed by the arguments to run tbd with\n",
+                      stderr);
+
+                destroy_tbds_array(&tbds);
+                return 1;
             }
 
-            if (!found_path) {
-                fputs("Please provide either a path to a mach-o file or "
-                      "\"stdin\" to parse from terminal input\n",
+            return serve_run_client(argv[2], argc - 3, argv + 3);
+        } else if (strcmp(option, "dedup-contents") == 0) {
+            dedup_contents = true;
+        } else if (strcmp(option, "jobs") == 0) {
+            index += 1;
+            if (index == argc) {
+                fputs("Please provide a number of jobs to parse files with\n",
                       stderr);
 
                 destroy_tbds_array(&tbds);
                 return 1;
             }
 
-            if (!tbd.parse_options.ignore_exports) {
-                if (!tbd.macho_options.use_symbol_table) {
-                    will_parse_export_trie = true;
-                }
+            const char *const number_string = argv[index];
+            const uint64_t number = strtoul(number_string, NULL, 10);
+
+            if (number == 0) {
+                fprintf(stderr,
+                        "A number of jobs of \"%s\" is invalid\n",
+                        number_string);
+
+                destroy_tbds_array(&tbds);
+                return 1;
             }
 
-            const enum array_result add_tbd_result =
-                array_add_item(&tbds, sizeof(tbd), &tbd, NULL);
+            job_count = number;
+        } else if (strcmp(option, "manifest") == 0) {
+            index += 1;
+            if (index == argc) {
+                fputs("Please provide a path to a manifest file\n", stderr);
 
-            if (add_tbd_result != E_ARRAY_OK) {
-                fputs("Internal failure: Failed to add path-info to array\n",
+                destroy_tbds_array(&tbds);
+                return 1;
+            }
+
+            manifest_path = argv[index];
+        } else if (strcmp(option, "serve") == 0) {
+            if (index != 1 || argc != 3) {
+                fputs("--serve needs to be run by itself, with a single path to "
+                      "the socket to listen on\n",
                       stderr);
 
                 destroy_tbds_array(&tbds);
-                free(tbd.parse_path);
-
                 return 1;
             }
+
+            /*
+             * Every request is run through main() again, in a process forked
+             * from the server.
+             */
+
+            return serve_run_server(argv[2], main);
         } else if (strcmp(option, "list-architectures") == 0) {
             if (index != 1 || argc > 3) {
                 fputs("--list-architectures needs to be run either by itself, "
@@ -1159,6 +2596,145 @@ int main(const int argc, char *const argv[]) {
         return 1;
     }
 
+    /*
+     * Files skipped with a manifest would be missing from a single combined
+     * .tbd file or archive, so a manifest is only used with separate tbds.
+     */
+
+    struct manifest manifest = {};
+    struct manifest *manifest_ptr = NULL;
+
+    if (manifest_path != NULL) {
+        const struct tbd_for_main *iter = tbds.data;
+        const struct tbd_for_main *const tbds_end = tbds.data_end;
+
+        for (; iter != tbds_end; iter++) {
+            const struct tbd_for_main_options options = iter->options;
+            if (!options.recurse_directories && !options.paths_from_file) {
+                continue;
+            }
+
+            if (options.combine_tbds || options.write_archive) {
+                fputs("A manifest can't be used when combining tbds, or when "
+                      "writing out an archive\n",
+                      stderr);
+
+                destroy_tbds_array(&tbds);
+                return 1;
+            }
+
+            /*
+             * The options of every tbd are recorded, so the manifest isn't
+             * used if any tbd's options have changed since.
+             */
+
+            struct result_cache_key options_key = {};
+            result_cache_create_options_key(iter, &options_key);
+
+            manifest_add_options(&manifest, &options_key, sizeof(options_key));
+        }
+
+        const enum manifest_result load_manifest_result =
+            manifest_load(&manifest, manifest_path);
+
+        switch (load_manifest_result) {
+            case E_MANIFEST_OK:
+                break;
+
+            case E_MANIFEST_ALLOC_FAIL:
+                fputs("Failed to allocate memory\n", stderr);
+
+                manifest_destroy(&manifest);
+                destroy_tbds_array(&tbds);
+
+                return 1;
+
+            case E_MANIFEST_INVALID:
+                fprintf(stderr,
+                        "Manifest (at path %s) is invalid\n",
+                        manifest_path);
+
+                manifest_destroy(&manifest);
+                destroy_tbds_array(&tbds);
+
+                return 1;
+
+            case E_MANIFEST_OPEN_FAIL:
+            case E_MANIFEST_READ_FAIL:
+            case E_MANIFEST_WRITE_FAIL:
+                fprintf(stderr,
+                        "Failed to read manifest (at path %s), error: %s\n",
+                        manifest_path,
+                        strerror(errno));
+
+                manifest_destroy(&manifest);
+                destroy_tbds_array(&tbds);
+
+                return 1;
+        }
+
+        manifest_ptr = &manifest;
+    }
+
+    /*
+     * tbds written out from the cache can't reflect any user-input, so no
+     * requests are made when using a cache.
+     */
+
+    struct result_cache result_cache = {};
+    struct result_cache *result_cache_ptr = NULL;
+
+    if (cache_dir_path != NULL) {
+        const enum result_cache_result create_cache_result =
+            result_cache_create(&result_cache, cache_dir_path);
+
+        switch (create_cache_result) {
+            case E_RESULT_CACHE_OK:
+                break;
+
+            case E_RESULT_CACHE_ALLOC_FAIL:
+                fputs("Failed to allocate memory\n", stderr);
+                break;
+
+            case E_RESULT_CACHE_NOT_A_DIRECTORY:
+                fprintf(stderr,
+                        "Object at the provided cache path (%s) is not a "
+                        "directory\n",
+                        cache_dir_path);
+
+                break;
+
+            case E_RESULT_CACHE_MKDIR_FAIL:
+            case E_RESULT_CACHE_READ_FAIL:
+            case E_RESULT_CACHE_WRITE_FAIL:
+                fprintf(stderr,
+                        "Failed to open cache directory (at path %s), "
+                        "error: %s\n",
+                        cache_dir_path,
+                        strerror(errno));
+
+                break;
+        }
+
+        if (create_cache_result != E_RESULT_CACHE_OK) {
+            if (manifest_ptr != NULL) {
+                manifest_destroy(manifest_ptr);
+            }
+
+            destroy_tbds_array(&tbds);
+            return 1;
+        }
+
+        struct tbd_for_main *iter = tbds.data;
+        const struct tbd_for_main *const tbds_end = tbds.data_end;
+
+        for (; iter != tbds_end; iter++) {
+            iter->options.no_requests = true;
+        }
+
+        result_cache_ptr = &result_cache;
+    }
+
     struct string_buffer export_trie_sb = {};
     if (will_parse_export_trie) {
         const enum string_buffer_result reserve_sb_result =
@@ -1181,6 +2757,40 @@ int main(const int argc, char *const argv[]) {
     struct tbd_for_main *tbd = tbds.data;
     const struct tbd_for_main *const end = tbds.data_end;
 
+    /*
+     * With more than one job, mach-o files are parsed on the parse-pool's
+     * workers, which can't ask for user-input. If the workers can't be
+     * created, all files are simply parsed on this thread.
+     */
+
+    struct input_dedup input_dedup = {
+        .match_contents = dedup_contents
+    };
+
+    struct parse_pool parse_pool = {};
+    struct parse_pool *pool = NULL;
+
+    struct pooled_file_info pooled_info = {
+        .retained = &retained,
+        .result_cache = result_cache_ptr,
+        .input_dedup = &input_dedup
+    };
+
+    if (job_count > 1) {
+        const enum parse_pool_result start_pool_result =
+            parse_pool_start(&parse_pool,
+                             job_count,
+                             finish_pooled_file,
+                             &pooled_info);
+
+        if (start_pool_result == E_PARSE_POOL_OK) {
+            pool = &parse_pool;
+            for (struct tbd_for_main *iter = tbd; iter != end; iter++) {
+                iter->options.no_requests = true;
+            }
+        }
+    }
+
     for (; tbd != end; tbd++) {
         /*
          * To allow user-input to modify tbd-info for single files, we create a
@@ -1190,18 +2800,38 @@ int main(const int argc, char *const argv[]) {
         struct tbd_for_main copy = *tbd;
         const struct tbd_for_main_options options = tbd->options;
 
-        if (options.recurse_directories) {
+        if (options.recurse_directories || options.paths_from_file) {
             /*
              * We have to check write_path here, as its possible the
              * output-command was not provided, leaving the write_path NULL.
              */
 
             if (tbd->write_path == NULL) {
-                fputs("Writing to stdout (the terminal) while recursing a "
-                      "directory is not supported.\nPlease provide a directory "
-                      "to write all created files to\n",
-                      stderr);
+                if (options.paths_from_file) {
+                    fputs("Writing to stdout (the terminal) with --paths-from "
+                          "is not supported.\nPlease provide a directory to "
+                          "write all created files to\n",
+                          stderr);
+                } else {
+                    fputs("Writing to stdout (the terminal) while recursing a "
+                          "directory is not supported.\nPlease provide a "
+                          "directory to write all created files to\n",
+                          stderr);
+                }
+
+                if (pool != NULL) {
+                    parse_pool_finish(pool);
+                }
+
+                if (manifest_ptr != NULL) {
+                    manifest_destroy(manifest_ptr);
+                }
+
+                if (result_cache_ptr != NULL) {
+                    result_cache_destroy(result_cache_ptr);
+                }
 
+                input_dedup_destroy(&input_dedup);
                 destroy_tbds_array(&tbds);
                 return 1;
             }
@@ -1209,17 +2839,68 @@ int main(const int argc, char *const argv[]) {
             struct recurse_callback_info recurse_info = {
                 .tbd = &copy,
                 .orig = tbd,
+                .parse_pool = pool,
                 .retained = &retained,
-                .export_trie_sb = &export_trie_sb
+                .export_trie_sb = &export_trie_sb,
+                .manifest = manifest_ptr,
+                .result_cache = result_cache_ptr,
+                .input_dedup = &input_dedup
             };
 
+            /*
+             * Write out the created tbds on a separate thread, so writing out
+             * one file overlaps with parsing the next. If the thread can't be
+             * created, we simply write out each tbd after parsing.
+             */
+
+            struct write_queue write_queue = {};
+            if (write_queue_start(&write_queue) == E_WRITE_QUEUE_OK) {
+                recurse_info.write_queue = &write_queue;
+            }
+
+            /*
+             * The magics of the files found are read in batches, through
+             * io_uring where available.
+             */
+
+            struct recursed_file_queue file_queue = {};
+            our_io_batch_init(&file_queue.io_batch,
+                              MAGIC_PREFILTER_BATCH_COUNT);
+
+            recurse_info.file_queue = &file_queue;
+
+            dir_recurse_filter_callback filter_callback = NULL;
+            if (manifest_ptr != NULL) {
+                filter_callback = recurse_directory_filter_callback;
+            }
+
             enum dir_recurse_result recurse_dir_result = E_DIR_RECURSE_OK;
-            if (options.recurse_subdirectories) {
+            if (options.paths_from_file) {
+                parse_paths_from_file(&recurse_info, tbd->parse_path);
+            } else if (options.recurse_subdirectories && pool != NULL) {
+                /*
+                 * With more than one job, sub-directories are also read on
+                 * separate threads, while files are still found in the same
+                 * order.
+                 */
+
+                recurse_dir_result =
+                    dir_recurse_with_subdirs_parallel(
+                        tbd->parse_path,
+                        tbd->parse_path_length,
+                        O_RDONLY,
+                        job_count,
+                        &recurse_info,
+                        filter_callback,
+                        recurse_directory_callback,
+                        recurse_directory_fail_callback);
+            } else if (options.recurse_subdirectories) {
                 recurse_dir_result =
                     dir_recurse_with_subdirs(tbd->parse_path,
                                              tbd->parse_path_length,
                                              O_RDONLY,
                                              &recurse_info,
+                                             filter_callback,
                                              recurse_directory_callback,
                                              recurse_directory_fail_callback);
             } else {
@@ -1228,10 +2909,37 @@ int main(const int argc, char *const argv[]) {
                                 tbd->parse_path_length,
                                 O_RDONLY,
                                 &recurse_info,
+                                filter_callback,
                                 recurse_directory_callback,
                                 recurse_directory_fail_callback);
             }
 
+            /*
+             * The files still queued or being parsed have to be written out
+             * before the write-queue and recurse_info go away.
+             */
+
+            const int recurse_error = errno;
+            handle_queued_files(&recurse_info);
+
+            our_io_batch_destroy(&file_queue.io_batch);
+            errno = recurse_error;
+
+            if (pool != NULL) {
+                parse_pool_drain(pool);
+            }
+
+            if (recurse_info.write_queue != NULL) {
+                write_queue_finish(recurse_info.write_queue);
+            }
+
+            /*
+             * All tbds have now been written out, so duplicates can be copied
+             * from them.
+             */
+
+            input_dedup_write_copies(&input_dedup);
+
             if (recurse_dir_result != E_DIR_RECURSE_OK) {
                 if (should_print_paths) {
                     fprintf(stderr,
@@ -1247,8 +2955,25 @@ int main(const int argc, char *const argv[]) {
                 }
             }
 
-            if (recurse_info.files_parsed == 0) {
-                if (should_print_paths) {
+            /*
+             * Files skipped as unchanged still have their .tbd files from a
+             * previous run.
+             */
+
+            if (recurse_info.files_parsed == 0 &&
+                recurse_info.files_unchanged == 0)
+            {
+                if (options.paths_from_file) {
+                    const char *list_path = tbd->parse_path;
+                    if (list_path == NULL) {
+                        list_path = "stdin";
+                    }
+
+                    fprintf(stderr,
+                            "No new .tbd files were created from the list of "
+                            "paths (at path %s)\n",
+                            list_path);
+                } else if (should_print_paths) {
                     fprintf(stderr,
                             "No new .tbd files were created while parsing "
                             "directory (at path %s)\n",
@@ -1261,7 +2986,7 @@ int main(const int argc, char *const argv[]) {
             }
 
             if (tbd->options.combine_tbds) {
-                if (tbd_write_footer(recurse_info.combine_file)) {
+                if (tbd_write_footer_to_file(recurse_info.combine_file)) {
                     if (should_print_paths) {
                         fprintf(stderr,
                                 "Failed to write footer for combined .tbd file "
@@ -1277,6 +3002,15 @@ int main(const int argc, char *const argv[]) {
                 }
 
                 fclose(recurse_info.combine_file);
+            } else if (recurse_info.combine_file != NULL) {
+                if (tbd_for_main_close_archive(tbd,
+                                               recurse_info.combine_file))
+                {
+                    fputs("Failed to write the end of the archive\n",
+                          stderr);
+
+                    return 1;
+                }
             }
 
             /*
@@ -1294,22 +3028,38 @@ int main(const int argc, char *const argv[]) {
             tbd_for_main_destroy(&copy);
             memset(tbd, 0, sizeof(*tbd));
         } else {
-            char *const parse_path = tbd->parse_path;
-            const int fd = our_open(parse_path, O_RDONLY, 0);
+            /*
+             * A NULL parse_path signifies that we're parsing from stdin.
+             */
 
-            if (fd < 0) {
-                if (should_print_paths) {
-                    fprintf(stderr,
-                            "Failed to open file (at path %s), error: %s\n",
-                            tbd->parse_path,
-                            strerror(errno));
-                } else {
-                    fprintf(stderr,
-                            "Failed to open the file at the provided path, "
-                            "error: %s\n",
-                            strerror(errno));
+            const char *parse_path = tbd->parse_path;
+            uint64_t parse_path_length = tbd->parse_path_length;
+
+            int fd = STDIN_FILENO;
+
+            if (parse_path != NULL) {
+                fd = our_open(parse_path, O_RDONLY, 0);
+                if (fd < 0) {
+                    if (should_print_paths) {
+                        fprintf(stderr,
+                                "Failed to open file (at path %s), error: %s\n",
+                                tbd->parse_path,
+                                strerror(errno));
+                    } else {
+                        fprintf(stderr,
+                                "Failed to open the file at the provided path, "
+                                "error: %s\n",
+                                strerror(errno));
+                    }
+
+                    continue;
                 }
+            } else {
+                parse_path = "stdin";
+                parse_path_length = 5;
+            }
 
+            if (spool_input_if_needed(&fd, parse_path, should_print_paths)) {
                 continue;
             }
 
@@ -1318,93 +3068,148 @@ int main(const int argc, char *const argv[]) {
              */
 
             struct magic_buffer magic_buffer = {};
-            if (tbd->filetypes.macho) {
-                struct parse_macho_for_main_args args = {
-                    .fd = fd,
-                    .magic_buffer = &magic_buffer,
-                    .retained = &retained,
+            struct parse_macho_for_main_args args = {
+                .fd = fd,
+                .magic_buffer = &magic_buffer,
+                .retained = &retained,
+
+                .tbd = &copy,
+                .orig = tbd,
 
-                    .tbd = &copy,
-                    .orig = tbd,
+                .dir_path = parse_path,
+                .dir_path_length = parse_path_length,
 
-                    .dir_path = parse_path,
-                    .dir_path_length = tbd->parse_path_length,
+                .dont_handle_non_macho_error = false,
+                .print_paths = should_print_paths,
 
-                    .dont_handle_non_macho_error = false,
-                    .print_paths = should_print_paths,
+                .export_trie_sb = &export_trie_sb,
+                .result_cache = result_cache_ptr,
+                .options.verify_write_path = true
+            };
 
-                    .export_trie_sb = &export_trie_sb,
-                    .options.verify_write_path = true
-                };
+            /*
+             * We're only supposed to print the non-macho error if no other
+             * filetypes are enabled.
+             */
 
-                /*
-                 * We're only supposed to print the non-macho error if no other
-                 * filetypes are enabled.
-                 */
+            if (tbd->filetypes.dyld_shared_cache) {
+                args.dont_handle_non_macho_error = true;
+            }
+
+            /*
+             * A file provided through multiple paths is only parsed once, and
+             * its tbd is copied once all files have been parsed.
+             */
 
-                if (tbd->filetypes.dyld_shared_cache) {
-                    args.dont_handle_non_macho_error = true;
+            if (tbd->filetypes.macho &&
+                input_dedup_can_dedup(tbd) &&
+                magic_prefilter_file(fd) == E_MAGIC_PREFILTER_MACHO)
+            {
+                const bool is_duplicate =
+                    input_dedup_find_or_add(&input_dedup,
+                                            tbd,
+                                            fd,
+                                            tbd->write_path,
+                                            tbd->write_path_length);
+
+                if (is_duplicate) {
+                    close(fd);
+                    continue;
                 }
+            }
 
-                const enum parse_macho_for_main_result parse_result =
-                    parse_macho_file_for_main(args);
+            if (tbd->filetypes.macho) {
+                enum parse_macho_for_main_result cached_result =
+                    E_PARSE_MACHO_FOR_MAIN_OK;
 
-                if (parse_result != E_PARSE_MACHO_FOR_MAIN_NOT_A_MACHO) {
+                if (write_cached_macho_file_for_main(&args, &cached_result)) {
+                    input_dedup_mark_written(&input_dedup, tbd, fd);
                     continue;
                 }
             }
 
-            if (tbd->filetypes.dyld_shared_cache) {
-                struct parse_dsc_for_main_args args = {
-                    .fd = fd,
-                    .magic_buffer = &magic_buffer,
-                    .retained = &retained,
+            if (pool != NULL) {
+                if (tbd->filetypes.macho) {
+                    const struct result_cache_key *cache_key = NULL;
+                    if (args.has_cache_key) {
+                        cache_key = &args.cache_key;
+                    }
 
-                    .tbd = &copy,
-                    .orig = tbd,
+                    const enum parse_pool_result add_file_result =
+                        parse_pool_add_file(pool,
+                                            tbd,
+                                            fd,
+                                            parse_path,
+                                            parse_path_length,
+                                            NULL,
+                                            0,
+                                            should_print_paths,
+                                            cache_key,
+                                            NULL);
+
+                    if (add_file_result == E_PARSE_POOL_OK) {
+                        continue;
+                    }
+                }
 
-                    .dsc_dir_path = parse_path,
-                    .dsc_dir_path_length = tbd->parse_path_length,
+                /*
+                 * Keep the output in the order of the provided paths.
+                 */
 
-                    .dont_handle_non_dsc_error = false,
-                    .print_paths = should_print_paths,
+                parse_pool_drain(pool);
+            }
 
-                    .export_trie_sb = &export_trie_sb,
-                    .options.verify_write_path = true
-                };
+            if (tbd->filetypes.macho) {
+                const enum parse_macho_for_main_result parse_result =
+                    parse_macho_file_for_main(args);
 
-                const enum parse_dsc_for_main_result parse_result =
-                    parse_dsc_for_main(args);
+                if (parse_result == E_PARSE_MACHO_FOR_MAIN_OK) {
+                    input_dedup_mark_written(&input_dedup, tbd, fd);
+                }
 
-                if (parse_result != E_PARSE_DSC_FOR_MAIN_NOT_A_SHARED_CACHE) {
+                if (parse_result != E_PARSE_MACHO_FOR_MAIN_NOT_A_MACHO) {
                     continue;
                 }
             }
 
-            if (!tbd->filetypes.user_provided) {
-                if (should_print_paths) {
-                    fputs("File (at path %s) is not among any of the provided "
-                          "filetypes\n",
-                          stderr);
-                } else {
-                    fputs("File at the provided path is not among any of the "
-                          "provided filetypes\n",
-                          stderr);
-                }
-            } else {
-                if (should_print_paths) {
-                    fputs("File (at path %s) is not among any of the supported "
-                          "filetypes\n",
-                          stderr);
-                } else {
-                    fputs("File at the provided path is not among any of the "
-                          "supported filetypes\n",
-                          stderr);
-                }
-            }
+            parse_non_macho_file(tbd,
+                                 &copy,
+                                 fd,
+                                 &magic_buffer,
+                                 parse_path,
+                                 parse_path_length,
+                                 should_print_paths,
+                                 &retained,
+                                 &export_trie_sb);
+        }
+    }
+
+    if (pool != NULL) {
+        parse_pool_finish(pool);
+    }
+
+    input_dedup_write_copies(&input_dedup);
+    input_dedup_destroy(&input_dedup);
+
+    int result = 0;
+    if (manifest_ptr != NULL) {
+        const enum manifest_result write_manifest_result =
+            manifest_write(manifest_ptr, manifest_path);
 
-            tbd_for_main_destroy(tbd);
+        if (write_manifest_result != E_MANIFEST_OK) {
+            fprintf(stderr,
+                    "Failed to write manifest to path: %s, error: %s\n",
+                    manifest_path,
+                    strerror(errno));
+
+            result = 1;
         }
+
+        manifest_destroy(manifest_ptr);
+    }
+
+    if (result_cache_ptr != NULL) {
+        result_cache_destroy(result_cache_ptr);
     }
 
     /*
@@ -1416,5 +3221,5 @@ int main(const int argc, char *const argv[]) {
     sb_destroy(&export_trie_sb);
     array_destroy(&tbds);
 
-    return 0;
+    return result;
 }
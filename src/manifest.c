@@ -0,0 +1,541 @@
+//
+//  src/manifest.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "copy.h"
+#include "manifest.h"
+#include "our_io.h"
+
+/*
+ * The header is followed by the options-digest, in hexadecimal. Manifests of
+ * every version start with manifest_magic.
+ */
+
+static const char manifest_magic[] = "tbd-manifest ";
+static const char manifest_header[] = "tbd-manifest v2 ";
+static const uint64_t digest_basis = 0xcbf29ce484222325ull;
+
+static inline uint64_t hash_inode(const uint64_t ino) {
+    return (ino * 0x9e3779b97f4a7c15ull) >> 17;
+}
+
+static enum manifest_result
+create_buckets(struct manifest *__notnull const manifest) {
+    /*
+     * Keep the table at most half-full, so probes stay short.
+     */
+
+    uint64_t bucket_count = 16;
+    while (bucket_count < manifest->entry_count * 2) {
+        bucket_count *= 2;
+    }
+
+    uint64_t *const buckets = calloc(bucket_count, sizeof(uint64_t));
+    if (buckets == NULL) {
+        return E_MANIFEST_ALLOC_FAIL;
+    }
+
+    const uint64_t mask = bucket_count - 1;
+    for (uint64_t i = 0; i != manifest->entry_count; i++) {
+        const struct manifest_entry *const entry = manifest->entries + i;
+        uint64_t index = hash_inode(entry->ino) & mask;
+
+        while (buckets[index] != 0) {
+            index = (index + 1) & mask;
+        }
+
+        buckets[index] = i + 1;
+    }
+
+    manifest->buckets = buckets;
+    manifest->bucket_count = bucket_count;
+
+    return E_MANIFEST_OK;
+}
+
+/*
+ * Digests are 64-bit FNV-1a hashes, which are only used to tell whether an
+ * input's contents (or the options used) changed.
+ */
+
+static inline uint64_t
+digest_bytes(uint64_t digest,
+             const void *__notnull const bytes,
+             const uint64_t size)
+{
+    const uint8_t *iter = (const uint8_t *)bytes;
+    const uint8_t *const end = iter + size;
+
+    for (; iter != end; iter++) {
+        digest ^= *iter;
+        digest *= 0x100000001b3ull;
+    }
+
+    return digest;
+}
+
+void
+manifest_add_options(struct manifest *__notnull const manifest,
+                     const void *__notnull const options,
+                     const uint64_t size)
+{
+    uint64_t digest = manifest->options_digest;
+    if (digest == 0) {
+        digest = digest_basis;
+    }
+
+    manifest->options_digest = digest_bytes(digest, options, size);
+}
+
+/*
+ * Returns whether line is a manifest-header written with the same options as
+ * manifest. Manifests written by older versions of tbd have no options-digest,
+ * and so never match.
+ */
+
+static bool
+header_matches(const struct manifest *__notnull const manifest,
+               const char *__notnull const line)
+{
+    const uint64_t header_length = sizeof(manifest_header) - 1;
+    if (strncmp(line, manifest_header, header_length) != 0) {
+        return false;
+    }
+
+    uint64_t options_digest = 0;
+    if (sscanf(line + header_length, "%" SCNx64, &options_digest) != 1) {
+        return false;
+    }
+
+    return (options_digest == manifest->options_digest);
+}
+
+static enum manifest_result
+parse_line(struct manifest_entry *__notnull const entry,
+           const char *__notnull const line,
+           uint64_t length)
+{
+    /*
+     * The output-path takes up the rest of the line, after all other fields.
+     */
+
+    int path_offset = 0;
+    const int count =
+        sscanf(line,
+               "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNd64 " %" SCNd64
+               " %" SCNx64 " %n",
+               &entry->dev,
+               &entry->ino,
+               &entry->size,
+               &entry->mtime_sec,
+               &entry->mtime_nsec,
+               &entry->digest,
+               &path_offset);
+
+    if (count != 6 || path_offset == 0) {
+        return E_MANIFEST_INVALID;
+    }
+
+    if (line[length - 1] == '\n') {
+        length -= 1;
+    }
+
+    if ((uint64_t)path_offset >= length) {
+        return E_MANIFEST_INVALID;
+    }
+
+    const uint64_t path_length = length - (uint64_t)path_offset;
+    char *const path = alloc_and_copy(line + path_offset, path_length);
+
+    if (path == NULL) {
+        return E_MANIFEST_ALLOC_FAIL;
+    }
+
+    entry->output_path = path;
+    entry->output_path_length = path_length;
+
+    return E_MANIFEST_OK;
+}
+
+static enum manifest_result
+read_entries(struct manifest *__notnull const manifest, FILE *__notnull file) {
+    char *line = NULL;
+    size_t line_capacity = 0;
+
+    const uint64_t magic_length = sizeof(manifest_magic) - 1;
+
+    ssize_t length = our_getline(&line, &line_capacity, file);
+    if (length <= 0 || strncmp(line, manifest_magic, magic_length) != 0) {
+        free(line);
+        return E_MANIFEST_INVALID;
+    }
+
+    /*
+     * The tbds recorded may not match what would be created with the current
+     * options, so the entries are dropped, and all inputs are parsed again.
+     */
+
+    if (!header_matches(manifest, line)) {
+        free(line);
+        return E_MANIFEST_OK;
+    }
+
+    struct array entries = {};
+    enum manifest_result result = E_MANIFEST_OK;
+
+    do {
+        length = our_getline(&line, &line_capacity, file);
+        if (length <= 0) {
+            if (ferror(file)) {
+                result = E_MANIFEST_READ_FAIL;
+            }
+
+            break;
+        }
+
+        struct manifest_entry entry = {};
+
+        result = parse_line(&entry, line, (uint64_t)length);
+        if (result != E_MANIFEST_OK) {
+            break;
+        }
+
+        const enum array_result add_entry_result =
+            array_add_item(&entries, sizeof(entry), &entry, NULL);
+
+        if (add_entry_result != E_ARRAY_OK) {
+            free(entry.output_path);
+
+            result = E_MANIFEST_ALLOC_FAIL;
+            break;
+        }
+    } while (true);
+
+    free(line);
+
+    manifest->entries = entries.data;
+    manifest->entry_count = entries.item_count;
+
+    return result;
+}
+
+enum manifest_result
+manifest_load(struct manifest *__notnull const manifest,
+              const char *__notnull const path)
+{
+    FILE *const file = fopen(path, "r");
+    if (file == NULL) {
+        if (errno == ENOENT) {
+            return create_buckets(manifest);
+        }
+
+        return E_MANIFEST_OPEN_FAIL;
+    }
+
+    const enum manifest_result read_entries_result =
+        read_entries(manifest, file);
+
+    fclose(file);
+
+    if (read_entries_result != E_MANIFEST_OK) {
+        return read_entries_result;
+    }
+
+    return create_buckets(manifest);
+}
+
+bool
+manifest_has_inode(const struct manifest *__notnull const manifest,
+                   const uint64_t ino)
+{
+    const uint64_t mask = manifest->bucket_count - 1;
+    uint64_t index = hash_inode(ino) & mask;
+
+    do {
+        const uint64_t bucket = manifest->buckets[index];
+        if (bucket == 0) {
+            return false;
+        }
+
+        if (manifest->entries[bucket - 1].ino == ino) {
+            return true;
+        }
+
+        index = (index + 1) & mask;
+    } while (true);
+}
+
+struct manifest_entry *
+manifest_find(const struct manifest *__notnull const manifest,
+              const struct stat *__notnull const sbuf,
+              const char *__notnull const output_path,
+              const uint64_t output_path_length)
+{
+    const uint64_t dev = (uint64_t)sbuf->st_dev;
+    const uint64_t ino = (uint64_t)sbuf->st_ino;
+
+    const uint64_t mask = manifest->bucket_count - 1;
+    uint64_t index = hash_inode(ino) & mask;
+
+    do {
+        const uint64_t bucket = manifest->buckets[index];
+        if (bucket == 0) {
+            return NULL;
+        }
+
+        struct manifest_entry *const entry = manifest->entries + (bucket - 1);
+
+        /*
+         * A hard-linked input has a separate entry for each of its tbds.
+         */
+
+        if (entry->ino == ino &&
+            entry->dev == dev &&
+            entry->output_path_length == output_path_length &&
+            memcmp(entry->output_path, output_path, output_path_length) == 0)
+        {
+            return entry;
+        }
+
+        index = (index + 1) & mask;
+    } while (true);
+}
+
+static inline int64_t get_mtime_sec(const struct stat *__notnull const sbuf) {
+#if defined(__APPLE__)
+    return sbuf->st_mtimespec.tv_sec;
+#else
+    return sbuf->st_mtim.tv_sec;
+#endif
+}
+
+static inline int64_t get_mtime_nsec(const struct stat *__notnull const sbuf) {
+#if defined(__APPLE__)
+    return sbuf->st_mtimespec.tv_nsec;
+#else
+    return sbuf->st_mtim.tv_nsec;
+#endif
+}
+
+bool
+manifest_entry_matches(const struct manifest_entry *__notnull const entry,
+                       const struct stat *__notnull const sbuf)
+{
+    if (entry->size != (uint64_t)sbuf->st_size) {
+        return false;
+    }
+
+    if (entry->mtime_sec != get_mtime_sec(sbuf)) {
+        return false;
+    }
+
+    return (entry->mtime_nsec == get_mtime_nsec(sbuf));
+}
+
+void
+manifest_entry_mark_unchanged(struct manifest_entry *__notnull const entry) {
+    __atomic_store_n(&entry->is_unchanged, true, __ATOMIC_RELAXED);
+}
+
+enum manifest_result
+manifest_add_entry(struct manifest *__notnull const manifest,
+                   const struct stat *__notnull const sbuf,
+                   const uint64_t digest,
+                   const char *__notnull const output_path,
+                   const uint64_t output_path_length)
+{
+    char *const path = alloc_and_copy(output_path, output_path_length);
+    if (path == NULL) {
+        return E_MANIFEST_ALLOC_FAIL;
+    }
+
+    const struct manifest_entry entry = {
+        .dev = (uint64_t)sbuf->st_dev,
+        .ino = (uint64_t)sbuf->st_ino,
+        .size = (uint64_t)sbuf->st_size,
+
+        .mtime_sec = get_mtime_sec(sbuf),
+        .mtime_nsec = get_mtime_nsec(sbuf),
+
+        .digest = digest,
+
+        .output_path = path,
+        .output_path_length = output_path_length
+    };
+
+    const enum array_result add_entry_result =
+        array_add_item(&manifest->new_entries, sizeof(entry), &entry, NULL);
+
+    if (add_entry_result != E_ARRAY_OK) {
+        free(path);
+        return E_MANIFEST_ALLOC_FAIL;
+    }
+
+    return E_MANIFEST_OK;
+}
+
+enum manifest_result
+manifest_digest_file(const int fd, uint64_t *__notnull const digest_out) {
+    uint8_t buff[16384];
+
+    uint64_t digest = digest_basis;
+    off_t offset = 0;
+
+    do {
+        const ssize_t read_size = our_pread(fd, buff, sizeof(buff), offset);
+        if (read_size < 0) {
+            return E_MANIFEST_READ_FAIL;
+        }
+
+        if (read_size == 0) {
+            break;
+        }
+
+        digest = digest_bytes(digest, buff, (uint64_t)read_size);
+        offset += read_size;
+    } while (true);
+
+    *digest_out = digest;
+    return E_MANIFEST_OK;
+}
+
+static bool
+write_entry(FILE *__notnull const file,
+            const struct manifest_entry *__notnull const entry)
+{
+    /*
+     * Paths with a newline can't be stored in the manifest, and so are always
+     * parsed again.
+     */
+
+    const char *const path = entry->output_path;
+    if (memchr(path, '\n', entry->output_path_length) != NULL) {
+        return true;
+    }
+
+    const int result =
+        fprintf(file,
+                "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRId64 " %" PRId64
+                " %016" PRIx64 " %s\n",
+                entry->dev,
+                entry->ino,
+                entry->size,
+                entry->mtime_sec,
+                entry->mtime_nsec,
+                entry->digest,
+                path);
+
+    return (result >= 0);
+}
+
+static bool
+write_entries(const struct manifest *__notnull const manifest,
+              FILE *__notnull const file)
+{
+    const int header_result =
+        fprintf(file,
+                "%s%016" PRIx64 "\n",
+                manifest_header,
+                manifest->options_digest);
+
+    if (header_result < 0) {
+        return false;
+    }
+
+    const struct manifest_entry *entry = manifest->entries;
+    const struct manifest_entry *end = entry + manifest->entry_count;
+
+    for (; entry != end; entry++) {
+        if (!entry->is_unchanged) {
+            continue;
+        }
+
+        if (!write_entry(file, entry)) {
+            return false;
+        }
+    }
+
+    entry = manifest->new_entries.data;
+    end = entry + manifest->new_entries.item_count;
+
+    for (; entry != end; entry++) {
+        if (!write_entry(file, entry)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+enum manifest_result
+manifest_write(const struct manifest *__notnull const manifest,
+               const char *__notnull const path)
+{
+    const uint64_t path_length = strlen(path);
+    char *const tmp_path = malloc(path_length + sizeof(".tmp"));
+
+    if (tmp_path == NULL) {
+        return E_MANIFEST_ALLOC_FAIL;
+    }
+
+    memcpy(tmp_path, path, path_length);
+    memcpy(tmp_path + path_length, ".tmp", sizeof(".tmp"));
+
+    FILE *const file = fopen(tmp_path, "w");
+    if (file == NULL) {
+        free(tmp_path);
+        return E_MANIFEST_OPEN_FAIL;
+    }
+
+    const bool wrote_entries = write_entries(manifest, file);
+    if (fclose(file) != 0 || !wrote_entries) {
+        our_unlink(tmp_path);
+        free(tmp_path);
+
+        return E_MANIFEST_WRITE_FAIL;
+    }
+
+    if (rename(tmp_path, path) != 0) {
+        our_unlink(tmp_path);
+        free(tmp_path);
+
+        return E_MANIFEST_WRITE_FAIL;
+    }
+
+    free(tmp_path);
+    return E_MANIFEST_OK;
+}
+
+static void
+destroy_entries(struct manifest_entry *const entries, const uint64_t count) {
+    for (uint64_t i = 0; i != count; i++) {
+        free(entries[i].output_path);
+    }
+}
+
+void manifest_destroy(struct manifest *__notnull const manifest) {
+    destroy_entries(manifest->entries, manifest->entry_count);
+    destroy_entries(manifest->new_entries.data,
+                    manifest->new_entries.item_count);
+
+    free(manifest->entries);
+    free(manifest->buckets);
+
+    array_destroy(&manifest->new_entries);
+
+    manifest->entries = NULL;
+    manifest->entry_count = 0;
+
+    manifest->buckets = NULL;
+    manifest->bucket_count = 0;
+}
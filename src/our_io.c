@@ -6,14 +6,35 @@
 //  Copyright © 2019 - 2020 inoahdev. All rights reserved.
 //
 
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "notnull.h"
 #include "our_io.h"
+#include "unused.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <sched.h>
+
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define OUR_IO_USE_IO_URING
+#endif
+#endif
+#endif
 
 int our_open(const char *const path, const int flags, const int mode) {
     do {
@@ -47,6 +68,27 @@ int our_openat(const int dirfd, const char *const path, const int flags) {
     return -1;
 }
 
+int
+our_openat_with_mode(const int dirfd,
+                     const char *const path,
+                     const int flags,
+                     const int mode)
+{
+    do {
+#ifdef O_CLOEXEC
+        const int fd = openat(dirfd, path, flags | O_CLOEXEC, mode);
+#else
+        const int fd = openat(dirfd, path, flags, mode);
+#endif
+
+        if (fd != -1) {
+            return fd;
+        }
+    } while (errno == EINTR);
+
+    return -1;
+}
+
 int our_mkdir(const char *const path, const mode_t mode) {
     do {
         const int ret = mkdir(path, mode);
@@ -102,6 +144,33 @@ ssize_t our_read(const int fd, void *const buf, const size_t size) {
     return -1;
 }
 
+ssize_t
+our_pread(const int fd,
+          void *const buf,
+          const size_t size,
+          const off_t offset)
+{
+    do {
+        const ssize_t num = pread(fd, buf, size, offset);
+        if (num != -1) {
+            return num;
+        }
+    } while (errno == EINTR);
+
+    return -1;
+}
+
+ssize_t our_write(const int fd, const void *const buf, const size_t size) {
+    do {
+        const ssize_t num = write(fd, buf, size);
+        if (num != -1) {
+            return num;
+        }
+    } while (errno == EINTR);
+
+    return -1;
+}
+
 DIR *our_fdopendir(const int fd) {
     do {
         DIR *const dir = fdopendir(fd);
@@ -134,3 +203,418 @@ ssize_t our_getline(char **const lineptr, size_t *const n, FILE *const stream) {
 
     return 0;
 }
+
+static void read_one(struct our_io_read *__notnull const read) {
+    const ssize_t result =
+        our_pread(read->fd, read->buf, read->size, read->offset);
+
+    read->result = result;
+    read->error = (result < 0) ? errno : 0;
+}
+
+static void
+read_each(struct our_io_read *__notnull const reads, const uint64_t count) {
+    struct our_io_read *read = reads;
+    const struct our_io_read *const end = reads + count;
+
+    for (; read != end; read++) {
+        read_one(read);
+    }
+}
+
+/*
+ * The most reads we keep in flight at once.
+ */
+
+#define OUR_IO_MAX_BATCH_COUNT 64
+
+#if defined(OUR_IO_USE_IO_URING)
+
+static void *map_ring(const int ring_fd, const size_t size, const off_t off) {
+    void *const ring =
+        mmap(NULL,
+             size,
+             PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE,
+             ring_fd,
+             off);
+
+    if (ring == MAP_FAILED) {
+        return NULL;
+    }
+
+    return ring;
+}
+
+bool
+our_io_batch_init(struct our_io_batch *__notnull const batch,
+                  uint32_t entry_count)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->ring_fd = -1;
+
+    if (entry_count > OUR_IO_MAX_BATCH_COUNT) {
+        entry_count = OUR_IO_MAX_BATCH_COUNT;
+    }
+
+    struct io_uring_params params = {};
+    const long ring_fd = syscall(__NR_io_uring_setup, entry_count, &params);
+
+    if (ring_fd < 0) {
+        return false;
+    }
+
+    batch->ring_fd = (int)ring_fd;
+    batch->entry_count = params.sq_entries;
+
+    if (batch->entry_count > entry_count) {
+        batch->entry_count = entry_count;
+    }
+
+    batch->sq_ring_size =
+        params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+
+    batch->cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    batch->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    batch->sq_ring =
+        map_ring(batch->ring_fd, batch->sq_ring_size, IORING_OFF_SQ_RING);
+
+    batch->cq_ring =
+        map_ring(batch->ring_fd, batch->cq_ring_size, IORING_OFF_CQ_RING);
+
+    batch->sqes = map_ring(batch->ring_fd, batch->sqes_size, IORING_OFF_SQES);
+
+    if (batch->sq_ring == NULL ||
+        batch->cq_ring == NULL ||
+        batch->sqes == NULL)
+    {
+        our_io_batch_destroy(batch);
+        return false;
+    }
+
+    batch->sq_off_head = params.sq_off.head;
+    batch->sq_off_tail = params.sq_off.tail;
+    batch->sq_off_mask = params.sq_off.ring_mask;
+    batch->sq_off_array = params.sq_off.array;
+
+    batch->cq_off_head = params.cq_off.head;
+    batch->cq_off_tail = params.cq_off.tail;
+    batch->cq_off_mask = params.cq_off.ring_mask;
+    batch->cq_off_cqes = params.cq_off.cqes;
+
+    return true;
+}
+
+static inline uint32_t *
+get_ring_field(void *__notnull const ring, const uint32_t offset) {
+    return (uint32_t *)((uint8_t *)ring + offset);
+}
+
+/*
+ * Returns the number of completions reaped.
+ */
+
+static uint32_t
+reap_completions(struct our_io_batch *__notnull const batch,
+                 struct our_io_read *__notnull const reads,
+                 bool *__notnull const done)
+{
+    void *const cq_ring = batch->cq_ring;
+
+    uint32_t *const cq_head = get_ring_field(cq_ring, batch->cq_off_head);
+    uint32_t *const cq_tail = get_ring_field(cq_ring, batch->cq_off_tail);
+
+    const uint32_t mask = *get_ring_field(cq_ring, batch->cq_off_mask);
+    const struct io_uring_cqe *const cqes =
+        (const struct io_uring_cqe *)get_ring_field(cq_ring,
+                                                    batch->cq_off_cqes);
+
+    uint32_t head = *cq_head;
+    const uint32_t tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    uint32_t reaped = 0;
+    for (; head != tail; head++, reaped++) {
+        const struct io_uring_cqe *const cqe = cqes + (head & mask);
+        const uint64_t index = cqe->user_data;
+
+        struct our_io_read *const read = reads + index;
+        const int res = cqe->res;
+
+        /*
+         * Retry reads that were interrupted the same way our_pread() would.
+         */
+
+        if (res == -EINTR || res == -EAGAIN) {
+            read_one(read);
+        } else if (res < 0) {
+            read->result = -1;
+            read->error = -res;
+        } else {
+            read->result = res;
+            read->error = 0;
+        }
+
+        done[index] = true;
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+/*
+ * The number of times in a row io_uring_enter() may report being busy, with no
+ * reads in flight, before io_uring is no longer used.
+ */
+
+#define OUR_IO_MAX_BUSY_COUNT 16
+
+/*
+ * Wait until all submitted reads have completed, so their buffers are no
+ * longer written to by the kernel.
+ *
+ * Should io_uring_enter() fail even to wait, the completion-queue is polled
+ * directly. As no more than entry_count reads are ever in flight, and the
+ * completion-queue has room for at least as many, every completion is posted
+ * to it without io_uring_enter().
+ */
+
+static uint32_t
+wait_for_submitted(struct our_io_batch *__notnull const batch,
+                   struct our_io_read *__notnull const reads,
+                   bool *__notnull const done,
+                   const uint32_t in_flight)
+{
+    uint32_t completed = 0;
+    bool can_enter = true;
+
+    while (completed < in_flight) {
+        if (can_enter) {
+            const long result =
+                syscall(__NR_io_uring_enter,
+                        batch->ring_fd,
+                        0,
+                        in_flight - completed,
+                        IORING_ENTER_GETEVENTS,
+                        NULL,
+                        0);
+
+            if (result < 0) {
+                if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                    can_enter = false;
+                }
+            }
+        } else {
+            sched_yield();
+        }
+
+        completed += reap_completions(batch, reads, done);
+    }
+
+    return completed;
+}
+
+/*
+ * Submit count reads, at most entry_count, and wait for all of them to
+ * complete.
+ *
+ * Returns false if io_uring failed, in which case all reads that were
+ * submitted have still completed, and all other reads have been done one after
+ * another.
+ */
+
+static bool
+read_with_ring(struct our_io_batch *__notnull const batch,
+               struct our_io_read *__notnull const reads,
+               const uint32_t count)
+{
+    struct iovec iovs[OUR_IO_MAX_BATCH_COUNT];
+    bool done[OUR_IO_MAX_BATCH_COUNT] = {};
+
+    void *const sq_ring = batch->sq_ring;
+
+    uint32_t *const sq_tail = get_ring_field(sq_ring, batch->sq_off_tail);
+    uint32_t *const array = get_ring_field(sq_ring, batch->sq_off_array);
+
+    const uint32_t mask = *get_ring_field(sq_ring, batch->sq_off_mask);
+    struct io_uring_sqe *const sqes = (struct io_uring_sqe *)batch->sqes;
+
+    uint32_t tail = *sq_tail;
+    for (uint32_t i = 0; i != count; i++, tail++) {
+        const struct our_io_read *const read = reads + i;
+        struct iovec *const iov = iovs + i;
+
+        iov->iov_base = read->buf;
+        iov->iov_len = read->size;
+
+        const uint32_t index = tail & mask;
+        struct io_uring_sqe *const sqe = sqes + index;
+
+        memset(sqe, 0, sizeof(*sqe));
+
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = read->fd;
+        sqe->off = (uint64_t)read->offset;
+        sqe->addr = (uint64_t)(uintptr_t)iov;
+        sqe->len = 1;
+        sqe->user_data = i;
+
+        array[index] = index;
+    }
+
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+    uint32_t submitted = 0;
+    uint32_t completed = 0;
+    uint32_t busy_count = 0;
+
+    while (completed != count) {
+        /*
+         * Once all reads are submitted, only wait for them to complete.
+         */
+
+        const long result =
+            syscall(__NR_io_uring_enter,
+                    batch->ring_fd,
+                    count - submitted,
+                    1,
+                    IORING_ENTER_GETEVENTS,
+                    NULL,
+                    0);
+
+        if (result >= 0) {
+            busy_count = 0;
+            submitted += (uint32_t)result;
+            completed += reap_completions(batch, reads, done);
+
+            continue;
+        }
+
+        if (errno == EINTR) {
+            continue;
+        }
+
+        /*
+         * EAGAIN and EBUSY mean the kernel is short on resources, or the
+         * completion-queue is full, for now. Make room by waiting for reads
+         * already submitted, if any, before submitting again. With no reads
+         * in flight, only retry a few times before giving up on io_uring.
+         */
+
+        const uint32_t in_flight = submitted - completed;
+        if (errno == EAGAIN || errno == EBUSY) {
+            if (in_flight != 0) {
+                completed += wait_for_submitted(batch, reads, done, 1);
+                continue;
+            }
+
+            if (busy_count != OUR_IO_MAX_BUSY_COUNT) {
+                busy_count++;
+                sched_yield();
+
+                continue;
+            }
+        }
+
+        /*
+         * Reads still in flight would otherwise complete into buffers that
+         * are being read into again, or have already been handed back.
+         */
+
+        wait_for_submitted(batch, reads, done, in_flight);
+        for (uint32_t i = 0; i != count; i++) {
+            if (!done[i]) {
+                read_one(reads + i);
+            }
+        }
+
+        return false;
+    }
+
+    return true;
+}
+
+void
+our_io_batch_read(struct our_io_batch *__notnull const batch,
+                  struct our_io_read *__notnull const reads,
+                  const uint64_t count)
+{
+    if (batch->ring_fd < 0) {
+        read_each(reads, count);
+        return;
+    }
+
+    uint64_t index = 0;
+    while (index != count) {
+        uint64_t chunk_count = count - index;
+        if (chunk_count > batch->entry_count) {
+            chunk_count = batch->entry_count;
+        }
+
+        /*
+         * Should io_uring fail, simply stop using it, and do all other reads
+         * one after another.
+         */
+
+        struct our_io_read *const chunk = reads + index;
+        if (!read_with_ring(batch, chunk, (uint32_t)chunk_count)) {
+            our_io_batch_destroy(batch);
+            read_each(chunk + chunk_count, count - index - chunk_count);
+
+            return;
+        }
+
+        index += chunk_count;
+    }
+}
+
+void our_io_batch_destroy(struct our_io_batch *__notnull const batch) {
+    if (batch->sqes != NULL) {
+        munmap(batch->sqes, batch->sqes_size);
+    }
+
+    if (batch->cq_ring != NULL) {
+        munmap(batch->cq_ring, batch->cq_ring_size);
+    }
+
+    if (batch->sq_ring != NULL) {
+        munmap(batch->sq_ring, batch->sq_ring_size);
+    }
+
+    if (batch->ring_fd >= 0) {
+        close(batch->ring_fd);
+    }
+
+    memset(batch, 0, sizeof(*batch));
+    batch->ring_fd = -1;
+}
+
+#else
+
+bool
+our_io_batch_init(struct our_io_batch *__notnull const batch,
+                  const uint32_t entry_count)
+{
+    memset(batch, 0, sizeof(*batch));
+
+    batch->ring_fd = -1;
+    batch->entry_count = entry_count;
+
+    return false;
+}
+
+void
+our_io_batch_read(struct our_io_batch *__unused __notnull const batch,
+                  struct our_io_read *__notnull const reads,
+                  const uint64_t count)
+{
+    read_each(reads, count);
+}
+
+void our_io_batch_destroy(struct our_io_batch *__notnull const batch) {
+    batch->ring_fd = -1;
+}
+
+#endif
@@ -26,6 +26,7 @@
 #include "path.h"
 
 #include "recursive.h"
+#include "serve.h"
 #include "tbd_for_main.h"
 #include "tbd_write.h"
 #include "unused.h"
@@ -50,9 +51,29 @@ struct dsc_iterate_images_info {
     struct tbd_for_main *tbd;
     struct tbd_for_main *orig;
 
+    /*
+     * images is a list of pointers to every dyld_cache_image_info, sorted by
+     * address, and is only created if the cache has alias images (images that
+     * share an address with another image).
+     */
+
     struct array images;
     FILE *combine_file;
 
+    /*
+     * When not NULL, tbds are handed to write_queue to be written out on its
+     * writer thread, which must be drained before dsc_info is destroyed.
+     */
+
+    struct write_queue *write_queue;
+
+    /*
+     * merge_caches is a list of dsc_merge_cache structures, whose images are
+     * parsed into the same tbd as the matching image of dsc_info.
+     */
+
+    struct array merge_caches;
+
     macho_file_parse_error_callback callback;
     struct handle_dsc_image_parse_error_cb_info *callback_info;
 
@@ -64,6 +85,23 @@ struct dsc_iterate_images_info {
     struct string_buffer *export_trie_sb;
 };
 
+struct dsc_merge_image {
+    const char *path;
+    struct dyld_cache_image_info *image;
+};
+
+struct dsc_merge_cache {
+    struct dyld_shared_cache_info info;
+    const char *path;
+
+    /*
+     * images is a list of dsc_merge_image structures, sorted by path, to match
+     * the images of the main cache by install-name.
+     */
+
+    struct array images;
+};
+
 enum dyld_cache_image_info_pad {
     F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED = 1ull << 0
 };
@@ -185,19 +223,26 @@ open_file_for_path(struct dsc_iterate_images_info *__notnull const info,
         return file;
     }
 
-    const enum tbd_for_main_open_write_file_result open_file_result =
-        tbd_for_main_open_write_file_for_path(tbd,
-                                              path,
-                                              path_length,
-                                              &file,
-                                              terminator_out);
+    enum tbd_for_main_open_write_file_result open_file_result =
+        E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK;
+
+    if (tbd->options.write_archive) {
+        open_file_result = tbd_for_main_open_archive(tbd, &file);
+    } else {
+        open_file_result =
+            tbd_for_main_open_write_file_for_path(tbd,
+                                                  path,
+                                                  path_length,
+                                                  &file,
+                                                  terminator_out);
+    }
 
     if (open_file_result != E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK) {
         print_write_file_result(info, tbd, open_file_result);
         return NULL;
     }
 
-    if (should_combine) {
+    if (should_combine || tbd->options.write_archive) {
         info->combine_file = file;
     }
 
@@ -225,14 +270,42 @@ write_to_path(struct dsc_iterate_images_info *__notnull const iterate_info,
         return;
     }
 
+    char *target_path = write_path;
+    uint64_t target_path_length = write_path_length;
+
+    const bool to_archive = tbd->options.write_archive;
+    if (to_archive) {
+        target_path =
+            tbd_for_main_get_archive_member_name(tbd,
+                                                 write_path,
+                                                 write_path_length,
+                                                 &target_path_length);
+    }
+
+    const bool close_file = !should_combine && !to_archive;
+    struct write_queue *const write_queue = iterate_info->write_queue;
+
+    if (write_queue != NULL) {
+        write_queue_add_job(write_queue,
+                            tbd,
+                            file,
+                            target_path,
+                            target_path_length,
+                            terminator,
+                            close_file,
+                            iterate_info->print_paths);
+
+        return;
+    }
+
     tbd_for_main_write_to_file(tbd,
-                               write_path,
-                               write_path_length,
+                               target_path,
+                               target_path_length,
                                terminator,
                                file,
                                iterate_info->print_paths);
 
-    if (!should_combine) {
+    if (close_file) {
         fclose(file);
     }
 }
@@ -430,57 +503,25 @@ write_out_tbd_info(struct dsc_iterate_images_info *__notnull const info,
     }
 }
 
-static int
-actually_parse_image(
-    struct dsc_iterate_images_info *__notnull const iterate_info,
-    struct dyld_cache_image_info *__notnull const image,
-    const char *const image_path)
-{
-    struct tbd_for_main *const tbd = iterate_info->tbd;
-    struct tbd_for_main *const orig = iterate_info->orig;
-
-    struct tbd_create_info *const info = &tbd->info;
-    struct handle_dsc_image_parse_error_cb_info *const cb_info =
-        iterate_info->callback_info;
-
-    cb_info->image_path = image_path;
-    cb_info->did_print_messages_header =
-        iterate_info->did_print_messages_header;
-
-    struct dsc_image_parse_options options = {};
-    const enum dsc_image_parse_result parse_image_result =
-        dsc_image_parse(info,
-                        iterate_info->dsc_info,
-                        image,
-                        iterate_info->callback,
-                        cb_info,
-                        iterate_info->export_trie_sb,
-                        tbd->macho_options,
-                        tbd->parse_options,
-                        options);
-
-    iterate_info->did_print_messages_header =
-        cb_info->did_print_messages_header;
-
-    if (parse_image_result != E_DSC_IMAGE_PARSE_OK) {
-        tbd_create_info_clear_fields_and_create_from(info, &orig->info);
-        print_image_error(iterate_info, image_path, parse_image_result);
-
-        return 1;
-    }
-
-    tbd_for_main_handle_post_parse(tbd);
+/*
+ * The number of images ahead of the current image that we ask the kernel to
+ * start reading in, so that the page-faults of upcoming images overlap with the
+ * parsing and writing of the current image.
+ */
 
-    uint64_t image_path_length = iterate_info->image_path_length;
-    if (image_path_length == 0) {
-        image_path_length = strlen(image_path);
-        iterate_info->image_path_length = image_path_length;
-    }
+static const uint32_t dsc_image_prefetch_count = 4;
 
-    write_out_tbd_info(iterate_info, tbd, image_path, image_path_length);
-    tbd_create_info_clear_fields_and_create_from(info, &orig->info);
+static void
+advise_image(const struct dyld_shared_cache_info *__notnull const dsc_info,
+             const struct dyld_cache_image_info *__notnull const image,
+             const enum dyld_shared_cache_advice advice)
+{
+    struct dsc_image_ranges ranges = {};
+    dsc_image_get_ranges(dsc_info, image, &ranges);
 
-    return 0;
+    dyld_shared_cache_advise_range(dsc_info, ranges.load_commands, advice);
+    dyld_shared_cache_advise_range(dsc_info, ranges.export_trie, advice);
+    dyld_shared_cache_advise_range(dsc_info, ranges.symbol_table, advice);
 }
 
 static bool
@@ -557,6 +598,506 @@ should_parse_image(struct dsc_iterate_images_info *__notnull const info,
     return should_parse;
 }
 
+static int
+image_address_comparator(const void *__notnull const left,
+                         const void *__notnull const right)
+{
+    const struct dyld_cache_image_info *const left_image =
+        *(const struct dyld_cache_image_info *const *)left;
+
+    const struct dyld_cache_image_info *const right_image =
+        *(const struct dyld_cache_image_info *const *)right;
+
+    const uint64_t left_address = left_image->address;
+    const uint64_t right_address = right_image->address;
+
+    if (left_address != right_address) {
+        return (left_address > right_address) ? 1 : -1;
+    }
+
+    /*
+     * Keep images of the same address in the order they appear in the cache.
+     */
+
+    if (left_image != right_image) {
+        return (left_image > right_image) ? 1 : -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Caches contain alias images (such as symlinked framework paths), which are
+ * separate dyld_cache_image_info entries sharing the same address, and
+ * therefore the same mach-o data.
+ *
+ * To avoid parsing the same mach-o multiple times, we group the images by
+ * address, and write out the tbd of one parsed image for all its aliases.
+ *
+ * If the cache has no aliases, the list is left empty.
+ */
+
+static int
+create_image_aliases_list(
+    const struct dyld_shared_cache_info *__notnull const dsc_info,
+    struct array *__notnull const list)
+{
+    const uint64_t images_count = dsc_info->images_count;
+    const enum array_result ensure_capacity_result =
+        array_ensure_item_capacity(list,
+                                   sizeof(struct dyld_cache_image_info *),
+                                   images_count);
+
+    if (ensure_capacity_result != E_ARRAY_OK) {
+        return 1;
+    }
+
+    struct dyld_cache_image_info **ptr = list->data;
+
+    struct dyld_cache_image_info *image = dsc_info->images;
+    const struct dyld_cache_image_info *const end = image + images_count;
+
+    for (; image != end; image++, ptr++) {
+        *ptr = image;
+    }
+
+    array_trim_to_item_count(list,
+                             sizeof(struct dyld_cache_image_info *),
+                             images_count);
+
+    array_sort_with_comparator(list,
+                               sizeof(struct dyld_cache_image_info *),
+                               image_address_comparator);
+
+    const struct dyld_cache_image_info *const *iter = list->data;
+    const struct dyld_cache_image_info *const *const list_end = list->data_end;
+
+    for (iter++; iter < list_end; iter++) {
+        if (iter[0]->address == iter[-1]->address) {
+            return 0;
+        }
+    }
+
+    array_destroy(list);
+    return 0;
+}
+
+static void
+write_out_tbd_info_for_aliases(
+    struct dsc_iterate_images_info *__notnull const iterate_info,
+    struct tbd_for_main *__notnull const tbd,
+    struct dyld_cache_image_info *__notnull const image)
+{
+    const struct array *const list = &iterate_info->images;
+    if (list->item_count == 0) {
+        return;
+    }
+
+    struct dyld_cache_image_info *const *const found =
+        array_find_item_in_sorted(list,
+                                  sizeof(struct dyld_cache_image_info *),
+                                  &image,
+                                  image_address_comparator,
+                                  NULL);
+
+    if (found == NULL) {
+        return;
+    }
+
+    struct dyld_cache_image_info *const *const front = list->data;
+    struct dyld_cache_image_info *const *const back = list->data_end;
+
+    /*
+     * Find the first image of the alias-group, as our image may be anywhere
+     * within the group.
+     */
+
+    struct dyld_cache_image_info *const *iter = found;
+    while (iter != front && iter[-1]->address == image->address) {
+        iter--;
+    }
+
+    const struct dyld_shared_cache_info *const dsc_info =
+        iterate_info->dsc_info;
+
+    const uint8_t *const map = dsc_info->map;
+    const struct array *const filters = &tbd->dsc_image_filters;
+
+    for (; iter != back && (*iter)->address == image->address; iter++) {
+        struct dyld_cache_image_info *const alias = *iter;
+        if (alias == image) {
+            continue;
+        }
+
+        if (alias->pad & F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED) {
+            continue;
+        }
+
+        const char *const alias_path =
+            (const char *)(map + alias->pathFileOffset);
+
+        if (unlikely(alias_path[0] == '\0')) {
+            continue;
+        }
+
+        iterate_info->image_path = alias_path;
+        iterate_info->image_path_length = 0;
+
+        if (!iterate_info->parse_all_images) {
+            if (!should_parse_image(iterate_info, filters, alias_path)) {
+                continue;
+            }
+        }
+
+        uint64_t alias_path_length = iterate_info->image_path_length;
+        if (alias_path_length == 0) {
+            alias_path_length = strlen(alias_path);
+            iterate_info->image_path_length = alias_path_length;
+        }
+
+        write_out_tbd_info(iterate_info, tbd, alias_path, alias_path_length);
+        alias->pad |= F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED;
+    }
+}
+
+static int
+merge_image_comparator(const void *__notnull const left,
+                       const void *__notnull const right)
+{
+    const struct dsc_merge_image *const left_image =
+        (const struct dsc_merge_image *)left;
+
+    const struct dsc_merge_image *const right_image =
+        (const struct dsc_merge_image *)right;
+
+    return strcmp(left_image->path, right_image->path);
+}
+
+/*
+ * Parse the image with the same path as image_path from every merge cache into
+ * the tbd of the main cache's image, with each merge cache's arch becoming
+ * another target of the tbd.
+ *
+ * Images that do not exist in a merge cache are simply skipped.
+ */
+
+static int
+parse_image_from_merge_caches(
+    struct dsc_iterate_images_info *__notnull const iterate_info,
+    const char *__notnull const image_path)
+{
+    struct tbd_for_main *const tbd = iterate_info->tbd;
+    struct tbd_create_info *const info = &tbd->info;
+
+    struct dsc_merge_cache *cache = iterate_info->merge_caches.data;
+    const struct dsc_merge_cache *const end =
+        iterate_info->merge_caches.data_end;
+
+    const struct dsc_merge_image key = {
+        .path = image_path
+    };
+
+    for (; cache != end; cache++) {
+        const struct dsc_merge_image *const merge_image =
+            array_find_item_in_sorted(&cache->images,
+                                      sizeof(struct dsc_merge_image),
+                                      &key,
+                                      merge_image_comparator,
+                                      NULL);
+
+        if (merge_image == NULL) {
+            continue;
+        }
+
+        /*
+         * Every symbol's targets are stored as a bit-list of indices into the
+         * target-list, so the merge cache's target will be the next index.
+         */
+
+        cache->info.arch_index = info->fields.targets.set_count;
+
+        struct dsc_image_parse_options options = {};
+        const enum dsc_image_parse_result parse_image_result =
+            dsc_image_parse(info,
+                            &cache->info,
+                            merge_image->image,
+                            iterate_info->callback,
+                            iterate_info->callback_info,
+                            iterate_info->export_trie_sb,
+                            tbd->macho_options,
+                            tbd->parse_options,
+                            options);
+
+        iterate_info->did_print_messages_header =
+            iterate_info->callback_info->did_print_messages_header;
+
+        if (parse_image_result != E_DSC_IMAGE_PARSE_OK) {
+            print_image_error(iterate_info, image_path, parse_image_result);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void destroy_merge_caches(struct array *__notnull const caches) {
+    struct dsc_merge_cache *cache = caches->data;
+    const struct dsc_merge_cache *const end = caches->data_end;
+
+    for (; cache != end; cache++) {
+        dyld_shared_cache_info_destroy(&cache->info);
+        array_destroy(&cache->images);
+    }
+
+    array_destroy(caches);
+}
+
+static int
+create_merge_images_list(struct dsc_merge_cache *__notnull const cache) {
+    const struct dyld_shared_cache_info *const dsc_info = &cache->info;
+    const uint64_t images_count = dsc_info->images_count;
+
+    struct array *const list = &cache->images;
+    const enum array_result ensure_capacity_result =
+        array_ensure_item_capacity(list,
+                                   sizeof(struct dsc_merge_image),
+                                   images_count);
+
+    if (ensure_capacity_result != E_ARRAY_OK) {
+        return 1;
+    }
+
+    struct dsc_merge_image *ptr = list->data;
+
+    struct dyld_cache_image_info *image = dsc_info->images;
+    const struct dyld_cache_image_info *const end = image + images_count;
+
+    for (; image != end; image++, ptr++) {
+        ptr->path = (const char *)(dsc_info->map + image->pathFileOffset);
+        ptr->image = image;
+    }
+
+    array_trim_to_item_count(list,
+                             sizeof(struct dsc_merge_image),
+                             images_count);
+
+    array_sort_with_comparator(list,
+                               sizeof(struct dsc_merge_image),
+                               merge_image_comparator);
+
+    return 0;
+}
+
+static bool
+merge_cache_has_arch(const struct dyld_shared_cache_info *__notnull const main,
+                     const struct array *__notnull const caches,
+                     const struct arch_info *__notnull const arch)
+{
+    if (main->arch == arch) {
+        return true;
+    }
+
+    const struct dsc_merge_cache *cache = caches->data;
+    const struct dsc_merge_cache *const end = caches->data_end;
+
+    for (; cache != end; cache++) {
+        if (cache->info.arch == arch) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int
+open_merge_cache(const struct tbd_for_main *__notnull const tbd,
+                 const struct dyld_shared_cache_info *__notnull const main,
+                 const char *__notnull const path,
+                 struct array *__notnull const caches)
+{
+    const int fd = our_open(path, O_RDONLY, 0);
+    if (fd < 0) {
+        fprintf(stderr,
+                "Failed to open dyld_shared_cache file to merge (at path %s), "
+                "error: %s\n",
+                path,
+                strerror(errno));
+
+        return 1;
+    }
+
+    struct magic_buffer magic_buffer = {};
+    const enum magic_buffer_result get_magic_result =
+        magic_buffer_read_n(&magic_buffer, fd, 16);
+
+    if (get_magic_result != E_MAGIC_BUFFER_OK) {
+        handle_dsc_file_parse_result(path,
+                                     NULL,
+                                     E_DYLD_SHARED_CACHE_PARSE_READ_FAIL,
+                                     true,
+                                     false);
+
+        close(fd);
+        return 1;
+    }
+
+    struct dsc_merge_cache cache = {
+        .path = path
+    };
+
+    /*
+     * The mapping of a dyld_shared_cache file stays valid after its
+     * file-descriptor is closed.
+     */
+
+    const enum dyld_shared_cache_parse_result parse_dsc_file_result =
+        dyld_shared_cache_parse_from_file(&cache.info,
+                                          fd,
+                                          (const char *)magic_buffer.buff,
+                                          tbd->dsc_options);
+
+    close(fd);
+
+    if (parse_dsc_file_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        handle_dsc_file_parse_result(path,
+                                     NULL,
+                                     parse_dsc_file_result,
+                                     true,
+                                     false);
+
+        return 1;
+    }
+
+    if (merge_cache_has_arch(main, caches, cache.info.arch)) {
+        fprintf(stderr,
+                "dyld_shared_cache file to merge (at path %s) has the same "
+                "architecture (%s) as another provided dyld_shared_cache "
+                "file\n",
+                path,
+                cache.info.arch->name);
+
+        dyld_shared_cache_info_destroy(&cache.info);
+        return 1;
+    }
+
+    if (create_merge_images_list(&cache)) {
+        fputs("Experienced an array failure while trying to order images of "
+              "a dyld_shared_cache file to merge\n",
+              stderr);
+
+        dyld_shared_cache_info_destroy(&cache.info);
+        return 1;
+    }
+
+    const enum array_result add_cache_result =
+        array_add_item(caches, sizeof(cache), &cache, NULL);
+
+    if (add_cache_result != E_ARRAY_OK) {
+        fputs("Experienced an array failure while trying to add a "
+              "dyld_shared_cache file to merge\n",
+              stderr);
+
+        dyld_shared_cache_info_destroy(&cache.info);
+        array_destroy(&cache.images);
+
+        return 1;
+    }
+
+    return 0;
+}
+
+static int
+open_merge_caches(const struct tbd_for_main *__notnull const tbd,
+                  const struct dyld_shared_cache_info *__notnull const main,
+                  struct array *__notnull const caches)
+{
+    const char *const *path = tbd->dsc_merge_paths.data;
+    const char *const *const end = tbd->dsc_merge_paths.data_end;
+
+    for (; path != end; path++) {
+        if (open_merge_cache(tbd, main, *path, caches)) {
+            destroy_merge_caches(caches);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int
+actually_parse_image(
+    struct dsc_iterate_images_info *__notnull const iterate_info,
+    struct dyld_cache_image_info *__notnull const image,
+    const char *const image_path)
+{
+    struct tbd_for_main *const tbd = iterate_info->tbd;
+    struct tbd_for_main *const orig = iterate_info->orig;
+
+    struct tbd_create_info *const info = &tbd->info;
+    struct handle_dsc_image_parse_error_cb_info *const cb_info =
+        iterate_info->callback_info;
+
+    cb_info->image_path = image_path;
+    cb_info->did_print_messages_header =
+        iterate_info->did_print_messages_header;
+
+    struct dsc_image_parse_options options = {};
+    const enum dsc_image_parse_result parse_image_result =
+        dsc_image_parse(info,
+                        iterate_info->dsc_info,
+                        image,
+                        iterate_info->callback,
+                        cb_info,
+                        iterate_info->export_trie_sb,
+                        tbd->macho_options,
+                        tbd->parse_options,
+                        options);
+
+    iterate_info->did_print_messages_header =
+        cb_info->did_print_messages_header;
+
+    /*
+     * Every image's data is only ever parsed once, so we let the kernel know
+     * it can reclaim the pages we just read through.
+     */
+
+    advise_image(iterate_info->dsc_info,
+                 image,
+                 DYLD_SHARED_CACHE_ADVICE_DONT_NEED);
+
+    if (parse_image_result != E_DSC_IMAGE_PARSE_OK) {
+        tbd_create_info_clear_fields_and_create_from(info, &orig->info);
+        print_image_error(iterate_info, image_path, parse_image_result);
+
+        return 1;
+    }
+
+    if (parse_image_from_merge_caches(iterate_info, image_path)) {
+        tbd_create_info_clear_fields_and_create_from(info, &orig->info);
+        return 1;
+    }
+
+    tbd_for_main_handle_post_parse(tbd);
+
+    uint64_t image_path_length = iterate_info->image_path_length;
+    if (image_path_length == 0) {
+        image_path_length = strlen(image_path);
+        iterate_info->image_path_length = image_path_length;
+    }
+
+    write_out_tbd_info(iterate_info, tbd, image_path, image_path_length);
+    write_out_tbd_info_for_aliases(iterate_info, tbd, image);
+
+    struct write_queue *const write_queue = iterate_info->write_queue;
+    if (write_queue != NULL) {
+        write_queue_submit(write_queue, tbd, &orig->info);
+        return 0;
+    }
+
+    tbd_create_info_clear_fields_and_create_from(info, &orig->info);
+    return 0;
+}
+
 static void
 unmark_happening_filters(const struct array *__notnull const list) {
     struct tbd_for_main_dsc_image_filter *filter = list->data;
@@ -704,7 +1245,44 @@ dsc_iterate_images(
     struct dyld_cache_image_info *image = dsc_info->images;
     const struct dyld_cache_image_info *const end = image + images_count;
 
+    /*
+     * If we fail to create the aliases list, we simply parse every alias on its
+     * own, as we would otherwise.
+     */
+
+    if (create_image_aliases_list(dsc_info, &info->images)) {
+        array_destroy(&info->images);
+    }
+
+    /*
+     * When parsing all images, we know exactly which images come next, and so
+     * we can prefetch their data ahead of time.
+     */
+
+    const bool prefetch = info->parse_all_images;
+    if (prefetch) {
+        uint64_t count = dsc_image_prefetch_count;
+        if (count > images_count) {
+            count = images_count;
+        }
+
+        for (uint64_t i = 0; i != count; i++) {
+            advise_image(dsc_info,
+                         image + i,
+                         DYLD_SHARED_CACHE_ADVICE_WILL_NEED);
+        }
+    }
+
     for (uint32_t i = 0; image != end; i++, image++) {
+        if (prefetch) {
+            const uint64_t next_index = i + dsc_image_prefetch_count;
+            if (next_index < images_count) {
+                advise_image(dsc_info,
+                             dsc_info->images + next_index,
+                             DYLD_SHARED_CACHE_ADVICE_WILL_NEED);
+            }
+        }
+
         if (image->pad & F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED) {
             continue;
         }
@@ -749,6 +1327,7 @@ dsc_iterate_images(
         image->pad |= F_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED;
     }
 
+    array_destroy(&info->images);
     print_dsc_warnings(info, filters);
 }
 
@@ -909,6 +1488,42 @@ static void verify_write_path(struct tbd_for_main *__notnull const tbd) {
     return;
 }
 
+/*
+ * The tbds still queued may point into the dyld_shared_cache's map, so they
+ * have to be written out before the map is destroyed.
+ */
+
+static void
+finish_write_queue(struct write_queue *const queue, const bool owns_queue) {
+    if (queue == NULL) {
+        return;
+    }
+
+    if (owns_queue) {
+        write_queue_finish(queue);
+    } else {
+        write_queue_drain(queue);
+    }
+}
+
+/*
+ * When running a request for tbd --serve, the server may have already mapped
+ * the dyld_shared_cache file.
+ */
+
+static enum dyld_shared_cache_parse_result
+parse_dsc_file(struct dyld_shared_cache_info *__notnull const info,
+               const int fd,
+               const char *__notnull const magic,
+               const struct dyld_shared_cache_parse_options options)
+{
+    if (serve_find_mapped_dsc(fd, options, info)) {
+        return E_DYLD_SHARED_CACHE_PARSE_OK;
+    }
+
+    return dyld_shared_cache_parse_from_file(info, fd, magic, options);
+}
+
 enum parse_dsc_for_main_result
 parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
     const enum magic_buffer_result get_magic_result =
@@ -929,10 +1544,10 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
 
     struct dyld_shared_cache_info dsc_info = {};
     const enum dyld_shared_cache_parse_result parse_dsc_file_result =
-        dyld_shared_cache_parse_from_file(&dsc_info,
-                                          args.fd,
-                                          (const char *)args.magic_buffer->buff,
-                                          dsc_options);
+        parse_dsc_file(&dsc_info,
+                       args.fd,
+                       (const char *)args.magic_buffer->buff,
+                       dsc_options);
 
     if (parse_dsc_file_result == E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE) {
         if (args.dont_handle_non_dsc_error) {
@@ -961,10 +1576,36 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
     if (args.tbd->options.combine_tbds) {
         args.tbd->flags.dsc_write_path_is_file = true;
         args.tbd->write_options.ignore_footer = true;
-    } else if (args.options.verify_write_path) {
+    } else if (args.options.verify_write_path &&
+               !args.tbd->options.write_archive)
+    {
         verify_write_path(args.tbd);
     }
 
+    struct array merge_caches = {};
+    if (args.tbd->dsc_merge_paths.item_count != 0) {
+        if (open_merge_caches(args.tbd, &dsc_info, &merge_caches)) {
+            dyld_shared_cache_info_destroy(&dsc_info);
+            return E_PARSE_DSC_FOR_MAIN_OTHER_ERROR;
+        }
+    }
+
+    /*
+     * Write out the tbds of the images on a separate thread when writing to
+     * files, so writing out one image's tbd overlaps with parsing the next.
+     */
+
+    struct write_queue write_queue = {};
+    struct write_queue *queue = args.write_queue;
+
+    bool owns_queue = false;
+    if (queue == NULL && args.tbd->write_path != NULL) {
+        if (write_queue_start(&write_queue) == E_WRITE_QUEUE_OK) {
+            queue = &write_queue;
+            owns_queue = true;
+        }
+    }
+
     struct handle_dsc_image_parse_error_cb_info cb_info = {
         .orig = args.orig,
         .tbd = args.tbd,
@@ -986,6 +1627,9 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
         .orig = args.orig,
 
         .combine_file = args.combine_file,
+        .write_queue = queue,
+        .merge_caches = merge_caches,
+
         .retained = args.retained,
 
         .callback = handle_dsc_image_parse_error_callback,
@@ -1059,7 +1703,10 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
          */
 
         if (filters->item_count == 0) {
+            finish_write_queue(queue, owns_queue);
             print_dsc_warnings(&iterate_info, filters);
+
+            destroy_merge_caches(&iterate_info.merge_caches);
             dyld_shared_cache_info_destroy(&dsc_info);
 
             return E_PARSE_DSC_FOR_MAIN_OK;
@@ -1083,6 +1730,9 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
      */
 
     dsc_iterate_images(&dsc_info, &iterate_info);
+    finish_write_queue(queue, owns_queue);
+
+    destroy_merge_caches(&iterate_info.merge_caches);
     dyld_shared_cache_info_destroy(&dsc_info);
 
     /*
@@ -1097,8 +1747,13 @@ parse_dsc_for_main(const struct parse_dsc_for_main_args args) {
      */
 
     FILE *const combine_file = iterate_info.combine_file;
-    if (combine_file != NULL) {
-        if (tbd_write_footer(combine_file)) {
+    if (combine_file != NULL && args.tbd->options.write_archive) {
+        if (tbd_for_main_close_archive(args.tbd, combine_file)) {
+            fputs("Failed to write the end of the archive\n", stderr);
+            return E_PARSE_DSC_FOR_MAIN_CLOSE_COMBINE_FILE_FAIL;
+        }
+    } else if (combine_file != NULL) {
+        if (tbd_write_footer_to_file(combine_file)) {
             if (args.print_paths) {
                 fprintf(stderr,
                         "Failed to write footer for combined .tbd file for "
@@ -1146,10 +1801,7 @@ parse_dsc_for_main_while_recursing(
 
     struct dyld_shared_cache_info dsc_info = {};
     const enum dyld_shared_cache_parse_result parse_dsc_file_result =
-        dyld_shared_cache_parse_from_file(&dsc_info,
-                                          args->fd,
-                                          magic,
-                                          dsc_options);
+        parse_dsc_file(&dsc_info, args->fd, magic, dsc_options);
 
     if (parse_dsc_file_result == E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE) {
         if (args->dont_handle_non_dsc_error) {
@@ -1178,7 +1830,9 @@ parse_dsc_for_main_while_recursing(
     if (tbd->options.combine_tbds) {
         tbd->flags.dsc_write_path_is_file = true;
         tbd->write_options.ignore_footer = true;
-    } else if (args->options.verify_write_path) {
+    } else if (args->options.verify_write_path &&
+               !tbd->options.write_archive)
+    {
         verify_write_path(tbd);
     }
 
@@ -1229,6 +1883,7 @@ parse_dsc_for_main_while_recursing(
         .orig = orig,
 
         .combine_file = args->combine_file,
+        .write_queue = args->write_queue,
         .retained = args->retained,
 
         .callback = handle_dsc_image_parse_error_callback,
@@ -1304,6 +1959,7 @@ parse_dsc_for_main_while_recursing(
         const uint64_t filters_count = filters->item_count;
         if (filters_count == 0) {
             free(write_path);
+            finish_write_queue(args->write_queue, false);
 
             print_dsc_warnings(&iterate_info, filters);
             dyld_shared_cache_info_destroy(&dsc_info);
@@ -1331,6 +1987,8 @@ parse_dsc_for_main_while_recursing(
      */
 
     dsc_iterate_images(&dsc_info, &iterate_info);
+    finish_write_queue(args->write_queue, false);
+
     dyld_shared_cache_info_destroy(&dsc_info);
 
     /*
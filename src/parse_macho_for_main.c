@@ -22,10 +22,11 @@
 #include "recursive.h"
 #include "tbd.h"
 #include "tbd_for_main.h"
+#include "util.h"
 
 static void verify_write_path(const struct tbd_for_main *__notnull const tbd) {
     const char *const write_path = tbd->write_path;
-    if (write_path == NULL) {
+    if (write_path == NULL || tbd->flags.archive_to_stdout) {
         return;
     }
 
@@ -67,12 +68,19 @@ open_file_for_path(const struct parse_macho_for_main_args *__notnull const args,
     FILE *file = NULL;
 
     const struct tbd_for_main *const tbd = args->tbd;
-    const enum tbd_for_main_open_write_file_result open_file_result =
-        tbd_for_main_open_write_file_for_path(tbd,
-                                              write_path,
-                                              write_path_length,
-                                              &file,
-                                              terminator_out);
+    enum tbd_for_main_open_write_file_result open_file_result =
+        E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK;
+
+    if (tbd->options.write_archive) {
+        open_file_result = tbd_for_main_open_archive(tbd, &file);
+    } else {
+        open_file_result =
+            tbd_for_main_open_write_file_for_path(tbd,
+                                                  write_path,
+                                                  write_path_length,
+                                                  &file,
+                                                  terminator_out);
+    }
 
     switch (open_file_result) {
         case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK:
@@ -127,12 +135,22 @@ open_file_for_path_while_recursing(struct parse_macho_for_main_args *const args,
     }
 
     const struct tbd_for_main *const tbd = args->tbd;
-    const enum tbd_for_main_open_write_file_result open_file_result =
-        tbd_for_main_open_write_file_for_path(tbd,
-                                              write_path,
-                                              write_path_length,
-                                              &file,
-                                              terminator_out);
+    const char *path = write_path;
+
+    enum tbd_for_main_open_write_file_result open_file_result =
+        E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK;
+
+    if (tbd->options.write_archive) {
+        path = tbd->write_path;
+        open_file_result = tbd_for_main_open_archive(tbd, &file);
+    } else {
+        open_file_result =
+            tbd_for_main_open_write_file_for_path(tbd,
+                                                  write_path,
+                                                  write_path_length,
+                                                  &file,
+                                                  terminator_out);
+    }
 
     switch (open_file_result) {
         case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK:
@@ -141,7 +159,7 @@ open_file_for_path_while_recursing(struct parse_macho_for_main_args *const args,
         case E_TBD_FOR_MAIN_OPEN_WRITE_FILE_FAILED:
             fprintf(stderr,
                     "Failed to open write-file (at path: %s), error: %s\n",
-                    write_path,
+                    path,
                     strerror(errno));
 
             return NULL;
@@ -153,26 +171,198 @@ open_file_for_path_while_recursing(struct parse_macho_for_main_args *const args,
 
             fprintf(stderr,
                     "File at write-path (%s) already exists\n",
-                    write_path);
+                    path);
 
             return NULL;
     }
 
-    if (tbd->options.combine_tbds) {
+    if (tbd->options.combine_tbds || tbd->options.write_archive) {
         args->combine_file = file;
     }
 
     return file;
 }
 
-enum parse_macho_for_main_result
-parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
-    struct macho_file macho = {};
-    struct range range = {};
+/*
+ * Write the tbd of a single file out as the only member of an archive, named
+ * after the file.
+ */
 
-    const enum macho_file_open_result open_macho_result =
-        macho_file_open(&macho, args.magic_buffer, args.fd, range);
+static void
+write_to_archive(const struct parse_macho_for_main_args *__notnull const args,
+                 FILE *__notnull const file)
+{
+    const struct tbd_for_main *const tbd = args->tbd;
+
+    const char *const path = args->dir_path;
+    const uint64_t path_length = args->dir_path_length;
+
+    const char *name = find_last_slash(path, path + path_length);
+    if (name != NULL) {
+        name += 1;
+    } else {
+        name = path;
+    }
+
+    const uint64_t name_length = (uint64_t)(path + path_length - name);
+
+    uint64_t write_path_length = 0;
+    char *const write_path =
+        tbd_for_main_create_write_path(tbd,
+                                       name,
+                                       name_length,
+                                       "tbd",
+                                       3,
+                                       &write_path_length);
+
+    uint64_t member_length = 0;
+    char *const member =
+        tbd_for_main_get_archive_member_name(tbd,
+                                             write_path,
+                                             write_path_length,
+                                             &member_length);
+
+    tbd_for_main_write_to_file(tbd,
+                               member,
+                               member_length,
+                               NULL,
+                               file,
+                               args->print_paths);
+
+    free(write_path);
+
+    if (tbd_for_main_close_archive(tbd, file)) {
+        fputs("Failed to write the end of the archive\n", stderr);
+    }
+}
+
+/*
+ * Create the cache-key for the file in args, returning the fd of the entry
+ * stored for it, or -1 if the file has to be parsed.
+ */
+
+static int
+open_result_cache_entry(struct parse_macho_for_main_args *__notnull const args)
+{
+    const struct result_cache *const cache = args->result_cache;
+    if (cache == NULL || args->has_cache_key) {
+        return -1;
+    }
+
+    const struct tbd_for_main *const orig = args->orig;
+    if (!result_cache_can_cache(orig)) {
+        return -1;
+    }
+
+    const enum result_cache_result create_key_result =
+        result_cache_create_key(orig, args->fd, &args->cache_key);
+
+    if (create_key_result != E_RESULT_CACHE_OK) {
+        return -1;
+    }
+
+    args->has_cache_key = true;
+    return result_cache_open_entry(cache, &args->cache_key);
+}
+
+static bool
+write_result_cache_entry(
+    const struct parse_macho_for_main_args *__notnull const args,
+    const int entry_fd,
+    FILE *__notnull const file,
+    char *__notnull const write_path,
+    const uint64_t write_path_length,
+    char *const terminator)
+{
+    const struct tbd_for_main_options options = args->tbd->options;
+    const enum result_cache_result write_entry_result =
+        result_cache_write_entry(entry_fd, file, options.write_if_changed);
+
+    if (write_entry_result == E_RESULT_CACHE_OK) {
+        return true;
+    }
+
+    if (!options.ignore_warnings) {
+        if (args->print_paths) {
+            fprintf(stderr,
+                    "Failed to write to write-file (at path %s)\n",
+                    write_path);
+        } else {
+            fputs("Failed to write to provided write-file\n", stderr);
+        }
+    }
+
+    if (terminator != NULL) {
+        remove_file_r(write_path, write_path_length, terminator);
+    }
+
+    return false;
+}
+
+/*
+ * Failing to store a tbd isn't an error, as the file is simply parsed again
+ * next time.
+ */
+
+static void
+store_in_result_cache(
+    const struct parse_macho_for_main_args *__notnull const args)
+{
+    if (!args->has_cache_key) {
+        return;
+    }
 
+    const struct tbd_for_main *const tbd = args->tbd;
+    result_cache_store(args->result_cache,
+                       &args->cache_key,
+                       &tbd->info,
+                       tbd->write_options);
+}
+
+bool
+write_cached_macho_file_for_main(
+    struct parse_macho_for_main_args *__notnull const args,
+    enum parse_macho_for_main_result *__notnull const result_out)
+{
+    const int entry_fd = open_result_cache_entry(args);
+    if (entry_fd < 0) {
+        return false;
+    }
+
+    if (args->options.verify_write_path) {
+        verify_write_path(args->tbd);
+    }
+
+    char *const write_path = args->tbd->write_path;
+    const uint64_t write_path_length = args->tbd->write_path_length;
+
+    char *terminator = NULL;
+    FILE *const file =
+        open_file_for_path(args, write_path, write_path_length, &terminator);
+
+    if (file != NULL) {
+        write_result_cache_entry(args,
+                                 entry_fd,
+                                 file,
+                                 write_path,
+                                 write_path_length,
+                                 terminator);
+
+        fclose(file);
+    }
+
+    close(entry_fd);
+
+    *result_out = E_PARSE_MACHO_FOR_MAIN_OK;
+    return true;
+}
+
+enum parse_macho_for_main_result
+write_parsed_macho_file_for_main(
+    const struct parse_macho_for_main_args args,
+    const enum macho_file_open_result open_macho_result,
+    const enum macho_file_parse_result parse_macho_result)
+{
     switch (open_macho_result) {
         case E_MACHO_FILE_OPEN_OK:
             break;
@@ -205,31 +395,7 @@ parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
     }
 
     struct tbd_create_info *const info = &args.tbd->info;
-
     const struct tbd_create_info *const orig = &args.orig->info;
-    const struct handle_macho_file_parse_error_cb_info cb_info = {
-        .tbd = args.tbd,
-
-        .dir_path = args.dir_path,
-        .name = args.name,
-
-        .print_paths = args.print_paths,
-        .is_recursing = false
-    };
-
-    struct string_buffer sb_buffer = {};
-    struct macho_file_parse_extra_args extra = {
-        .callback = handle_macho_file_for_main_error_callback,
-        .cb_info = (void *)&cb_info,
-        .export_trie_sb = &sb_buffer
-    };
-
-    const enum macho_file_parse_result parse_macho_result =
-        macho_file_parse_from_file(info,
-                                   &macho,
-                                   extra,
-                                   args.tbd->parse_options,
-                                   args.tbd->macho_options);
 
     if (parse_macho_result != E_MACHO_FILE_PARSE_OK) {
         tbd_create_info_clear_fields_and_create_from(info, orig);
@@ -254,6 +420,7 @@ parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
     char *terminator = NULL;
 
     if (write_path != NULL) {
+        store_in_result_cache(&args);
         file = open_file_for_path(&args,
                                   write_path,
                                   write_path_length,
@@ -264,6 +431,13 @@ parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
             return E_PARSE_MACHO_FOR_MAIN_OK;
         }
 
+        if (args.tbd->options.write_archive) {
+            write_to_archive(&args, file);
+            tbd_create_info_clear_fields_and_create_from(info, orig);
+
+            return E_PARSE_MACHO_FOR_MAIN_OK;
+        }
+
         tbd_for_main_write_to_file(args.tbd,
                                    write_path,
                                    write_path_length,
@@ -281,15 +455,113 @@ parse_macho_file_for_main(const struct parse_macho_for_main_args args) {
 }
 
 enum parse_macho_for_main_result
-parse_macho_file_for_main_while_recursing(
-    struct parse_macho_for_main_args *__notnull const args)
-{
+parse_macho_file_for_main(struct parse_macho_for_main_args args) {
+    enum parse_macho_for_main_result cached_result = E_PARSE_MACHO_FOR_MAIN_OK;
+    if (write_cached_macho_file_for_main(&args, &cached_result)) {
+        return cached_result;
+    }
+
     struct macho_file macho = {};
     struct range range = {};
 
     const enum macho_file_open_result open_macho_result =
-        macho_file_open(&macho, args->magic_buffer, args->fd, range);
+        macho_file_open(&macho, args.magic_buffer, args.fd, range);
+
+    enum macho_file_parse_result parse_macho_result = E_MACHO_FILE_PARSE_OK;
+    if (open_macho_result == E_MACHO_FILE_OPEN_OK) {
+        struct tbd_create_info *const info = &args.tbd->info;
+        const struct handle_macho_file_parse_error_cb_info cb_info = {
+            .tbd = args.tbd,
+
+            .dir_path = args.dir_path,
+            .name = args.name,
+
+            .print_paths = args.print_paths,
+            .is_recursing = false
+        };
+
+        struct string_buffer sb_buffer = {};
+        struct macho_file_parse_extra_args extra = {
+            .callback = handle_macho_file_for_main_error_callback,
+            .cb_info = (void *)&cb_info,
+            .export_trie_sb = &sb_buffer
+        };
+
+        parse_macho_result =
+            macho_file_parse_from_file(info,
+                                       &macho,
+                                       extra,
+                                       args.tbd->parse_options,
+                                       args.tbd->macho_options);
+    }
 
+    return write_parsed_macho_file_for_main(args,
+                                            open_macho_result,
+                                            parse_macho_result);
+}
+
+bool
+write_cached_macho_file_for_main_while_recursing(
+    struct parse_macho_for_main_args *__notnull const args,
+    enum parse_macho_for_main_result *__notnull const result_out)
+{
+    const int entry_fd = open_result_cache_entry(args);
+    if (entry_fd < 0) {
+        return false;
+    }
+
+    const struct tbd_for_main *const tbd = args->tbd;
+
+    uint64_t write_path_length = 0;
+    char *const write_path =
+        tbd_for_main_create_write_path_for_recursing(tbd,
+                                                     args->dir_path,
+                                                     args->dir_path_length,
+                                                     args->name,
+                                                     args->name_length,
+                                                     "tbd",
+                                                     3,
+                                                     &write_path_length);
+
+    enum parse_macho_for_main_result result =
+        E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR;
+
+    char *terminator = NULL;
+    FILE *const file =
+        open_file_for_path_while_recursing(args,
+                                           write_path,
+                                           write_path_length,
+                                           &terminator);
+
+    if (file != NULL) {
+        const bool wrote_entry =
+            write_result_cache_entry(args,
+                                     entry_fd,
+                                     file,
+                                     write_path,
+                                     write_path_length,
+                                     terminator);
+
+        if (wrote_entry) {
+            result = E_PARSE_MACHO_FOR_MAIN_OK;
+        }
+
+        fclose(file);
+    }
+
+    close(entry_fd);
+    free(write_path);
+
+    *result_out = result;
+    return true;
+}
+
+enum parse_macho_for_main_result
+write_parsed_macho_file_for_main_while_recursing(
+    struct parse_macho_for_main_args *__notnull const args,
+    const enum macho_file_open_result open_macho_result,
+    const enum macho_file_parse_result parse_macho_result)
+{
     switch (open_macho_result) {
         case E_MACHO_FILE_OPEN_OK:
             break;
@@ -321,44 +593,14 @@ parse_macho_file_for_main_while_recursing(
             break;
     }
 
-    /*
-     * Handle any provided replacement options.
-     */
-
     struct tbd_for_main *const tbd = args->tbd;
     struct tbd_create_info *const info = &tbd->info;
-
-    struct tbd_for_main *const orig = args->orig;
-    struct tbd_create_info *const orig_info = &orig->info;
+    struct tbd_create_info *const orig_info = &args->orig->info;
 
     const char *const dir_path = args->dir_path;
     const char *const name = args->name;
     const bool print_paths = args->print_paths;
 
-    const struct handle_macho_file_parse_error_cb_info cb_info = {
-        .orig = orig,
-        .tbd = tbd,
-
-        .dir_path = dir_path,
-        .name = name,
-
-        .print_paths = print_paths,
-        .is_recursing = true
-    };
-
-    struct macho_file_parse_extra_args extra = {
-        .callback = handle_macho_file_for_main_error_callback,
-        .cb_info = (void *)&cb_info,
-        .export_trie_sb = args->export_trie_sb
-    };
-
-    const enum macho_file_parse_result parse_macho_result =
-        macho_file_parse_from_file(info,
-                                   &macho,
-                                   extra,
-                                   tbd->parse_options,
-                                   tbd->macho_options);
-
     if (parse_macho_result != E_MACHO_FILE_PARSE_OK) {
         tbd_create_info_clear_fields_and_create_from(info, orig_info);
         handle_macho_file_parse_result(dir_path,
@@ -372,11 +614,14 @@ parse_macho_file_for_main_while_recursing(
     }
 
     tbd_for_main_handle_post_parse(tbd);
+    store_in_result_cache(args);
 
     char *write_path = NULL;
     uint64_t write_path_length = 0;
 
     const bool should_combine = tbd->options.combine_tbds;
+    const bool to_archive = tbd->options.write_archive;
+
     if (!should_combine) {
         write_path =
             tbd_for_main_create_write_path_for_recursing(tbd,
@@ -410,18 +655,113 @@ parse_macho_file_for_main_while_recursing(
         return E_PARSE_MACHO_FOR_MAIN_OTHER_ERROR;
     }
 
+    /*
+     * The tbd is written into the archive as a member named by the part of
+     * its write-path following the archive's path.
+     */
+
+    char *target_path = write_path;
+    uint64_t target_path_length = write_path_length;
+
+    if (to_archive) {
+        target_path =
+            tbd_for_main_get_archive_member_name(tbd,
+                                                 write_path,
+                                                 write_path_length,
+                                                 &target_path_length);
+    }
+
+    const bool close_file = !should_combine && !to_archive;
+    struct write_queue *const write_queue = args->write_queue;
+
+    if (write_queue != NULL) {
+        write_queue_add_job(write_queue,
+                            tbd,
+                            file,
+                            target_path,
+                            target_path_length,
+                            terminator,
+                            close_file,
+                            print_paths);
+
+        if (!should_combine) {
+            free(write_path);
+        }
+
+        write_queue_submit(write_queue, tbd, orig_info);
+        return E_PARSE_MACHO_FOR_MAIN_OK;
+    }
+
     tbd_for_main_write_to_file(tbd,
-                               write_path,
-                               write_path_length,
+                               target_path,
+                               target_path_length,
                                terminator,
                                file,
                                print_paths);
 
-    if (!should_combine) {
+    if (close_file) {
         fclose(file);
+    }
+
+    if (!should_combine) {
         free(write_path);
     }
 
     tbd_create_info_clear_fields_and_create_from(info, orig_info);
     return E_PARSE_MACHO_FOR_MAIN_OK;
 }
+
+enum parse_macho_for_main_result
+parse_macho_file_for_main_while_recursing(
+    struct parse_macho_for_main_args *__notnull const args)
+{
+    enum parse_macho_for_main_result cached_result = E_PARSE_MACHO_FOR_MAIN_OK;
+    const bool wrote_cached =
+        write_cached_macho_file_for_main_while_recursing(args, &cached_result);
+
+    if (wrote_cached) {
+        return cached_result;
+    }
+
+    struct macho_file macho = {};
+    struct range range = {};
+
+    const enum macho_file_open_result open_macho_result =
+        macho_file_open(&macho, args->magic_buffer, args->fd, range);
+
+    enum macho_file_parse_result parse_macho_result = E_MACHO_FILE_PARSE_OK;
+    if (open_macho_result == E_MACHO_FILE_OPEN_OK) {
+        /*
+         * Handle any provided replacement options.
+         */
+
+        struct tbd_for_main *const tbd = args->tbd;
+        const struct handle_macho_file_parse_error_cb_info cb_info = {
+            .orig = args->orig,
+            .tbd = tbd,
+
+            .dir_path = args->dir_path,
+            .name = args->name,
+
+            .print_paths = args->print_paths,
+            .is_recursing = true
+        };
+
+        struct macho_file_parse_extra_args extra = {
+            .callback = handle_macho_file_for_main_error_callback,
+            .cb_info = (void *)&cb_info,
+            .export_trie_sb = args->export_trie_sb
+        };
+
+        parse_macho_result =
+            macho_file_parse_from_file(&tbd->info,
+                                       &macho,
+                                       extra,
+                                       tbd->parse_options,
+                                       tbd->macho_options);
+    }
+
+    return write_parsed_macho_file_for_main_while_recursing(args,
+                                                            open_macho_result,
+                                                            parse_macho_result);
+}
@@ -349,6 +349,8 @@ enum tbd_version parse_tbd_version(const char *__notnull const version) {
         return TBD_VERSION_V3;
     } else if (strcmp(version, "v4") == 0) {
         return TBD_VERSION_V4;
+    } else if (strcmp(version, "v5") == 0) {
+        return TBD_VERSION_V5;
     }
 
     return TBD_VERSION_NONE;
@@ -475,6 +477,7 @@ void print_tbd_version_list(void) {
     fputs("v1\n"
           "v2\n"
           "v3\n"
-          "v4\n",
+          "v4\n"
+          "v5\n",
           stdout);
 }
@@ -0,0 +1,348 @@
+//
+//  src/parse_pool.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "copy.h"
+#include "handle_macho_file_parse_result.h"
+#include "parse_pool.h"
+
+struct parse_pool_worker {
+    pthread_t thread;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    struct parse_pool_file file;
+
+    /*
+     * The tbd_for_main tbd is currently a clone of.
+     */
+
+    struct tbd_for_main tbd;
+    const struct tbd_for_main *clone_of;
+
+    struct magic_buffer magic_buffer;
+    struct string_buffer export_trie_sb;
+
+    /*
+     * Errors printed while parsing the current file.
+     */
+
+    char *log;
+    size_t log_size;
+
+    bool has_file : 1;
+    bool is_parsed : 1;
+    bool should_exit : 1;
+};
+
+static void parse_file(struct parse_pool_worker *__notnull const worker) {
+    struct parse_pool_file *const file = &worker->file;
+    struct tbd_for_main *const tbd = &worker->tbd;
+
+    struct macho_file macho = {};
+    struct range range = {};
+
+    memset(&worker->magic_buffer, 0, sizeof(worker->magic_buffer));
+
+    file->open_result =
+        macho_file_open(&macho, &worker->magic_buffer, file->fd, range);
+
+    file->parse_result = E_MACHO_FILE_PARSE_OK;
+    if (file->open_result != E_MACHO_FILE_OPEN_OK) {
+        return;
+    }
+
+    /*
+     * If the log can't be created, errors are simply printed to stderr right
+     * away.
+     */
+
+    FILE *const log = open_memstream(&worker->log, &worker->log_size);
+    const struct handle_macho_file_parse_error_cb_info cb_info = {
+        .orig = file->orig,
+        .tbd = tbd,
+
+        .dir_path = file->dir_path,
+        .name = file->name,
+
+        .print_paths = file->print_paths,
+        .is_recursing = (file->name != NULL),
+
+        .file = log
+    };
+
+    struct macho_file_parse_extra_args extra = {
+        .callback = handle_macho_file_for_main_error_callback,
+        .cb_info = (void *)&cb_info,
+        .export_trie_sb = &worker->export_trie_sb
+    };
+
+    file->parse_result =
+        macho_file_parse_from_file(&tbd->info,
+                                   &macho,
+                                   extra,
+                                   tbd->parse_options,
+                                   tbd->macho_options);
+
+    if (log != NULL) {
+        fclose(log);
+    }
+}
+
+static void *parse_files(void *__notnull const arg) {
+    struct parse_pool_worker *const worker = (struct parse_pool_worker *)arg;
+    pthread_mutex_lock(&worker->lock);
+
+    do {
+        while (!worker->has_file || worker->is_parsed) {
+            if (worker->should_exit) {
+                pthread_mutex_unlock(&worker->lock);
+                return NULL;
+            }
+
+            pthread_cond_wait(&worker->cond, &worker->lock);
+        }
+
+        pthread_mutex_unlock(&worker->lock);
+        parse_file(worker);
+        pthread_mutex_lock(&worker->lock);
+
+        worker->is_parsed = true;
+        pthread_cond_signal(&worker->cond);
+    } while (true);
+}
+
+enum parse_pool_result
+parse_pool_start(struct parse_pool *__notnull const pool,
+                 const uint64_t worker_count,
+                 __notnull const parse_pool_finish_callback finish_callback,
+                 void *const finish_info)
+{
+    struct parse_pool_worker *const workers =
+        calloc(worker_count, sizeof(struct parse_pool_worker));
+
+    if (workers == NULL) {
+        return E_PARSE_POOL_ALLOC_FAIL;
+    }
+
+    uint64_t created_count = 0;
+    for (; created_count != worker_count; created_count++) {
+        struct parse_pool_worker *const worker = workers + created_count;
+
+        pthread_mutex_init(&worker->lock, NULL);
+        pthread_cond_init(&worker->cond, NULL);
+
+        if (pthread_create(&worker->thread, NULL, parse_files, worker) != 0) {
+            pthread_cond_destroy(&worker->cond);
+            pthread_mutex_destroy(&worker->lock);
+
+            break;
+        }
+    }
+
+    /*
+     * Fewer workers than asked for are fine, as long as there's at least one.
+     */
+
+    if (created_count == 0) {
+        free(workers);
+        return E_PARSE_POOL_THREAD_CREATE_FAIL;
+    }
+
+    pool->workers = workers;
+    pool->worker_count = created_count;
+
+    pool->next_worker = 0;
+    pool->pending_count = 0;
+
+    pool->finish_callback = finish_callback;
+    pool->finish_info = finish_info;
+
+    return E_PARSE_POOL_OK;
+}
+
+static void finish_oldest_file(struct parse_pool *__notnull const pool) {
+    const uint64_t worker_count = pool->worker_count;
+    const uint64_t index =
+        (pool->next_worker + worker_count - pool->pending_count) % worker_count;
+
+    struct parse_pool_worker *const worker = pool->workers + index;
+    pthread_mutex_lock(&worker->lock);
+
+    while (!worker->is_parsed) {
+        pthread_cond_wait(&worker->cond, &worker->lock);
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+    if (worker->log != NULL) {
+        fwrite(worker->log, 1, worker->log_size, stderr);
+        free(worker->log);
+
+        worker->log = NULL;
+        worker->log_size = 0;
+    }
+
+    struct parse_pool_file *const file = &worker->file;
+    pool->finish_callback(file, pool->finish_info);
+
+    free(file->dir_path);
+    free(file->name);
+
+    pthread_mutex_lock(&worker->lock);
+    worker->has_file = false;
+    pthread_mutex_unlock(&worker->lock);
+
+    pool->pending_count -= 1;
+}
+
+/*
+ * Make worker's tbd a clone of orig, while keeping the arrays it already
+ * allocated for parsing. The arrays are always cleared after a file is
+ * finished.
+ */
+
+static void
+clone_tbd(struct parse_pool_worker *__notnull const worker,
+          const struct tbd_for_main *__notnull const orig)
+{
+    struct tbd_for_main *const tbd = &worker->tbd;
+
+    const struct array metadata = tbd->info.fields.metadata;
+    const struct array symbols = tbd->info.fields.symbols;
+    const struct array uuids = tbd->info.fields.uuids;
+
+    *tbd = *orig;
+
+    tbd->info.fields.metadata = metadata;
+    tbd->info.fields.symbols = symbols;
+    tbd->info.fields.uuids = uuids;
+
+    worker->clone_of = orig;
+}
+
+enum parse_pool_result
+parse_pool_add_file(struct parse_pool *__notnull const pool,
+                    struct tbd_for_main *__notnull const orig,
+                    const int fd,
+                    const char *__notnull const dir_path,
+                    const uint64_t dir_path_length,
+                    const char *const name,
+                    const uint64_t name_length,
+                    const bool print_paths,
+                    const struct result_cache_key *const cache_key,
+                    void *const info)
+{
+    if (pool->pending_count == pool->worker_count) {
+        finish_oldest_file(pool);
+    }
+
+    char *const dir_path_copy = alloc_and_copy(dir_path, dir_path_length);
+    if (dir_path_copy == NULL) {
+        return E_PARSE_POOL_ALLOC_FAIL;
+    }
+
+    char *name_copy = NULL;
+    if (name != NULL) {
+        name_copy = alloc_and_copy(name, name_length);
+        if (name_copy == NULL) {
+            free(dir_path_copy);
+            return E_PARSE_POOL_ALLOC_FAIL;
+        }
+    }
+
+    struct parse_pool_worker *const worker = pool->workers + pool->next_worker;
+    if (worker->clone_of != orig) {
+        clone_tbd(worker, orig);
+    }
+
+    struct parse_pool_file file = {
+        .tbd = &worker->tbd,
+        .orig = orig,
+
+        .fd = fd,
+
+        .magic_buffer = &worker->magic_buffer,
+        .export_trie_sb = &worker->export_trie_sb,
+
+        .dir_path = dir_path_copy,
+        .dir_path_length = dir_path_length,
+
+        .name = name_copy,
+        .name_length = name_length,
+
+        .print_paths = print_paths,
+        .info = info
+    };
+
+    if (cache_key != NULL) {
+        file.cache_key = *cache_key;
+        file.has_cache_key = true;
+    }
+
+    pthread_mutex_lock(&worker->lock);
+
+    worker->file = file;
+    worker->has_file = true;
+    worker->is_parsed = false;
+
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->lock);
+
+    pool->next_worker = (pool->next_worker + 1) % pool->worker_count;
+    pool->pending_count += 1;
+
+    return E_PARSE_POOL_OK;
+}
+
+void parse_pool_drain(struct parse_pool *__notnull const pool) {
+    while (pool->pending_count != 0) {
+        finish_oldest_file(pool);
+    }
+}
+
+void parse_pool_finish(struct parse_pool *__notnull const pool) {
+    parse_pool_drain(pool);
+
+    struct parse_pool_worker *worker = pool->workers;
+    const struct parse_pool_worker *const end = worker + pool->worker_count;
+
+    for (; worker != end; worker++) {
+        pthread_mutex_lock(&worker->lock);
+
+        worker->should_exit = true;
+        pthread_cond_signal(&worker->cond);
+
+        pthread_mutex_unlock(&worker->lock);
+        pthread_join(worker->thread, NULL);
+
+        /*
+         * Everything else in the clone is shared with the tbd_for_main it was
+         * cloned from.
+         */
+
+        struct tbd_create_info_fields *const fields = &worker->tbd.info.fields;
+
+        array_destroy(&fields->metadata);
+        array_destroy(&fields->symbols);
+        array_destroy(&fields->uuids);
+
+        sb_destroy(&worker->export_trie_sb);
+
+        pthread_cond_destroy(&worker->cond);
+        pthread_mutex_destroy(&worker->lock);
+    }
+
+    free(pool->workers);
+
+    pool->workers = NULL;
+    pool->worker_count = 0;
+}
@@ -0,0 +1,183 @@
+//
+//  src/paths_file.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "our_io.h"
+#include "paths_file.h"
+
+#define PATHS_FILE_INITIAL_CAPACITY 65536
+
+enum paths_file_result
+paths_file_open(struct paths_file *__notnull const paths_file,
+                const char *const path)
+{
+    int fd = STDIN_FILENO;
+    if (path != NULL) {
+        fd = our_open(path, O_RDONLY, 0);
+        if (fd < 0) {
+            return E_PATHS_FILE_OPEN_FAIL;
+        }
+    }
+
+    char *const buffer = malloc(PATHS_FILE_INITIAL_CAPACITY);
+    if (buffer == NULL) {
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+
+        return E_PATHS_FILE_ALLOC_FAIL;
+    }
+
+    paths_file->fd = fd;
+    paths_file->buffer = buffer;
+    paths_file->capacity = PATHS_FILE_INITIAL_CAPACITY;
+
+    return E_PATHS_FILE_OK;
+}
+
+static const char *
+find_delimiter(struct paths_file *__notnull const paths_file) {
+    const char *const begin = paths_file->buffer + paths_file->start;
+    const uint64_t size = paths_file->end - paths_file->start;
+
+    if (paths_file->found_delimiter) {
+        return memchr(begin, paths_file->delimiter, size);
+    }
+
+    const char *const end = begin + size;
+    for (const char *iter = begin; iter != end; iter++) {
+        const char ch = *iter;
+        if (ch == '\n' || ch == '\0') {
+            paths_file->delimiter = ch;
+            paths_file->found_delimiter = true;
+
+            return iter;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Read more of the list into the buffer, first moving the unread part to the
+ * front, and growing the buffer if it's still full.
+ *
+ * One byte is always left free, so the last path can be null-terminated.
+ */
+
+static enum paths_file_result
+read_more(struct paths_file *__notnull const paths_file) {
+    const uint64_t start = paths_file->start;
+    if (start != 0) {
+        const uint64_t size = paths_file->end - start;
+        memmove(paths_file->buffer, paths_file->buffer + start, size);
+
+        paths_file->start = 0;
+        paths_file->end = size;
+    }
+
+    if (paths_file->end + 1 >= paths_file->capacity) {
+        const uint64_t capacity = paths_file->capacity * 2;
+        char *const buffer = realloc(paths_file->buffer, capacity);
+
+        if (buffer == NULL) {
+            return E_PATHS_FILE_ALLOC_FAIL;
+        }
+
+        paths_file->buffer = buffer;
+        paths_file->capacity = capacity;
+    }
+
+    const uint64_t end = paths_file->end;
+    const uint64_t free_size = paths_file->capacity - end - 1;
+
+    do {
+        const ssize_t read_size =
+            our_read(paths_file->fd, paths_file->buffer + end, free_size);
+
+        if (read_size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return E_PATHS_FILE_READ_FAIL;
+        }
+
+        if (read_size == 0) {
+            paths_file->reached_end = true;
+        }
+
+        paths_file->end += (uint64_t)read_size;
+        return E_PATHS_FILE_OK;
+    } while (true);
+}
+
+enum paths_file_result
+paths_file_next(struct paths_file *__notnull const paths_file,
+                char **__notnull const path_out,
+                uint64_t *__notnull const length_out)
+{
+    do {
+        char *const path = paths_file->buffer + paths_file->start;
+        char *delimiter = (char *)find_delimiter(paths_file);
+
+        /*
+         * The last path may not be followed by a delimiter.
+         */
+
+        if (delimiter == NULL && paths_file->reached_end) {
+            if (paths_file->start == paths_file->end) {
+                return E_PATHS_FILE_NO_MORE_PATHS;
+            }
+
+            delimiter = paths_file->buffer + paths_file->end;
+        }
+
+        if (delimiter != NULL) {
+            const uint64_t length = (uint64_t)(delimiter - path);
+
+            *delimiter = '\0';
+            paths_file->start += length;
+
+            if (paths_file->start != paths_file->end) {
+                paths_file->start += 1;
+            }
+
+            if (length == 0) {
+                continue;
+            }
+
+            *path_out = path;
+            *length_out = length;
+
+            return E_PATHS_FILE_OK;
+        }
+
+        const enum paths_file_result read_more_result = read_more(paths_file);
+        if (read_more_result != E_PATHS_FILE_OK) {
+            return read_more_result;
+        }
+    } while (true);
+}
+
+void paths_file_close(struct paths_file *__notnull const paths_file) {
+    if (paths_file->fd != STDIN_FILENO) {
+        close(paths_file->fd);
+    }
+
+    free(paths_file->buffer);
+
+    paths_file->fd = -1;
+    paths_file->buffer = NULL;
+    paths_file->capacity = 0;
+}
@@ -0,0 +1,143 @@
+//
+//  src/record_write.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include "record_write.h"
+#include "tbd.h"
+
+/*
+ * Targets of the same arch (with different platforms) are listed next to each
+ * other in a target-list, but not necessarily, so check all targets before
+ * index.
+ */
+
+static bool
+is_first_target_of_arch(const struct target_list *__notnull const targets,
+                        const uint64_t index,
+                        const struct arch_info *__notnull const arch)
+{
+    for (uint64_t i = 0; i != index; i++) {
+        const struct arch_info *other = NULL;
+        enum tbd_platform platform = TBD_PLATFORM_NONE;
+
+        target_list_get_target(targets, i, &other, &platform);
+        if (other == arch) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint64_t
+get_archs_length(const struct target_list *__notnull const targets) {
+    uint64_t length = 0;
+    for (uint64_t i = 0; i != targets->set_count; i++) {
+        const struct arch_info *arch = NULL;
+        enum tbd_platform platform = TBD_PLATFORM_NONE;
+
+        target_list_get_target(targets, i, &arch, &platform);
+        if (!is_first_target_of_arch(targets, i, arch)) {
+            continue;
+        }
+
+        if (length != 0) {
+            length += 1;
+        }
+
+        length += arch->name_length;
+    }
+
+    return length;
+}
+
+static int
+write_archs(struct write_buffer *__notnull const wb,
+            const struct target_list *__notnull const targets)
+{
+    bool is_first = true;
+    for (uint64_t i = 0; i != targets->set_count; i++) {
+        const struct arch_info *arch = NULL;
+        enum tbd_platform platform = TBD_PLATFORM_NONE;
+
+        target_list_get_target(targets, i, &arch, &platform);
+        if (!is_first_target_of_arch(targets, i, arch)) {
+            continue;
+        }
+
+        if (!is_first) {
+            if (wb_add_char(wb, ',')) {
+                return 1;
+            }
+        }
+
+        if (wb_add_bytes(wb, arch->name, arch->name_length)) {
+            return 1;
+        }
+
+        is_first = false;
+    }
+
+    return 0;
+}
+
+static void
+write_le(uint8_t *__notnull const bytes,
+         const uint64_t byte_count,
+         uint64_t number)
+{
+    for (uint64_t i = 0; i != byte_count; i++) {
+        bytes[i] = (uint8_t)(number & 0xff);
+        number >>= 8;
+    }
+}
+
+int
+record_write_header(struct write_buffer *__notnull const wb,
+                    const char *__notnull const path,
+                    const uint64_t path_length,
+                    const struct target_list *__notnull const targets,
+                    const uint64_t size)
+{
+    uint8_t header[24] = { 'T', 'B', 'D', 'R' };
+
+    write_le(header + 4, 4, path_length);
+    write_le(header + 8, 4, get_archs_length(targets));
+    write_le(header + 16, 8, size);
+
+    if (wb_add_bytes(wb, header, sizeof(header))) {
+        return 1;
+    }
+
+    if (wb_add_bytes(wb, path, path_length)) {
+        return 1;
+    }
+
+    return write_archs(wb, targets);
+}
+
+int
+record_write_nul_delimited_header(
+    struct write_buffer *__notnull const wb,
+    const char *__notnull const path,
+    const uint64_t path_length,
+    const struct target_list *__notnull const targets)
+{
+    if (wb_add_bytes(wb, path, path_length)) {
+        return 1;
+    }
+
+    if (wb_add_char(wb, '\0')) {
+        return 1;
+    }
+
+    if (write_archs(wb, targets)) {
+        return 1;
+    }
+
+    return wb_add_char(wb, '\0');
+}
@@ -8,10 +8,15 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "copy.h"
 #include "likely.h"
 #include "our_io.h"
 
@@ -246,6 +251,275 @@ reverse_mkdir_ignoring_last(char *__notnull const path,
     return 0;
 }
 
+/*
+ * Write-files are mostly created in the same few directories, so we keep a
+ * file-descriptor for each of the directories most recently written to, to
+ * create files with a single openat() call.
+ *
+ * Only DIR_CACHE_MAX_COUNT directories are kept open, well below any limit on
+ * open files, with the least recently used directory closed to make room for
+ * another.
+ *
+ * A cached directory may have since been removed (such as by remove_file_r()),
+ * in which case it's dropped from the cache, until the directory is created
+ * again.
+ */
+
+#define DIR_CACHE_MAX_COUNT 16
+
+struct dir_cache_entry {
+    char *path;
+    uint64_t length;
+
+    int fd;
+
+    /*
+     * The number of threads currently opening a file in the directory. An
+     * entry is only closed once it has no users.
+     */
+
+    uint32_t user_count;
+    uint64_t last_used;
+
+    bool is_removed;
+};
+
+static struct dir_cache_entry dir_cache[DIR_CACHE_MAX_COUNT] = {};
+static uint64_t dir_cache_clock = 0;
+
+static pthread_mutex_t dir_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Get the length of the directory-path of path's parent directory, or 0 if
+ * path has no parent directory we can cache.
+ */
+
+static uint64_t
+get_parent_dir_length(const char *__notnull const path, const uint64_t length) {
+    const char *const last_slash = find_last_slash(path, path + length);
+    if (last_slash == NULL || last_slash == path) {
+        return 0;
+    }
+
+    /*
+     * A path ending with a slash doesn't name a file we can open.
+     */
+
+    if (unlikely(last_slash[1] == '\0')) {
+        return 0;
+    }
+
+    return (uint64_t)(last_slash - path);
+}
+
+/*
+ * Must be called with dir_cache_lock held.
+ */
+
+static struct dir_cache_entry *
+find_dir_cache_entry(const char *__notnull const path, const uint64_t length) {
+    struct dir_cache_entry *entry = dir_cache;
+    const struct dir_cache_entry *const end = dir_cache + DIR_CACHE_MAX_COUNT;
+
+    for (; entry != end; entry++) {
+        if (entry->path == NULL || entry->is_removed) {
+            continue;
+        }
+
+        if (entry->length == length &&
+            memcmp(entry->path, path, length) == 0)
+        {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Clear entry, returning its file-descriptor to be closed once dir_cache_lock
+ * is released. Must be called with dir_cache_lock held.
+ */
+
+static int
+clear_dir_cache_entry(struct dir_cache_entry *__notnull const entry) {
+    const int fd = entry->fd;
+
+    free(entry->path);
+    *entry = (struct dir_cache_entry){ .fd = -1 };
+
+    return fd;
+}
+
+/*
+ * Try to open path relative to its cached parent directory. Returns false if
+ * the parent directory wasn't cached, or was found to have been removed.
+ *
+ * dir_cache_lock is only held to find the entry, and not while opening the
+ * file, so threads writing to different directories don't wait on each other.
+ */
+
+static bool
+open_in_cached_dir(const char *__notnull const path,
+                   const uint64_t dir_length,
+                   const int flags,
+                   const mode_t mode,
+                   int *__notnull const fd_out)
+{
+    pthread_mutex_lock(&dir_cache_lock);
+
+    struct dir_cache_entry *const entry =
+        find_dir_cache_entry(path, dir_length);
+
+    if (entry == NULL) {
+        pthread_mutex_unlock(&dir_cache_lock);
+        return false;
+    }
+
+    entry->user_count += 1;
+    entry->last_used = ++dir_cache_clock;
+
+    const int dir_fd = entry->fd;
+    pthread_mutex_unlock(&dir_cache_lock);
+
+    const char *const name = path + dir_length + 1;
+    const int fd = our_openat_with_mode(dir_fd, name, flags, mode);
+
+    /*
+     * Creating a file fails with ENOENT only if the directory no longer
+     * exists.
+     */
+
+    const bool is_removed = (fd < 0 && errno == ENOENT);
+    const int error = errno;
+
+    int fd_to_close = -1;
+    pthread_mutex_lock(&dir_cache_lock);
+
+    entry->user_count -= 1;
+    if (is_removed) {
+        entry->is_removed = true;
+    }
+
+    if (entry->is_removed && entry->user_count == 0) {
+        fd_to_close = clear_dir_cache_entry(entry);
+    }
+
+    pthread_mutex_unlock(&dir_cache_lock);
+
+    if (fd_to_close >= 0) {
+        close(fd_to_close);
+    }
+
+    if (is_removed) {
+        return false;
+    }
+
+    *fd_out = fd;
+    errno = error;
+
+    return true;
+}
+
+static bool
+dir_is_cached(const char *__notnull const path, const uint64_t length) {
+    pthread_mutex_lock(&dir_cache_lock);
+
+    const bool is_cached = (find_dir_cache_entry(path, length) != NULL);
+    pthread_mutex_unlock(&dir_cache_lock);
+
+    return is_cached;
+}
+
+/*
+ * Find an entry to cache another directory in, evicting the least recently
+ * used entry if needed. Entries that are in use are never evicted, so NULL is
+ * returned if every entry is in use. Must be called with dir_cache_lock held.
+ */
+
+static struct dir_cache_entry *
+get_free_dir_cache_entry(int *__notnull const fd_to_close_out) {
+    struct dir_cache_entry *entry = dir_cache;
+    const struct dir_cache_entry *const end = dir_cache + DIR_CACHE_MAX_COUNT;
+
+    struct dir_cache_entry *oldest = NULL;
+    for (; entry != end; entry++) {
+        if (entry->path == NULL) {
+            return entry;
+        }
+
+        if (entry->user_count != 0) {
+            continue;
+        }
+
+        if (oldest == NULL || entry->last_used < oldest->last_used) {
+            oldest = entry;
+        }
+    }
+
+    if (oldest != NULL) {
+        *fd_to_close_out = clear_dir_cache_entry(oldest);
+    }
+
+    return oldest;
+}
+
+static void
+cache_parent_dir(char *__notnull const path, const uint64_t dir_length) {
+    char *const slash = path + dir_length;
+
+    terminate_c_str(slash);
+    const int dir_fd = our_open(path, O_RDONLY | O_DIRECTORY, 0);
+    restore_slash_c_str(slash);
+
+    if (dir_fd < 0) {
+        return;
+    }
+
+    char *const dir_path = alloc_and_copy(path, dir_length);
+    if (dir_path == NULL) {
+        close(dir_fd);
+        return;
+    }
+
+    /*
+     * Another thread may have cached the directory in the meantime, in which
+     * case our file-descriptor is simply closed.
+     */
+
+    int fd_to_close = dir_fd;
+    pthread_mutex_lock(&dir_cache_lock);
+
+    if (find_dir_cache_entry(path, dir_length) == NULL) {
+        fd_to_close = -1;
+
+        struct dir_cache_entry *const entry =
+            get_free_dir_cache_entry(&fd_to_close);
+
+        if (entry != NULL) {
+            *entry = (struct dir_cache_entry){
+                .path = dir_path,
+                .length = dir_length,
+                .fd = dir_fd,
+                .last_used = ++dir_cache_clock
+            };
+        } else {
+            fd_to_close = dir_fd;
+        }
+    }
+
+    const bool is_cached = (fd_to_close != dir_fd);
+    pthread_mutex_unlock(&dir_cache_lock);
+
+    if (fd_to_close >= 0) {
+        close(fd_to_close);
+    }
+
+    if (!is_cached) {
+        free(dir_path);
+    }
+}
+
 int
 open_r(char *__notnull const path,
        const uint64_t length,
@@ -254,8 +528,20 @@ open_r(char *__notnull const path,
        const mode_t dir_mode,
        char **const terminator_out)
 {
+    const uint64_t dir_length = get_parent_dir_length(path, length);
+    if (dir_length != 0) {
+        int fd = -1;
+        if (open_in_cached_dir(path, dir_length, O_CREAT | flags, mode, &fd)) {
+            return fd;
+        }
+    }
+
     int fd = our_open(path, O_CREAT | flags, mode);
     if (likely(fd >= 0)) {
+        if (dir_length != 0) {
+            cache_parent_dir(path, dir_length);
+        }
+
         return fd;
     }
 
@@ -280,6 +566,10 @@ open_r(char *__notnull const path,
         return -1;
     }
 
+    if (dir_length != 0) {
+        cache_parent_dir(path, dir_length);
+    }
+
     return fd;
 }
 
@@ -289,6 +579,10 @@ mkdir_r(char *__notnull const path,
         const mode_t mode,
         char **const first_terminator_out)
 {
+    if (dir_is_cached(path, length)) {
+        return 0;
+    }
+
     if (likely(our_mkdir(path, mode) == 0)) {
         return 0;
     }
@@ -0,0 +1,496 @@
+//
+//  src/result_cache.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/fs.h>
+#endif
+
+#include "arch_info.h"
+#include "our_io.h"
+#include "result_cache.h"
+#include "write_buffer.h"
+
+/*
+ * Bump the version whenever the tbds written out change for the same input and
+ * options, so entries from older versions of tbd are never used.
+ */
+
+static const char result_cache_tag[] = "tbd-result-cache v1";
+
+/*
+ * Keys are 128-bit FNV-1a hashes. The FNV-128 prime is 2^88 + 0x13b, so
+ * multiplying by it only takes a shift and a small multiply.
+ */
+
+typedef unsigned __int128 result_cache_hash;
+
+static inline result_cache_hash
+hash_bytes(result_cache_hash hash,
+           const void *__notnull const bytes,
+           const uint64_t size)
+{
+    const uint8_t *iter = (const uint8_t *)bytes;
+    const uint8_t *const end = iter + size;
+
+    for (; iter != end; iter++) {
+        hash ^= *iter;
+        hash = (hash << 88) + (hash * 0x13b);
+    }
+
+    return hash;
+}
+
+static inline result_cache_hash
+hash_uint(const result_cache_hash hash, const uint64_t number) {
+    return hash_bytes(hash, &number, sizeof(number));
+}
+
+enum result_cache_result
+result_cache_create(struct result_cache *__notnull const cache,
+                    const char *__notnull const path)
+{
+    struct stat sbuf = {};
+    if (stat(path, &sbuf) != 0) {
+        if (errno != ENOENT) {
+            return E_RESULT_CACHE_READ_FAIL;
+        }
+
+        /*
+         * Another process may have created the directory in the meantime.
+         */
+
+        if (our_mkdir(path, 0755) != 0 && errno != EEXIST) {
+            return E_RESULT_CACHE_MKDIR_FAIL;
+        }
+    } else if (!S_ISDIR(sbuf.st_mode)) {
+        return E_RESULT_CACHE_NOT_A_DIRECTORY;
+    }
+
+    const uint64_t path_length = strlen(path);
+    char *const copy = malloc(path_length + 1);
+
+    if (copy == NULL) {
+        return E_RESULT_CACHE_ALLOC_FAIL;
+    }
+
+    memcpy(copy, path, path_length + 1);
+
+    cache->path = copy;
+    cache->path_length = path_length;
+
+    return E_RESULT_CACHE_OK;
+}
+
+bool result_cache_can_cache(const struct tbd_for_main *__notnull const tbd) {
+    const struct tbd_for_main_options options = tbd->options;
+    if (options.combine_tbds || options.write_archive || options.binary_index) {
+        return false;
+    }
+
+    return (tbd->write_path != NULL);
+}
+
+static result_cache_hash
+hash_options(result_cache_hash hash,
+             const struct tbd_for_main *__notnull const tbd)
+{
+    hash = hash_bytes(hash, result_cache_tag, sizeof(result_cache_tag));
+    hash = hash_uint(hash, (uint64_t)tbd->info.version);
+
+    hash = hash_bytes(hash, &tbd->parse_options, sizeof(tbd->parse_options));
+    hash = hash_uint(hash, tbd->write_options.value);
+    hash = hash_bytes(hash, &tbd->macho_options, sizeof(tbd->macho_options));
+
+    /*
+     * Hash the values of all replacement options. Targets hold pointers to
+     * their arch-info, which are replaced by the arch's index, as pointers
+     * differ between processes.
+     */
+
+    const struct tbd_create_info_fields *const fields = &tbd->info.fields;
+    const struct target_list *const targets = &fields->targets;
+
+    const struct arch_info *const arch_list = arch_info_get_list();
+    const uint64_t target_count = targets->set_count;
+
+    hash = hash_uint(hash, target_count);
+    for (uint64_t i = 0; i != target_count; i++) {
+        const struct arch_info *arch = NULL;
+        enum tbd_platform platform = TBD_PLATFORM_NONE;
+
+        target_list_get_target(targets, i, &arch, &platform);
+
+        hash = hash_uint(hash, (uint64_t)(arch - arch_list));
+        hash = hash_uint(hash, (uint64_t)platform);
+    }
+
+    hash = hash_uint(hash, (uint64_t)fields->archs.objc_constraint);
+    hash = hash_uint(hash, fields->flags.value);
+
+    const uint64_t install_name_length = fields->install_name_length;
+    hash = hash_uint(hash, install_name_length);
+
+    if (fields->install_name != NULL) {
+        hash = hash_bytes(hash, fields->install_name, install_name_length);
+    }
+
+    hash = hash_uint(hash, fields->current_version);
+    hash = hash_uint(hash, fields->compatibility_version);
+    hash = hash_uint(hash, fields->swift_version);
+
+    if (tbd->flags.provided_platform) {
+        hash = hash_uint(hash, (uint64_t)tbd->platform);
+    }
+
+    return hash;
+}
+
+static inline result_cache_hash get_hash_basis(void) {
+    const result_cache_hash hash = 0x62b821756295c58d;
+    return hash | ((result_cache_hash)0x6c62272e07bb0142 << 64);
+}
+
+static inline void
+set_key(struct result_cache_key *__notnull const key,
+        const result_cache_hash hash)
+{
+    key->hash[0] = (uint64_t)(hash >> 64);
+    key->hash[1] = (uint64_t)hash;
+}
+
+enum result_cache_result
+result_cache_create_key(const struct tbd_for_main *__notnull const tbd,
+                        const int fd,
+                        struct result_cache_key *__notnull const key_out)
+{
+    result_cache_hash hash = hash_options(get_hash_basis(), tbd);
+
+    uint8_t buff[16384];
+    off_t offset = 0;
+
+    do {
+        const ssize_t read_size = our_pread(fd, buff, sizeof(buff), offset);
+        if (read_size < 0) {
+            return E_RESULT_CACHE_READ_FAIL;
+        }
+
+        if (read_size == 0) {
+            break;
+        }
+
+        hash = hash_bytes(hash, buff, (uint64_t)read_size);
+        offset += read_size;
+    } while (true);
+
+    set_key(key_out, hash);
+    return E_RESULT_CACHE_OK;
+}
+
+void
+result_cache_create_file_id_key(
+    const struct tbd_for_main *__notnull const tbd,
+    const uint64_t dev,
+    const uint64_t ino,
+    struct result_cache_key *__notnull const key_out)
+{
+    static const char file_id_tag[] = "file-id";
+
+    result_cache_hash hash = hash_options(get_hash_basis(), tbd);
+    hash = hash_bytes(hash, file_id_tag, sizeof(file_id_tag));
+
+    hash = hash_uint(hash, dev);
+    hash = hash_uint(hash, ino);
+
+    set_key(key_out, hash);
+}
+
+void
+result_cache_create_options_key(
+    const struct tbd_for_main *__notnull const tbd,
+    struct result_cache_key *__notnull const key_out)
+{
+    const result_cache_hash hash = hash_options(get_hash_basis(), tbd);
+    set_key(key_out, hash);
+}
+
+/*
+ * Entries are spread over 256 sub-directories, named by the first two
+ * hex-digits of their key, so no single directory grows too large. The entry
+ * itself is named by the remaining 30 hex-digits.
+ */
+
+static char *
+create_entry_path(const struct result_cache *__notnull const cache,
+                  const struct result_cache_key *__notnull const key,
+                  uint64_t *__notnull const dir_length_out)
+{
+    const uint64_t dir_length = cache->path_length + 3;
+    char *const path = malloc(dir_length + 1 + 30 + sizeof(".tbd"));
+
+    if (path == NULL) {
+        return NULL;
+    }
+
+    char name[33];
+    snprintf(name,
+             sizeof(name),
+             "%016" PRIx64 "%016" PRIx64,
+             key->hash[0],
+             key->hash[1]);
+
+    memcpy(path, cache->path, cache->path_length);
+
+    char *iter = path + cache->path_length;
+    iter[0] = '/';
+    iter[1] = name[0];
+    iter[2] = name[1];
+    iter[3] = '/';
+
+    memcpy(iter + 4, name + 2, 30);
+    memcpy(iter + 34, ".tbd", sizeof(".tbd"));
+
+    *dir_length_out = dir_length;
+    return path;
+}
+
+int
+result_cache_open_entry(const struct result_cache *__notnull const cache,
+                        const struct result_cache_key *__notnull const key)
+{
+    uint64_t dir_length = 0;
+    char *const path = create_entry_path(cache, key, &dir_length);
+
+    if (path == NULL) {
+        return -1;
+    }
+
+    const int fd = our_open(path, O_RDONLY, 0);
+
+    free(path);
+    return fd;
+}
+
+static bool
+write_all(const int fd, const char *__notnull data, uint64_t length) {
+    while (length != 0) {
+        const ssize_t written = our_write(fd, data, length);
+        if (written <= 0) {
+            return false;
+        }
+
+        data += written;
+        length -= (uint64_t)written;
+    }
+
+    return true;
+}
+
+static bool
+file_matches_entry(const int fd,
+                   const char *__notnull const data,
+                   const uint64_t length)
+{
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) != 0 || !S_ISREG(sbuf.st_mode)) {
+        return false;
+    }
+
+    if ((uint64_t)sbuf.st_size != length) {
+        return false;
+    }
+
+    if (length == 0) {
+        return true;
+    }
+
+    void *const map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const bool matches = (memcmp(map, data, length) == 0);
+    munmap(map, length);
+
+    return matches;
+}
+
+enum result_cache_result
+result_cache_write_entry(const int entry_fd,
+                         FILE *__notnull const file,
+                         const bool only_if_changed)
+{
+    if (fflush(file) != 0) {
+        return E_RESULT_CACHE_WRITE_FAIL;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(entry_fd, &sbuf) != 0) {
+        return E_RESULT_CACHE_READ_FAIL;
+    }
+
+    const int fd = fileno(file);
+    const uint64_t length = (uint64_t)sbuf.st_size;
+
+    if (length == 0) {
+        if (only_if_changed && ftruncate(fd, 0) != 0) {
+            return E_RESULT_CACHE_WRITE_FAIL;
+        }
+
+        return E_RESULT_CACHE_OK;
+    }
+
+    char *const data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, entry_fd, 0);
+    if (data == MAP_FAILED) {
+        return E_RESULT_CACHE_READ_FAIL;
+    }
+
+    enum result_cache_result result = E_RESULT_CACHE_OK;
+    if (only_if_changed) {
+        if (file_matches_entry(fd, data, length)) {
+            munmap(data, length);
+            return E_RESULT_CACHE_OK;
+        }
+
+        if (ftruncate(fd, 0) != 0 || our_lseek(fd, 0, SEEK_SET) < 0) {
+            munmap(data, length);
+            return E_RESULT_CACHE_WRITE_FAIL;
+        }
+    }
+
+    /*
+     * On filesystems that support it, the output simply shares the entry's
+     * blocks.
+     */
+
+#if defined(FICLONE)
+    if (ioctl(fd, FICLONE, entry_fd) == 0) {
+        munmap(data, length);
+        return E_RESULT_CACHE_OK;
+    }
+#endif
+
+    if (!write_all(fd, data, length)) {
+        result = E_RESULT_CACHE_WRITE_FAIL;
+    }
+
+    munmap(data, length);
+    return result;
+}
+
+static bool
+write_info_to_fd(const int fd,
+                 const struct tbd_create_info *__notnull const info,
+                 const struct tbd_create_options options)
+{
+    struct write_buffer wb;
+    wb_create_with_fd(&wb, fd);
+
+    const enum tbd_create_result create_result =
+        tbd_create_with_info_to_buffer(info, &wb, options);
+
+    bool result = (create_result == E_TBD_CREATE_OK);
+    if (result && wb_flush(&wb)) {
+        result = false;
+    }
+
+    wb_destroy(&wb);
+    return result;
+}
+
+enum result_cache_result
+result_cache_store(const struct result_cache *__notnull const cache,
+                   const struct result_cache_key *__notnull const key,
+                   const struct tbd_create_info *__notnull const info,
+                   const struct tbd_create_options options)
+{
+    uint64_t dir_length = 0;
+    char *const path = create_entry_path(cache, key, &dir_length);
+
+    if (path == NULL) {
+        return E_RESULT_CACHE_ALLOC_FAIL;
+    }
+
+    /*
+     * The temporary file is created next to the entry, so it can be renamed
+     * into place. mkstemp() gives each process and thread its own file.
+     */
+
+    static const char tmp_name[] = "/.tmp-XXXXXX";
+    char *const tmp_path = malloc(dir_length + sizeof(tmp_name));
+
+    if (tmp_path == NULL) {
+        free(path);
+        return E_RESULT_CACHE_ALLOC_FAIL;
+    }
+
+    memcpy(tmp_path, path, dir_length);
+    tmp_path[dir_length] = '\0';
+
+    if (our_mkdir(tmp_path, 0755) != 0 && errno != EEXIST) {
+        free(tmp_path);
+        free(path);
+
+        return E_RESULT_CACHE_MKDIR_FAIL;
+    }
+
+    memcpy(tmp_path + dir_length, tmp_name, sizeof(tmp_name));
+
+    const int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        free(tmp_path);
+        free(path);
+
+        return E_RESULT_CACHE_WRITE_FAIL;
+    }
+
+    /*
+     * mkstemp() creates the file only readable by its owner, while the cache
+     * may be shared between users.
+     */
+
+    enum result_cache_result result = E_RESULT_CACHE_OK;
+    if (fchmod(fd, 0644) != 0 || !write_info_to_fd(fd, info, options)) {
+        result = E_RESULT_CACHE_WRITE_FAIL;
+    }
+
+    if (close(fd) != 0) {
+        result = E_RESULT_CACHE_WRITE_FAIL;
+    }
+
+    if (result == E_RESULT_CACHE_OK && rename(tmp_path, path) != 0) {
+        result = E_RESULT_CACHE_WRITE_FAIL;
+    }
+
+    if (result != E_RESULT_CACHE_OK) {
+        our_unlink(tmp_path);
+    }
+
+    free(tmp_path);
+    free(path);
+
+    return result;
+}
+
+void result_cache_destroy(struct result_cache *__notnull const cache) {
+    free(cache->path);
+
+    cache->path = NULL;
+    cache->path_length = 0;
+}
@@ -0,0 +1,1491 @@
+//
+//  src/serve.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "array.h"
+#include "our_io.h"
+#include "serve.h"
+
+/*
+ * A request is a serve_request_header, followed by a payload of header.size
+ * bytes holding the client's working directory, and then each of its
+ * header.argc arguments, all null-terminated.
+ *
+ * The client's stdin, stdout, and stderr are sent along with the header.
+ *
+ * The response is a single serve_response, sent once the request finishes.
+ */
+
+#define SERVE_PROTOCOL_VERSION 1
+#define SERVE_MAX_PAYLOAD_SIZE (4 << 20)
+
+struct serve_request_header {
+    uint32_t version;
+    uint32_t argc;
+    uint32_t size;
+};
+
+struct serve_response {
+    int32_t exit_status;
+};
+
+struct serve_request {
+    int fds[3];
+
+    char *payload;
+    uint32_t argc;
+    uint32_t size;
+};
+
+struct serve_worker {
+    pid_t pid;
+    int conn_fd;
+};
+
+struct serve_mapped_dsc {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+
+    uint64_t last_used;
+    struct dyld_shared_cache_info info;
+};
+
+/*
+ * Only so many dyld_shared_cache files are kept mapped, after which the least
+ * recently used file is unmapped.
+ */
+
+#define SERVE_MAX_MAPPED_DSCS 8
+
+static struct array mapped_dscs = {};
+static uint64_t mapped_dscs_clock = 0;
+
+static const struct dyld_shared_cache_parse_options mapped_dsc_options = {
+    .zero_image_pads = true
+};
+
+/*
+ * Signals are forwarded to the server's loop through signal_pipe.
+ */
+
+static int signal_pipe[2] = { -1, -1 };
+
+static void handle_signal(const int signal) {
+    const int saved_errno = errno;
+    const char byte = (char)signal;
+
+    write(signal_pipe[1], &byte, 1);
+    errno = saved_errno;
+}
+
+static inline int64_t get_mtime_sec(const struct stat *__notnull const sbuf) {
+#if defined(__APPLE__)
+    return sbuf->st_mtimespec.tv_sec;
+#else
+    return sbuf->st_mtim.tv_sec;
+#endif
+}
+
+static inline int64_t get_mtime_nsec(const struct stat *__notnull const sbuf) {
+#if defined(__APPLE__)
+    return sbuf->st_mtimespec.tv_nsec;
+#else
+    return sbuf->st_mtim.tv_nsec;
+#endif
+}
+
+static struct serve_mapped_dsc *
+find_mapped_dsc(const struct stat *__notnull const sbuf) {
+    struct serve_mapped_dsc *dsc = mapped_dscs.data;
+    const struct serve_mapped_dsc *const end = mapped_dscs.data_end;
+
+    for (; dsc != end; dsc++) {
+        if (dsc->dev == (uint64_t)sbuf->st_dev &&
+            dsc->ino == (uint64_t)sbuf->st_ino)
+        {
+            return dsc;
+        }
+    }
+
+    return NULL;
+}
+
+static inline bool
+mapped_dsc_is_current(const struct serve_mapped_dsc *__notnull const dsc,
+                      const struct stat *__notnull const sbuf)
+{
+    return (dsc->size == (uint64_t)sbuf->st_size &&
+            dsc->mtime_sec == get_mtime_sec(sbuf) &&
+            dsc->mtime_nsec == get_mtime_nsec(sbuf));
+}
+
+static void remove_mapped_dsc(struct serve_mapped_dsc *__notnull const dsc) {
+    dyld_shared_cache_info_destroy(&dsc->info);
+
+    const uint64_t count = mapped_dscs.item_count;
+    struct serve_mapped_dsc *const back =
+        array_get_back(&mapped_dscs, sizeof(*back));
+
+    if (dsc != back) {
+        *dsc = *back;
+    }
+
+    array_trim_to_item_count(&mapped_dscs, sizeof(*dsc), count - 1);
+}
+
+static void remove_least_recently_used_dsc(void) {
+    struct serve_mapped_dsc *dsc = mapped_dscs.data;
+    const struct serve_mapped_dsc *const end = mapped_dscs.data_end;
+
+    struct serve_mapped_dsc *oldest = dsc;
+    for (dsc++; dsc < end; dsc++) {
+        if (dsc->last_used < oldest->last_used) {
+            oldest = dsc;
+        }
+    }
+
+    remove_mapped_dsc(oldest);
+}
+
+static void
+map_dsc(const int dir_fd,
+        const char *__notnull const path,
+        const struct stat *__notnull const sbuf)
+{
+    const int fd = our_openat(dir_fd, path, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    char magic[16] = {};
+    if (our_pread(fd, magic, sizeof(magic), 0) != sizeof(magic)) {
+        close(fd);
+        return;
+    }
+
+    if (strncmp(magic, "dyld_v1", 7) != 0) {
+        close(fd);
+        return;
+    }
+
+    struct serve_mapped_dsc dsc = {
+        .dev = (uint64_t)sbuf->st_dev,
+        .ino = (uint64_t)sbuf->st_ino,
+        .size = (uint64_t)sbuf->st_size,
+
+        .mtime_sec = get_mtime_sec(sbuf),
+        .mtime_nsec = get_mtime_nsec(sbuf),
+
+        .last_used = mapped_dscs_clock
+    };
+
+    const enum dyld_shared_cache_parse_result parse_result =
+        dyld_shared_cache_parse_from_file(&dsc.info,
+                                          fd,
+                                          magic,
+                                          mapped_dsc_options);
+
+    close(fd);
+
+    if (parse_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        return;
+    }
+
+    if (mapped_dscs.item_count == SERVE_MAX_MAPPED_DSCS) {
+        remove_least_recently_used_dsc();
+    }
+
+    const enum array_result add_dsc_result =
+        array_add_item(&mapped_dscs, sizeof(dsc), &dsc, NULL);
+
+    if (add_dsc_result != E_ARRAY_OK) {
+        dyld_shared_cache_info_destroy(&dsc.info);
+    }
+}
+
+/*
+ * Map every dyld_shared_cache file found in a request's arguments, or mark
+ * them as used if they're already mapped.
+ */
+
+static void
+map_dscs_in_arguments(const int dir_fd,
+                      const uint32_t argc,
+                      char *const argv[])
+{
+    mapped_dscs_clock++;
+
+    for (uint32_t i = 0; i != argc; i++) {
+        const char *const arg = argv[i];
+        if (arg[0] == '-') {
+            continue;
+        }
+
+        struct stat sbuf = {};
+        if (fstatat(dir_fd, arg, &sbuf, 0) != 0) {
+            continue;
+        }
+
+        if (!S_ISREG(sbuf.st_mode)) {
+            continue;
+        }
+
+        struct serve_mapped_dsc *const dsc = find_mapped_dsc(&sbuf);
+        if (dsc != NULL) {
+            if (mapped_dsc_is_current(dsc, &sbuf)) {
+                dsc->last_used = mapped_dscs_clock;
+                continue;
+            }
+
+            remove_mapped_dsc(dsc);
+        }
+
+        map_dsc(dir_fd, arg, &sbuf);
+    }
+}
+
+static void destroy_mapped_dscs(void) {
+    struct serve_mapped_dsc *dsc = mapped_dscs.data;
+    const struct serve_mapped_dsc *const end = mapped_dscs.data_end;
+
+    for (; dsc != end; dsc++) {
+        dyld_shared_cache_info_destroy(&dsc->info);
+    }
+
+    array_destroy(&mapped_dscs);
+}
+
+bool
+serve_find_mapped_dsc(const int fd,
+                      const struct dyld_shared_cache_parse_options options,
+                      struct dyld_shared_cache_info *__notnull const info_out)
+{
+    if (mapped_dscs.item_count == 0) {
+        return false;
+    }
+
+    if (options.zero_image_pads != mapped_dsc_options.zero_image_pads ||
+        options.verify_image_path_offsets !=
+            mapped_dsc_options.verify_image_path_offsets ||
+        options.use_huge_pages != mapped_dsc_options.use_huge_pages)
+    {
+        return false;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) != 0) {
+        return false;
+    }
+
+    const struct serve_mapped_dsc *const dsc = find_mapped_dsc(&sbuf);
+    if (dsc == NULL || !mapped_dsc_is_current(dsc, &sbuf)) {
+        return false;
+    }
+
+    /*
+     * The mapping belongs to the server, and is only unmapped along with the
+     * request's process.
+     */
+
+    *info_out = dsc->info;
+    info_out->flags.unmap_map = false;
+
+    return true;
+}
+
+static bool
+read_all(const int fd, void *__notnull const buff, const uint64_t size) {
+    uint8_t *iter = buff;
+    uint64_t left = size;
+
+    while (left != 0) {
+        const ssize_t read_size = read(fd, iter, left);
+        if (read_size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        if (read_size == 0) {
+            return false;
+        }
+
+        iter += read_size;
+        left -= (uint64_t)read_size;
+    }
+
+    return true;
+}
+
+static bool
+write_all(const int fd, const void *__notnull const buff, const uint64_t size) {
+    const uint8_t *iter = buff;
+    uint64_t left = size;
+
+    while (left != 0) {
+        const ssize_t write_size = write(fd, iter, left);
+        if (write_size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        iter += write_size;
+        left -= (uint64_t)write_size;
+    }
+
+    return true;
+}
+
+static void close_fds(const int *__notnull const fds, const uint32_t count) {
+    for (uint32_t i = 0; i != count; i++) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+}
+
+/*
+ * Requests are received without blocking, a piece at a time as they arrive, so
+ * a client that is slow to send its request, or never does, doesn't hold up any
+ * other client. Connections that haven't sent their full request in time are
+ * dropped.
+ */
+
+#define SERVE_MAX_CONNECTIONS 64
+#define SERVE_RECEIVE_TIMEOUT_MS 10000
+
+struct serve_connection {
+    int fd;
+
+    struct serve_request_header header;
+    uint64_t header_received;
+    uint64_t payload_received;
+
+    struct serve_request request;
+    int64_t deadline;
+
+    bool is_received : 1;
+};
+
+/*
+ * Connections are kept in the order they were accepted, so requests are run in
+ * the order they arrive.
+ */
+
+struct serve_connections {
+    struct serve_connection list[SERVE_MAX_CONNECTIONS];
+    uint64_t count;
+};
+
+enum receive_result {
+    E_RECEIVE_OK,
+    E_RECEIVE_NEEDS_MORE,
+    E_RECEIVE_FAIL
+};
+
+static int64_t get_time_ms(void) {
+    struct timespec time = {};
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (int64_t)time.tv_sec * 1000 + time.tv_nsec / 1000000;
+}
+
+static inline bool is_would_block_error(const int error) {
+    return (error == EAGAIN || error == EWOULDBLOCK);
+}
+
+/*
+ * The client's file-descriptors are sent along with the first part of the
+ * header. Any other file-descriptors received are simply closed.
+ */
+
+static void
+take_fds(struct serve_connection *__notnull const conn,
+         struct msghdr *__notnull const msg)
+{
+    const struct cmsghdr *const cmsg = CMSG_FIRSTHDR(msg);
+    if (cmsg == NULL ||
+        cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        return;
+    }
+
+    const uint32_t count =
+        (uint32_t)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+
+    int fds[3] = { -1, -1, -1 };
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+
+    if (count != 3 || conn->request.fds[0] >= 0) {
+        close_fds(fds, count);
+        return;
+    }
+
+    memcpy(conn->request.fds, fds, sizeof(fds));
+}
+
+static enum receive_result
+receive_header(struct serve_connection *__notnull const conn) {
+    union {
+        struct cmsghdr header;
+        char buff[CMSG_SPACE(sizeof(int) * 3)];
+    } control = {};
+
+    struct iovec iov = {
+        .iov_base = (uint8_t *)&conn->header + conn->header_received,
+        .iov_len = sizeof(conn->header) - conn->header_received
+    };
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buff,
+        .msg_controllen = sizeof(control.buff)
+    };
+
+    ssize_t received = 0;
+    do {
+        received = recvmsg(conn->fd, &msg, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received < 0) {
+        if (is_would_block_error(errno)) {
+            return E_RECEIVE_NEEDS_MORE;
+        }
+
+        return E_RECEIVE_FAIL;
+    }
+
+    take_fds(conn, &msg);
+    if (received == 0 || (msg.msg_flags & MSG_CTRUNC)) {
+        return E_RECEIVE_FAIL;
+    }
+
+    /*
+     * The header itself may arrive in pieces.
+     */
+
+    conn->header_received += (uint64_t)received;
+    if (conn->header_received != sizeof(conn->header)) {
+        return E_RECEIVE_NEEDS_MORE;
+    }
+
+    const struct serve_request_header header = conn->header;
+    if (conn->request.fds[0] < 0 ||
+        header.version != SERVE_PROTOCOL_VERSION ||
+        header.size == 0 ||
+        header.size > SERVE_MAX_PAYLOAD_SIZE)
+    {
+        return E_RECEIVE_FAIL;
+    }
+
+    char *const payload = malloc(header.size);
+    if (payload == NULL) {
+        return E_RECEIVE_FAIL;
+    }
+
+    conn->request.payload = payload;
+    conn->request.argc = header.argc;
+    conn->request.size = header.size;
+
+    return E_RECEIVE_OK;
+}
+
+static enum receive_result
+receive_payload(struct serve_connection *__notnull const conn) {
+    struct serve_request *const request = &conn->request;
+    while (conn->payload_received != request->size) {
+        const ssize_t received =
+            recv(conn->fd,
+                 request->payload + conn->payload_received,
+                 request->size - conn->payload_received,
+                 0);
+
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if (is_would_block_error(errno)) {
+                return E_RECEIVE_NEEDS_MORE;
+            }
+
+            return E_RECEIVE_FAIL;
+        }
+
+        if (received == 0) {
+            return E_RECEIVE_FAIL;
+        }
+
+        conn->payload_received += (uint64_t)received;
+    }
+
+    if (request->payload[request->size - 1] != '\0') {
+        return E_RECEIVE_FAIL;
+    }
+
+    return E_RECEIVE_OK;
+}
+
+static enum receive_result
+continue_receiving(struct serve_connection *__notnull const conn) {
+    if (conn->request.payload == NULL) {
+        const enum receive_result receive_header_result =
+            receive_header(conn);
+
+        if (receive_header_result != E_RECEIVE_OK) {
+            return receive_header_result;
+        }
+    }
+
+    return receive_payload(conn);
+}
+
+static void destroy_connection(struct serve_connection *__notnull const conn) {
+    free(conn->request.payload);
+    close_fds(conn->request.fds, 3);
+
+    close(conn->fd);
+}
+
+static void
+remove_connection(struct serve_connections *__notnull const connections,
+                  const uint64_t index)
+{
+    struct serve_connection *const conn = connections->list + index;
+    const uint64_t after_count = connections->count - index - 1;
+
+    memmove(conn, conn + 1, sizeof(*conn) * after_count);
+    connections->count -= 1;
+}
+
+/*
+ * Requests are run as the server's user, so only that same user may send them.
+ */
+
+static bool is_peer_allowed(const int conn_fd) {
+#if defined(__linux__)
+    struct ucred cred = {};
+    socklen_t length = sizeof(cred);
+
+    if (getsockopt(conn_fd, SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) {
+        return false;
+    }
+
+    return (cred.uid == geteuid());
+#else
+    uid_t uid = 0;
+    gid_t gid = 0;
+
+    if (getpeereid(conn_fd, &uid, &gid) != 0) {
+        return false;
+    }
+
+    return (uid == geteuid());
+#endif
+}
+
+static void
+accept_connection(const int listen_fd,
+                  struct serve_connections *__notnull const connections)
+{
+    const int conn_fd = accept(listen_fd, NULL, NULL);
+    if (conn_fd < 0) {
+        return;
+    }
+
+    if (!is_peer_allowed(conn_fd)) {
+        close(conn_fd);
+        return;
+    }
+
+    const int flags = fcntl(conn_fd, F_GETFL);
+    if (flags < 0 || fcntl(conn_fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+        close(conn_fd);
+        return;
+    }
+
+    struct serve_connection *const conn =
+        connections->list + connections->count;
+
+    *conn = (struct serve_connection){
+        .fd = conn_fd,
+        .request = {
+            .fds = { -1, -1, -1 }
+        },
+        .deadline = get_time_ms() + SERVE_RECEIVE_TIMEOUT_MS
+    };
+
+    connections->count += 1;
+}
+
+/*
+ * Split the payload into the working directory, and a null-terminated list of
+ * arguments, with "tbd" in front in place of the program's path.
+ */
+
+static char program_name[] = "tbd";
+
+static char **
+create_argv(const struct serve_request *__notnull const request,
+            const char **__notnull const cwd_out)
+{
+    char **const argv = calloc(request->argc + 2, sizeof(char *));
+    if (argv == NULL) {
+        return NULL;
+    }
+
+    char *iter = request->payload;
+    const char *const end = request->payload + request->size;
+
+    *cwd_out = iter;
+    iter += strlen(iter) + 1;
+
+    argv[0] = program_name;
+    for (uint32_t i = 0; i != request->argc; i++) {
+        if (iter == end) {
+            free(argv);
+            return NULL;
+        }
+
+        argv[i + 1] = iter;
+        iter += strlen(iter) + 1;
+    }
+
+    if (iter != end) {
+        free(argv);
+        return NULL;
+    }
+
+    return argv;
+}
+
+static int32_t get_exit_status(const int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+
+    return 1;
+}
+
+static void send_exit_status(const int conn_fd, const int32_t exit_status) {
+    const struct serve_response response = {
+        .exit_status = exit_status
+    };
+
+    write_all(conn_fd, &response, sizeof(response));
+}
+
+static void reset_signals(void) {
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+}
+
+/*
+ * Make the client's file-descriptors our standard streams, first moving them
+ * past the standard streams so none are overwritten before being moved.
+ */
+
+static bool use_client_fds(int *__notnull const fds) {
+    for (int i = 0; i != 3; i++) {
+        const int fd = fcntl(fds[i], F_DUPFD, 3);
+        if (fd < 0) {
+            return false;
+        }
+
+        close(fds[i]);
+        fds[i] = fd;
+    }
+
+    for (int i = 0; i != 3; i++) {
+        if (dup2(fds[i], i) < 0) {
+            return false;
+        }
+
+        close(fds[i]);
+    }
+
+    return true;
+}
+
+static void
+run_request(const int listen_fd,
+            const int conn_fd,
+            struct serve_connections *__notnull const connections,
+            const struct array *__notnull const workers,
+            struct serve_request *__notnull const request,
+            const int cwd_fd,
+            char *const argv[],
+            const serve_handler handler)
+{
+    reset_signals();
+
+    close(listen_fd);
+    close(conn_fd);
+
+    close(signal_pipe[0]);
+    close(signal_pipe[1]);
+
+    const struct serve_worker *worker = workers->data;
+    const struct serve_worker *const end = workers->data_end;
+
+    for (; worker != end; worker++) {
+        close(worker->conn_fd);
+    }
+
+    for (uint64_t i = 0; i != connections->count; i++) {
+        destroy_connection(connections->list + i);
+    }
+
+    if (!use_client_fds(request->fds)) {
+        exit(1);
+    }
+
+    if (fchdir(cwd_fd) != 0) {
+        fprintf(stderr,
+                "Failed to change to the working directory of the request, "
+                "error: %s\n",
+                strerror(errno));
+
+        exit(1);
+    }
+
+    close(cwd_fd);
+    exit(handler((int)request->argc + 1, argv));
+}
+
+static void
+fail_request(struct serve_request *__notnull const request,
+             const int conn_fd,
+             const char *__notnull const message)
+{
+    const int stderr_fd = request->fds[2];
+
+    write_all(stderr_fd, message, strlen(message));
+    send_exit_status(conn_fd, 1);
+}
+
+/*
+ * Start the fully received request of the connection at index, removing the
+ * connection from connections.
+ */
+
+static void
+start_request(const int listen_fd,
+              struct serve_connections *__notnull const connections,
+              const uint64_t index,
+              struct array *__notnull const workers,
+              const serve_handler handler)
+{
+    const int conn_fd = connections->list[index].fd;
+    struct serve_request request = connections->list[index].request;
+
+    remove_connection(connections, index);
+
+    /*
+     * Only the exit status is left to send, which is sent with a blocking
+     * write.
+     */
+
+    const int flags = fcntl(conn_fd, F_GETFL);
+    if (flags >= 0) {
+        fcntl(conn_fd, F_SETFL, flags & ~O_NONBLOCK);
+    }
+
+    const char *cwd = NULL;
+    char **const argv = create_argv(&request, &cwd);
+
+    if (argv == NULL) {
+        fail_request(&request, conn_fd, "Received a malformed request\n");
+
+        free(request.payload);
+        close_fds(request.fds, 3);
+        close(conn_fd);
+
+        return;
+    }
+
+    const int cwd_fd = our_open(cwd, O_RDONLY | O_DIRECTORY, 0);
+    if (cwd_fd < 0) {
+        fail_request(&request,
+                     conn_fd,
+                     "Failed to open the working directory of the request\n");
+
+        free(argv);
+        free(request.payload);
+        close_fds(request.fds, 3);
+        close(conn_fd);
+
+        return;
+    }
+
+    map_dscs_in_arguments(cwd_fd, request.argc, argv + 1);
+
+    const pid_t pid = fork();
+    if (pid == 0) {
+        run_request(listen_fd,
+                    conn_fd,
+                    connections,
+                    workers,
+                    &request,
+                    cwd_fd,
+                    argv,
+                    handler);
+    }
+
+    free(argv);
+    free(request.payload);
+
+    close(cwd_fd);
+    close_fds(request.fds, 3);
+
+    if (pid < 0) {
+        send_exit_status(conn_fd, 1);
+        close(conn_fd);
+
+        return;
+    }
+
+    const struct serve_worker worker = {
+        .pid = pid,
+        .conn_fd = conn_fd
+    };
+
+    const enum array_result add_worker_result =
+        array_add_item(workers, sizeof(worker), &worker, NULL);
+
+    /*
+     * If the worker can't be tracked, the client is only sent its exit status
+     * once the request finishes.
+     */
+
+    if (add_worker_result != E_ARRAY_OK) {
+        int status = 0;
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+
+        send_exit_status(conn_fd, get_exit_status(status));
+        close(conn_fd);
+    }
+}
+
+static void
+finish_worker(struct array *__notnull const workers,
+              const pid_t pid,
+              const int status)
+{
+    struct serve_worker *worker = workers->data;
+    const struct serve_worker *const end = workers->data_end;
+
+    for (; worker != end; worker++) {
+        if (worker->pid != pid) {
+            continue;
+        }
+
+        send_exit_status(worker->conn_fd, get_exit_status(status));
+        close(worker->conn_fd);
+
+        const uint64_t count = workers->item_count;
+        const struct serve_worker *const back =
+            array_get_back(workers, sizeof(*back));
+
+        if (worker != back) {
+            *worker = *back;
+        }
+
+        array_trim_to_item_count(workers, sizeof(*worker), count - 1);
+        return;
+    }
+}
+
+static void
+reap_workers(struct array *__notnull const workers, const bool wait) {
+    const int options = (wait) ? 0 : WNOHANG;
+
+    while (workers->item_count != 0) {
+        int status = 0;
+        const pid_t pid = waitpid(-1, &status, options);
+
+        if (pid < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (pid <= 0) {
+            break;
+        }
+
+        finish_worker(workers, pid, status);
+    }
+}
+
+/*
+ * Bind to the socket at path, replacing the socket left behind by a server
+ * that is no longer running.
+ */
+
+static bool
+bind_socket(const int fd, const struct sockaddr_un *__notnull const addr) {
+    const struct sockaddr *const sockaddr = (const struct sockaddr *)addr;
+    if (bind(fd, sockaddr, sizeof(*addr)) == 0) {
+        return true;
+    }
+
+    if (errno != EADDRINUSE) {
+        return false;
+    }
+
+    const int test_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (test_fd < 0) {
+        return false;
+    }
+
+    const int connect_result = connect(test_fd, sockaddr, sizeof(*addr));
+    const int connect_errno = errno;
+
+    close(test_fd);
+
+    if (connect_result == 0 || connect_errno != ECONNREFUSED) {
+        errno = EADDRINUSE;
+        return false;
+    }
+
+    if (our_unlink(addr->sun_path) != 0) {
+        return false;
+    }
+
+    return (bind(fd, sockaddr, sizeof(*addr)) == 0);
+}
+
+static bool
+create_address(const char *__notnull const path,
+               struct sockaddr_un *__notnull const addr_out)
+{
+    const size_t path_length = strlen(path);
+    if (path_length >= sizeof(addr_out->sun_path)) {
+        fprintf(stderr, "Socket path is too long: %s\n", path);
+        return false;
+    }
+
+    addr_out->sun_family = AF_UNIX;
+    memcpy(addr_out->sun_path, path, path_length + 1);
+
+    return true;
+}
+
+static bool install_signal_handlers(void) {
+    if (pipe(signal_pipe) != 0) {
+        return false;
+    }
+
+    fcntl(signal_pipe[1], F_SETFL, O_NONBLOCK);
+
+    struct sigaction action = {};
+    action.sa_handler = handle_signal;
+    action.sa_flags = SA_RESTART;
+
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGCHLD, &action, NULL);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    /*
+     * A client that goes away before its exit status is sent shouldn't take the
+     * server down with it.
+     */
+
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+/*
+ * Returns whether the server should keep running.
+ */
+
+static bool handle_signals(struct array *__notnull const workers) {
+    char signals[64];
+    const ssize_t count = read(signal_pipe[0], signals, sizeof(signals));
+
+    bool keep_running = true;
+    for (ssize_t i = 0; i < count; i++) {
+        if (signals[i] != SIGCHLD) {
+            keep_running = false;
+        }
+    }
+
+    reap_workers(workers, false);
+    return keep_running;
+}
+
+static void
+start_received_requests(
+    const int listen_fd,
+    struct serve_connections *__notnull const connections,
+    struct array *__notnull const workers,
+    const uint64_t worker_limit,
+    const serve_handler handler)
+{
+    uint64_t index = 0;
+    while (index != connections->count && workers->item_count < worker_limit) {
+        if (!connections->list[index].is_received) {
+            index++;
+            continue;
+        }
+
+        start_request(listen_fd, connections, index, workers, handler);
+    }
+}
+
+/*
+ * Add a pollfd for every connection still being received, storing the index
+ * of each connection polled in indices, and returning the timeout to poll with.
+ */
+
+static int
+add_connection_pollfds(
+    const struct serve_connections *__notnull const connections,
+    struct pollfd *__notnull const fds,
+    uint64_t *__notnull const indices,
+    uint64_t *__notnull const count_out)
+{
+    const int64_t now = get_time_ms();
+
+    uint64_t count = 0;
+    int64_t timeout = -1;
+
+    for (uint64_t i = 0; i != connections->count; i++) {
+        const struct serve_connection *const conn = connections->list + i;
+        if (conn->is_received) {
+            continue;
+        }
+
+        fds[count].fd = conn->fd;
+        fds[count].events = POLLIN;
+
+        indices[count] = i;
+        count++;
+
+        int64_t left = conn->deadline - now;
+        if (left < 0) {
+            left = 0;
+        }
+
+        if (timeout < 0 || left < timeout) {
+            timeout = left;
+        }
+    }
+
+    *count_out = count;
+    return (int)timeout;
+}
+
+/*
+ * Go through the polled connections in reverse, so the indices of those not yet
+ * handled stay valid as connections are removed.
+ */
+
+static void
+receive_from_connections(struct serve_connections *__notnull const connections,
+                         const struct pollfd *__notnull const fds,
+                         const uint64_t *__notnull const indices,
+                         uint64_t count)
+{
+    while (count != 0) {
+        count--;
+        if (fds[count].revents == 0) {
+            continue;
+        }
+
+        const uint64_t index = indices[count];
+        struct serve_connection *const conn = connections->list + index;
+
+        switch (continue_receiving(conn)) {
+            case E_RECEIVE_OK:
+                conn->is_received = true;
+                break;
+
+            case E_RECEIVE_NEEDS_MORE:
+                break;
+
+            case E_RECEIVE_FAIL:
+                destroy_connection(conn);
+                remove_connection(connections, index);
+
+                break;
+        }
+    }
+}
+
+static void
+drop_expired_connections(
+    struct serve_connections *__notnull const connections)
+{
+    const int64_t now = get_time_ms();
+
+    uint64_t index = connections->count;
+    while (index != 0) {
+        index--;
+
+        struct serve_connection *const conn = connections->list + index;
+        if (conn->is_received || conn->deadline > now) {
+            continue;
+        }
+
+        destroy_connection(conn);
+        remove_connection(connections, index);
+    }
+}
+
+static void
+destroy_connections(struct serve_connections *__notnull const connections) {
+    for (uint64_t i = 0; i != connections->count; i++) {
+        destroy_connection(connections->list + i);
+    }
+
+    connections->count = 0;
+}
+
+int serve_run_server(const char *__notnull const path, serve_handler handler) {
+    struct sockaddr_un addr = {};
+    if (!create_address(path, &addr)) {
+        return 1;
+    }
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr,
+                "Failed to create a socket, error: %s\n",
+                strerror(errno));
+
+        return 1;
+    }
+
+    /*
+     * Create the socket with only the owner able to connect to it.
+     */
+
+    const mode_t mask = umask(S_IXUSR | S_IRWXG | S_IRWXO);
+    const bool did_bind = bind_socket(listen_fd, &addr);
+
+    umask(mask);
+
+    if (!did_bind) {
+        fprintf(stderr,
+                "Failed to bind to socket at path: %s, error: %s\n",
+                path,
+                strerror(errno));
+
+        close(listen_fd);
+        return 1;
+    }
+
+    if (listen(listen_fd, SOMAXCONN) != 0) {
+        fprintf(stderr,
+                "Failed to listen on socket at path: %s, error: %s\n",
+                path,
+                strerror(errno));
+
+        our_unlink(path);
+        close(listen_fd);
+
+        return 1;
+    }
+
+    if (!install_signal_handlers()) {
+        fprintf(stderr,
+                "Failed to set up signal handling, error: %s\n",
+                strerror(errno));
+
+        our_unlink(path);
+        close(listen_fd);
+
+        return 1;
+    }
+
+    /*
+     * Only as many requests as there are processors are run at once, with the
+     * rest waiting as received connections.
+     */
+
+    long worker_limit = sysconf(_SC_NPROCESSORS_ONLN);
+    if (worker_limit < 1) {
+        worker_limit = 1;
+    }
+
+    struct array workers = {};
+    struct serve_connections connections = {};
+
+    bool keep_running = true;
+
+    while (keep_running) {
+        start_received_requests(listen_fd,
+                                &connections,
+                                &workers,
+                                (uint64_t)worker_limit,
+                                handler);
+
+        const bool can_accept = connections.count != SERVE_MAX_CONNECTIONS;
+
+        struct pollfd fds[2 + SERVE_MAX_CONNECTIONS] = {
+            { .fd = signal_pipe[0], .events = POLLIN },
+            { .fd = (can_accept) ? listen_fd : -1, .events = POLLIN }
+        };
+
+        uint64_t indices[SERVE_MAX_CONNECTIONS];
+        uint64_t conn_count = 0;
+
+        const int timeout =
+            add_connection_pollfds(&connections,
+                                   fds + 2,
+                                   indices,
+                                   &conn_count);
+
+        if (poll(fds, (nfds_t)(2 + conn_count), timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            fprintf(stderr,
+                    "Failed to wait for requests, error: %s\n",
+                    strerror(errno));
+
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            keep_running = handle_signals(&workers);
+            continue;
+        }
+
+        receive_from_connections(&connections, fds + 2, indices, conn_count);
+        drop_expired_connections(&connections);
+
+        if (fds[1].revents & POLLIN) {
+            accept_connection(listen_fd, &connections);
+        }
+    }
+
+    destroy_connections(&connections);
+
+    our_unlink(path);
+    close(listen_fd);
+
+    reap_workers(&workers, true);
+    array_destroy(&workers);
+
+    destroy_mapped_dscs();
+
+    close(signal_pipe[0]);
+    close(signal_pipe[1]);
+
+    return 0;
+}
+
+static char *
+create_payload(const int argc,
+               char *const argv[],
+               uint32_t *__notnull const size_out)
+{
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr,
+                "Failed to get the current working directory, error: %s\n",
+                strerror(errno));
+
+        return NULL;
+    }
+
+    uint64_t size = strlen(cwd) + 1;
+    for (int i = 0; i != argc; i++) {
+        size += strlen(argv[i]) + 1;
+    }
+
+    if (size > SERVE_MAX_PAYLOAD_SIZE) {
+        fputs("Arguments are too long to send to the server\n", stderr);
+        return NULL;
+    }
+
+    char *const payload = malloc(size);
+    if (payload == NULL) {
+        fputs("Failed to allocate memory for the request\n", stderr);
+        return NULL;
+    }
+
+    char *iter = stpcpy(payload, cwd) + 1;
+    for (int i = 0; i != argc; i++) {
+        iter = stpcpy(iter, argv[i]) + 1;
+    }
+
+    *size_out = (uint32_t)size;
+    return payload;
+}
+
+static bool
+send_header(const int fd,
+            const struct serve_request_header *__notnull const header)
+{
+    union {
+        struct cmsghdr header;
+        char buff[CMSG_SPACE(sizeof(int) * 3)];
+    } control = {};
+
+    struct iovec iov = {
+        .iov_base = (void *)header,
+        .iov_len = sizeof(*header)
+    };
+
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buff,
+        .msg_controllen = sizeof(control.buff)
+    };
+
+    struct cmsghdr *const cmsg = CMSG_FIRSTHDR(&msg);
+
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * 3);
+
+    const int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t sent = 0;
+    do {
+        sent = sendmsg(fd, &msg, 0);
+    } while (sent < 0 && errno == EINTR);
+
+    if (sent < 0) {
+        return false;
+    }
+
+    const uint64_t header_left = sizeof(*header) - (uint64_t)sent;
+    if (header_left != 0) {
+        return write_all(fd, (const uint8_t *)header + sent, header_left);
+    }
+
+    return true;
+}
+
+int
+serve_run_client(const char *__notnull const path,
+                 const int argc,
+                 char *const argv[])
+{
+    struct sockaddr_un addr = {};
+    if (!create_address(path, &addr)) {
+        return 1;
+    }
+
+    uint32_t size = 0;
+    char *const payload = create_payload(argc, argv, &size);
+
+    if (payload == NULL) {
+        return 1;
+    }
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        fprintf(stderr,
+                "Failed to create a socket, error: %s\n",
+                strerror(errno));
+
+        free(payload);
+        return 1;
+    }
+
+    const struct sockaddr *const sockaddr = (const struct sockaddr *)&addr;
+    if (connect(fd, sockaddr, sizeof(addr)) != 0) {
+        fprintf(stderr,
+                "Failed to connect to server at path: %s, error: %s\n",
+                path,
+                strerror(errno));
+
+        free(payload);
+        close(fd);
+
+        return 1;
+    }
+
+    const struct serve_request_header header = {
+        .version = SERVE_PROTOCOL_VERSION,
+        .argc = (uint32_t)argc,
+        .size = size
+    };
+
+    /*
+     * A server that goes away should be reported, rather than ending the
+     * client.
+     */
+
+    signal(SIGPIPE, SIG_IGN);
+
+    const bool sent_request =
+        send_header(fd, &header) && write_all(fd, payload, size);
+
+    free(payload);
+
+    if (!sent_request) {
+        fprintf(stderr,
+                "Failed to send request to server at path: %s, error: %s\n",
+                path,
+                strerror(errno));
+
+        close(fd);
+        return 1;
+    }
+
+    struct serve_response response = {};
+    if (!read_all(fd, &response, sizeof(response))) {
+        fprintf(stderr,
+                "Server at path: %s closed the connection before the request "
+                "finished\n",
+                path);
+
+        close(fd);
+        return 1;
+    }
+
+    close(fd);
+    return response.exit_status;
+}
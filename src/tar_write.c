@@ -0,0 +1,224 @@
+//
+//  src/tar_write.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <string.h>
+
+#include "tar_write.h"
+
+#define TAR_BLOCK_SIZE 512
+
+struct tar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+};
+
+static const char zero_block[TAR_BLOCK_SIZE * 2] = {};
+
+/*
+ * Write number into field as zero-padded octal, followed by a null-terminator.
+ */
+
+static void
+write_octal(char *__notnull const field,
+            const uint64_t field_size,
+            uint64_t number)
+{
+    char *iter = field + field_size - 1;
+    *iter = '\0';
+
+    while (iter != field) {
+        iter--;
+
+        *iter = (char)('0' + (number & 7));
+        number >>= 3;
+    }
+}
+
+/*
+ * Fill out the fields of a regular-file header besides its name. Members are
+ * given an mtime of zero, so archives of the same tbds are always identical.
+ */
+
+static void
+fill_header(struct tar_header *__notnull const header,
+            const char typeflag,
+            const uint64_t size)
+{
+    write_octal(header->mode, sizeof(header->mode), 0644);
+    write_octal(header->uid, sizeof(header->uid), 0);
+    write_octal(header->gid, sizeof(header->gid), 0);
+    write_octal(header->size, sizeof(header->size), size);
+    write_octal(header->mtime, sizeof(header->mtime), 0);
+
+    header->typeflag = typeflag;
+
+    memcpy(header->magic, "ustar", 6);
+    memcpy(header->version, "00", 2);
+
+    /*
+     * The checksum is calculated with the checksum field filled with spaces,
+     * and is stored as six octal digits, a null-terminator, and a space.
+     */
+
+    memset(header->checksum, ' ', sizeof(header->checksum));
+
+    const unsigned char *const bytes = (const unsigned char *)header;
+    uint64_t checksum = 0;
+
+    for (uint64_t i = 0; i != TAR_BLOCK_SIZE; i++) {
+        checksum += bytes[i];
+    }
+
+    write_octal(header->checksum, 7, checksum);
+    header->checksum[7] = ' ';
+}
+
+/*
+ * Split name at a slash into the ustar prefix and name fields, returning false
+ * if no such slash exists.
+ */
+
+static bool
+split_name_into_header(struct tar_header *__notnull const header,
+                       const char *__notnull const name,
+                       const uint64_t name_length)
+{
+    if (name_length <= sizeof(header->name)) {
+        memcpy(header->name, name, name_length);
+        return true;
+    }
+
+    uint64_t index = name_length - sizeof(header->name) - 1;
+    for (; index <= sizeof(header->prefix); index++) {
+        if (index >= name_length) {
+            break;
+        }
+
+        if (name[index] != '/') {
+            continue;
+        }
+
+        memcpy(header->prefix, name, index);
+        memcpy(header->name, name + index + 1, name_length - index - 1);
+
+        return true;
+    }
+
+    return false;
+}
+
+static uint64_t get_digit_count(uint64_t number) {
+    uint64_t count = 1;
+    for (; number >= 10; number /= 10) {
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * Write out a pax extended header holding the full path of the member
+ * following it.
+ */
+
+static int
+write_pax_path_header(struct write_buffer *__notnull const wb,
+                      const char *__notnull const name,
+                      const uint64_t name_length)
+{
+    /*
+     * A pax record is "<length> path=<name>\n", where length counts the digits
+     * of length itself.
+     */
+
+    const uint64_t base_length = sizeof(" path=\n") - 1 + name_length;
+
+    uint64_t record_length = base_length + 1;
+    while (base_length + get_digit_count(record_length) != record_length) {
+        record_length = base_length + get_digit_count(record_length);
+    }
+
+    struct tar_header header = {};
+    memcpy(header.name, "PaxHeader", sizeof("PaxHeader") - 1);
+
+    fill_header(&header, 'x', record_length);
+
+    if (wb_add_bytes(wb, &header, sizeof(header))) {
+        return 1;
+    }
+
+    if (wb_add_uint(wb, record_length)) {
+        return 1;
+    }
+
+    if (wb_add_literal(wb, " path=")) {
+        return 1;
+    }
+
+    if (wb_add_bytes(wb, name, name_length)) {
+        return 1;
+    }
+
+    if (wb_add_char(wb, '\n')) {
+        return 1;
+    }
+
+    return tar_write_padding(wb, record_length);
+}
+
+int
+tar_write_header(struct write_buffer *__notnull const wb,
+                 const char *__notnull const name,
+                 const uint64_t name_length,
+                 const uint64_t size)
+{
+    struct tar_header header = {};
+    if (!split_name_into_header(&header, name, name_length)) {
+        if (write_pax_path_header(wb, name, name_length)) {
+            return 1;
+        }
+
+        /*
+         * Readers without pax support still get the start of the name.
+         */
+
+        memcpy(header.name, name, sizeof(header.name));
+    }
+
+    fill_header(&header, '0', size);
+    return wb_add_bytes(wb, &header, sizeof(header));
+}
+
+int
+tar_write_padding(struct write_buffer *__notnull const wb, const uint64_t size) {
+    const uint64_t remainder = size % TAR_BLOCK_SIZE;
+    if (remainder == 0) {
+        return 0;
+    }
+
+    return wb_add_bytes(wb, zero_block, TAR_BLOCK_SIZE - remainder);
+}
+
+int tar_write_end(struct write_buffer *__notnull const wb) {
+    return wb_add_bytes(wb, zero_block, sizeof(zero_block));
+}
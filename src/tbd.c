@@ -6,17 +6,25 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "copy.h"
 #include "likely.h"
+#include "our_io.h"
+#include "record_write.h"
+#include "tar_write.h"
 #include "target_list.h"
 #include "tbd.h"
 #include "tbd_write.h"
+#include "tbd_write_index.h"
+#include "tbd_write_v5.h"
 #include "yaml.h"
 
 const char *tbd_version_to_string(const enum tbd_version version) {
@@ -35,6 +43,9 @@ const char *tbd_version_to_string(const enum tbd_version version) {
 
         case TBD_VERSION_V4:
             return "v4";
+
+        case TBD_VERSION_V5:
+            return "v5";
     }
 }
 
@@ -47,7 +58,7 @@ tbd_platform_to_string(const enum tbd_platform platform,
             return NULL;
 
         case TBD_PLATFORM_MACOS:
-            if (version == TBD_VERSION_V4) {
+            if (version >= TBD_VERSION_V4) {
                 return "macos";
             }
 
@@ -69,7 +80,7 @@ tbd_platform_to_string(const enum tbd_platform platform,
             return "xros";
 
         case TBD_PLATFORM_IOSMAC:
-            if (version == TBD_VERSION_V4) {
+            if (version >= TBD_VERSION_V4) {
                 return "maccatalyst";
             }
 
@@ -97,7 +108,7 @@ tbd_should_parse_objc_constraint(const struct tbd_parse_options options,
         return false;
     }
 
-    if (version == TBD_VERSION_V1 || version == TBD_VERSION_V4) {
+    if (version == TBD_VERSION_V1 || version >= TBD_VERSION_V4) {
         return false;
     }
 
@@ -119,7 +130,7 @@ tbd_should_parse_flags(const struct tbd_parse_options options,
 }
 
 bool tbd_uses_archs(const enum tbd_version version) {
-    return (version != TBD_VERSION_V4);
+    return (version < TBD_VERSION_V4);
 }
 
 enum tbd_ci_set_target_count_result
@@ -686,11 +697,12 @@ tbd_ci_add_symbol_with_type(struct tbd_create_info *__notnull const info_in,
             break;
 
         /*
-         * On tbd-version v4, clients and re-exports are their own metadata
-         * sections.
+         * On tbd-version v4 and above, clients and re-exports are their own
+         * metadata sections.
          */
 
         case TBD_VERSION_V4:
+        case TBD_VERSION_V5:
             switch (type) {
                 case TBD_SYMBOL_TYPE_NONE:
                 case TBD_SYMBOL_TYPE_NORMAL:
@@ -1333,12 +1345,21 @@ tbd_ci_add_uuid(struct tbd_create_info *__notnull const info_in,
 }
 
 enum tbd_create_result
-tbd_create_with_info(const struct tbd_create_info *__notnull const info,
-                     FILE *__notnull const file,
-                     const struct tbd_create_options options)
+tbd_create_with_info_to_buffer(
+    const struct tbd_create_info *__notnull const info,
+    struct write_buffer *__notnull const wb,
+    const struct tbd_create_options options)
 {
     const enum tbd_version version = info->version;
-    if (tbd_write_magic(file, version)) {
+    if (version == TBD_VERSION_V5) {
+        if (tbd_write_v5(wb, info, options)) {
+            return E_TBD_CREATE_WRITE_FAIL;
+        }
+
+        return E_TBD_CREATE_OK;
+    }
+
+    if (tbd_write_magic(wb, version)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
 
@@ -1346,11 +1367,11 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
     const bool uses_archs = tbd_uses_archs(version);
 
     if (!uses_archs) {
-        if (tbd_write_targets_for_header(file, targets, version)) {
+        if (tbd_write_targets_for_header(wb, targets, version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     } else {
-        if (tbd_write_archs_for_header(file, targets)) {
+        if (tbd_write_archs_for_header(wb, targets)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
@@ -1358,34 +1379,34 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
     if (!options.ignore_uuids) {
         const struct array *const uuids = &info->fields.uuids;
         if (!uses_archs) {
-            if (tbd_write_uuids_for_targets(file, uuids, version)) {
+            if (tbd_write_uuids_for_targets(wb, uuids, version)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         } else if (version != TBD_VERSION_V1) {
-            if (tbd_write_uuids_for_archs(file, uuids)) {
+            if (tbd_write_uuids_for_archs(wb, uuids)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     }
 
     if (uses_archs) {
-        if (tbd_write_platform(file, info, version)) {
+        if (tbd_write_platform(wb, info, version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
 
     if (version != TBD_VERSION_V1 && !options.ignore_flags) {
-        if (tbd_write_flags(file, info->fields.flags)) {
+        if (tbd_write_flags(wb, info->fields.flags)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
 
-    if (tbd_write_install_name(file, info)) {
+    if (tbd_write_install_name(wb, info)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
 
     if (!options.ignore_current_version) {
-        if (tbd_write_current_version(file, info->fields.current_version)) {
+        if (tbd_write_current_version(wb, info->fields.current_version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
@@ -1394,7 +1415,7 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
         const uint32_t compatibility_version =
             info->fields.compatibility_version;
 
-        if (tbd_write_compatibility_version(file, compatibility_version)) {
+        if (tbd_write_compatibility_version(wb, compatibility_version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
@@ -1402,7 +1423,7 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
     if (version != TBD_VERSION_V1) {
         if (!options.ignore_swift_version) {
             const uint32_t swift_version = info->fields.swift_version;
-            if (tbd_write_swift_version(file, version, swift_version)) {
+            if (tbd_write_swift_version(wb, version, swift_version)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
@@ -1412,13 +1433,13 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
                 const enum tbd_objc_constraint objc_constraint =
                     info->fields.archs.objc_constraint;
 
-                if (tbd_write_objc_constraint(file, objc_constraint)) {
+                if (tbd_write_objc_constraint(wb, objc_constraint)) {
                     return E_TBD_CREATE_WRITE_FAIL;
                 }
             }
 
             if (!options.ignore_parent_umbrellas) {
-                if (tbd_write_parent_umbrella_for_archs(file, info)) {
+                if (tbd_write_parent_umbrella_for_archs(wb, info)) {
                     return E_TBD_CREATE_WRITE_FAIL;
                 }
             }
@@ -1427,36 +1448,36 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
 
     if (!uses_archs) {
         if (info->flags.uses_full_targets) {
-            if (tbd_write_metadata_with_full_targets(file, info, options)) {
+            if (tbd_write_metadata_with_full_targets(wb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
 
-            if (tbd_write_symbols_with_full_targets(file, info, options)) {
+            if (tbd_write_symbols_with_full_targets(wb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         } else {
-            if (tbd_write_metadata(file, info, options)) {
+            if (tbd_write_metadata(wb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
 
-            if (tbd_write_symbols_for_targets(file, info, options)) {
+            if (tbd_write_symbols_for_targets(wb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     } else {
         if (info->flags.uses_full_targets) {
-            if (tbd_write_symbols_with_full_archs(file, info, options)) {
+            if (tbd_write_symbols_with_full_archs(wb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         } else {
-            if (tbd_write_symbols_for_archs(file, info, options)) {
+            if (tbd_write_symbols_for_archs(wb, info, options)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     }
 
     if (!options.ignore_footer) {
-        if (tbd_write_footer(file)) {
+        if (tbd_write_footer(wb)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
@@ -1464,6 +1485,368 @@ tbd_create_with_info(const struct tbd_create_info *__notnull const info,
     return E_TBD_CREATE_OK;
 }
 
+enum tbd_create_result
+tbd_create_with_info(const struct tbd_create_info *__notnull const info,
+                     FILE *__notnull const file,
+                     const struct tbd_create_options options)
+{
+    /*
+     * Text may already be buffered in file (for example, when combining tbds),
+     * so flush it out before writing to its file-descriptor directly.
+     */
+
+    if (fflush(file) != 0) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    struct write_buffer wb;
+    wb_create_with_fd(&wb, fileno(file));
+
+    enum tbd_create_result result =
+        tbd_create_with_info_to_buffer(info, &wb, options);
+
+    if (result == E_TBD_CREATE_OK) {
+        if (wb_flush(&wb)) {
+            result = E_TBD_CREATE_WRITE_FAIL;
+        }
+    }
+
+    wb_destroy(&wb);
+    return result;
+}
+
+/*
+ * Render the tbd into memory mapped at offset in fd, which has already been
+ * truncated to hold size bytes past offset.
+ */
+
+static enum tbd_create_result
+render_into_mapped_file(const struct tbd_create_info *__notnull const info,
+                        const int fd,
+                        const off_t offset,
+                        const uint64_t size,
+                        const struct tbd_create_options options)
+{
+    /*
+     * mmap() requires a page-aligned offset, so map starting from the page
+     * that offset is in.
+     */
+
+    const off_t page_size = (off_t)sysconf(_SC_PAGESIZE);
+    const off_t map_offset = offset - (offset % page_size);
+    const uint64_t map_delta = (uint64_t)(offset - map_offset);
+    const uint64_t map_size = map_delta + size;
+
+    char *const map =
+        mmap(NULL,
+             map_size,
+             PROT_READ | PROT_WRITE,
+             MAP_SHARED,
+             fd,
+             map_offset);
+
+    if (map == MAP_FAILED) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    struct write_buffer wb;
+    wb_create_with_fixed_buffer(&wb, map + map_delta, size);
+
+    enum tbd_create_result result =
+        tbd_create_with_info_to_buffer(info, &wb, options);
+
+    /*
+     * The rendered length should always match the counted length, but don't
+     * leave a partially written tbd behind if it somehow doesn't.
+     */
+
+    if (result == E_TBD_CREATE_OK && wb.length != size) {
+        result = E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    munmap(map, map_size);
+    return result;
+}
+
+enum tbd_create_result
+tbd_create_with_info_mapped(const struct tbd_create_info *__notnull const info,
+                            FILE *__notnull const file,
+                            const struct tbd_create_options options)
+{
+    if (fflush(file) != 0) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    /*
+     * Only regular files can be resized and mapped.
+     */
+
+    const int fd = fileno(file);
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) != 0 || !S_ISREG(sbuf.st_mode)) {
+        return tbd_create_with_info(info, file, options);
+    }
+
+    /*
+     * First count the exact length of the tbd, as the line-wrapping of lists
+     * only depends on the lengths of the strings written out.
+     */
+
+    struct write_buffer counter;
+    wb_create_for_counting(&counter);
+
+    if (tbd_create_with_info_to_buffer(info, &counter, options) !=
+        E_TBD_CREATE_OK)
+    {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    const uint64_t size = counter.length;
+    if (size == 0) {
+        return E_TBD_CREATE_OK;
+    }
+
+    /*
+     * Render at the current position, so tbds that are being combined into one
+     * file are appended one after another.
+     */
+
+    const off_t offset = our_lseek(fd, 0, SEEK_CUR);
+    if (offset < 0) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    const off_t end = offset + (off_t)size;
+    if (ftruncate(fd, end) != 0) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    const enum tbd_create_result render_result =
+        render_into_mapped_file(info, fd, offset, size, options);
+
+    if (render_result != E_TBD_CREATE_OK) {
+        ftruncate(fd, offset);
+        return render_result;
+    }
+
+    if (our_lseek(fd, end, SEEK_SET) < 0) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    return E_TBD_CREATE_OK;
+}
+
+/*
+ * Compare the length bytes of data against the contents of fd, which is
+ * expected to be length bytes large.
+ */
+
+static bool
+file_matches_data(const int fd,
+                  const char *__notnull const data,
+                  const uint64_t length)
+{
+    if (length == 0) {
+        return true;
+    }
+
+    void *const map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const bool matches = (memcmp(map, data, length) == 0);
+    munmap(map, length);
+
+    return matches;
+}
+
+enum tbd_create_result
+tbd_create_with_info_if_changed(
+    const struct tbd_create_info *__notnull const info,
+    FILE *__notnull const file,
+    const struct tbd_create_options options)
+{
+    if (fflush(file) != 0) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    const int fd = fileno(file);
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) != 0 || !S_ISREG(sbuf.st_mode)) {
+        return tbd_create_with_info(info, file, options);
+    }
+
+    struct write_buffer wb;
+    wb_create_with_fd(&wb, -1);
+
+    enum tbd_create_result result =
+        tbd_create_with_info_to_buffer(info, &wb, options);
+
+    if (result != E_TBD_CREATE_OK) {
+        wb_destroy(&wb);
+        return result;
+    }
+
+    /*
+     * Only compare the contents when the sizes match, which is the cheaper
+     * check and rules out most changed files.
+     */
+
+    if ((uint64_t)sbuf.st_size == wb.length) {
+        if (file_matches_data(fd, wb.data, wb.length)) {
+            wb_destroy(&wb);
+            return E_TBD_CREATE_OK;
+        }
+    }
+
+    if (ftruncate(fd, 0) != 0 || our_lseek(fd, 0, SEEK_SET) < 0) {
+        wb_destroy(&wb);
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    /*
+     * Hand the rendered tbd to fd now that we know it has to be written out.
+     */
+
+    wb.fd = fd;
+    if (wb_flush(&wb)) {
+        result = E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    wb_destroy(&wb);
+    return result;
+}
+
+/*
+ * Archive members and records are preceded by a header holding their size, so
+ * the tbd has to be rendered before anything is written out.
+ */
+
+static enum tbd_create_result
+render_before_header(const struct tbd_create_info *__notnull const info,
+                     FILE *__notnull const file,
+                     struct write_buffer *__notnull const tbd_wb,
+                     const struct tbd_create_options options)
+{
+    if (fflush(file) != 0) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    wb_create_with_fd(tbd_wb, -1);
+
+    const enum tbd_create_result result =
+        tbd_create_with_info_to_buffer(info, tbd_wb, options);
+
+    if (result != E_TBD_CREATE_OK) {
+        wb_destroy(tbd_wb);
+    }
+
+    return result;
+}
+
+enum tbd_create_result
+tbd_create_with_info_as_tar_member(
+    const struct tbd_create_info *__notnull const info,
+    FILE *__notnull const file,
+    const char *__notnull const name,
+    const uint64_t name_length,
+    const struct tbd_create_options options)
+{
+    struct write_buffer tbd_wb;
+    enum tbd_create_result result =
+        render_before_header(info, file, &tbd_wb, options);
+
+    if (result != E_TBD_CREATE_OK) {
+        return result;
+    }
+
+    struct write_buffer wb;
+    wb_create_with_fd(&wb, fileno(file));
+
+    const uint64_t size = tbd_wb.length;
+    if (tar_write_header(&wb, name, name_length, size) ||
+        wb_add_bytes(&wb, tbd_wb.data, size) ||
+        tar_write_padding(&wb, size) ||
+        wb_flush(&wb))
+    {
+        result = E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    wb_destroy(&wb);
+    wb_destroy(&tbd_wb);
+
+    return result;
+}
+
+enum tbd_create_result
+tbd_create_with_info_as_record(
+    const struct tbd_create_info *__notnull const info,
+    FILE *__notnull const file,
+    const char *__notnull const path,
+    const uint64_t path_length,
+    const bool nul_delimited,
+    const struct tbd_create_options options)
+{
+    struct write_buffer tbd_wb;
+    enum tbd_create_result result =
+        render_before_header(info, file, &tbd_wb, options);
+
+    if (result != E_TBD_CREATE_OK) {
+        return result;
+    }
+
+    struct write_buffer wb;
+    wb_create_with_fd(&wb, fileno(file));
+
+    const struct target_list *const targets = &info->fields.targets;
+    const uint64_t size = tbd_wb.length;
+
+    if (nul_delimited) {
+        if (record_write_nul_delimited_header(&wb,
+                                              path,
+                                              path_length,
+                                              targets) ||
+            wb_add_bytes(&wb, tbd_wb.data, size) ||
+            wb_add_char(&wb, '\0') ||
+            wb_flush(&wb))
+        {
+            result = E_TBD_CREATE_WRITE_FAIL;
+        }
+    } else {
+        if (record_write_header(&wb, path, path_length, targets, size) ||
+            wb_add_bytes(&wb, tbd_wb.data, size) ||
+            wb_flush(&wb))
+        {
+            result = E_TBD_CREATE_WRITE_FAIL;
+        }
+    }
+
+    wb_destroy(&wb);
+    wb_destroy(&tbd_wb);
+
+    return result;
+}
+
+enum tbd_create_result
+tbd_create_index_with_info(const struct tbd_create_info *__notnull const info,
+                           const int fd,
+                           const struct tbd_create_options options)
+{
+    struct write_buffer wb;
+    wb_create_with_fd(&wb, fd);
+
+    enum tbd_create_result result = E_TBD_CREATE_OK;
+    if (tbd_write_index(&wb, info, options) || wb_flush(&wb)) {
+        result = E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    wb_destroy(&wb);
+    return result;
+}
+
 static void clear_metadata_array(struct array *__notnull const list) {
     struct tbd_metadata_info *info = list->data;
     const struct tbd_metadata_info *const end = list->data_end;
@@ -14,14 +14,18 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "macho_file.h"
+#include "our_io.h"
 #include "parse_or_list_fields.h"
 
 #include "path.h"
 #include "recursive.h"
+#include "tar_write.h"
 #include "tbd.h"
 #include "tbd_for_main.h"
+#include "util.h"
 #include "yaml.h"
 
 static void
@@ -159,6 +163,38 @@ add_image_path(int *__notnull const index_in,
     *index_in = index + 1;
 }
 
+static void
+add_merge_path(int *__notnull const index_in,
+               struct tbd_for_main *__notnull const tbd,
+               const int argc,
+               char *const *__notnull const argv)
+{
+    const int index = *index_in;
+    if (index + 1 == argc) {
+        fputs("Please provide the path to a dyld_shared_cache file to merge "
+              "images from\n",
+              stderr);
+
+        exit(1);
+    }
+
+    const char *const path = argv[index + 1];
+    struct array *const paths = &tbd->dsc_merge_paths;
+
+    const enum array_result add_path_result =
+        array_add_item(paths, sizeof(path), &path, NULL);
+
+    if (add_path_result != E_ARRAY_OK) {
+        fprintf(stderr,
+                "Experienced an array failure trying to add merge-path %s\n",
+                path);
+
+        exit(1);
+    }
+
+    *index_in = index + 1;
+}
+
 bool
 tbd_for_main_parse_option(int *const __notnull index_in,
                           struct tbd_for_main *__notnull const tbd,
@@ -249,6 +285,8 @@ tbd_for_main_parse_option(int *const __notnull index_in,
         add_image_number(&index, tbd, argc, argv);
     } else if (strcmp(option, "image-path") == 0) {
         add_image_path(&index, tbd, argc, argv);
+    } else if (strcmp(option, "merge-dsc") == 0) {
+        add_merge_path(&index, tbd, argc, argv);
     } else if (strcmp(option, "dsc") == 0) {
         if (!tbd->filetypes.user_provided) {
             tbd->filetypes.value = 0;
@@ -526,6 +564,8 @@ tbd_for_main_parse_option(int *const __notnull index_in,
         tbd->flags.provided_targets = true;
     } else if (strcmp(option, "skip-invalid-archs") == 0) {
         tbd->macho_options.skip_invalid_archs = true;
+    } else if (strcmp(option, "use-huge-pages") == 0) {
+        tbd->dsc_options.use_huge_pages = true;
     } else if (strcmp(option, "use-export-trie") == 0) {
         tbd->macho_options.use_export_trie = true;
     } else if (strcmp(option, "use-symbol-table") == 0) {
@@ -597,6 +637,15 @@ tbd_for_main_parse_option(int *const __notnull index_in,
 
         tbd->info.version = TBD_VERSION_V4;
         tbd->flags.provided_tbd_version = true;
+    } else if (strcmp(option, "v5") == 0) {
+        if (tbd->flags.provided_tbd_version) {
+            fputs("Note: Option -v has been provided multiple times.\nOlder "
+                  "option's .tbd version will be overriden\n",
+                  stderr);
+        }
+
+        tbd->info.version = TBD_VERSION_V5;
+        tbd->flags.provided_tbd_version = true;
     } else {
         return false;
     }
@@ -636,6 +685,25 @@ tbd_for_main_create_write_path(const struct tbd_for_main *__notnull const tbd,
     return write_path;
 }
 
+/*
+ * Get the length of the part of a found file's folder-path that isn't recreated
+ * in the write-path when preserving sub-directories.
+ */
+
+static inline uint64_t
+get_recurse_path_length(const struct tbd_for_main *__notnull const tbd) {
+    /*
+     * Files listed with --paths-from don't share a directory, and so keep all
+     * of their directories.
+     */
+
+    if (tbd->options.paths_from_file) {
+        return 0;
+    }
+
+    return tbd->parse_path_length;
+}
+
 char *
 tbd_for_main_create_write_path_for_recursing(
     const struct tbd_for_main *__notnull const tbd,
@@ -658,7 +726,7 @@ tbd_for_main_create_write_path_for_recursing(
          * in the hierarchy of file_path.
          */
 
-        const uint64_t parse_path_length = tbd->parse_path_length;
+        const uint64_t parse_path_length = get_recurse_path_length(tbd);
         const uint64_t subdirs_length = folder_path_length - parse_path_length;
 
         const char *subdirs_iter = folder_path + parse_path_length;
@@ -754,7 +822,7 @@ tbd_for_main_create_dsc_folder_path(
          * to recreate in our write-path.
          */
 
-        const uint64_t parse_path_length = tbd->parse_path_length;
+        const uint64_t parse_path_length = get_recurse_path_length(tbd);
 
         const char *subdirs_iter = folder_path + parse_path_length;
         const uint64_t subdirs_length = folder_path_length - parse_path_length;
@@ -798,11 +866,32 @@ tbd_for_main_open_write_file_for_path(
 {
     char *terminator = NULL;
 
-    const int flags = tbd->options.no_overwrite ? O_EXCL : 0;
+    /*
+     * Mapping the write-file for writing requires it to be opened for reading
+     * as well.
+     *
+     * When only writing if changed, the write-file is read to be compared, and
+     * is only truncated once we know its contents differ. A combined tbd is
+     * written out in pieces, and so can't be compared.
+     */
+
+    int access = tbd->options.map_output ? O_RDWR : O_WRONLY;
+    int flags = tbd->options.no_overwrite ? O_EXCL : 0;
+
+    const struct tbd_for_main_options options = tbd->options;
+    if (options.write_if_changed &&
+        !options.combine_tbds &&
+        !options.write_archive)
+    {
+        access = O_RDWR;
+    } else {
+        flags |= O_TRUNC;
+    }
+
     const int write_fd =
         open_r(path,
                path_length,
-               O_WRONLY | O_TRUNC | flags,
+               access | flags,
                DEFFILEMODE,
                0755,
                &terminator);
@@ -842,20 +931,129 @@ tbd_for_main_open_write_file_for_path(
     return E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK;
 }
 
+/*
+ * Write a binary index of info next to the tbd at write_path, replacing a
+ * ".tbd" extension with ".tbdi", or otherwise appending ".tbdi".
+ */
+
+static void
+write_index_for_path(const struct tbd_create_info *__notnull const info,
+                     const struct tbd_create_options write_options,
+                     const struct tbd_for_main_options options,
+                     const char *__notnull const write_path,
+                     uint64_t write_path_length)
+{
+    const char *const extension = ".tbd";
+    const uint64_t extension_length = strlen(extension);
+
+    if (write_path_length >= extension_length) {
+        const char *const end =
+            write_path + (write_path_length - extension_length);
+
+        if (memcmp(end, extension, extension_length) == 0) {
+            write_path_length -= extension_length;
+        }
+    }
+
+    const uint64_t index_path_length = write_path_length + 5;
+    char *const index_path = malloc(index_path_length + 1);
+
+    if (index_path == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        return;
+    }
+
+    memcpy(index_path, write_path, write_path_length);
+    memcpy(index_path + write_path_length, ".tbdi", 6);
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (options.no_overwrite) {
+        flags |= O_EXCL;
+    }
+
+    const int fd = our_open(index_path, flags, 0644);
+    if (fd < 0) {
+        if (!options.ignore_warnings) {
+            fprintf(stderr,
+                    "Failed to open binary index (at path %s), error: %s\n",
+                    index_path,
+                    strerror(errno));
+        }
+
+        free(index_path);
+        return;
+    }
+
+    const enum tbd_create_result create_index_result =
+        tbd_create_index_with_info(info, fd, write_options);
+
+    if (create_index_result != E_TBD_CREATE_OK) {
+        if (!options.ignore_warnings) {
+            fprintf(stderr,
+                    "Failed to write binary index (at path %s)\n",
+                    index_path);
+        }
+
+        our_unlink(index_path);
+    }
+
+    close(fd);
+    free(index_path);
+}
+
 void
-tbd_for_main_write_to_file(const struct tbd_for_main *__notnull const tbd,
-                           char *__notnull const write_path,
-                           const uint64_t write_path_length,
-                           char *const terminator,
-                           FILE *__notnull const file,
-                           const bool print_paths)
+tbd_for_main_write_info_to_file(
+    const struct tbd_create_info *__notnull const info,
+    const struct tbd_create_options write_options,
+    const struct tbd_for_main_options options,
+    char *__notnull const write_path,
+    const uint64_t write_path_length,
+    char *const terminator,
+    FILE *__notnull const file,
+    const bool print_paths)
 {
-    const struct tbd_create_info *const create_info = &tbd->info;
-    const enum tbd_create_result create_tbd_result =
-        tbd_create_with_info(create_info, file, tbd->write_options);
+    enum tbd_create_result create_tbd_result = E_TBD_CREATE_OK;
+    if (options.write_archive) {
+        switch (options.archive_format) {
+            case TBD_FOR_MAIN_ARCHIVE_FORMAT_TAR:
+                create_tbd_result =
+                    tbd_create_with_info_as_tar_member(info,
+                                                       file,
+                                                       write_path,
+                                                       write_path_length,
+                                                       write_options);
+
+                break;
+
+            case TBD_FOR_MAIN_ARCHIVE_FORMAT_RECORDS:
+            case TBD_FOR_MAIN_ARCHIVE_FORMAT_NUL_DELIMITED: {
+                const bool nul_delimited =
+                    (options.archive_format ==
+                     TBD_FOR_MAIN_ARCHIVE_FORMAT_NUL_DELIMITED);
+
+                create_tbd_result =
+                    tbd_create_with_info_as_record(info,
+                                                   file,
+                                                   write_path,
+                                                   write_path_length,
+                                                   nul_delimited,
+                                                   write_options);
+
+                break;
+            }
+        }
+    } else if (options.write_if_changed && !options.combine_tbds) {
+        create_tbd_result =
+            tbd_create_with_info_if_changed(info, file, write_options);
+    } else if (options.map_output) {
+        create_tbd_result =
+            tbd_create_with_info_mapped(info, file, write_options);
+    } else {
+        create_tbd_result = tbd_create_with_info(info, file, write_options);
+    }
 
     if (create_tbd_result != E_TBD_CREATE_OK) {
-        if (!tbd->options.ignore_warnings) {
+        if (!options.ignore_warnings) {
             if (print_paths) {
                 fprintf(stderr,
                         "Failed to write to write-file (at path %s)\n",
@@ -868,9 +1066,113 @@ tbd_for_main_write_to_file(const struct tbd_for_main *__notnull const tbd,
         if (terminator != NULL) {
             remove_file_r(write_path, write_path_length, terminator);
         }
+
+        return;
+    }
+
+    if (options.binary_index) {
+        write_index_for_path(info,
+                             write_options,
+                             options,
+                             write_path,
+                             write_path_length);
     }
 }
 
+void
+tbd_for_main_write_to_file(const struct tbd_for_main *__notnull const tbd,
+                           char *__notnull const write_path,
+                           const uint64_t write_path_length,
+                           char *const terminator,
+                           FILE *__notnull const file,
+                           const bool print_paths)
+{
+    tbd_for_main_write_info_to_file(&tbd->info,
+                                    tbd->write_options,
+                                    tbd->options,
+                                    write_path,
+                                    write_path_length,
+                                    terminator,
+                                    file,
+                                    print_paths);
+}
+
+enum tbd_for_main_open_write_file_result
+tbd_for_main_open_archive(const struct tbd_for_main *__notnull const tbd,
+                          FILE **__notnull const file_out)
+{
+    if (tbd->flags.archive_to_stdout) {
+        *file_out = stdout;
+        return E_TBD_FOR_MAIN_OPEN_WRITE_FILE_OK;
+    }
+
+    /*
+     * The archive is never removed once created, so we don't need to keep the
+     * terminator around.
+     */
+
+    char *terminator = NULL;
+    return tbd_for_main_open_write_file_for_path(tbd,
+                                                 tbd->write_path,
+                                                 tbd->write_path_length,
+                                                 file_out,
+                                                 &terminator);
+}
+
+char *
+tbd_for_main_get_archive_member_name(
+    const struct tbd_for_main *__notnull const tbd,
+    char *__notnull const write_path,
+    const uint64_t write_path_length,
+    uint64_t *__notnull const length_out)
+{
+    /*
+     * Write-paths are created without any slashes at the back of write_path.
+     */
+
+    const uint64_t root_length =
+        remove_end_slashes(tbd->write_path, tbd->write_path_length);
+
+    char *const end = write_path + write_path_length;
+    char *name = write_path + root_length;
+
+    while (name != end && *name == '/') {
+        name++;
+    }
+
+    *length_out = (uint64_t)(end - name);
+    return name;
+}
+
+int
+tbd_for_main_close_archive(const struct tbd_for_main *__notnull const tbd,
+                           FILE *__notnull const file)
+{
+    if (fflush(file) != 0) {
+        return 1;
+    }
+
+    /*
+     * Only tar archives have an end, as records are simply written back to
+     * back.
+     */
+
+    int result = 0;
+    if (tbd->options.archive_format == TBD_FOR_MAIN_ARCHIVE_FORMAT_TAR) {
+        struct write_buffer wb;
+        wb_create_with_fd(&wb, fileno(file));
+
+        result = (tar_write_end(&wb) || wb_flush(&wb));
+        wb_destroy(&wb);
+    }
+
+    if (!tbd->flags.archive_to_stdout) {
+        fclose(file);
+    }
+
+    return result;
+}
+
 void
 tbd_for_main_write_to_stdout(const struct tbd_for_main *__notnull const tbd,
                              const char *__notnull const input_path,
@@ -935,6 +1237,7 @@ void tbd_for_main_destroy(struct tbd_for_main *__notnull const tbd) {
 
     array_destroy(&tbd->dsc_image_filters);
     array_destroy(&tbd->dsc_image_numbers);
+    array_destroy(&tbd->dsc_merge_paths);
 
     free(tbd->parse_path);
     free(tbd->write_path);
@@ -6,15 +6,26 @@
 //  Copyright © 2018 - 2020 inoahdev. All rights reserved.
 //
 
-#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 #include "tbd.h"
 #include "tbd_write.h"
 
 static const uint64_t MAX_ARCH_ON_LINE = 7;
 static const uint64_t MAX_TARGET_ON_LINE = 5;
 
+/*
+ * A comma, followed by a newline and the indentation that aligns the next line
+ * with the values of a key's list.
+ */
+
+static const char comma_next_line[] = ",\n                            ";
+
 int
-tbd_write_archs_for_header(FILE *__notnull const file,
+tbd_write_archs_for_header(struct write_buffer *__notnull const wb,
                            const struct target_list list)
 {
     if (list.set_count == 0) {
@@ -25,7 +36,11 @@ tbd_write_archs_for_header(FILE *__notnull const file,
     enum tbd_platform platform = TBD_PLATFORM_NONE;
 
     target_list_get_target(&list, 0, &arch, &platform);
-    if (fprintf(file, "archs:%-17s[ %s", "", arch->name) < 0) {
+    if (wb_add_literal(wb, "archs:                 [ ")) {
+        return 1;
+    }
+
+    if (wb_add_bytes(wb, arch->name, arch->name_length)) {
         return 1;
     }
 
@@ -39,17 +54,17 @@ tbd_write_archs_for_header(FILE *__notnull const file,
 
         const bool write_comma = (counter != 0);
         if (write_comma) {
-            if (fputs(", ", file) < 0) {
+            if (wb_add_literal(wb, ", ")) {
                 return 1;
             }
         }
 
-        if (fwrite(arch->name, arch->name_length, 1, file) != 1) {
+        if (wb_add_bytes(wb, arch->name, arch->name_length)) {
             return 1;
         }
 
         if (counter == MAX_ARCH_ON_LINE && i != (list.set_count - 1)) {
-            if (fprintf(file, ",\n%-28s", "") < 0) {
+            if (wb_add_literal(wb, comma_next_line)) {
                 return 1;
             }
 
@@ -63,7 +78,7 @@ tbd_write_archs_for_header(FILE *__notnull const file,
      * Write the end bracket for the arch-info list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (wb_add_literal(wb, " ]\n")) {
         return 1;
     }
 
@@ -71,28 +86,27 @@ tbd_write_archs_for_header(FILE *__notnull const file,
 }
 
 static inline int
-write_target(FILE *__notnull const file,
+write_target(struct write_buffer *__notnull const wb,
              const struct arch_info *__notnull const arch,
              const enum tbd_platform platform,
              const enum tbd_version version,
              const bool has_comma)
 {
-    int ret = 0;
     if (has_comma) {
-        ret =
-            fprintf(file,
-                    ", %s-%s",
-                    arch->name,
-                    tbd_platform_to_string(platform, version));
-    } else {
-        ret =
-            fprintf(file,
-                    "%s-%s",
-                    arch->name,
-                    tbd_platform_to_string(platform, version));
+        if (wb_add_literal(wb, ", ")) {
+            return 1;
+        }
     }
 
-    if (ret < 0) {
+    if (wb_add_bytes(wb, arch->name, arch->name_length)) {
+        return 1;
+    }
+
+    if (wb_add_char(wb, '-')) {
+        return 1;
+    }
+
+    if (wb_add_c_str(wb, tbd_platform_to_string(platform, version))) {
         return 1;
     }
 
@@ -100,7 +114,7 @@ write_target(FILE *__notnull const file,
 }
 
 int
-tbd_write_targets_for_header(FILE *__notnull const file,
+tbd_write_targets_for_header(struct write_buffer *__notnull const wb,
                              const struct target_list list,
                              const enum tbd_version version)
 {
@@ -108,7 +122,7 @@ tbd_write_targets_for_header(FILE *__notnull const file,
         return 1;
     }
 
-    if (fprintf(file, "targets:%-15s[ ", "") < 0) {
+    if (wb_add_literal(wb, "targets:               [ ")) {
         return 1;
     }
 
@@ -116,7 +130,7 @@ tbd_write_targets_for_header(FILE *__notnull const file,
     enum tbd_platform platform = TBD_PLATFORM_NONE;
 
     target_list_get_target(&list, 0, &arch, &platform);
-    if (write_target(file, arch, platform, version, false) < 0) {
+    if (write_target(wb, arch, platform, version, false) < 0) {
         return 1;
     }
 
@@ -129,12 +143,12 @@ tbd_write_targets_for_header(FILE *__notnull const file,
          */
 
         const bool write_comma = (counter != 0);
-        if (write_target(file, arch, platform, version, write_comma) < 0) {
+        if (write_target(wb, arch, platform, version, write_comma) < 0) {
             return 1;
         }
 
         if (counter == MAX_TARGET_ON_LINE && i != (list.set_count - 1)) {
-            if (fprintf(file, ",\n%-28s", "") < 0) {
+            if (wb_add_literal(wb, comma_next_line)) {
                 return 1;
             }
 
@@ -144,18 +158,18 @@ tbd_write_targets_for_header(FILE *__notnull const file,
         }
     }
 
-    if (fputs(" ]\n", file) < 0) {
+    if (wb_add_literal(wb, " ]\n")) {
         return 1;
     }
 
     return 0;
 }
 
-static const char *const archs_symbol_key_fmt = "  - archs:%-16s[ %s";
-static const char *const targets_symbol_key_fmt = "  - targets:%-14s[ ";
+static const char archs_symbol_key[] = "  - archs:                [ ";
+static const char targets_symbol_key[] = "  - targets:              [ ";
 
 static int
-write_archs_for_symbol_arrays(FILE *__notnull const file,
+write_archs_for_symbol_arrays(struct write_buffer *__notnull const wb,
                               const struct target_list list,
                               const struct bit_list bits)
 {
@@ -169,7 +183,11 @@ write_archs_for_symbol_arrays(FILE *__notnull const file,
     uint64_t first = bit_list_find_first_bit(bits);
     target_list_get_target(&list, first, &arch, &platform);
 
-    if (fprintf(file, archs_symbol_key_fmt, "", arch->name) < 0) {
+    if (wb_add_literal(wb, archs_symbol_key)) {
+        return 1;
+    }
+
+    if (wb_add_bytes(wb, arch->name, arch->name_length)) {
         return 1;
     }
 
@@ -184,17 +202,17 @@ write_archs_for_symbol_arrays(FILE *__notnull const file,
 
         const bool write_comma = (counter != 0);
         if (write_comma) {
-            if (fputs(", ", file) < 0) {
+            if (wb_add_literal(wb, ", ")) {
                 return 1;
             }
         }
 
-        if (fwrite(arch->name, arch->name_length, 1, file) != 1) {
+        if (wb_add_bytes(wb, arch->name, arch->name_length)) {
             return 1;
         }
 
         if (counter == MAX_ARCH_ON_LINE && i != (bits.set_count - 1)) {
-            if (fprintf(file, ",\n%-28s", "") < 0) {
+            if (wb_add_literal(wb, comma_next_line)) {
                 return 1;
             }
 
@@ -208,7 +226,7 @@ write_archs_for_symbol_arrays(FILE *__notnull const file,
      * Write the end bracket for the arch-info list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (wb_add_literal(wb, " ]\n")) {
         return 1;
     }
 
@@ -216,7 +234,7 @@ write_archs_for_symbol_arrays(FILE *__notnull const file,
 }
 
 static int
-write_targets_as_dict_key(FILE *__notnull const file,
+write_targets_as_dict_key(struct write_buffer *__notnull const wb,
                           const struct target_list list,
                           const struct bit_list bits,
                           const enum tbd_version version)
@@ -225,7 +243,7 @@ write_targets_as_dict_key(FILE *__notnull const file,
         return 1;
     }
 
-    if (fprintf(file, targets_symbol_key_fmt, "") < 0) {
+    if (wb_add_literal(wb, targets_symbol_key)) {
         return 1;
     }
 
@@ -235,7 +253,7 @@ write_targets_as_dict_key(FILE *__notnull const file,
     uint64_t first = bit_list_find_first_bit(bits);
     target_list_get_target(&list, first, &arch, &platform);
 
-    if (write_target(file, arch, platform, version, false) < 0) {
+    if (write_target(wb, arch, platform, version, false) < 0) {
         return 1;
     }
 
@@ -249,12 +267,12 @@ write_targets_as_dict_key(FILE *__notnull const file,
          */
 
         const bool write_comma = (counter != 0);
-        if (write_target(file, arch, platform, version, write_comma) < 0) {
+        if (write_target(wb, arch, platform, version, write_comma) < 0) {
             return 1;
         }
 
         if (counter == MAX_TARGET_ON_LINE && i != (bits.set_count != 1)) {
-            if (fprintf(file, ",\n%-28s", "") < 0) {
+            if (wb_add_literal(wb, comma_next_line)) {
                 return 1;
             }
 
@@ -268,60 +286,22 @@ write_targets_as_dict_key(FILE *__notnull const file,
      * Write the end bracket for the target-list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (wb_add_literal(wb, " ]\n")) {
         return 1;
     }
 
     return 0;
 }
 
-static
-int write_packed_version(FILE *__notnull const file, const uint32_t version) {
-    /*
-     * The revision for a packed-version is stored in the LSB.
-     */
-
-    const uint8_t revision = (version & 0xff);
-
-    /*
-     * The minor for a packed-version is stored in the second LSB.
-     */
-
-    const uint8_t minor = ((version & 0xff00) >> 8);
-
-    /*
-     * The major for a packed-version is stored in the two MSB.
-     */
-
-    const uint16_t major = ((version & 0xffff0000) >> 16);
-    if (fprintf(file, "%" PRIu16, major) < 0) {
+static inline int
+write_packed_version(struct write_buffer *__notnull const wb,
+                     const uint32_t version)
+{
+    if (wb_add_packed_version(wb, version)) {
         return 1;
     }
 
-    if (minor != 0) {
-        if (fprintf(file, ".%" PRIu8, minor) < 0) {
-            return 1;
-        }
-    }
-
-    if (revision != 0) {
-        /*
-         * Write out a .0 version-component because if minor was zero, we didn't
-         * write it as a component.
-         */
-
-        if (minor == 0) {
-            if (fprintf(file, ".0.%" PRIu8, revision) < 0) {
-                return 1;
-            }
-        } else {
-            if (fprintf(file, ".%" PRIu8, revision) < 0) {
-                return 1;
-            }
-        }
-    }
-
-    if (fputc('\n', file) == EOF) {
+    if (wb_add_char(wb, '\n')) {
         return 1;
     }
 
@@ -329,50 +309,76 @@ int write_packed_version(FILE *__notnull const file, const uint32_t version) {
 }
 
 int
-tbd_write_current_version(FILE *__notnull const file, const uint32_t version) {
-    if (fprintf(file, "current-version:%-7s", "") < 0) {
+tbd_write_current_version(struct write_buffer *__notnull const wb,
+                          const uint32_t version)
+{
+    if (wb_add_literal(wb, "current-version:       ")) {
         return 1;
     }
 
-    return write_packed_version(file, version);
+    return write_packed_version(wb, version);
 }
 
 int
-tbd_write_compatibility_version(FILE *__notnull const file,
+tbd_write_compatibility_version(struct write_buffer *__notnull const wb,
                                 const uint32_t version)
 {
-    if (fputs("compatibility-version: ", file) < 0) {
+    if (wb_add_literal(wb, "compatibility-version: ")) {
         return 1;
     }
 
-    return write_packed_version(file, version);
+    return write_packed_version(wb, version);
 }
 
-int tbd_write_footer(FILE *__notnull const file) {
-    if (fputs("...\n", file) < 0) {
+int tbd_write_footer(struct write_buffer *__notnull const wb) {
+    if (wb_add_literal(wb, "...\n")) {
         return 1;
     }
 
     return 0;
 }
 
-int tbd_write_flags(FILE *__notnull const file, const struct tbd_flags flags) {
+int tbd_write_footer_to_file(FILE *__notnull const file) {
+    if (fflush(file) != 0) {
+        return 1;
+    }
+
+    struct write_buffer wb;
+    wb_create_with_fd(&wb, fileno(file));
+
+    int result = tbd_write_footer(&wb);
+    if (result == 0) {
+        result = wb_flush(&wb);
+    }
+
+    wb_destroy(&wb);
+    return result;
+}
+
+int
+tbd_write_flags(struct write_buffer *__notnull const wb,
+                const struct tbd_flags flags)
+{
     if (flags.flat_namespace) {
-        if (fprintf(file, "flags:%-17s[ flat_namespace", "") < 0) {
+        if (wb_add_literal(wb, "flags:                 [ flat_namespace")) {
             return 1;
         }
 
         if (flags.not_app_extension_safe) {
-            if (fputs(", not_app_extension_safe", file) < 0) {
+            if (wb_add_literal(wb, ", not_app_extension_safe")) {
                 return 1;
             }
         }
 
-        if (fputs(" ]\n", file) < 0) {
+        if (wb_add_literal(wb, " ]\n")) {
             return 1;
         }
     } else if (flags.not_app_extension_safe) {
-        if (fprintf(file, "flags:%-17s[ not_app_extension_safe ]\n", "") < 0) {
+        if (wb_add_literal(wb, "flags:                 ")) {
+            return 1;
+        }
+
+        if (wb_add_literal(wb, "[ not_app_extension_safe ]\n")) {
             return 1;
         }
     } else {
@@ -383,17 +389,25 @@ int tbd_write_flags(FILE *__notnull const file, const struct tbd_flags flags) {
 }
 
 static int
-write_yaml_string(FILE *__notnull const file,
+write_yaml_string(struct write_buffer *__notnull const wb,
                   const char *__notnull const string,
                   const uint64_t length,
                   const bool needs_quotes)
 {
     if (needs_quotes) {
-        if (fprintf(file, "\"%s\"", string) < 0) {
+        if (wb_add_char(wb, '"')) {
+            return 1;
+        }
+
+        if (wb_add_bytes(wb, string, length)) {
+            return 1;
+        }
+
+        if (wb_add_char(wb, '"')) {
             return 1;
         }
     } else {
-        if (fwrite(string, length, 1, file) != 1) {
+        if (wb_add_bytes(wb, string, length)) {
             return 1;
         }
     }
@@ -402,10 +416,10 @@ write_yaml_string(FILE *__notnull const file,
 }
 
 int
-tbd_write_install_name(FILE *__notnull const file,
+tbd_write_install_name(struct write_buffer *__notnull const wb,
                        const struct tbd_create_info *__notnull const info)
 {
-    if (fprintf(file, "install-name:%-10s", "") < 0) {
+    if (wb_add_literal(wb, "install-name:          ")) {
         return 1;
     }
 
@@ -413,11 +427,11 @@ tbd_write_install_name(FILE *__notnull const file,
     const uint64_t length = info->fields.install_name_length;
     const bool needs_quotes = info->flags.install_name_needs_quotes;
 
-    if (write_yaml_string(file, install_name, length, needs_quotes)) {
+    if (write_yaml_string(wb, install_name, length, needs_quotes)) {
         return 1;
     }
 
-    if (fputc('\n', file) == EOF) {
+    if (wb_add_char(wb, '\n')) {
         return 1;
     }
 
@@ -425,7 +439,7 @@ tbd_write_install_name(FILE *__notnull const file,
 }
 
 int
-tbd_write_objc_constraint(FILE *__notnull const file,
+tbd_write_objc_constraint(struct write_buffer *__notnull const wb,
                           const enum tbd_objc_constraint constraint)
 {
     switch (constraint) {
@@ -433,29 +447,29 @@ tbd_write_objc_constraint(FILE *__notnull const file,
             break;
 
         case TBD_OBJC_CONSTRAINT_NONE:
-            if (fprintf(file, "objc-constraint:%-7snone\n", "") < 0) {
+            if (wb_add_literal(wb, "objc-constraint:       none\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_OBJC_CONSTRAINT_GC:
-            if (fprintf(file, "objc-constraint:%-7sgc\n", "") < 0) {
+            if (wb_add_literal(wb, "objc-constraint:       gc\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE:
-            if (fprintf(file, "objc-constraint:%-7sretain_release\n", "") < 0) {
+            if (wb_add_literal(wb, "objc-constraint:       retain_release\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE_OR_GC: {
-            const char *const str = "retain_release_or_gc";
-            if (fprintf(file, "objc-constraint:%-7s%s\n", "", str) < 0) {
+            const char str[] = "objc-constraint:       retain_release_or_gc\n";
+            if (wb_add_literal(wb, str)) {
                 return 1;
             }
 
@@ -463,8 +477,9 @@ tbd_write_objc_constraint(FILE *__notnull const file,
         }
 
         case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE_FOR_SIMULATOR: {
-            const char *const str = "retain_release_for_simulator";
-            if (fprintf(file, "objc-constraint:%-7s%s\n", "", str) < 0) {
+            const char str[] =
+                "objc-constraint:       retain_release_for_simulator\n";
+            if (wb_add_literal(wb, str)) {
                 return 1;
             }
 
@@ -476,38 +491,51 @@ tbd_write_objc_constraint(FILE *__notnull const file,
 }
 
 int
-tbd_write_magic(FILE *__notnull const file, const enum tbd_version version) {
+tbd_write_magic(struct write_buffer *__notnull const wb,
+                const enum tbd_version version)
+{
     switch (version) {
         case TBD_VERSION_NONE:
             return 1;
 
         case TBD_VERSION_V1:
-            if (fputs("---\n", file) < 0) {
+            if (wb_add_literal(wb, "---\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_VERSION_V2:
-            if (fputs("--- !tapi-tbd-v2\n", file) < 0) {
+            if (wb_add_literal(wb, "--- !tapi-tbd-v2\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_VERSION_V3:
-            if (fputs("--- !tapi-tbd-v3\n", file) < 0) {
+            if (wb_add_literal(wb, "--- !tapi-tbd-v3\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_VERSION_V4:
-            if (fprintf(file, "--- !tapi-tbd\ntbd-version:%-11s4\n", "") < 0) {
+            if (wb_add_literal(wb, "--- !tapi-tbd\n")) {
+                return 1;
+            }
+
+            if (wb_add_literal(wb, "tbd-version:           4\n")) {
                 return 1;
             }
 
             break;
+
+        /*
+         * tbd-version v5 is written out separately, by tbd_write_v5().
+         */
+
+        case TBD_VERSION_V5:
+            return 1;
     }
 
     return 0;
@@ -515,7 +543,7 @@ tbd_write_magic(FILE *__notnull const file, const enum tbd_version version) {
 
 int
 tbd_write_parent_umbrella_for_archs(
-    FILE *__notnull const file,
+    struct write_buffer *__notnull const wb,
     const struct tbd_create_info *__notnull const info)
 {
     if (info->fields.metadata.item_count == 0) {
@@ -534,18 +562,18 @@ tbd_write_parent_umbrella_for_archs(
         return 1;
     }
 
-    if (fprintf(file, "parent-umbrella:%-7s", "") < 0) {
+    if (wb_add_literal(wb, "parent-umbrella:       ")) {
         return 1;
     }
 
     const uint64_t length = umbrella_info->length;
     const bool needs_quotes = umbrella_info->flags.needs_quotes;
 
-    if (write_yaml_string(file, umbrella, length, needs_quotes)) {
+    if (write_yaml_string(wb, umbrella, length, needs_quotes)) {
         return 1;
     }
 
-    if (fputc('\n', file) == EOF) {
+    if (wb_add_char(wb, '\n')) {
         return 1;
     }
 
@@ -553,7 +581,7 @@ tbd_write_parent_umbrella_for_archs(
 }
 
 int
-tbd_write_platform(FILE *__notnull const file,
+tbd_write_platform(struct write_buffer *__notnull const wb,
                    const struct tbd_create_info *__notnull const info,
                    const enum tbd_version version)
 {
@@ -562,8 +590,15 @@ tbd_write_platform(FILE *__notnull const file,
 
     target_list_get_target(&info->fields.targets, 0, &arch, &platform);
 
-    const char *const platform_str = tbd_platform_to_string(platform, version);
-    if (fprintf(file, "platform:%-14s%s\n", "", platform_str) < 0) {
+    if (wb_add_literal(wb, "platform:              ")) {
+        return 1;
+    }
+
+    if (wb_add_c_str(wb, tbd_platform_to_string(platform, version))) {
+        return 1;
+    }
+
+    if (wb_add_char(wb, '\n')) {
         return 1;
     }
 
@@ -571,7 +606,7 @@ tbd_write_platform(FILE *__notnull const file,
 }
 
 int
-tbd_write_swift_version(FILE *__notnull const file,
+tbd_write_swift_version(struct write_buffer *__notnull const wb,
                         const enum tbd_version tbd_version,
                         const uint32_t swift_version)
 {
@@ -587,7 +622,7 @@ tbd_write_swift_version(FILE *__notnull const file,
             return 0;
 
         case TBD_VERSION_V2:
-            if (fprintf(file, "swift-version:%-9s", "") < 0) {
+            if (wb_add_literal(wb, "swift-version:         ")) {
                 return 1;
             }
 
@@ -595,7 +630,8 @@ tbd_write_swift_version(FILE *__notnull const file,
 
         case TBD_VERSION_V3:
         case TBD_VERSION_V4:
-            if (fprintf(file, "swift-abi-version:%-5s", "") < 0) {
+        case TBD_VERSION_V5:
+            if (wb_add_literal(wb, "swift-abi-version:     ")) {
                 return 1;
             }
 
@@ -604,62 +640,36 @@ tbd_write_swift_version(FILE *__notnull const file,
 
     switch (swift_version) {
         case 1:
-            if (fputs("1\n", file) < 0) {
+            if (wb_add_literal(wb, "1\n")) {
                 return 1;
             }
 
             break;
 
         case 2:
-            if (fputs("1.2\n", file) < 0) {
+            if (wb_add_literal(wb, "1.2\n")) {
                 return 1;
             }
 
             break;
 
         default:
-            if (fprintf(file, "%" PRIu32 "\n", swift_version - 1) < 0) {
+            if (wb_add_uint(wb, swift_version - 1)) {
                 return 1;
             }
 
-            break;
-    }
-
-    return 0;
-}
+            if (wb_add_char(wb, '\n')) {
+                return 1;
+            }
 
-static inline int
-write_uuid(FILE *__notnull const file, const uint8_t *__notnull const uuid) {
-    const int ret =
-        fprintf(file,
-                "%.2X%.2X%.2X%.2X-%.2X%.2X-%.2X%.2X-%.2X%.2X-%.2X"
-                "%.2X%.2X%.2X%.2X%.2X",
-                uuid[0],
-                uuid[1],
-                uuid[2],
-                uuid[3],
-                uuid[4],
-                uuid[5],
-                uuid[6],
-                uuid[7],
-                uuid[8],
-                uuid[9],
-                uuid[10],
-                uuid[11],
-                uuid[12],
-                uuid[13],
-                uuid[14],
-                uuid[15]);
-
-    if (ret < 0) {
-        return 1;
+            break;
     }
 
     return 0;
 }
 
 static inline int
-write_single_uuid_for_archs(FILE *__notnull const file,
+write_single_uuid_for_archs(struct write_buffer *__notnull const wb,
                             const uint64_t target,
                             const uint8_t *__notnull const uuid,
                             const bool has_comma)
@@ -667,22 +677,29 @@ write_single_uuid_for_archs(FILE *__notnull const file,
     const struct arch_info *const arch =
         (const struct arch_info *)(target & TARGET_ARCH_INFO_MASK);
 
-    int ret = 0;
     if (has_comma) {
-        ret = fprintf(file, ", '%s: ", arch->name);
+        if (wb_add_literal(wb, ", '")) {
+            return 1;
+        }
     } else {
-        ret = fprintf(file, "'%s: ", arch->name);
+        if (wb_add_char(wb, '\'')) {
+            return 1;
+        }
+    }
+
+    if (wb_add_bytes(wb, arch->name, arch->name_length)) {
+        return 1;
     }
 
-    if (ret < 0) {
+    if (wb_add_literal(wb, ": ")) {
         return 1;
     }
 
-    if (write_uuid(file, uuid)) {
+    if (wb_add_uuid(wb, uuid)) {
         return 1;
     }
 
-    if (fputc('\'', file) < 0) {
+    if (wb_add_char(wb, '\'')) {
         return 1;
     }
 
@@ -690,21 +707,21 @@ write_single_uuid_for_archs(FILE *__notnull const file,
 }
 
 int
-tbd_write_uuids_for_archs(FILE *__notnull const file,
+tbd_write_uuids_for_archs(struct write_buffer *__notnull const wb,
                           const struct array *__notnull const uuids)
 {
     if (uuids->item_count == 0) {
         return 0;
     }
 
-    if (fprintf(file, "uuids:%-17s[ ", "") < 0) {
+    if (wb_add_literal(wb, "uuids:                 [ ")) {
         return 1;
     }
 
     const struct tbd_uuid_info *info = uuids->data;
     const struct tbd_uuid_info *const end = uuids->data_end;
 
-    if (write_single_uuid_for_archs(file, info->target, info->uuid, false)) {
+    if (write_single_uuid_for_archs(wb, info->target, info->uuid, false)) {
         return 1;
     }
 
@@ -729,7 +746,7 @@ tbd_write_uuids_for_archs(FILE *__notnull const file,
         const uint64_t target = info->target;
         const uint8_t *const uuid = info->uuid;
 
-        if (write_single_uuid_for_archs(file, target, uuid, needs_comma)) {
+        if (write_single_uuid_for_archs(wb, target, uuid, needs_comma)) {
             return 1;
         }
 
@@ -740,7 +757,7 @@ tbd_write_uuids_for_archs(FILE *__notnull const file,
 
         counter++;
         if (counter == 2) {
-            if (fprintf(file, ",%-26s", "\n") < 0) {
+            if (wb_add_literal(wb, ",\n                         ")) {
                 return 1;
             }
 
@@ -751,7 +768,7 @@ tbd_write_uuids_for_archs(FILE *__notnull const file,
         }
     } while (true);
 
-    if (fputs(" ]\n", file) < 0) {
+    if (wb_add_literal(wb, " ]\n")) {
         return 1;
     }
 
@@ -759,7 +776,7 @@ tbd_write_uuids_for_archs(FILE *__notnull const file,
 }
 
 static inline int
-write_uuid_with_target(FILE *__notnull const file,
+write_uuid_with_target(struct write_buffer *__notnull const wb,
                        const uint64_t target,
                        const uint8_t *__notnull const uuid,
                        const enum tbd_version version)
@@ -770,25 +787,23 @@ write_uuid_with_target(FILE *__notnull const file,
     const enum tbd_platform platform =
         (const enum tbd_platform)(target & TARGET_PLATFORM_MASK);
 
-    const char *const platform_str = tbd_platform_to_string(platform, version);
-    if (fprintf(file,
-                "  - target: %s-%s\n%-4svalue: ",
-                arch->name,
-                platform_str,
-                "") < 0)
-    {
+    if (wb_add_literal(wb, "  - target: ")) {
         return 1;
     }
 
-    if (fputc('\'', file) < 0) {
+    if (write_target(wb, arch, platform, version, false)) {
         return 1;
     }
 
-    if (write_uuid(file, uuid)) {
+    if (wb_add_literal(wb, "\n    value: '")) {
         return 1;
     }
 
-    if (fputs("'\n", file) < 0) {
+    if (wb_add_uuid(wb, uuid)) {
+        return 1;
+    }
+
+    if (wb_add_literal(wb, "'\n")) {
         return 1;
     }
 
@@ -796,7 +811,7 @@ write_uuid_with_target(FILE *__notnull const file,
 }
 
 int
-tbd_write_uuids_for_targets(FILE *__notnull const file,
+tbd_write_uuids_for_targets(struct write_buffer *__notnull const wb,
                             const struct array *__notnull const uuids,
                             const enum tbd_version version)
 {
@@ -804,7 +819,7 @@ tbd_write_uuids_for_targets(FILE *__notnull const file,
         return 0;
     }
 
-    if (fputs("uuids:\n", file) < 0) {
+    if (wb_add_literal(wb, "uuids:\n")) {
         return 1;
     }
 
@@ -812,7 +827,7 @@ tbd_write_uuids_for_targets(FILE *__notnull const file,
     const struct tbd_uuid_info *const end = uuids->data_end;
 
     for (; uuid != end; uuid++) {
-        if (write_uuid_with_target(file, uuid->target, uuid->uuid, version)) {
+        if (write_uuid_with_target(wb, uuid->target, uuid->uuid, version)) {
             return 1;
         }
     }
@@ -843,7 +858,7 @@ enum write_comma_result {
 };
 
 static enum write_comma_result
-write_comma_or_newline(FILE *__notnull const file,
+write_comma_or_newline(struct write_buffer *__notnull const wb,
                        const uint64_t line_length,
                        const uint64_t string_length)
 {
@@ -854,7 +869,7 @@ write_comma_or_newline(FILE *__notnull const file,
 
     const uint64_t max_string_length = line_length_max - line_length_initial;
     if (string_length >= max_string_length) {
-        if (fprintf(file, ",\n%-28s", "") < 0) {
+        if (wb_add_literal(wb, comma_next_line)) {
             return E_WRITE_COMMA_WRITE_FAIL;
         }
 
@@ -869,7 +884,7 @@ write_comma_or_newline(FILE *__notnull const file,
 
     const uint64_t new_line_length = line_length + string_length + 2;
     if (new_line_length > line_length_max) {
-        if (fprintf(file, ",\n%-28s", "") < 0) {
+        if (wb_add_literal(wb, comma_next_line)) {
             return E_WRITE_COMMA_WRITE_FAIL;
         }
 
@@ -881,8 +896,7 @@ write_comma_or_newline(FILE *__notnull const file,
      * before writing the next string.
      */
 
-    const char *const comma_space = ", ";
-    if (fwrite(comma_space, 2, 1, file) != 1) {
+    if (wb_add_literal(wb, ", ")) {
         return E_WRITE_COMMA_WRITE_FAIL;
     }
 
@@ -890,7 +904,7 @@ write_comma_or_newline(FILE *__notnull const file,
 }
 
 static int
-write_metadata_type(FILE *__notnull const file,
+write_metadata_type(struct write_buffer *__notnull const wb,
                     const enum tbd_metadata_type type)
 {
     switch (type) {
@@ -898,21 +912,21 @@ write_metadata_type(FILE *__notnull const file,
             return 1;
 
         case TBD_METADATA_TYPE_PARENT_UMBRELLA:
-            if (fputs("parent-umbrella:\n", file) < 0) {
+            if (wb_add_literal(wb, "parent-umbrella:\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_METADATA_TYPE_CLIENT:
-            if (fputs("allowable-clients:\n", file) < 0) {
+            if (wb_add_literal(wb, "allowable-clients:\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_METADATA_TYPE_REEXPORTED_LIBRARY:
-            if (fputs("reexported-libraries:\n", file) < 0) {
+            if (wb_add_literal(wb, "reexported-libraries:\n")) {
                 return 1;
             }
 
@@ -922,9 +936,9 @@ write_metadata_type(FILE *__notnull const file,
     return 0;
 }
 
-static inline int end_written_sequence(FILE *__notnull const file) {
-    static const char *const end = " ]\n";
-    if (fwrite(end, 3, 1, file) != 1) {
+static inline int
+end_written_sequence(struct write_buffer *__notnull const wb) {
+    if (wb_add_literal(wb, " ]\n")) {
         return 1;
     }
 
@@ -972,15 +986,15 @@ skip_metadata_if_needed(const struct tbd_metadata_info *__notnull info,
 }
 
 static inline int
-write_metadata_info(FILE *__notnull const file,
+write_metadata_info(struct write_buffer *__notnull const wb,
                     const struct tbd_metadata_info *__notnull const info)
 {
     const bool needs_quotes = info->flags.needs_quotes;
-    return write_yaml_string(file, info->string, info->length, needs_quotes);
+    return write_yaml_string(wb, info->string, info->length, needs_quotes);
 }
 
 static int
-write_umbrella_list(FILE *__notnull const file,
+write_umbrella_list(struct write_buffer *__notnull const wb,
                     const struct tbd_create_info *__notnull const info,
                     const struct tbd_metadata_info *__notnull m_info,
                     const struct tbd_metadata_info *__notnull const end,
@@ -990,19 +1004,19 @@ write_umbrella_list(FILE *__notnull const file,
     const enum tbd_version version = info->version;
 
     do {
-        if (write_targets_as_dict_key(file, targets, m_info->targets, version)) {
+        if (write_targets_as_dict_key(wb, targets, m_info->targets, version)) {
             return 1;
         }
 
-        if (fprintf(file, "%-4sumbrella:%-15s", "", "") < 0) {
+        if (wb_add_literal(wb, "    umbrella:               ")) {
             return 1;
         }
 
-        if (write_metadata_info(file, m_info)) {
+        if (write_metadata_info(wb, m_info)) {
             return 1;
         }
 
-        if (fputc('\n', file) < 0) {
+        if (wb_add_char(wb, '\n')) {
             return 1;
         }
 
@@ -1021,7 +1035,7 @@ write_umbrella_list(FILE *__notnull const file,
 }
 
 int
-tbd_write_metadata(FILE *__notnull const file,
+tbd_write_metadata(struct write_buffer *__notnull const wb,
                    const struct tbd_create_info *__notnull const info_in,
                    const struct tbd_create_options options)
 {
@@ -1045,7 +1059,7 @@ tbd_write_metadata(FILE *__notnull const file,
         }
 
         type = info->type;
-        if (write_metadata_type(file, type)) {
+        if (write_metadata_type(wb, type)) {
             return 1;
         }
 
@@ -1055,14 +1069,14 @@ tbd_write_metadata(FILE *__notnull const file,
 
             case TBD_METADATA_TYPE_PARENT_UMBRELLA: {
                 const int result =
-                    write_umbrella_list(file, info_in, info, end, &info);
+                    write_umbrella_list(wb, info_in, info, end, &info);
 
                 if (result != 2) {
                     return result;
                 }
 
                 type = info->type;
-                if (write_metadata_type(file, type)) {
+                if (write_metadata_type(wb, type)) {
                     return 1;
                 }
 
@@ -1078,15 +1092,15 @@ tbd_write_metadata(FILE *__notnull const file,
         uint64_t line_length = 0;
 
         do {
-            if (write_targets_as_dict_key(file, targets, bits, version)) {
+            if (write_targets_as_dict_key(wb, targets, bits, version)) {
                 return 1;
             }
 
-            if (fprintf(file, "%-4slibraries:%-12s[ ", "", "") < 0) {
+            if (wb_add_literal(wb, "    libraries:            [ ")) {
                 return 1;
             }
 
-            if (write_metadata_info(file, info)) {
+            if (write_metadata_info(wb, info)) {
                 return 1;
             }
 
@@ -1094,7 +1108,7 @@ tbd_write_metadata(FILE *__notnull const file,
             do {
                 info++;
                 if (info == end) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1103,7 +1117,7 @@ tbd_write_metadata(FILE *__notnull const file,
 
                 const enum tbd_metadata_type inner_type = info->type;
                 if (inner_type != type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1122,7 +1136,7 @@ tbd_write_metadata(FILE *__notnull const file,
 
                 const uint64_t length = info->length;
                 const enum write_comma_result write_comma_result =
-                    write_comma_or_newline(file, line_length, length);
+                    write_comma_or_newline(wb, line_length, length);
 
                 switch (write_comma_result) {
                     case E_WRITE_COMMA_OK:
@@ -1136,7 +1150,7 @@ tbd_write_metadata(FILE *__notnull const file,
                         break;
                 }
 
-                if (write_metadata_info(file, info)) {
+                if (write_metadata_info(wb, info)) {
                     return 1;
                 }
 
@@ -1149,7 +1163,7 @@ tbd_write_metadata(FILE *__notnull const file,
 }
 
 static int
-write_full_targets(FILE *__notnull file,
+write_full_targets(struct write_buffer *__notnull const wb,
                    const enum tbd_version version,
                    const struct target_list list)
 {
@@ -1157,7 +1171,7 @@ write_full_targets(FILE *__notnull file,
         return 1;
     }
 
-    if (fprintf(file, targets_symbol_key_fmt, "") < 0) {
+    if (wb_add_literal(wb, targets_symbol_key)) {
         return 1;
     }
 
@@ -1165,7 +1179,7 @@ write_full_targets(FILE *__notnull file,
     enum tbd_platform platform = TBD_PLATFORM_NONE;
 
     target_list_get_target(&list, 0, &arch, &platform);
-    if (write_target(file, arch, platform, version, false) < 0) {
+    if (write_target(wb, arch, platform, version, false) < 0) {
         return 1;
     }
 
@@ -1178,12 +1192,12 @@ write_full_targets(FILE *__notnull file,
          */
 
         const bool write_comma = (counter != 0);
-        if (write_target(file, arch, platform, version, write_comma) < 0) {
+        if (write_target(wb, arch, platform, version, write_comma) < 0) {
             return 1;
         }
 
         if (counter == MAX_TARGET_ON_LINE && (i != list.set_count - 1)) {
-            if (fprintf(file, ",\n%-11s", "") < 0) {
+            if (wb_add_literal(wb, ",\n           ")) {
                 return 1;
             }
 
@@ -1197,7 +1211,7 @@ write_full_targets(FILE *__notnull file,
      * Write the end bracket for the target-list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (wb_add_literal(wb, " ]\n")) {
         return 1;
     }
 
@@ -1206,7 +1220,7 @@ write_full_targets(FILE *__notnull file,
 
 static int
 write_umbrella_list_with_full_targets(
-    FILE *__notnull const file,
+    struct write_buffer *__notnull const wb,
     const struct tbd_create_info *__notnull const info,
     const struct tbd_metadata_info *__notnull m_info,
     const struct tbd_metadata_info *__notnull const end,
@@ -1216,19 +1230,19 @@ write_umbrella_list_with_full_targets(
     const enum tbd_version version = info->version;
 
     do {
-        if (write_full_targets(file, version, targets)) {
+        if (write_full_targets(wb, version, targets)) {
             return 1;
         }
 
-        if (fprintf(file, "%-4sumbrella:%-15s", "", "") < 0) {
+        if (wb_add_literal(wb, "    umbrella:               ")) {
             return 1;
         }
 
-        if (write_metadata_info(file, m_info)) {
+        if (write_metadata_info(wb, m_info)) {
             return 1;
         }
 
-        if (fputc('\n', file) < 0) {
+        if (wb_add_char(wb, '\n')) {
             return 1;
         }
 
@@ -1248,7 +1262,7 @@ write_umbrella_list_with_full_targets(
 
 int
 tbd_write_metadata_with_full_targets(
-    FILE *__notnull const file,
+    struct write_buffer *__notnull const wb,
     const struct tbd_create_info *__notnull const info_in,
     const struct tbd_create_options options)
 {
@@ -1271,7 +1285,7 @@ tbd_write_metadata_with_full_targets(
         }
 
         type = info->type;
-        if (write_metadata_type(file, type)) {
+        if (write_metadata_type(wb, type)) {
             return 1;
         }
 
@@ -1281,7 +1295,7 @@ tbd_write_metadata_with_full_targets(
 
             case TBD_METADATA_TYPE_PARENT_UMBRELLA: {
                 const int result =
-                    write_umbrella_list_with_full_targets(file,
+                    write_umbrella_list_with_full_targets(wb,
                                                           info_in,
                                                           info,
                                                           end,
@@ -1292,7 +1306,7 @@ tbd_write_metadata_with_full_targets(
                 }
 
                 type = info->type;
-                if (write_metadata_type(file, type)) {
+                if (write_metadata_type(wb, type)) {
                     return 1;
                 }
 
@@ -1305,15 +1319,15 @@ tbd_write_metadata_with_full_targets(
         }
 
         uint64_t line_length = 0;
-        if (write_full_targets(file, version, targets)) {
+        if (write_full_targets(wb, version, targets)) {
             return 1;
         }
 
-        if (fprintf(file, "%-4slibraries:%-12s[ ", "", "") < 0) {
+        if (wb_add_literal(wb, "    libraries:            [ ")) {
             return 1;
         }
 
-        if (write_metadata_info(file, info)) {
+        if (write_metadata_info(wb, info)) {
             return 1;
         }
 
@@ -1322,7 +1336,7 @@ tbd_write_metadata_with_full_targets(
         do {
             info++;
             if (info == end) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(wb)) {
                     return 1;
                 }
 
@@ -1331,7 +1345,7 @@ tbd_write_metadata_with_full_targets(
 
             const enum tbd_metadata_type inner_type = info->type;
             if (inner_type != type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(wb)) {
                     return 1;
                 }
 
@@ -1345,7 +1359,7 @@ tbd_write_metadata_with_full_targets(
 
             const uint64_t length = info->length;
             const enum write_comma_result write_comma_result =
-                write_comma_or_newline(file, line_length, length);
+                write_comma_or_newline(wb, line_length, length);
 
             switch (write_comma_result) {
                 case E_WRITE_COMMA_OK:
@@ -1359,7 +1373,7 @@ tbd_write_metadata_with_full_targets(
                     break;
             }
 
-            if (write_metadata_info(file, info)) {
+            if (write_metadata_info(wb, info)) {
                 return 1;
             }
 
@@ -1371,7 +1385,7 @@ tbd_write_metadata_with_full_targets(
 }
 
 static int
-write_symbol_meta_type(FILE *__notnull const file,
+write_symbol_meta_type(struct write_buffer *__notnull const wb,
                        const enum tbd_symbol_meta_type type)
 {
     switch (type) {
@@ -1379,21 +1393,21 @@ write_symbol_meta_type(FILE *__notnull const file,
             return 1;
 
         case TBD_SYMBOL_META_TYPE_EXPORT:
-            if (fputs("exports:\n", file) < 0) {
+            if (wb_add_literal(wb, "exports:\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_META_TYPE_REEXPORT:
-            if (fputs("reexports:\n", file) < 0) {
+            if (wb_add_literal(wb, "reexports:\n")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_META_TYPE_UNDEFINED:
-            if (fputs("undefineds:\n", file) < 0) {
+            if (wb_add_literal(wb, "undefineds:\n")) {
                 return 1;
             }
 
@@ -1403,7 +1417,7 @@ write_symbol_meta_type(FILE *__notnull const file,
 }
 
 static int
-write_symbol_type_key(FILE *__notnull const file,
+write_symbol_type_key(struct write_buffer *__notnull const wb,
                       const enum tbd_symbol_type type,
                       const enum tbd_version version,
                       const bool is_export)
@@ -1414,11 +1428,11 @@ write_symbol_type_key(FILE *__notnull const file,
 
         case TBD_SYMBOL_TYPE_CLIENT: {
             if (version != TBD_VERSION_V1) {
-                if (fprintf(file, "%-4sallowable-clients:%-4s[ ", "", "") < 0) {
+                if (wb_add_literal(wb, "    allowable-clients:    [ ")) {
                     return 1;
                 }
             } else {
-                if (fprintf(file, "%-4sallowed-clients:%-6s[ ", "", "") < 0) {
+                if (wb_add_literal(wb, "    allowed-clients:      [ ")) {
                     return 1;
                 }
             }
@@ -1427,35 +1441,35 @@ write_symbol_type_key(FILE *__notnull const file,
         }
 
         case TBD_SYMBOL_TYPE_REEXPORT:
-            if (fprintf(file, "%-4sre-exports:%11s[ ", "", "") < 0) {
+            if (wb_add_literal(wb, "    re-exports:           [ ")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_TYPE_NORMAL:
-            if (fprintf(file, "%-4ssymbols:%14s[ ", "", "") < 0) {
+            if (wb_add_literal(wb, "    symbols:              [ ")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_TYPE_OBJC_CLASS:
-            if (fprintf(file, "%-4sobjc-classes:%9s[ ", "", "") < 0) {
+            if (wb_add_literal(wb, "    objc-classes:         [ ")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_TYPE_OBJC_EHTYPE:
-            if (fprintf(file, "%-4sobjc-eh-types:%8s[ ", "", "") < 0) {
+            if (wb_add_literal(wb, "    objc-eh-types:        [ ")) {
                 return 1;
             }
 
             break;
 
         case TBD_SYMBOL_TYPE_OBJC_IVAR:
-            if (fprintf(file, "%-4sobjc-ivars:%11s[ ", "", "") < 0) {
+            if (wb_add_literal(wb, "    objc-ivars:           [ ")) {
                 return 1;
             }
 
@@ -1463,11 +1477,11 @@ write_symbol_type_key(FILE *__notnull const file,
 
         case TBD_SYMBOL_TYPE_WEAK_DEF:
             if (is_export) {
-                if (fprintf(file, "%-4sweak-def-symbols:%5s[ ", "", "") < 0) {
+                if (wb_add_literal(wb, "    weak-def-symbols:     [ ")) {
                     return 1;
                 }
             } else {
-                if (fprintf(file, "%-4sweak-ref-symbols:%5s[ ", "", "") < 0) {
+                if (wb_add_literal(wb, "    weak-ref-symbols:     [ ")) {
                     return 1;
                 }
             }
@@ -1479,7 +1493,7 @@ write_symbol_type_key(FILE *__notnull const file,
                 return 1;
             }
 
-            if (fprintf(file, "%-4sthread-local-symbols: [ ", "") < 0) {
+            if (wb_add_literal(wb, "    thread-local-symbols: [ ")) {
                 return 1;
             }
 
@@ -1490,11 +1504,11 @@ write_symbol_type_key(FILE *__notnull const file,
 }
 
 static inline int
-write_symbol_info(FILE *__notnull const file,
+write_symbol_info(struct write_buffer *__notnull const wb,
                   const struct tbd_symbol_info *__notnull const info)
 {
     const bool needs_quotes = info->flags.needs_quotes;
-    return write_yaml_string(file, info->string, info->length, needs_quotes);
+    return write_yaml_string(wb, info->string, info->length, needs_quotes);
 }
 
 static int
@@ -1605,7 +1619,7 @@ skip_syms_with_mtype(const struct tbd_symbol_info *__notnull sym,
 }
 
 int
-tbd_write_symbols_for_archs(FILE *__notnull const file,
+tbd_write_symbols_for_archs(struct write_buffer *__notnull const wb,
                             const struct tbd_create_info *__notnull const info,
                             const struct tbd_create_options options)
 {
@@ -1636,22 +1650,22 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
         }
 
         m_type = sym->meta_type;
-        if (write_symbol_meta_type(file, m_type)) {
+        if (write_symbol_meta_type(wb, m_type)) {
             return 1;
         }
 
         do {
             const struct bit_list bits = sym->targets;
-            if (write_archs_for_symbol_arrays(file, targets, bits)) {
+            if (write_archs_for_symbol_arrays(wb, targets, bits)) {
                 return 1;
             }
 
             enum tbd_symbol_type type = sym->type;
-            if (write_symbol_type_key(file, type, version, true)) {
+            if (write_symbol_type_key(wb, type, version, true)) {
                 return 1;
             }
 
-            if (write_symbol_info(file, sym)) {
+            if (write_symbol_info(wb, sym)) {
                 return 1;
             }
 
@@ -1671,7 +1685,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                  */
 
                 if (sym == end) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1682,7 +1696,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                     sym->meta_type;
 
                 if (inner_meta_type != m_type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1699,7 +1713,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                 const uint64_t inner_count = inner_bits.set_count;
 
                 if (inner_count != bits.set_count) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1707,7 +1721,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                 }
 
                 if (!bit_list_equal_counts_is_equal(bits, inner_bits)) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1722,7 +1736,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
 
                 enum tbd_symbol_type in_type = sym->type;
                 if (in_type != type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1732,11 +1746,11 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                         return 0;
                     }
 
-                    if (write_symbol_type_key(file, in_type, version, true)) {
+                    if (write_symbol_type_key(wb, in_type, version, true)) {
                         return 1;
                     }
 
-                    if (write_symbol_info(file, sym)) {
+                    if (write_symbol_info(wb, sym)) {
                         return 1;
                     }
 
@@ -1758,7 +1772,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
 
                 const uint64_t length = sym->length;
                 const enum write_comma_result write_comma_result =
-                    write_comma_or_newline(file, line_length, length);
+                    write_comma_or_newline(wb, line_length, length);
 
                 switch (write_comma_result) {
                     case E_WRITE_COMMA_OK:
@@ -1772,7 +1786,7 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
                         break;
                 }
 
-                if (write_symbol_info(file, sym)) {
+                if (write_symbol_info(wb, sym)) {
                     return 1;
                 }
 
@@ -1784,9 +1798,374 @@ tbd_write_symbols_for_archs(FILE *__notnull const file,
     return 0;
 }
 
+/*
+ * Images with fewer symbols than this are written out serially, as the cost of
+ * starting threads would outweigh the rendering itself.
+ */
+
+static const uint64_t parallel_symbols_min_count = 16384;
+
+/*
+ * A macro, as the thread-list is sized with it, and a static const isn't a
+ * constant expression in C.
+ */
+
+#define PARALLEL_SYMBOLS_MAX_THREADS 8
+
+/*
+ * Split the symbols into this many chunks per thread, so that threads that
+ * finish early can pick up the remaining chunks.
+ */
+
+static const uint64_t parallel_chunks_per_thread = 4;
+
+static bool
+can_write_symbols_in_parallel(const struct array *__notnull const symbols,
+                              const struct tbd_create_options options)
+{
+    if (symbols->item_count < parallel_symbols_min_count) {
+        return false;
+    }
+
+    /*
+     * The serial writers skip ignored symbols only at the start of a
+     * symbol-type array, which chunks rendered on their own can't reproduce,
+     * so only symbols that are all written out are rendered in parallel.
+     */
+
+    if (options.ignore_exports ||
+        options.ignore_reexports ||
+        options.ignore_undefineds ||
+        options.ignore_clients ||
+        options.ignore_normal_syms ||
+        options.ignore_objc_class_syms ||
+        options.ignore_objc_ivar_syms ||
+        options.ignore_objc_ehtype_syms ||
+        options.ignore_thread_local_syms ||
+        options.ignore_weak_defs_syms)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static inline bool
+symbol_targets_differ(const struct tbd_symbol_info *__notnull const prev,
+                      const struct tbd_symbol_info *__notnull const sym)
+{
+    const struct bit_list bits = sym->targets;
+    if (bits.set_count != prev->targets.set_count) {
+        return true;
+    }
+
+    return !bit_list_equal_counts_is_equal(bits, prev->targets);
+}
+
+static inline bool
+symbol_starts_new_array(const struct tbd_symbol_info *__notnull const prev,
+                        const struct tbd_symbol_info *__notnull const sym,
+                        const bool full_targets)
+{
+    if (sym->meta_type != prev->meta_type || sym->type != prev->type) {
+        return true;
+    }
+
+    if (full_targets) {
+        return false;
+    }
+
+    return symbol_targets_differ(prev, sym);
+}
+
+/*
+ * Write out the symbol-type arrays of the symbols in [sym, end). The keys to
+ * write before each array are decided by comparing against the symbol before
+ * it, with prev being the symbol before sym, or NULL if sym is the first.
+ */
+
+static int
+write_symbol_arrays(struct write_buffer *__notnull const wb,
+                    const struct tbd_create_info *__notnull const info,
+                    const struct tbd_symbol_info *prev,
+                    const struct tbd_symbol_info *__notnull sym,
+                    const struct tbd_symbol_info *__notnull const end,
+                    const bool full_targets)
+{
+    const struct target_list targets = info->fields.targets;
+    const enum tbd_version version = info->version;
+
+    while (sym != end) {
+        const enum tbd_symbol_meta_type m_type = sym->meta_type;
+        const bool new_m_type = (prev == NULL || prev->meta_type != m_type);
+
+        if (new_m_type) {
+            if (write_symbol_meta_type(wb, m_type)) {
+                return 1;
+            }
+        }
+
+        if (full_targets) {
+            if (new_m_type) {
+                if (write_full_targets(wb, version, targets)) {
+                    return 1;
+                }
+            }
+        } else if (new_m_type || symbol_targets_differ(prev, sym)) {
+            if (write_targets_as_dict_key(wb, targets, sym->targets, version)) {
+                return 1;
+            }
+        }
+
+        if (write_symbol_type_key(wb, sym->type, version, true)) {
+            return 1;
+        }
+
+        if (write_symbol_info(wb, sym)) {
+            return 1;
+        }
+
+        uint64_t line_length = line_length_initial + sym->length;
+
+        prev = sym;
+        sym++;
+
+        for (; sym != end; prev = sym, sym++) {
+            if (symbol_starts_new_array(prev, sym, full_targets)) {
+                break;
+            }
+
+            const uint64_t length = sym->length;
+            const enum write_comma_result write_comma_result =
+                write_comma_or_newline(wb, line_length, length);
+
+            switch (write_comma_result) {
+                case E_WRITE_COMMA_OK:
+                    break;
+
+                case E_WRITE_COMMA_WRITE_FAIL:
+                    return 1;
+
+                case E_WRITE_COMMA_RESET_LINE_LENGTH:
+                    line_length = line_length_initial;
+                    break;
+            }
+
+            if (write_symbol_info(wb, sym)) {
+                return 1;
+            }
+
+            line_length += length;
+        }
+
+        if (end_written_sequence(wb)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+struct symbol_chunk {
+    const struct tbd_symbol_info *begin;
+    const struct tbd_symbol_info *end;
+
+    struct write_buffer wb;
+    int result;
+};
+
+struct symbol_chunk_jobs {
+    const struct tbd_create_info *info;
+
+    struct symbol_chunk *chunks;
+    uint64_t chunk_count;
+
+    atomic_uint_fast64_t next_chunk;
+    bool full_targets;
+};
+
+static void *render_symbol_chunks(void *__notnull const arg) {
+    struct symbol_chunk_jobs *const jobs = (struct symbol_chunk_jobs *)arg;
+    const struct tbd_symbol_info *const first = jobs->info->fields.symbols.data;
+
+    do {
+        const uint64_t index = atomic_fetch_add(&jobs->next_chunk, 1);
+        if (index >= jobs->chunk_count) {
+            break;
+        }
+
+        struct symbol_chunk *const chunk = jobs->chunks + index;
+        const struct tbd_symbol_info *const begin = chunk->begin;
+        const struct tbd_symbol_info *const prev =
+            (begin != first) ? (begin - 1) : NULL;
+
+        chunk->result =
+            write_symbol_arrays(&chunk->wb,
+                                jobs->info,
+                                prev,
+                                begin,
+                                chunk->end,
+                                jobs->full_targets);
+    } while (true);
+
+    return NULL;
+}
+
+static uint64_t get_parallel_thread_count(void) {
+    const long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count < 1) {
+        return 1;
+    }
+
+    if ((uint64_t)cpu_count > PARALLEL_SYMBOLS_MAX_THREADS) {
+        return PARALLEL_SYMBOLS_MAX_THREADS;
+    }
+
+    return (uint64_t)cpu_count;
+}
+
+/*
+ * Split the symbols at symbol-type array boundaries into chunks of roughly
+ * chunk_size symbols. Line-wrapping restarts with every symbol-type array, so
+ * each chunk can be rendered without knowing what was written before it.
+ *
+ * When only counting the length of the output, the chunks only count as well.
+ */
+
+static uint64_t
+split_symbols_into_chunks(const struct array *__notnull const symbols,
+                          struct symbol_chunk *__notnull const chunks,
+                          const uint64_t chunk_size,
+                          const bool full_targets,
+                          const bool is_counting)
+{
+    const struct tbd_symbol_info *begin = symbols->data;
+    const struct tbd_symbol_info *const end = symbols->data_end;
+
+    uint64_t count = 0;
+    while (begin != end) {
+        const struct tbd_symbol_info *chunk_end = end;
+        if ((uint64_t)(end - begin) > chunk_size) {
+            chunk_end = begin + chunk_size;
+            for (; chunk_end != end; chunk_end++) {
+                if (symbol_starts_new_array(chunk_end - 1,
+                                            chunk_end,
+                                            full_targets))
+                {
+                    break;
+                }
+            }
+        }
+
+        struct symbol_chunk *const chunk = chunks + count;
+
+        chunk->begin = begin;
+        chunk->end = chunk_end;
+
+        if (is_counting) {
+            wb_create_for_counting(&chunk->wb);
+        } else {
+            wb_create_with_fd(&chunk->wb, -1);
+        }
+
+        begin = chunk_end;
+        count++;
+    }
+
+    return count;
+}
+
+static int
+write_symbols_in_parallel(struct write_buffer *__notnull const wb,
+                          const struct tbd_create_info *__notnull const info,
+                          const bool full_targets)
+{
+    const struct array *const symbols = &info->fields.symbols;
+    const uint64_t thread_count = get_parallel_thread_count();
+
+    if (thread_count == 1) {
+        const struct tbd_symbol_info *const begin = symbols->data;
+        const struct tbd_symbol_info *const end = symbols->data_end;
+
+        return write_symbol_arrays(wb, info, NULL, begin, end, full_targets);
+    }
+
+    const uint64_t chunk_goal = thread_count * parallel_chunks_per_thread;
+    const uint64_t chunk_size = symbols->item_count / chunk_goal;
+
+    /*
+     * Chunks only ever end up larger than chunk_size, so there can't be more
+     * than chunk_goal + 1 of them.
+     */
+
+    struct symbol_chunk *const chunks =
+        calloc(chunk_goal + 1, sizeof(struct symbol_chunk));
+
+    if (chunks == NULL) {
+        return 1;
+    }
+
+    struct symbol_chunk_jobs jobs = {
+        .info = info,
+        .chunks = chunks,
+        .full_targets = full_targets
+    };
+
+    jobs.chunk_count =
+        split_symbols_into_chunks(symbols,
+                                  chunks,
+                                  chunk_size,
+                                  full_targets,
+                                  wb->is_counting);
+
+    atomic_init(&jobs.next_chunk, 0);
+
+    /*
+     * The current thread renders chunks as well, so only create the rest. If
+     * creating a thread fails, the threads already running (and the current
+     * thread) simply render more of the chunks.
+     */
+
+    pthread_t threads[PARALLEL_SYMBOLS_MAX_THREADS];
+    uint64_t created_count = 0;
+
+    for (; created_count != thread_count - 1; created_count++) {
+        pthread_t *const thread = threads + created_count;
+        if (pthread_create(thread, NULL, render_symbol_chunks, &jobs) != 0) {
+            break;
+        }
+    }
+
+    render_symbol_chunks(&jobs);
+
+    for (uint64_t i = 0; i != created_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    int result = 0;
+
+    struct symbol_chunk *chunk = chunks;
+    const struct symbol_chunk *const chunks_end = chunks + jobs.chunk_count;
+
+    for (; chunk != chunks_end; chunk++) {
+        if (result == 0) {
+            if (chunk->result != 0) {
+                result = 1;
+            } else if (wb_add_bytes(wb, chunk->wb.data, chunk->wb.length)) {
+                result = 1;
+            }
+        }
+
+        wb_destroy(&chunk->wb);
+    }
+
+    free(chunks);
+    return result;
+}
+
 int
 tbd_write_symbols_for_targets(
-    FILE *__notnull const file,
+    struct write_buffer *__notnull const wb,
     const struct tbd_create_info *__notnull const info,
     const struct tbd_create_options options)
 {
@@ -1799,6 +2178,10 @@ tbd_write_symbols_for_targets(
         return 0;
     }
 
+    if (can_write_symbols_in_parallel(symbol_list, options)) {
+        return write_symbols_in_parallel(wb, info, false);
+    }
+
     const struct target_list targets = info->fields.targets;
     const enum tbd_version version = info->version;
 
@@ -1812,22 +2195,22 @@ meta:
         }
 
         m_type = sym->meta_type;
-        if (write_symbol_meta_type(file, m_type)) {
+        if (write_symbol_meta_type(wb, m_type)) {
             return 1;
         }
 
         do {
             const struct bit_list bits = sym->targets;
-            if (write_targets_as_dict_key(file, targets, bits, version)) {
+            if (write_targets_as_dict_key(wb, targets, bits, version)) {
                 return 1;
             }
 
             enum tbd_symbol_type type = sym->type;
-            if (write_symbol_type_key(file, type, version, true)) {
+            if (write_symbol_type_key(wb, type, version, true)) {
                 return 1;
             }
 
-            if (write_symbol_info(file, sym)) {
+            if (write_symbol_info(wb, sym)) {
                 return 1;
             }
 
@@ -1847,7 +2230,7 @@ meta:
                  */
 
                 if (sym == end) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1856,7 +2239,7 @@ meta:
 
                 const enum tbd_symbol_meta_type inner_m_type = sym->meta_type;
                 if (inner_m_type != m_type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1873,7 +2256,7 @@ meta:
                 const uint64_t inner_count = inner_bits.set_count;
 
                 if (inner_count != bits.set_count) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1881,7 +2264,7 @@ meta:
                 }
 
                 if (!bit_list_equal_counts_is_equal(bits, inner_bits)) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1896,7 +2279,7 @@ meta:
 
                 enum tbd_symbol_type in_type = sym->type;
                 if (in_type != type) {
-                    if (end_written_sequence(file)) {
+                    if (end_written_sequence(wb)) {
                         return 1;
                     }
 
@@ -1906,11 +2289,11 @@ meta:
                         return 0;
                     }
 
-                    if (write_symbol_type_key(file, in_type, version, true)) {
+                    if (write_symbol_type_key(wb, in_type, version, true)) {
                         return 1;
                     }
 
-                    if (write_symbol_info(file, sym)) {
+                    if (write_symbol_info(wb, sym)) {
                         return 1;
                     }
 
@@ -1932,7 +2315,7 @@ meta:
 
                 const uint64_t length = sym->length;
                 const enum write_comma_result write_comma_result =
-                    write_comma_or_newline(file, line_length, length);
+                    write_comma_or_newline(wb, line_length, length);
 
                 switch (write_comma_result) {
                     case E_WRITE_COMMA_OK:
@@ -1946,7 +2329,7 @@ meta:
                         break;
                 }
 
-                if (write_symbol_info(file, sym)) {
+                if (write_symbol_info(wb, sym)) {
                     return 1;
                 }
 
@@ -1958,8 +2341,10 @@ meta:
     return 0;
 }
 
-static
-int write_full_archs(FILE *__notnull file, const struct target_list list) {
+static int
+write_full_archs(struct write_buffer *__notnull const wb,
+                 const struct target_list list)
+{
     if (list.set_count == 0) {
         return 1;
     }
@@ -1968,7 +2353,11 @@ int write_full_archs(FILE *__notnull file, const struct target_list list) {
     enum tbd_platform platform = TBD_PLATFORM_NONE;
 
     target_list_get_target(&list, 0, &arch, &platform);
-    if (fprintf(file, archs_symbol_key_fmt, "", arch->name) < 0) {
+    if (wb_add_literal(wb, archs_symbol_key)) {
+        return 1;
+    }
+
+    if (wb_add_bytes(wb, arch->name, arch->name_length)) {
         return 1;
     }
 
@@ -1982,17 +2371,17 @@ int write_full_archs(FILE *__notnull file, const struct target_list list) {
 
         const bool write_comma = (counter != 0);
         if (write_comma) {
-            if (fputs(", ", file) < 0) {
+            if (wb_add_literal(wb, ", ")) {
                 return 1;
             }
         }
 
-        if (fwrite(arch->name, arch->name_length, 1, file) < 0) {
+        if (wb_add_bytes(wb, arch->name, arch->name_length)) {
             return 1;
         }
 
         if (counter == MAX_TARGET_ON_LINE && (i != list.set_count - 1)) {
-            if (fprintf(file, ",\n%-11s", "") < 0) {
+            if (wb_add_literal(wb, ",\n           ")) {
                 return 1;
             }
 
@@ -2006,7 +2395,7 @@ int write_full_archs(FILE *__notnull file, const struct target_list list) {
      * Write the end bracket for the target-list and return.
      */
 
-    if (fputs(" ]\n", file) < 0) {
+    if (wb_add_literal(wb, " ]\n")) {
         return 1;
     }
 
@@ -2015,7 +2404,7 @@ int write_full_archs(FILE *__notnull file, const struct target_list list) {
 
 int
 tbd_write_symbols_with_full_archs(
-    FILE *__notnull const file,
+    struct write_buffer *__notnull const wb,
     const struct tbd_create_info *__notnull const info,
     const struct tbd_create_options options)
 {
@@ -2038,22 +2427,22 @@ tbd_write_symbols_with_full_archs(
         }
 
         m_type = sym->meta_type;
-        if (write_symbol_meta_type(file, m_type)) {
+        if (write_symbol_meta_type(wb, m_type)) {
             return 1;
         }
 
-        if (write_full_archs(file, targets)) {
+        if (write_full_archs(wb, targets)) {
             return 1;
         }
 
         const enum tbd_version version = info->version;
         enum tbd_symbol_type type = sym->type;
 
-        if (write_symbol_type_key(file, type, version, true)) {
+        if (write_symbol_type_key(wb, type, version, true)) {
             return 1;
         }
 
-        if (write_symbol_info(file, sym)) {
+        if (write_symbol_info(wb, sym)) {
             return 1;
         }
 
@@ -2068,7 +2457,7 @@ tbd_write_symbols_with_full_archs(
              */
 
             if (sym == end) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(wb)) {
                     return 1;
                 }
 
@@ -2077,7 +2466,7 @@ tbd_write_symbols_with_full_archs(
 
             const enum tbd_symbol_meta_type inner_meta_type = sym->meta_type;
             if (inner_meta_type != m_type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(wb)) {
                     return 1;
                 }
 
@@ -2093,15 +2482,15 @@ tbd_write_symbols_with_full_archs(
 
             const enum tbd_symbol_type inner_type = sym->type;
             if (inner_type != type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(wb)) {
                     return 1;
                 }
 
-                if (write_symbol_type_key(file, inner_type, version, true)) {
+                if (write_symbol_type_key(wb, inner_type, version, true)) {
                     return 1;
                 }
 
-                if (write_symbol_info(file, sym)) {
+                if (write_symbol_info(wb, sym)) {
                     return 1;
                 }
 
@@ -2123,7 +2512,7 @@ tbd_write_symbols_with_full_archs(
 
             const uint64_t length = sym->length;
             const enum write_comma_result write_comma_result =
-                write_comma_or_newline(file, line_length, length);
+                write_comma_or_newline(wb, line_length, length);
 
             switch (write_comma_result) {
                 case E_WRITE_COMMA_OK:
@@ -2137,7 +2526,7 @@ tbd_write_symbols_with_full_archs(
                     break;
             }
 
-            if (write_symbol_info(file, sym)) {
+            if (write_symbol_info(wb, sym)) {
                 return 1;
             }
 
@@ -2150,7 +2539,7 @@ tbd_write_symbols_with_full_archs(
 
 int
 tbd_write_symbols_with_full_targets(
-    FILE *__notnull const file,
+    struct write_buffer *__notnull const wb,
     const struct tbd_create_info *__notnull const info,
     const struct tbd_create_options options)
 {
@@ -2163,6 +2552,10 @@ tbd_write_symbols_with_full_targets(
         return 0;
     }
 
+    if (can_write_symbols_in_parallel(symbol_list, options)) {
+        return write_symbols_in_parallel(wb, info, true);
+    }
+
     enum tbd_symbol_meta_type m_type = sym->meta_type;
 
     do {
@@ -2172,23 +2565,23 @@ tbd_write_symbols_with_full_targets(
         }
 
         m_type = sym->meta_type;
-        if (write_symbol_meta_type(file, m_type)) {
+        if (write_symbol_meta_type(wb, m_type)) {
             return 1;
         }
 
         const struct target_list targets = info->fields.targets;
         const enum tbd_version version = info->version;
 
-        if (write_full_targets(file, version, targets)) {
+        if (write_full_targets(wb, version, targets)) {
             return 1;
         }
 
         enum tbd_symbol_type type = sym->type;
-        if (write_symbol_type_key(file, type, version, true)) {
+        if (write_symbol_type_key(wb, type, version, true)) {
             return 1;
         }
 
-        if (write_symbol_info(file, sym)) {
+        if (write_symbol_info(wb, sym)) {
             return 1;
         }
 
@@ -2203,7 +2596,7 @@ tbd_write_symbols_with_full_targets(
              */
 
             if (sym == end) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(wb)) {
                     return 1;
                 }
 
@@ -2212,7 +2605,7 @@ tbd_write_symbols_with_full_targets(
 
             const enum tbd_symbol_meta_type inner_meta_type = sym->meta_type;
             if (inner_meta_type != m_type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(wb)) {
                     return 1;
                 }
 
@@ -2228,15 +2621,15 @@ tbd_write_symbols_with_full_targets(
 
             const enum tbd_symbol_type inner_type = sym->type;
             if (inner_type != type) {
-                if (end_written_sequence(file)) {
+                if (end_written_sequence(wb)) {
                     return 1;
                 }
 
-                if (write_symbol_type_key(file, inner_type, version, true)) {
+                if (write_symbol_type_key(wb, inner_type, version, true)) {
                     return 1;
                 }
 
-                if (write_symbol_info(file, sym)) {
+                if (write_symbol_info(wb, sym)) {
                     return 1;
                 }
 
@@ -2258,7 +2651,7 @@ tbd_write_symbols_with_full_targets(
 
             const uint64_t length = sym->length;
             const enum write_comma_result write_comma_result =
-                write_comma_or_newline(file, line_length, length);
+                write_comma_or_newline(wb, line_length, length);
 
             switch (write_comma_result) {
                 case E_WRITE_COMMA_OK:
@@ -2272,7 +2665,7 @@ tbd_write_symbols_with_full_targets(
                     break;
             }
 
-            if (write_symbol_info(file, sym)) {
+            if (write_symbol_info(wb, sym)) {
                 return 1;
             }
 
@@ -0,0 +1,524 @@
+//
+//  src/tbd_write_index.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "array.h"
+#include "bit_list.h"
+#include "target_list.h"
+#include "tbd_write_index.h"
+
+static const uint32_t index_version = 1;
+static const uint32_t no_symbol = UINT32_MAX;
+
+static const uint64_t header_size = 80;
+static const uint64_t target_entry_size = 8;
+static const uint64_t group_entry_size = 24;
+static const uint64_t symbol_entry_size = 16;
+
+struct index_group {
+    uint64_t targets;
+
+    uint32_t kind;
+    uint32_t type;
+
+    uint32_t first_symbol;
+    uint32_t symbol_count;
+};
+
+static int add_u32(struct write_buffer *__notnull const wb, uint32_t number) {
+    uint8_t bytes[4];
+    for (uint64_t i = 0; i != sizeof(bytes); i++) {
+        bytes[i] = (uint8_t)(number & 0xff);
+        number >>= 8;
+    }
+
+    return wb_add_bytes(wb, bytes, sizeof(bytes));
+}
+
+static int add_u64(struct write_buffer *__notnull const wb, uint64_t number) {
+    uint8_t bytes[8];
+    for (uint64_t i = 0; i != sizeof(bytes); i++) {
+        bytes[i] = (uint8_t)(number & 0xff);
+        number >>= 8;
+    }
+
+    return wb_add_bytes(wb, bytes, sizeof(bytes));
+}
+
+static uint32_t
+hash_name(const char *__notnull const name, const uint64_t length) {
+    uint32_t hash = 2166136261u;
+    for (uint64_t i = 0; i != length; i++) {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+/*
+ * Clients and re-exports are only symbols on tbd-versions v1 to v3, and aren't
+ * exported symbols, so they aren't indexed.
+ */
+
+static bool
+should_index_symbol(const struct tbd_symbol_info *__notnull const sym,
+                    const struct tbd_create_options options,
+                    uint32_t *__notnull const kind_out,
+                    uint32_t *__notnull const type_out)
+{
+    switch (sym->meta_type) {
+        case TBD_SYMBOL_META_TYPE_NONE:
+            return false;
+
+        case TBD_SYMBOL_META_TYPE_EXPORT:
+            if (options.ignore_exports) {
+                return false;
+            }
+
+            *kind_out = 0;
+            break;
+
+        case TBD_SYMBOL_META_TYPE_REEXPORT:
+            if (options.ignore_reexports) {
+                return false;
+            }
+
+            *kind_out = 1;
+            break;
+
+        case TBD_SYMBOL_META_TYPE_UNDEFINED:
+            if (options.ignore_undefineds) {
+                return false;
+            }
+
+            *kind_out = 2;
+            break;
+    }
+
+    switch (sym->type) {
+        case TBD_SYMBOL_TYPE_NONE:
+        case TBD_SYMBOL_TYPE_CLIENT:
+        case TBD_SYMBOL_TYPE_REEXPORT:
+            return false;
+
+        case TBD_SYMBOL_TYPE_NORMAL:
+            *type_out = 0;
+            return !options.ignore_normal_syms;
+
+        case TBD_SYMBOL_TYPE_OBJC_CLASS:
+            *type_out = 1;
+            return !options.ignore_objc_class_syms;
+
+        case TBD_SYMBOL_TYPE_OBJC_EHTYPE:
+            *type_out = 2;
+            return !options.ignore_objc_ehtype_syms;
+
+        case TBD_SYMBOL_TYPE_OBJC_IVAR:
+            *type_out = 3;
+            return !options.ignore_objc_ivar_syms;
+
+        case TBD_SYMBOL_TYPE_WEAK_DEF:
+            *type_out = 4;
+            return !options.ignore_weak_defs_syms;
+
+        case TBD_SYMBOL_TYPE_THREAD_LOCAL:
+            *type_out = 5;
+            return !options.ignore_thread_local_syms;
+    }
+
+    return false;
+}
+
+static uint64_t
+get_targets_mask(const struct tbd_symbol_info *__notnull const sym,
+                 const uint64_t target_count,
+                 const bool full_targets)
+{
+    if (full_targets) {
+        if (target_count == 64) {
+            return UINT64_MAX;
+        }
+
+        return (1ull << target_count) - 1;
+    }
+
+    const struct bit_list bits = sym->targets;
+
+    uint64_t mask = 0;
+    uint64_t index = bit_list_find_first_bit(bits);
+
+    for (uint64_t i = 0; i != bits.set_count; i++) {
+        if (i != 0) {
+            index = bit_list_find_bit_after_last(bits, index);
+        }
+
+        mask |= (1ull << index);
+    }
+
+    return mask;
+}
+
+static uint64_t
+get_target_name_length(const struct target_list *__notnull const list,
+                       const uint64_t index)
+{
+    const struct arch_info *arch = NULL;
+    enum tbd_platform platform = TBD_PLATFORM_NONE;
+
+    target_list_get_target(list, index, &arch, &platform);
+
+    const char *const platform_string =
+        tbd_platform_to_string(platform, TBD_VERSION_V4);
+
+    return arch->name_length + 1 + strlen(platform_string);
+}
+
+static int
+write_target_name(struct write_buffer *__notnull const wb,
+                  const struct target_list *__notnull const list,
+                  const uint64_t index)
+{
+    const struct arch_info *arch = NULL;
+    enum tbd_platform platform = TBD_PLATFORM_NONE;
+
+    target_list_get_target(list, index, &arch, &platform);
+
+    if (wb_add_bytes(wb, arch->name, arch->name_length)) {
+        return 1;
+    }
+
+    if (wb_add_char(wb, '-')) {
+        return 1;
+    }
+
+    if (wb_add_c_str(wb, tbd_platform_to_string(platform, TBD_VERSION_V4))) {
+        return 1;
+    }
+
+    return wb_add_char(wb, '\0');
+}
+
+/*
+ * Collect the groups of the symbols to index, and chain every indexed symbol
+ * into its bucket.
+ *
+ * Symbols are sorted by their meta-type, then their targets, then their type,
+ * so a new group is started whenever any of them differ from the previous
+ * indexed symbol.
+ */
+
+static int
+collect_groups(const struct tbd_create_info *__notnull const info,
+               const struct tbd_create_options options,
+               struct array *__notnull const groups,
+               uint32_t *__notnull const buckets,
+               const uint64_t bucket_count,
+               uint32_t *__notnull const next,
+               uint64_t *__notnull const symbol_count_out,
+               uint64_t *__notnull const names_size_out)
+{
+    const struct array *const symbols = &info->fields.symbols;
+    const uint64_t target_count = info->fields.targets.set_count;
+    const bool full_targets = info->flags.uses_full_targets;
+
+    const struct tbd_symbol_info *sym = symbols->data;
+    const struct tbd_symbol_info *const end = symbols->data_end;
+
+    struct index_group *group = NULL;
+
+    uint64_t symbol_count = 0;
+    uint64_t names_size = 0;
+
+    for (; sym != end; sym++) {
+        uint32_t kind = 0;
+        uint32_t type = 0;
+
+        if (!should_index_symbol(sym, options, &kind, &type)) {
+            continue;
+        }
+
+        const uint64_t targets =
+            get_targets_mask(sym, target_count, full_targets);
+
+        if (group == NULL ||
+            group->kind != kind ||
+            group->type != type ||
+            group->targets != targets)
+        {
+            const struct index_group new_group = {
+                .targets = targets,
+                .kind = kind,
+                .type = type,
+                .first_symbol = (uint32_t)symbol_count
+            };
+
+            if (array_add_item(groups, sizeof(new_group), &new_group, NULL)) {
+                return 1;
+            }
+
+            group = (struct index_group *)groups->data_end - 1;
+        }
+
+        group->symbol_count += 1;
+
+        const uint32_t hash = hash_name(sym->string, sym->length);
+        const uint64_t bucket = (hash & (bucket_count - 1));
+
+        next[symbol_count] = buckets[bucket];
+        buckets[bucket] = (uint32_t)symbol_count;
+
+        symbol_count += 1;
+        names_size += sym->length + 1;
+    }
+
+    *symbol_count_out = symbol_count;
+    *names_size_out = names_size;
+
+    return 0;
+}
+
+static int
+write_index_with_groups(struct write_buffer *__notnull const wb,
+                        const struct tbd_create_info *__notnull const info,
+                        const struct tbd_create_options options,
+                        const struct array *__notnull const groups,
+                        const uint32_t *__notnull const buckets,
+                        const uint64_t bucket_count,
+                        const uint32_t *__notnull const next,
+                        const uint64_t symbol_count,
+                        const uint64_t names_size)
+{
+    const struct target_list *const targets = &info->fields.targets;
+    const uint64_t target_count = targets->set_count;
+
+    uint64_t targets_size = 0;
+    for (uint64_t i = 0; i != target_count; i++) {
+        targets_size += get_target_name_length(targets, i) + 1;
+    }
+
+    const struct tbd_create_info_fields *const fields = &info->fields;
+
+    const uint64_t install_name_offset = targets_size;
+    const uint64_t install_name_length = fields->install_name_length;
+    const uint64_t symbol_names_offset =
+        install_name_offset + install_name_length + 1;
+
+    if (symbol_names_offset + names_size >= UINT32_MAX) {
+        return 1;
+    }
+
+    const uint64_t group_count = groups->item_count;
+
+    const uint64_t targets_offset = header_size;
+    const uint64_t groups_offset =
+        targets_offset + (target_count * target_entry_size);
+
+    const uint64_t symbols_offset =
+        groups_offset + (group_count * group_entry_size);
+
+    const uint64_t buckets_offset =
+        symbols_offset + (symbol_count * symbol_entry_size);
+
+    const uint64_t strings_offset = buckets_offset + (bucket_count * 4);
+
+    if (wb_add_literal(wb, "TBDI") ||
+        add_u32(wb, index_version) ||
+        add_u32(wb, (uint32_t)target_count) ||
+        add_u32(wb, (uint32_t)group_count) ||
+        add_u32(wb, (uint32_t)symbol_count) ||
+        add_u32(wb, (uint32_t)bucket_count) ||
+        add_u32(wb, (uint32_t)install_name_offset) ||
+        add_u32(wb, (uint32_t)install_name_length) ||
+        add_u32(wb, fields->current_version) ||
+        add_u32(wb, fields->compatibility_version) ||
+        add_u64(wb, targets_offset) ||
+        add_u64(wb, groups_offset) ||
+        add_u64(wb, symbols_offset) ||
+        add_u64(wb, buckets_offset) ||
+        add_u64(wb, strings_offset))
+    {
+        return 1;
+    }
+
+    uint64_t name_offset = 0;
+    for (uint64_t i = 0; i != target_count; i++) {
+        const uint64_t length = get_target_name_length(targets, i);
+        if (add_u32(wb, (uint32_t)name_offset) ||
+            add_u32(wb, (uint32_t)length))
+        {
+            return 1;
+        }
+
+        name_offset += length + 1;
+    }
+
+    const struct index_group *group = groups->data;
+    const struct index_group *const groups_end = groups->data_end;
+
+    for (; group != groups_end; group++) {
+        if (add_u64(wb, group->targets) ||
+            add_u32(wb, group->kind) ||
+            add_u32(wb, group->type) ||
+            add_u32(wb, group->first_symbol) ||
+            add_u32(wb, group->symbol_count))
+        {
+            return 1;
+        }
+    }
+
+    /*
+     * Go over the symbols again in the same order as collect_groups(), to
+     * write out the indexed ones.
+     */
+
+    const struct array *const symbols = &fields->symbols;
+
+    const struct tbd_symbol_info *sym = symbols->data;
+    const struct tbd_symbol_info *const end = symbols->data_end;
+
+    group = groups->data;
+    name_offset = symbol_names_offset;
+
+    for (uint64_t index = 0; sym != end; sym++) {
+        uint32_t kind = 0;
+        uint32_t type = 0;
+
+        if (!should_index_symbol(sym, options, &kind, &type)) {
+            continue;
+        }
+
+        if (index == group->first_symbol + group->symbol_count) {
+            group++;
+        }
+
+        const uint32_t group_index =
+            (uint32_t)(group - (const struct index_group *)groups->data);
+
+        if (add_u32(wb, (uint32_t)name_offset) ||
+            add_u32(wb, (uint32_t)sym->length) ||
+            add_u32(wb, group_index) ||
+            add_u32(wb, next[index]))
+        {
+            return 1;
+        }
+
+        name_offset += sym->length + 1;
+        index++;
+    }
+
+    for (uint64_t i = 0; i != bucket_count; i++) {
+        if (add_u32(wb, buckets[i])) {
+            return 1;
+        }
+    }
+
+    for (uint64_t i = 0; i != target_count; i++) {
+        if (write_target_name(wb, targets, i)) {
+            return 1;
+        }
+    }
+
+    if (wb_add_bytes(wb, fields->install_name, install_name_length) ||
+        wb_add_char(wb, '\0'))
+    {
+        return 1;
+    }
+
+    for (sym = symbols->data; sym != end; sym++) {
+        uint32_t kind = 0;
+        uint32_t type = 0;
+
+        if (!should_index_symbol(sym, options, &kind, &type)) {
+            continue;
+        }
+
+        if (wb_add_bytes(wb, sym->string, sym->length) ||
+            wb_add_char(wb, '\0'))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int
+tbd_write_index(struct write_buffer *__notnull const wb,
+                const struct tbd_create_info *__notnull const info,
+                const struct tbd_create_options options)
+{
+    const uint64_t target_count = info->fields.targets.set_count;
+    if (target_count == 0 || target_count > 64) {
+        return 1;
+    }
+
+    const uint64_t max_symbol_count = info->fields.symbols.item_count;
+    if (max_symbol_count >= UINT32_MAX) {
+        return 1;
+    }
+
+    /*
+     * Keep at most one symbol per bucket on average.
+     */
+
+    uint64_t bucket_count = 1;
+    while (bucket_count < max_symbol_count) {
+        bucket_count <<= 1;
+    }
+
+    uint32_t *const buckets = malloc(bucket_count * sizeof(uint32_t));
+    if (buckets == NULL) {
+        return 1;
+    }
+
+    uint32_t *const next = malloc((max_symbol_count + 1) * sizeof(uint32_t));
+    if (next == NULL) {
+        free(buckets);
+        return 1;
+    }
+
+    for (uint64_t i = 0; i != bucket_count; i++) {
+        buckets[i] = no_symbol;
+    }
+
+    struct array groups = {};
+
+    uint64_t symbol_count = 0;
+    uint64_t names_size = 0;
+
+    int result = collect_groups(info,
+                                options,
+                                &groups,
+                                buckets,
+                                bucket_count,
+                                next,
+                                &symbol_count,
+                                &names_size);
+
+    if (result == 0) {
+        result = write_index_with_groups(wb,
+                                         info,
+                                         options,
+                                         &groups,
+                                         buckets,
+                                         bucket_count,
+                                         next,
+                                         symbol_count,
+                                         names_size);
+    }
+
+    array_destroy(&groups);
+
+    free(next);
+    free(buckets);
+
+    return result;
+}
@@ -0,0 +1,830 @@
+//
+//  src/tbd_write_v5.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include "bit_list.h"
+#include "target_list.h"
+#include "tbd_write_v5.h"
+
+/*
+ * tbd-version v5 is a json document, with the following structure:
+ *
+ * {
+ *   "tapi_tbd_version": 5,
+ *   "main_library": {
+ *     "target_info": [ { "target": "x86_64-macos" } ],
+ *     "install_names": [ { "name": "/usr/lib/libSystem.B.dylib" } ],
+ *     ...
+ *     "exported_symbols": [
+ *       {
+ *         "targets": [ "x86_64-macos" ],
+ *         "data": { "global": [ "_symbol" ] }
+ *       }
+ *     ]
+ *   }
+ * }
+ *
+ * Every field of main_library besides target_info and install_names is an
+ * array of entries that may be limited to a set of "targets", with a missing
+ * targets-list meaning all targets.
+ *
+ * The fields of main_library are each written with a leading comma, as
+ * target_info is always written first.
+ */
+
+static int
+write_escaped_char(struct write_buffer *__notnull const wb,
+                   const unsigned char ch)
+{
+    switch (ch) {
+        case '"':
+            return wb_add_literal(wb, "\\\"");
+
+        case '\\':
+            return wb_add_literal(wb, "\\\\");
+
+        case '\n':
+            return wb_add_literal(wb, "\\n");
+
+        case '\t':
+            return wb_add_literal(wb, "\\t");
+
+        default:
+            break;
+    }
+
+    static const char hex[] = "0123456789abcdef";
+    const char buffer[6] = { '\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xf] };
+
+    return wb_add_bytes(wb, buffer, sizeof(buffer));
+}
+
+static int
+write_json_string(struct write_buffer *__notnull const wb,
+                  const char *__notnull const string,
+                  const uint64_t length)
+{
+    if (wb_add_char(wb, '"')) {
+        return 1;
+    }
+
+    /*
+     * Symbols almost never need escaping, so write out every run of characters
+     * between the ones that do at once.
+     */
+
+    const char *run = string;
+    const char *const end = string + length;
+
+    for (const char *iter = string; iter != end; iter++) {
+        const unsigned char ch = (unsigned char)*iter;
+        if (ch >= 0x20 && ch != '"' && ch != '\\') {
+            continue;
+        }
+
+        if (wb_add_bytes(wb, run, (uint64_t)(iter - run))) {
+            return 1;
+        }
+
+        if (write_escaped_char(wb, ch)) {
+            return 1;
+        }
+
+        run = iter + 1;
+    }
+
+    if (wb_add_bytes(wb, run, (uint64_t)(end - run))) {
+        return 1;
+    }
+
+    return wb_add_char(wb, '"');
+}
+
+static int
+write_target(struct write_buffer *__notnull const wb,
+             const struct target_list *__notnull const list,
+             const uint64_t index)
+{
+    const struct arch_info *arch = NULL;
+    enum tbd_platform platform = TBD_PLATFORM_NONE;
+
+    target_list_get_target(list, index, &arch, &platform);
+
+    if (wb_add_char(wb, '"')) {
+        return 1;
+    }
+
+    if (wb_add_bytes(wb, arch->name, arch->name_length)) {
+        return 1;
+    }
+
+    if (wb_add_char(wb, '-')) {
+        return 1;
+    }
+
+    if (wb_add_c_str(wb, tbd_platform_to_string(platform, TBD_VERSION_V5))) {
+        return 1;
+    }
+
+    return wb_add_char(wb, '"');
+}
+
+static int
+write_target_info(struct write_buffer *__notnull const wb,
+                  const struct target_list *__notnull const list)
+{
+    if (list->set_count == 0) {
+        return 1;
+    }
+
+    if (wb_add_literal(wb, "    \"target_info\": [\n")) {
+        return 1;
+    }
+
+    for (uint64_t i = 0; i != list->set_count; i++) {
+        if (i != 0) {
+            if (wb_add_literal(wb, ",\n")) {
+                return 1;
+            }
+        }
+
+        if (wb_add_literal(wb, "      { \"target\": ")) {
+            return 1;
+        }
+
+        if (write_target(wb, list, i)) {
+            return 1;
+        }
+
+        if (wb_add_literal(wb, " }")) {
+            return 1;
+        }
+    }
+
+    return wb_add_literal(wb, "\n    ]");
+}
+
+/*
+ * Write out the targets-list of an entry, unless the entry applies to all
+ * targets, in which case the targets-list is left out.
+ */
+
+static int
+write_entry_targets(struct write_buffer *__notnull const wb,
+                    const struct target_list *__notnull const list,
+                    const struct bit_list bits,
+                    const bool full_targets)
+{
+    if (full_targets || bits.set_count == list->set_count) {
+        return 0;
+    }
+
+    if (wb_add_literal(wb, "        \"targets\": [ ")) {
+        return 1;
+    }
+
+    uint64_t index = bit_list_find_first_bit(bits);
+    for (uint64_t i = 0; i != bits.set_count; i++) {
+        if (i != 0) {
+            index = bit_list_find_bit_after_last(bits, index);
+            if (wb_add_literal(wb, ", ")) {
+                return 1;
+            }
+        }
+
+        if (write_target(wb, list, index)) {
+            return 1;
+        }
+    }
+
+    return wb_add_literal(wb, " ],\n");
+}
+
+/*
+ * Write out a field with a single entry holding a single value, such as
+ * install_names.
+ */
+
+static int
+write_single_string_field(struct write_buffer *__notnull const wb,
+                          const char *__notnull const field,
+                          const char *__notnull const key,
+                          const char *__notnull const string,
+                          const uint64_t length)
+{
+    if (wb_add_literal(wb, ",\n    \"")) {
+        return 1;
+    }
+
+    if (wb_add_c_str(wb, field)) {
+        return 1;
+    }
+
+    if (wb_add_literal(wb, "\": [\n      { \"")) {
+        return 1;
+    }
+
+    if (wb_add_c_str(wb, key)) {
+        return 1;
+    }
+
+    if (wb_add_literal(wb, "\": ")) {
+        return 1;
+    }
+
+    if (write_json_string(wb, string, length)) {
+        return 1;
+    }
+
+    return wb_add_literal(wb, " }\n    ]");
+}
+
+static int
+write_version_field(struct write_buffer *__notnull const wb,
+                    const char *__notnull const field,
+                    const uint32_t version)
+{
+    if (wb_add_literal(wb, ",\n    \"")) {
+        return 1;
+    }
+
+    if (wb_add_c_str(wb, field)) {
+        return 1;
+    }
+
+    if (wb_add_literal(wb, "\": [\n      { \"version\": \"")) {
+        return 1;
+    }
+
+    if (wb_add_packed_version(wb, version)) {
+        return 1;
+    }
+
+    return wb_add_literal(wb, "\" }\n    ]");
+}
+
+/*
+ * Unlike the swift-abi-version of the yaml versions, swift_abi holds the
+ * swift-version exactly as stored in the mach-o file.
+ */
+
+static int
+write_swift_abi(struct write_buffer *__notnull const wb,
+                const uint32_t swift_version)
+{
+    if (swift_version == 0) {
+        return 0;
+    }
+
+    if (wb_add_literal(wb, ",\n    \"swift_abi\": [\n      { \"abi\": ")) {
+        return 1;
+    }
+
+    if (wb_add_uint(wb, swift_version)) {
+        return 1;
+    }
+
+    return wb_add_literal(wb, " }\n    ]");
+}
+
+static int
+write_flags(struct write_buffer *__notnull const wb,
+            const struct tbd_flags flags)
+{
+    if (!flags.flat_namespace && !flags.not_app_extension_safe) {
+        return 0;
+    }
+
+    if (wb_add_literal(wb, ",\n    \"flags\": [\n      { \"attributes\": [ ")) {
+        return 1;
+    }
+
+    if (flags.flat_namespace) {
+        if (wb_add_literal(wb, "\"flat_namespace\"")) {
+            return 1;
+        }
+
+        if (flags.not_app_extension_safe) {
+            if (wb_add_literal(wb, ", ")) {
+                return 1;
+            }
+        }
+    }
+
+    if (flags.not_app_extension_safe) {
+        if (wb_add_literal(wb, "\"not_app_extension_safe\"")) {
+            return 1;
+        }
+    }
+
+    return wb_add_literal(wb, " ] }\n    ]");
+}
+
+static bool
+should_write_metadata(const struct tbd_metadata_info *__notnull const info,
+                      const struct tbd_create_options options)
+{
+    switch (info->type) {
+        case TBD_METADATA_TYPE_NONE:
+            return false;
+
+        case TBD_METADATA_TYPE_PARENT_UMBRELLA:
+            return !options.ignore_parent_umbrellas;
+
+        case TBD_METADATA_TYPE_CLIENT:
+            return !options.ignore_clients;
+
+        case TBD_METADATA_TYPE_REEXPORTED_LIBRARY:
+            return !options.ignore_reexports;
+    }
+
+    return false;
+}
+
+static int
+write_metadata_field_key(struct write_buffer *__notnull const wb,
+                         const enum tbd_metadata_type type)
+{
+    switch (type) {
+        case TBD_METADATA_TYPE_NONE:
+            return 1;
+
+        case TBD_METADATA_TYPE_PARENT_UMBRELLA:
+            return wb_add_literal(wb, ",\n    \"parent_umbrellas\": [\n");
+
+        case TBD_METADATA_TYPE_CLIENT:
+            return wb_add_literal(wb, ",\n    \"allowable_clients\": [\n");
+
+        case TBD_METADATA_TYPE_REEXPORTED_LIBRARY:
+            return wb_add_literal(wb, ",\n    \"reexported_libraries\": [\n");
+    }
+
+    return 1;
+}
+
+/*
+ * Parent-umbrellas are written out as an entry for each umbrella, while
+ * clients and re-exported libraries are written out as an entry holding a list
+ * for each group of matching targets.
+ */
+
+static int
+open_metadata_entry(struct write_buffer *__notnull const wb,
+                    const struct tbd_create_info *__notnull const info_in,
+                    const struct tbd_metadata_info *__notnull const info)
+{
+    if (wb_add_literal(wb, "      {\n")) {
+        return 1;
+    }
+
+    const struct target_list *const targets = &info_in->fields.targets;
+    const bool full_targets = info_in->flags.uses_full_targets;
+
+    if (write_entry_targets(wb, targets, info->targets, full_targets)) {
+        return 1;
+    }
+
+    switch (info->type) {
+        case TBD_METADATA_TYPE_NONE:
+            return 1;
+
+        case TBD_METADATA_TYPE_PARENT_UMBRELLA:
+            return wb_add_literal(wb, "        \"umbrella\": ");
+
+        case TBD_METADATA_TYPE_CLIENT:
+            return wb_add_literal(wb, "        \"clients\": [\n");
+
+        case TBD_METADATA_TYPE_REEXPORTED_LIBRARY:
+            return wb_add_literal(wb, "        \"names\": [\n");
+    }
+
+    return 1;
+}
+
+static int
+close_metadata_entry(struct write_buffer *__notnull const wb,
+                     const enum tbd_metadata_type type)
+{
+    if (type == TBD_METADATA_TYPE_PARENT_UMBRELLA) {
+        return wb_add_literal(wb, "\n      }");
+    }
+
+    return wb_add_literal(wb, "\n        ]\n      }");
+}
+
+static inline bool
+metadata_targets_differ(const struct tbd_metadata_info *__notnull const prev,
+                        const struct tbd_metadata_info *__notnull const info)
+{
+    const struct bit_list bits = info->targets;
+    if (bits.set_count != prev->targets.set_count) {
+        return true;
+    }
+
+    return !bit_list_equal_counts_is_equal(bits, prev->targets);
+}
+
+static int
+write_metadata(struct write_buffer *__notnull const wb,
+               const struct tbd_create_info *__notnull const info_in,
+               const struct tbd_create_options options)
+{
+    const struct array *const metadata = &info_in->fields.metadata;
+    const bool full_targets = info_in->flags.uses_full_targets;
+
+    const struct tbd_metadata_info *info = metadata->data;
+    const struct tbd_metadata_info *const end = metadata->data_end;
+    const struct tbd_metadata_info *prev = NULL;
+
+    for (; info != end; info++) {
+        if (!should_write_metadata(info, options)) {
+            continue;
+        }
+
+        const enum tbd_metadata_type type = info->type;
+        if (prev == NULL || prev->type != type) {
+            if (prev != NULL) {
+                if (close_metadata_entry(wb, prev->type)) {
+                    return 1;
+                }
+
+                if (wb_add_literal(wb, "\n    ]")) {
+                    return 1;
+                }
+            }
+
+            if (write_metadata_field_key(wb, type)) {
+                return 1;
+            }
+
+            if (open_metadata_entry(wb, info_in, info)) {
+                return 1;
+            }
+        } else if (type == TBD_METADATA_TYPE_PARENT_UMBRELLA ||
+                   (!full_targets && metadata_targets_differ(prev, info)))
+        {
+            if (close_metadata_entry(wb, type)) {
+                return 1;
+            }
+
+            if (wb_add_literal(wb, ",\n")) {
+                return 1;
+            }
+
+            if (open_metadata_entry(wb, info_in, info)) {
+                return 1;
+            }
+        } else {
+            if (wb_add_literal(wb, ",\n")) {
+                return 1;
+            }
+        }
+
+        if (type != TBD_METADATA_TYPE_PARENT_UMBRELLA) {
+            if (wb_add_literal(wb, "          ")) {
+                return 1;
+            }
+        }
+
+        if (write_json_string(wb, info->string, info->length)) {
+            return 1;
+        }
+
+        prev = info;
+    }
+
+    if (prev == NULL) {
+        return 0;
+    }
+
+    if (close_metadata_entry(wb, prev->type)) {
+        return 1;
+    }
+
+    return wb_add_literal(wb, "\n    ]");
+}
+
+static bool
+should_write_symbol(const struct tbd_symbol_info *__notnull const sym,
+                    const struct tbd_create_options options)
+{
+    switch (sym->meta_type) {
+        case TBD_SYMBOL_META_TYPE_NONE:
+            return false;
+
+        case TBD_SYMBOL_META_TYPE_EXPORT:
+            if (options.ignore_exports) {
+                return false;
+            }
+
+            break;
+
+        case TBD_SYMBOL_META_TYPE_REEXPORT:
+            if (options.ignore_reexports) {
+                return false;
+            }
+
+            break;
+
+        case TBD_SYMBOL_META_TYPE_UNDEFINED:
+            if (options.ignore_undefineds) {
+                return false;
+            }
+
+            break;
+    }
+
+    /*
+     * Clients and re-exports are stored as metadata for tbd-version v5, as
+     * they are for tbd-version v4.
+     */
+
+    switch (sym->type) {
+        case TBD_SYMBOL_TYPE_NONE:
+        case TBD_SYMBOL_TYPE_CLIENT:
+        case TBD_SYMBOL_TYPE_REEXPORT:
+            return false;
+
+        case TBD_SYMBOL_TYPE_NORMAL:
+            return !options.ignore_normal_syms;
+
+        case TBD_SYMBOL_TYPE_OBJC_CLASS:
+            return !options.ignore_objc_class_syms;
+
+        case TBD_SYMBOL_TYPE_OBJC_EHTYPE:
+            return !options.ignore_objc_ehtype_syms;
+
+        case TBD_SYMBOL_TYPE_OBJC_IVAR:
+            return !options.ignore_objc_ivar_syms;
+
+        case TBD_SYMBOL_TYPE_WEAK_DEF:
+            return !options.ignore_weak_defs_syms;
+
+        case TBD_SYMBOL_TYPE_THREAD_LOCAL:
+            return !options.ignore_thread_local_syms;
+    }
+
+    return false;
+}
+
+static int
+write_symbols_field_key(struct write_buffer *__notnull const wb,
+                        const enum tbd_symbol_meta_type type)
+{
+    switch (type) {
+        case TBD_SYMBOL_META_TYPE_NONE:
+            return 1;
+
+        case TBD_SYMBOL_META_TYPE_EXPORT:
+            return wb_add_literal(wb, ",\n    \"exported_symbols\": [\n");
+
+        case TBD_SYMBOL_META_TYPE_REEXPORT:
+            return wb_add_literal(wb, ",\n    \"reexported_symbols\": [\n");
+
+        case TBD_SYMBOL_META_TYPE_UNDEFINED:
+            return wb_add_literal(wb, ",\n    \"undefined_symbols\": [\n");
+    }
+
+    return 1;
+}
+
+static int
+open_symbol_type_list(struct write_buffer *__notnull const wb,
+                      const enum tbd_symbol_type type)
+{
+    switch (type) {
+        case TBD_SYMBOL_TYPE_NONE:
+        case TBD_SYMBOL_TYPE_CLIENT:
+        case TBD_SYMBOL_TYPE_REEXPORT:
+            return 1;
+
+        case TBD_SYMBOL_TYPE_NORMAL:
+            return wb_add_literal(wb, "          \"global\": [\n");
+
+        case TBD_SYMBOL_TYPE_OBJC_CLASS:
+            return wb_add_literal(wb, "          \"objc_class\": [\n");
+
+        case TBD_SYMBOL_TYPE_OBJC_EHTYPE:
+            return wb_add_literal(wb, "          \"objc_eh_type\": [\n");
+
+        case TBD_SYMBOL_TYPE_OBJC_IVAR:
+            return wb_add_literal(wb, "          \"objc_ivar\": [\n");
+
+        case TBD_SYMBOL_TYPE_WEAK_DEF:
+            return wb_add_literal(wb, "          \"weak\": [\n");
+
+        case TBD_SYMBOL_TYPE_THREAD_LOCAL:
+            return wb_add_literal(wb, "          \"thread_local\": [\n");
+    }
+
+    return 1;
+}
+
+/*
+ * We don't know whether a symbol is in a text or data section, so all symbols
+ * are written into the "data" dictionary, which is read the same as "text".
+ */
+
+static int
+open_symbol_entry(struct write_buffer *__notnull const wb,
+                  const struct tbd_create_info *__notnull const info,
+                  const struct tbd_symbol_info *__notnull const sym)
+{
+    if (wb_add_literal(wb, "      {\n")) {
+        return 1;
+    }
+
+    const struct target_list *const targets = &info->fields.targets;
+    const bool full_targets = info->flags.uses_full_targets;
+
+    if (write_entry_targets(wb, targets, sym->targets, full_targets)) {
+        return 1;
+    }
+
+    if (wb_add_literal(wb, "        \"data\": {\n")) {
+        return 1;
+    }
+
+    return open_symbol_type_list(wb, sym->type);
+}
+
+static inline int close_symbol_type_list(struct write_buffer *__notnull wb) {
+    return wb_add_literal(wb, "\n          ]");
+}
+
+static inline int close_symbol_entry(struct write_buffer *__notnull wb) {
+    return wb_add_literal(wb, "\n          ]\n        }\n      }");
+}
+
+static inline bool
+symbol_targets_differ(const struct tbd_symbol_info *__notnull const prev,
+                      const struct tbd_symbol_info *__notnull const sym)
+{
+    const struct bit_list bits = sym->targets;
+    if (bits.set_count != prev->targets.set_count) {
+        return true;
+    }
+
+    return !bit_list_equal_counts_is_equal(bits, prev->targets);
+}
+
+/*
+ * The symbols are sorted by their meta-type, then their targets, then their
+ * type, so each field, entry, and symbol-type list is simply opened when the
+ * symbol written before differs.
+ */
+
+static int
+write_symbols(struct write_buffer *__notnull const wb,
+              const struct tbd_create_info *__notnull const info,
+              const struct tbd_create_options options)
+{
+    const struct array *const symbols = &info->fields.symbols;
+    const bool full_targets = info->flags.uses_full_targets;
+
+    const struct tbd_symbol_info *sym = symbols->data;
+    const struct tbd_symbol_info *const end = symbols->data_end;
+    const struct tbd_symbol_info *prev = NULL;
+
+    for (; sym != end; sym++) {
+        if (!should_write_symbol(sym, options)) {
+            continue;
+        }
+
+        if (prev == NULL || prev->meta_type != sym->meta_type) {
+            if (prev != NULL) {
+                if (close_symbol_entry(wb)) {
+                    return 1;
+                }
+
+                if (wb_add_literal(wb, "\n    ]")) {
+                    return 1;
+                }
+            }
+
+            if (write_symbols_field_key(wb, sym->meta_type)) {
+                return 1;
+            }
+
+            if (open_symbol_entry(wb, info, sym)) {
+                return 1;
+            }
+        } else if (!full_targets && symbol_targets_differ(prev, sym)) {
+            if (close_symbol_entry(wb)) {
+                return 1;
+            }
+
+            if (wb_add_literal(wb, ",\n")) {
+                return 1;
+            }
+
+            if (open_symbol_entry(wb, info, sym)) {
+                return 1;
+            }
+        } else if (prev->type != sym->type) {
+            if (close_symbol_type_list(wb)) {
+                return 1;
+            }
+
+            if (wb_add_literal(wb, ",\n")) {
+                return 1;
+            }
+
+            if (open_symbol_type_list(wb, sym->type)) {
+                return 1;
+            }
+        } else {
+            if (wb_add_literal(wb, ",\n")) {
+                return 1;
+            }
+        }
+
+        if (wb_add_literal(wb, "            ")) {
+            return 1;
+        }
+
+        if (write_json_string(wb, sym->string, sym->length)) {
+            return 1;
+        }
+
+        prev = sym;
+    }
+
+    if (prev == NULL) {
+        return 0;
+    }
+
+    if (close_symbol_entry(wb)) {
+        return 1;
+    }
+
+    return wb_add_literal(wb, "\n    ]");
+}
+
+int
+tbd_write_v5(struct write_buffer *__notnull const wb,
+             const struct tbd_create_info *__notnull const info,
+             const struct tbd_create_options options)
+{
+    if (wb_add_literal(wb, "{\n  \"tapi_tbd_version\": 5,\n")) {
+        return 1;
+    }
+
+    if (wb_add_literal(wb, "  \"main_library\": {\n")) {
+        return 1;
+    }
+
+    if (write_target_info(wb, &info->fields.targets)) {
+        return 1;
+    }
+
+    const struct tbd_create_info_fields *const fields = &info->fields;
+    if (write_single_string_field(wb,
+                                  "install_names",
+                                  "name",
+                                  fields->install_name,
+                                  fields->install_name_length))
+    {
+        return 1;
+    }
+
+    if (!options.ignore_current_version) {
+        const uint32_t current_version = fields->current_version;
+        if (write_version_field(wb, "current_versions", current_version)) {
+            return 1;
+        }
+    }
+
+    if (!options.ignore_compat_version) {
+        const uint32_t compat_version = fields->compatibility_version;
+        if (write_version_field(wb, "compatibility_versions", compat_version)) {
+            return 1;
+        }
+    }
+
+    if (!options.ignore_swift_version) {
+        if (write_swift_abi(wb, fields->swift_version)) {
+            return 1;
+        }
+    }
+
+    if (!options.ignore_flags) {
+        if (write_flags(wb, fields->flags)) {
+            return 1;
+        }
+    }
+
+    if (write_metadata(wb, info, options)) {
+        return 1;
+    }
+
+    if (write_symbols(wb, info, options)) {
+        return 1;
+    }
+
+    return wb_add_literal(wb, "\n  }\n}\n");
+}
@@ -11,13 +11,37 @@
 void print_usage(void) {
     fputs("Usage: tbd [-p/--path] [path-options] [file-paths] [-o/--output] [output-options] [output-paths]\n", stdout);
     fputs("Main options:\n", stdout);
-    fputs("    -h, --help,   Print this message\n", stdout);
-    fputs("    -o, --output, Path to an output file (or directory for recursing/dyld_shared_cache files) to write converted tbd files.\n", stdout);
-    fputs("                  If provided file(s) already exists, contents will be overridden.\n", stdout);
-    fputs("                  Can also provide \"stdout\" to print to stdout\n", stdout);
-    fputs("    -p, --path,   Path to a mach-o or dyld_shared_cache file to convert to a tbd file.\n", stdout);
-    fputs("                  Can also provide \"stdin\" to use standard input.\n", stdout);
-    fputs("    -u, --usage,  Print this message\n", stdout);
+    fputs("        --cache-dir,      Directory to cache created .tbd files in, which can be shared by many tbd processes at once.\n", stdout);
+    fputs("                          Mach-o files whose .tbd (with the same options) is already cached are not parsed, and the cached\n", stdout);
+    fputs("                          .tbd is copied (or cloned) instead. Requests for user-input are disabled when using a cache.\n", stdout);
+    fputs("        --client,         Run tbd with the arguments that follow on the server listening on the provided socket (see --serve).\n", stdout);
+    fputs("                          Must be the first option, followed by the socket's path. Exits with the exit-status of the request\n", stdout);
+    fputs("        --dedup-contents, Also match mach-o files by their contents (not only by device and inode) when finding files\n", stdout);
+    fputs("                          reached through multiple paths. Each such file is parsed once, and its .tbd is copied to\n", stdout);
+    fputs("                          the write-paths of all other paths\n", stdout);
+    fputs("    -h, --help,           Print this message\n", stdout);
+    fputs("        --jobs,           Number of threads to parse mach-o files on (Default is 1). Files are still written out, and any\n", stdout);
+    fputs("                          errors printed, in the order they were found. Requests for user-input are disabled with more than 1 job.\n", stdout);
+    fputs("                          With --recurse all, sub-directories are then also read on separate threads\n", stdout);
+    fputs("        --manifest,       Path to a manifest of the files parsed while recursing. Files unchanged since the manifest\n", stdout);
+    fputs("                          was written, and whose .tbd files still exist, are skipped. The manifest is then rewritten.\n", stdout);
+    fputs("                          If any options changed since the manifest was written, all files are parsed again.\n", stdout);
+    fputs("                          Can't be used with --combine-tbds, or with an archive --output-format\n", stdout);
+    fputs("    -o, --output,         Path to an output file (or directory for recursing/dyld_shared_cache files) to write converted tbd files.\n", stdout);
+    fputs("                          If provided file(s) already exists, contents will be overridden.\n", stdout);
+    fputs("                          Can also provide \"stdout\" to print to stdout\n", stdout);
+    fputs("    -p, --path,           Path to a mach-o or dyld_shared_cache file to convert to a tbd file.\n", stdout);
+    fputs("                          Can also provide \"stdin\" to use standard input.\n", stdout);
+    fputs("                          Input from stdin or a pipe is first copied into an anonymous (in-memory) file.\n", stdout);
+    fputs("        --paths-from,     Path to a file listing the paths of mach-o or dyld_shared_cache files to convert, or \"-\" to read\n", stdout);
+    fputs("                          the list from stdin. Takes the same options as --path. Paths are separated by either newlines\n", stdout);
+    fputs("                          or null-characters, and all files are handled in a single process, just like files found while\n", stdout);
+    fputs("                          recursing. With --preserve-subdirs, the full directory of each file is recreated\n", stdout);
+    fputs("        --serve,          Listen on the provided unix-domain socket, and run the requests of tbd --client, each in its own process.\n", stdout);
+    fputs("                          Output is written by the server, from the client's working directory. dyld_shared_cache files\n", stdout);
+    fputs("                          provided as paths are kept mapped across requests. Only requests from the server's own user are run.\n", stdout);
+    fputs("                          Must be run by itself\n", stdout);
+    fputs("    -u, --usage,          Print this message\n", stdout);
 
     fputc('\n', stdout);
     fputs("Write options:\n", stdout);
@@ -29,6 +53,19 @@ void print_usage(void) {
     fputs("                                  writing out (Instead of simply appending .tbd)\n", stdout);
     fputs("        --combine-tbds,           Combine all tbds created (when recursing or with a dyld-shared-cache) into a\n", stdout);
     fputs("                                  single .tbd file\n", stdout);
+    fputs("        --map-output,             Size each output file to the exact length of its tbd first, and write the\n", stdout);
+    fputs("                                  tbd directly into a memory-mapping of the file\n", stdout);
+    fputs("        --write-if-changed,       Leave an existing output file untouched if it already has the exact contents\n", stdout);
+    fputs("                                  of its tbd, to preserve its modification time\n", stdout);
+    fputs("        --binary-index,           Also write a binary symbol index (.tbdi) next to each .tbd file, for fast\n", stdout);
+    fputs("                                  symbol lookups without parsing the tbd\n", stdout);
+    fputs("        --output-format,          Format to write out in, either tbd (default), or one of the following to\n", stdout);
+    fputs("                                  write all tbds created to a single archive (Which may be stdout):\n", stdout);
+    fputs("                                      tar,           A tar archive, with each tbd as a member\n", stdout);
+    fputs("                                      records,       A stream of records, each a binary header (holding the\n", stdout);
+    fputs("                                                     path, archs, and length) followed by the tbd\n", stdout);
+    fputs("                                      nul-delimited, The path, archs, and tbd of each record, each\n", stdout);
+    fputs("                                                     followed by a NUL byte\n", stdout);
 
     fputc('\n', stdout);
     fputs("Path options:\n", stdout);
@@ -50,6 +87,13 @@ void print_usage(void) {
     fputs("                                         To get the numbers of all available images, use the option --list-dsc-images\n", stdout);
     fputs("               --image-path,             Specify the path of an image to parse out.\n", stdout);
     fputs("                                         To get the paths of all available images, use the option --list-dsc-images\n", stdout);
+    fputs("               --merge-dsc,              Specify the path of another dyld_shared_cache file (of a different architecture) to merge.\n", stdout);
+    fputs("                                         Images are matched by their image-path, and each merged cache's architecture is added\n", stdout);
+    fputs("                                         as another target of the image's .tbd file. Can be provided multiple times.\n", stdout);
+    fputs("                                         Merging is best used with .tbd version v4\n", stdout);
+    fputs("               --use-huge-pages,         Advise the mappings of dyld_shared_cache files to use transparent huge-pages,\n", stdout);
+    fputs("                                         reducing TLB misses when extracting many images. Files on tmpfs are instead\n", stdout);
+    fputs("                                         copied into anonymous memory backed by huge-pages, which uses more memory\n", stdout);
     fputs("        -v, --version,                   Specify version of .tbd files to convert to (default is v2).\n", stdout);
     fputs("                                         This applies to all files where tbd-version was not explicitly set.\n", stdout);
     fputs("                                         To get a list of all available versions, look at the options below, or use\n", stdout);
@@ -58,6 +102,7 @@ void print_usage(void) {
     fputs("        -v2,                             Set version of .tbd files to version v2. (This is the default .tbd version)\n", stdout);
     fputs("        -v3,                             Set version of .tbd files to version v3.\n", stdout);
     fputs("        -v4,                             Set version of .tbd files to version v4.\n", stdout);
+    fputs("        -v5,                             Set version of .tbd files to version v5. (Written as json)\n", stdout);
 
     fputc('\n', stdout);
     fputs("Ignore options: (Subset of path options)\n", stdout);
@@ -0,0 +1,343 @@
+//
+//  src/write_buffer.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "likely.h"
+#include "write_buffer.h"
+
+/*
+ * The capacity of a write_buffer backed by a file-descriptor. Once filled, its
+ * contents are handed to the file-descriptor in a single write.
+ */
+
+static const uint64_t fd_buffer_capacity = 65536;
+
+static const char spaces[] = "                                                ";
+static const char hex_chars[] = "0123456789ABCDEF";
+
+void wb_create_with_fd(struct write_buffer *__notnull const wb, const int fd) {
+    wb->data = NULL;
+    wb->length = 0;
+    wb->capacity = 0;
+    wb->fd = fd;
+    wb->is_counting = false;
+    wb->is_fixed = false;
+}
+
+void wb_create_for_counting(struct write_buffer *__notnull const wb) {
+    wb_create_with_fd(wb, -1);
+    wb->is_counting = true;
+}
+
+void
+wb_create_with_fixed_buffer(struct write_buffer *__notnull const wb,
+                            char *__notnull const buffer,
+                            const uint64_t capacity)
+{
+    wb_create_with_fd(wb, -1);
+
+    wb->data = buffer;
+    wb->capacity = capacity;
+    wb->is_fixed = true;
+}
+
+static int write_iov_fully(const int fd, struct iovec *iov, int iov_count) {
+    do {
+        ssize_t written = 0;
+        do {
+            written = writev(fd, iov, iov_count);
+        } while (written == -1 && errno == EINTR);
+
+        if (written < 0) {
+            return 1;
+        }
+
+        /*
+         * Skip past the iovecs that were fully written, and advance into the
+         * one that was only partially written, if any.
+         */
+
+        uint64_t left = (uint64_t)written;
+        while (iov_count != 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+
+            iov++;
+            iov_count--;
+        }
+
+        if (iov_count == 0) {
+            return 0;
+        }
+
+        iov->iov_base = (char *)iov->iov_base + left;
+        iov->iov_len -= left;
+    } while (true);
+}
+
+int wb_flush(struct write_buffer *__notnull const wb) {
+    if (wb->fd < 0 || wb->length == 0) {
+        return 0;
+    }
+
+    struct iovec iov = {
+        .iov_base = wb->data,
+        .iov_len = wb->length
+    };
+
+    if (write_iov_fully(wb->fd, &iov, 1)) {
+        return 1;
+    }
+
+    wb->length = 0;
+    return 0;
+}
+
+static int
+expand_to_fit(struct write_buffer *__notnull const wb, const uint64_t wanted) {
+    uint64_t new_cap = wb->capacity;
+    if (new_cap == 0) {
+        new_cap = fd_buffer_capacity;
+    }
+
+    while (new_cap < wanted) {
+        new_cap *= 2;
+    }
+
+    char *const new_data = realloc(wb->data, new_cap);
+    if (new_data == NULL) {
+        return 1;
+    }
+
+    wb->data = new_data;
+    wb->capacity = new_cap;
+
+    return 0;
+}
+
+/*
+ * Write out both the buffered text and bytes with one writev() call, for when
+ * bytes is too large to ever be buffered.
+ */
+
+static int
+write_through(struct write_buffer *__notnull const wb,
+              const void *__notnull const bytes,
+              const uint64_t length)
+{
+    struct iovec iov[2] = {
+        { .iov_base = wb->data, .iov_len = wb->length },
+        { .iov_base = (void *)bytes, .iov_len = length }
+    };
+
+    if (write_iov_fully(wb->fd, iov, 2)) {
+        return 1;
+    }
+
+    wb->length = 0;
+    return 0;
+}
+
+/*
+ * Ensure space for length bytes is available at the end of the buffer.
+ */
+
+static inline int
+reserve_space(struct write_buffer *__notnull const wb, const uint64_t length) {
+    const uint64_t wanted = wb->length + length;
+    if (likely(wanted <= wb->capacity)) {
+        return 0;
+    }
+
+    if (wb->fd >= 0 && wb->capacity != 0) {
+        return wb_flush(wb);
+    }
+
+    if (wb->is_fixed) {
+        return 1;
+    }
+
+    return expand_to_fit(wb, wanted);
+}
+
+int
+wb_add_bytes(struct write_buffer *__notnull const wb,
+             const void *__notnull const bytes,
+             const uint64_t length)
+{
+    if (wb->is_counting) {
+        wb->length += length;
+        return 0;
+    }
+
+    if (wb->fd >= 0 && length > fd_buffer_capacity) {
+        return write_through(wb, bytes, length);
+    }
+
+    if (reserve_space(wb, length)) {
+        return 1;
+    }
+
+    memcpy(wb->data + wb->length, bytes, length);
+    wb->length += length;
+
+    return 0;
+}
+
+int
+wb_add_c_str(struct write_buffer *__notnull const wb,
+             const char *__notnull const c_str)
+{
+    return wb_add_bytes(wb, c_str, strlen(c_str));
+}
+
+int wb_add_char(struct write_buffer *__notnull const wb, const char ch) {
+    if (wb->is_counting) {
+        wb->length += 1;
+        return 0;
+    }
+
+    if (reserve_space(wb, 1)) {
+        return 1;
+    }
+
+    wb->data[wb->length] = ch;
+    wb->length += 1;
+
+    return 0;
+}
+
+int wb_add_spaces(struct write_buffer *__notnull const wb, uint64_t count) {
+    const uint64_t max = sizeof(spaces) - 1;
+    for (; count > max; count -= max) {
+        if (wb_add_bytes(wb, spaces, max)) {
+            return 1;
+        }
+    }
+
+    return wb_add_bytes(wb, spaces, count);
+}
+
+/*
+ * Format number into the end of buffer, returning a pointer to its first
+ * digit.
+ */
+
+static char *format_uint(char *__notnull const buffer_end, uint64_t number) {
+    char *iter = buffer_end;
+    do {
+        iter--;
+        *iter = (char)('0' + (number % 10));
+
+        number /= 10;
+    } while (number != 0);
+
+    return iter;
+}
+
+int
+wb_add_uint(struct write_buffer *__notnull const wb, const uint64_t number) {
+    char buffer[20];
+
+    char *const end = buffer + sizeof(buffer);
+    char *const begin = format_uint(end, number);
+
+    return wb_add_bytes(wb, begin, (uint64_t)(end - begin));
+}
+
+int
+wb_add_packed_version(struct write_buffer *__notnull const wb,
+                      const uint32_t version)
+{
+    /*
+     * The major, minor, and revision are stored in the two MSB, the second
+     * LSB, and the LSB respectively.
+     */
+
+    const uint16_t major = ((version & 0xffff0000) >> 16);
+    const uint8_t minor = ((version & 0xff00) >> 8);
+    const uint8_t revision = (version & 0xff);
+
+    /*
+     * The longest packed-version is "65535.255.255", which is 13 characters.
+     */
+
+    char buffer[16];
+
+    char *const end = buffer + sizeof(buffer);
+    char *begin = end;
+
+    if (revision != 0) {
+        begin = format_uint(begin, revision);
+        *(--begin) = '.';
+
+        /*
+         * Write out a .0 version-component because if minor was zero, we
+         * wouldn't write it as a component.
+         */
+
+        begin = format_uint(begin, minor);
+        *(--begin) = '.';
+    } else if (minor != 0) {
+        begin = format_uint(begin, minor);
+        *(--begin) = '.';
+    }
+
+    begin = format_uint(begin, major);
+    return wb_add_bytes(wb, begin, (uint64_t)(end - begin));
+}
+
+int
+wb_add_uuid(struct write_buffer *__notnull const wb,
+            const uint8_t *__notnull const uuid)
+{
+    if (wb->is_counting) {
+        wb->length += 36;
+        return 0;
+    }
+
+    if (reserve_space(wb, 36)) {
+        return 1;
+    }
+
+    char *iter = wb->data + wb->length;
+    for (uint8_t i = 0; i != 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *iter = '-';
+            iter++;
+        }
+
+        const uint8_t byte = uuid[i];
+
+        iter[0] = hex_chars[byte >> 4];
+        iter[1] = hex_chars[byte & 0xf];
+
+        iter += 2;
+    }
+
+    wb->length += 36;
+    return 0;
+}
+
+void wb_clear(struct write_buffer *__notnull const wb) {
+    wb->length = 0;
+}
+
+void wb_destroy(struct write_buffer *__notnull const wb) {
+    if (!wb->is_fixed) {
+        free(wb->data);
+    }
+
+    wb->data = NULL;
+    wb->length = 0;
+    wb->capacity = 0;
+}
@@ -0,0 +1,335 @@
+//
+//  src/write_queue.c
+//  tbd
+//
+//  Created by inoahdev on 10/19/20.
+//  Copyright © 2020 inoahdev. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "copy.h"
+#include "write_queue.h"
+
+/*
+ * The most tbds that may be waiting to be written out. Once reached, parsing
+ * waits for the writer thread to catch up, bounding the memory used by parsed
+ * tbds.
+ */
+
+static const uint64_t write_queue_max_count = 8;
+
+struct write_queue_job {
+    FILE *file;
+
+    char *write_path;
+    uint64_t write_path_length;
+
+    char *terminator;
+
+    bool close_file : 1;
+    bool print_paths : 1;
+};
+
+struct write_queue_entry {
+    struct tbd_create_info info;
+
+    struct tbd_create_options write_options;
+    struct tbd_for_main_options options;
+
+    struct array jobs;
+    struct write_queue_entry *next;
+};
+
+static void
+write_out_job(const struct tbd_create_info *__notnull const info,
+              const struct tbd_create_options write_options,
+              const struct tbd_for_main_options options,
+              const struct write_queue_job *__notnull const job)
+{
+    tbd_for_main_write_info_to_file(info,
+                                    write_options,
+                                    options,
+                                    job->write_path,
+                                    job->write_path_length,
+                                    job->terminator,
+                                    job->file,
+                                    job->print_paths);
+
+    if (job->close_file) {
+        fclose(job->file);
+    }
+}
+
+static void
+write_out_jobs(const struct tbd_create_info *__notnull const info,
+               const struct tbd_create_options write_options,
+               const struct tbd_for_main_options options,
+               struct array *__notnull const jobs)
+{
+    struct write_queue_job *job = jobs->data;
+    const struct write_queue_job *const end = jobs->data_end;
+
+    for (; job != end; job++) {
+        write_out_job(info, write_options, options, job);
+        free(job->write_path);
+    }
+
+    array_clear(jobs);
+}
+
+static void *write_queue_thread(void *__notnull const arg) {
+    struct write_queue *const queue = (struct write_queue *)arg;
+    pthread_mutex_lock(&queue->lock);
+
+    do {
+        struct write_queue_entry *const entry = queue->front;
+        if (entry == NULL) {
+            if (queue->is_finishing) {
+                break;
+            }
+
+            pthread_cond_wait(&queue->has_entries, &queue->lock);
+            continue;
+        }
+
+        queue->front = entry->next;
+        if (queue->front == NULL) {
+            queue->back = NULL;
+        }
+
+        queue->queued_count -= 1;
+        queue->is_writing = true;
+
+        pthread_cond_signal(&queue->has_space);
+        pthread_mutex_unlock(&queue->lock);
+
+        write_out_jobs(&entry->info,
+                       entry->write_options,
+                       entry->options,
+                       &entry->jobs);
+
+        /*
+         * The entry's tbd_create_info is kept as is, and is only cleared once
+         * it's recycled for parsing, as clearing it keeps its allocations.
+         */
+
+        pthread_mutex_lock(&queue->lock);
+
+        entry->next = queue->free_list;
+        queue->free_list = entry;
+        queue->is_writing = false;
+
+        if (queue->front == NULL) {
+            pthread_cond_broadcast(&queue->is_drained);
+        }
+    } while (true);
+
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+enum write_queue_result write_queue_start(struct write_queue *__notnull queue) {
+    memset(queue, 0, sizeof(*queue));
+
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->has_entries, NULL);
+    pthread_cond_init(&queue->has_space, NULL);
+    pthread_cond_init(&queue->is_drained, NULL);
+
+    if (pthread_create(&queue->thread, NULL, write_queue_thread, queue) != 0) {
+        pthread_cond_destroy(&queue->is_drained);
+        pthread_cond_destroy(&queue->has_space);
+        pthread_cond_destroy(&queue->has_entries);
+        pthread_mutex_destroy(&queue->lock);
+
+        return E_WRITE_QUEUE_THREAD_CREATE_FAIL;
+    }
+
+    return E_WRITE_QUEUE_OK;
+}
+
+void
+write_queue_add_job(struct write_queue *__notnull const queue,
+                    const struct tbd_for_main *__notnull const tbd,
+                    FILE *__notnull const file,
+                    char *__notnull const write_path,
+                    const uint64_t write_path_length,
+                    char *const terminator,
+                    const bool close_file,
+                    const bool print_paths)
+{
+    struct write_queue_job job = {
+        .file = file,
+        .write_path = write_path,
+        .write_path_length = write_path_length,
+        .terminator = terminator,
+        .close_file = close_file,
+        .print_paths = print_paths
+    };
+
+    char *const path_copy = alloc_and_copy(write_path, write_path_length);
+    if (path_copy != NULL) {
+        /*
+         * terminator points into write_path, so have it point into our copy.
+         */
+
+        if (terminator != NULL) {
+            job.terminator = path_copy + (terminator - write_path);
+        }
+
+        job.write_path = path_copy;
+
+        const enum array_result add_job_result =
+            array_add_item(&queue->pending_jobs, sizeof(job), &job, NULL);
+
+        if (add_job_result == E_ARRAY_OK) {
+            return;
+        }
+
+        free(path_copy);
+
+        job.write_path = write_path;
+        job.terminator = terminator;
+    }
+
+    /*
+     * If we can't queue the job, write it out right away, after every job
+     * before it, to keep the order of files written to a combine-file.
+     */
+
+    write_queue_drain(queue);
+    write_out_jobs(&tbd->info,
+                   tbd->write_options,
+                   tbd->options,
+                   &queue->pending_jobs);
+
+    write_out_job(&tbd->info, tbd->write_options, tbd->options, &job);
+}
+
+static struct write_queue_entry *
+get_free_entry(struct write_queue *__notnull const queue) {
+    pthread_mutex_lock(&queue->lock);
+
+    struct write_queue_entry *entry = queue->free_list;
+    if (entry != NULL) {
+        queue->free_list = entry->next;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(struct write_queue_entry));
+    }
+
+    return entry;
+}
+
+void
+write_queue_submit(struct write_queue *__notnull const queue,
+                   struct tbd_for_main *__notnull const tbd,
+                   const struct tbd_create_info *__notnull const orig)
+{
+    struct tbd_create_info *const info = &tbd->info;
+    if (queue->pending_jobs.item_count == 0) {
+        tbd_create_info_clear_fields_and_create_from(info, orig);
+        return;
+    }
+
+    struct write_queue_entry *const entry = get_free_entry(queue);
+    if (entry == NULL) {
+        write_queue_drain(queue);
+        write_out_jobs(info,
+                       tbd->write_options,
+                       tbd->options,
+                       &queue->pending_jobs);
+
+        tbd_create_info_clear_fields_and_create_from(info, orig);
+        return;
+    }
+
+    /*
+     * Swap the parsed info with the entry's recycled info, whose allocations
+     * are then reused for parsing the next file. The version is kept, as
+     * clearing the info doesn't reset it.
+     */
+
+    const struct tbd_create_info recycled = entry->info;
+    entry->info = *info;
+
+    info->fields = recycled.fields;
+    info->flags = recycled.flags;
+
+    tbd_create_info_clear_fields_and_create_from(info, orig);
+
+    /*
+     * Similarly, swap the pending jobs with the entry's emptied jobs array.
+     */
+
+    const struct array jobs = entry->jobs;
+
+    entry->jobs = queue->pending_jobs;
+    queue->pending_jobs = jobs;
+
+    entry->write_options = tbd->write_options;
+    entry->options = tbd->options;
+    entry->next = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->queued_count == write_queue_max_count) {
+        pthread_cond_wait(&queue->has_space, &queue->lock);
+    }
+
+    if (queue->back != NULL) {
+        queue->back->next = entry;
+    } else {
+        queue->front = entry;
+    }
+
+    queue->back = entry;
+    queue->queued_count += 1;
+
+    pthread_cond_signal(&queue->has_entries);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void write_queue_drain(struct write_queue *__notnull const queue) {
+    pthread_mutex_lock(&queue->lock);
+
+    while (queue->front != NULL || queue->is_writing) {
+        pthread_cond_wait(&queue->is_drained, &queue->lock);
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+}
+
+void write_queue_finish(struct write_queue *__notnull const queue) {
+    pthread_mutex_lock(&queue->lock);
+
+    queue->is_finishing = true;
+
+    pthread_cond_signal(&queue->has_entries);
+    pthread_mutex_unlock(&queue->lock);
+
+    pthread_join(queue->thread, NULL);
+
+    struct write_queue_entry *entry = queue->free_list;
+    while (entry != NULL) {
+        struct write_queue_entry *const next = entry->next;
+
+        tbd_create_info_destroy(&entry->info);
+        array_destroy(&entry->jobs);
+
+        free(entry);
+        entry = next;
+    }
+
+    array_destroy(&queue->pending_jobs);
+
+    pthread_cond_destroy(&queue->is_drained);
+    pthread_cond_destroy(&queue->has_space);
+    pthread_cond_destroy(&queue->has_entries);
+    pthread_mutex_destroy(&queue->lock);
+}